@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <benchmark/benchmark.h>
+#include <boinc_rpc.h>
+#include <tests/fake_boinc_rpc_server.h>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ============================================================================
+// BOINC run mode change: in-process GUI RPC against the script path
+// ============================================================================
+
+// All three run against the stand-in GUI RPC server on loopback, so they measure the idle_detect side of a transition,
+// not the BOINC client's handling of set_run_mode.
+
+static void BM_BoincRpc_SetRunMode_HeldConnection(benchmark::State& state)
+{
+    FakeBoincRpcServer server("secret");
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("secret");
+
+    bool never = true;
+
+    for (auto _ : state) {
+        if (!client.SetRunMode(never ? BoincRpcClient::RUN_MODE_NEVER : BoincRpcClient::RUN_MODE_ALWAYS)) {
+            state.SkipWithError("set_run_mode failed");
+            return;
+        }
+
+        never = !never;
+    }
+}
+BENCHMARK(BM_BoincRpc_SetRunMode_HeldConnection);
+
+static void BM_BoincRpc_SetRunMode_NewConnection(benchmark::State& state)
+{
+    FakeBoincRpcServer server("secret");
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("secret");
+
+    bool never = true;
+
+    // Connect and authenticate on every call, as each boinccmd run does.
+    for (auto _ : state) {
+        if (!client.SetRunMode(never ? BoincRpcClient::RUN_MODE_NEVER : BoincRpcClient::RUN_MODE_ALWAYS)) {
+            state.SkipWithError("set_run_mode failed");
+            return;
+        }
+
+        client.Disconnect();
+        never = !never;
+    }
+}
+BENCHMARK(BM_BoincRpc_SetRunMode_NewConnection);
+
+static void BM_BoincRpc_SetRunMode_ScriptPath(benchmark::State& state)
+{
+    FakeBoincRpcServer server("secret");
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("secret");
+
+    // Stands in for dc_pause / dc_unpause: a shell that finds and reads the auth file, then a new connection. The real
+    // path also execs boinccmd, which is not counted here, so this is a lower bound for the script path.
+    char sh[] = "sh";
+    char dash_c[] = "-c";
+    char script[] = "for d in \"$BOINC_DATA_DIR\" /var/lib/boinc /var/lib/boinc-client; do "
+                    "[ -r \"$d/gui_rpc_auth.cfg\" ] && break; done; exit 0";
+    char* argv[] = {sh, dash_c, script, nullptr};
+
+    bool never = true;
+
+    for (auto _ : state) {
+        pid_t pid = -1;
+        int status = 0;
+
+        if (posix_spawn(&pid, "/bin/sh", nullptr, nullptr, argv, environ) != 0 || waitpid(pid, &status, 0) != pid) {
+            state.SkipWithError("could not run the shell");
+            return;
+        }
+
+        if (!client.SetRunMode(never ? BoincRpcClient::RUN_MODE_NEVER : BoincRpcClient::RUN_MODE_ALWAYS)) {
+            state.SkipWithError("set_run_mode failed");
+            return;
+        }
+
+        client.Disconnect();
+        never = !never;
+    }
+}
+BENCHMARK(BM_BoincRpc_SetRunMode_ScriptPath);
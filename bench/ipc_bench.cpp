@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <benchmark/benchmark.h>
+#include <shmem.h>
+#include <util.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+//!
+//! \brief Name of the shared memory segment used by the benchmarks. The pid keeps it distinct from a running
+//! event_detect.
+//!
+std::string BenchShmemName()
+{
+    return "/idle_detect_bench_" + std::to_string(getpid());
+}
+
+} // namespace
+
+// ============================================================================
+// Shared memory: event_detect writer and idle_detect reader paths
+// ============================================================================
+
+static void BM_Shmem_UpdateTimestamps(benchmark::State& state)
+{
+    SharedMemoryTimestampExporter exporter(BenchShmemName());
+
+    if (!exporter.CreateOrOpen(0600)) {
+        state.SkipWithError("could not create shared memory segment");
+        return;
+    }
+
+    int64_t now = GetUnixEpochTime();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(exporter.UpdateTimestamps(now, now));
+    }
+
+    exporter.UnlinkSegment();
+}
+BENCHMARK(BM_Shmem_UpdateTimestamps);
+
+static void BM_Shmem_Read(benchmark::State& state)
+{
+    SharedMemoryTimestampExporter exporter(BenchShmemName());
+
+    if (!exporter.CreateOrOpen(0600)) {
+        state.SkipWithError("could not create shared memory segment");
+        return;
+    }
+
+    int64_t update_time = 0;
+    int64_t last_active_time = 0;
+
+    // This is the complete idle_detect reader path: open, map, read, unmap.
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ReadSharedMemoryTimestamps(BenchShmemName(), update_time, last_active_time));
+    }
+
+    exporter.UnlinkSegment();
+}
+BENCHMARK(BM_Shmem_Read);
+
+// ============================================================================
+// FIFO round trip: idle_detect writer to the IdleDetectMonitor parse loop
+// ============================================================================
+
+static void BM_Fifo_RoundTrip(benchmark::State& state)
+{
+    fs::path fifo_path = fs::temp_directory_path() / ("idle_detect_bench_fifo_" + std::to_string(getpid()));
+
+    if (mkfifo(fifo_path.c_str(), 0600) == -1) {
+        state.SkipWithError("could not create fifo");
+        return;
+    }
+
+    // Same open modes as IdleDetectMonitor (reader) and SendPipeNotification (writer).
+    int read_fd = open(fifo_path.c_str(), O_RDONLY | O_NONBLOCK);
+    int write_fd = open(fifo_path.c_str(), O_WRONLY);
+
+    char buffer[256];
+    int64_t now = GetUnixEpochTime();
+
+    for (auto _ : state) {
+        EventMessage sent(now, EventMessage::USER_ACTIVE);
+        sent.m_send_time_us = GetUnixEpochTimeMicros();
+        std::string message = sent.ToString() + "\n";
+
+        if (write(write_fd, message.data(), message.size()) != static_cast<ssize_t>(message.size())) {
+            state.SkipWithError("fifo write failed");
+            break;
+        }
+
+        struct pollfd fds[1];
+        fds[0].fd = read_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        poll(fds, 1, 100);
+
+        ssize_t bytes_read = read(read_fd, buffer, sizeof(buffer) - 1);
+
+        if (bytes_read <= 0) {
+            state.SkipWithError("fifo read failed");
+            break;
+        }
+
+        buffer[bytes_read] = '\0';
+
+        EventMessage received = EventMessage::FromString(std::string(buffer));
+        benchmark::DoNotOptimize(received.IsValid());
+    }
+
+    close(write_fd);
+    close(read_fd);
+    fs::remove(fifo_path);
+}
+BENCHMARK(BM_Fifo_RoundTrip);
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <benchmark/benchmark.h>
+#include <util.h>
+
+#include <iostream>
+#include <streambuf>
+
+namespace {
+
+//!
+//! \brief Stream buffer that discards everything written to it. Used to redirect std::cout during the benchmarks so
+//! that the measurement is of the formatting work and not of the terminal.
+//!
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+//!
+//! \brief RAII helper that swaps std::cout to a NullBuffer for the lifetime of the object.
+//!
+class CoutSilencer
+{
+public:
+    CoutSilencer() : m_saved(std::cout.rdbuf(&m_null)) {}
+    ~CoutSilencer() { std::cout.rdbuf(m_saved); }
+
+private:
+    NullBuffer m_null;
+    std::streambuf* m_saved;
+};
+
+std::string StateToString()
+{
+    return std::string("NORMAL");
+}
+
+//!
+//! \brief Replicates the debug_log statements executed on every iteration of
+//! EventDetect::Monitor::EventActivityMonitorThread(), with the same argument expressions.
+//!
+void MonitorTickLogging(int64_t event_count, int64_t last_active_time, int64_t tty_last_active_time,
+                        int64_t last_idle_detect_active_time, int64_t update_time)
+{
+    debug_log("INFO: %s: event monitor thread loop at top of iteration",
+              __func__);
+
+    debug_log("INFO: %s: loop: event_count = %lld",
+              __func__,
+              event_count);
+
+    debug_log("INFO: %s: loop: input devices last_active_time = %lld: %s",
+              __func__,
+              last_active_time,
+              FormatISO8601DateTime(last_active_time));
+
+    debug_log("INFO: %s: loop: ttys last_active_time = %lld: %s",
+              __func__,
+              tty_last_active_time,
+              FormatISO8601DateTime(tty_last_active_time));
+
+    debug_log("INFO: %s: loop: idle detect last_active_time = %lld: %s",
+              __func__,
+              last_idle_detect_active_time,
+              FormatISO8601DateTime(last_idle_detect_active_time));
+
+    debug_log("INFO: %s: loop: overall last_active time %lld: update time %s, state %s",
+              __func__,
+              last_active_time,
+              FormatISO8601DateTime(last_active_time),
+              StateToString());
+
+    debug_log("INFO: %s: Updated shmem: update=%lld, last_active=%lld",
+              __func__, (long long) update_time, (long long) last_active_time);
+}
+
+void RunMonitorTick(benchmark::State& state, bool debug)
+{
+    CoutSilencer silencer;
+    bool debug_saved = g_debug.exchange(debug);
+
+    int64_t now = GetUnixEpochTime();
+
+    for (auto _ : state) {
+        MonitorTickLogging(state.iterations(), now, now - 10, now - 5, now);
+    }
+
+    g_debug = debug_saved;
+}
+
+} // namespace
+
+// ============================================================================
+// Per-tick logging cost of the event_detect monitor loop
+// ============================================================================
+
+static void BM_MonitorTickLogging_DebugOff(benchmark::State& state)
+{
+    RunMonitorTick(state, false);
+}
+BENCHMARK(BM_MonitorTickLogging_DebugOff);
+
+static void BM_MonitorTickLogging_DebugOn(benchmark::State& state)
+{
+    RunMonitorTick(state, true);
+}
+BENCHMARK(BM_MonitorTickLogging_DebugOn);
+
+// ============================================================================
+// LogPrintStr
+// ============================================================================
+
+static void BM_LogPrintStr_Timestamps(benchmark::State& state)
+{
+    bool saved = g_log_timestamps.exchange(true);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LogPrintStr("INFO: %s: loop: event_count = %lld", "bench", (long long) 42));
+    }
+
+    g_log_timestamps = saved;
+}
+BENCHMARK(BM_LogPrintStr_Timestamps);
+
+static void BM_LogPrintStr_NoTimestamps(benchmark::State& state)
+{
+    bool saved = g_log_timestamps.exchange(false);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LogPrintStr("INFO: %s: loop: event_count = %lld", "bench", (long long) 42));
+    }
+
+    g_log_timestamps = saved;
+}
+BENCHMARK(BM_LogPrintStr_NoTimestamps);
+
+static void BM_FormatISO8601DateTime(benchmark::State& state)
+{
+    int64_t now = GetUnixEpochTime();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(FormatISO8601DateTime(now));
+    }
+}
+BENCHMARK(BM_FormatISO8601DateTime);
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <benchmark/benchmark.h>
+#include <input_source.h>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+//!
+//! \brief Replays the trace flat out into a socketpair and drains it with ReadInputEventBatch, as an event recorder
+//! thread would. Returns the number of events read, or -1 on setup failure.
+//!
+int64_t ReplayAndDrain(const std::vector<input_event>& events)
+{
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0) {
+        return -1;
+    }
+
+    InputTraceReplayer replayer(events, 0.0);
+
+    if (!replayer.Start(fds[1])) {
+        close(fds[0]);
+        return -1;
+    }
+
+    FdInputEventSource source(fds[0]);
+    int64_t total = 0;
+    InputEventBatch batch;
+
+    while (true) {
+        batch = ReadInputEventBatch(source);
+        total += batch.events;
+
+        if (batch.status != -EAGAIN) {
+            break;
+        }
+
+        // Wait for the writer rather than spinning, which would starve it on a small machine.
+        pollfd pfd {fds[0], POLLIN, 0};
+        poll(&pfd, 1, 100);
+    }
+
+    replayer.Join();
+    close(fds[0]);
+
+    return total;
+}
+
+} // namespace
+
+// ============================================================================
+// Replayed input: the recorder read path under synthetic device load
+// ============================================================================
+
+static void BM_Replay_HighRateMouse(benchmark::State& state)
+{
+    // One second of an 8 kHz pointer: 24000 events.
+    std::vector<input_event> events = GeneratePointerTrace(8000, 1000000);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ReplayAndDrain(events));
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(events.size()));
+}
+BENCHMARK(BM_Replay_HighRateMouse)->Unit(benchmark::kMillisecond);
+
+static void BM_Replay_SynDroppedFlood(benchmark::State& state)
+{
+    // A SYN_DROPPED after every report, forcing the sync path on every batch.
+    std::vector<input_event> events = GeneratePointerTrace(8000, 1000000, 1);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ReplayAndDrain(events));
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(events.size()));
+}
+BENCHMARK(BM_Replay_SynDroppedFlood)->Unit(benchmark::kMillisecond);
+
+static void BM_Replay_HotplugStorm(benchmark::State& state)
+{
+    // Each iteration is a short-lived device: attach, a handful of reports, removal (end of file).
+    std::vector<input_event> events = GeneratePointerTrace(1000, 5000);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ReplayAndDrain(events));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Replay_HotplugStorm);
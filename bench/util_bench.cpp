@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <benchmark/benchmark.h>
+#include <util.h>
+
+#include <fstream>
+
+#include <unistd.h>
+
+namespace {
+
+//!
+//! \brief Config subclass with the same number and kinds of parameters as EventDetectConfig, so that GetArg is measured
+//! against a realistically sized map.
+//!
+class BenchConfig : public Config
+{
+    void ProcessArgs() override
+    {
+        m_config.insert(std::make_pair("debug", false));
+        m_config.insert(std::make_pair("event_count_files_path", fs::path("/run/event_detect")));
+        m_config.insert(std::make_pair("write_last_active_time_to_file", true));
+        m_config.insert(std::make_pair("last_active_time_cpp_filename", std::string("last_active_time.dat")));
+        m_config.insert(std::make_pair("monitor_ttys", true));
+        m_config.insert(std::make_pair("ttys_to_monitor", std::string("pts/*")));
+        m_config.insert(std::make_pair("monitor_idle_detect_events", true));
+        m_config.insert(std::make_pair("use_shared_memory", true));
+        m_config.insert(std::make_pair("write_metrics_file", false));
+        m_config.insert(std::make_pair("metrics_filename", std::string("event_detect_metrics.prom")));
+        m_config.insert(std::make_pair("write_latency_trace", false));
+        m_config.insert(std::make_pair("latency_trace_filename", std::string("event_detect_latency_trace.json")));
+    }
+};
+
+//!
+//! \brief RAII temporary directory populated with files named like the /dev/input and event data entries that
+//! FindDirEntriesWithWildcard is used on.
+//!
+class TempEntryDir
+{
+public:
+    explicit TempEntryDir(int entries)
+        : m_path(fs::temp_directory_path() / ("idle_detect_bench_" + std::to_string(getpid())))
+    {
+        fs::create_directories(m_path);
+
+        for (int i = 0; i < entries; ++i) {
+            std::ofstream(m_path / ("event" + std::to_string(i)));
+            std::ofstream(m_path / ("mouse" + std::to_string(i)));
+        }
+    }
+
+    ~TempEntryDir()
+    {
+        std::error_code ec;
+        fs::remove_all(m_path, ec);
+    }
+
+    const fs::path& GetPath() const { return m_path; }
+
+private:
+    fs::path m_path;
+};
+
+} // namespace
+
+// ============================================================================
+// EventMessage
+// ============================================================================
+
+static void BM_EventMessage_Construct(benchmark::State& state)
+{
+    int64_t now = GetUnixEpochTime();
+
+    for (auto _ : state) {
+        EventMessage msg(now, EventMessage::USER_ACTIVE);
+        benchmark::DoNotOptimize(msg);
+    }
+}
+BENCHMARK(BM_EventMessage_Construct);
+
+static void BM_EventMessage_ToString(benchmark::State& state)
+{
+    EventMessage msg(GetUnixEpochTime(), EventMessage::USER_ACTIVE);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg.ToString());
+    }
+}
+BENCHMARK(BM_EventMessage_ToString);
+
+static void BM_EventMessage_FromString(benchmark::State& state)
+{
+    std::string str = EventMessage(GetUnixEpochTime(), EventMessage::USER_ACTIVE).ToString() + "\n";
+
+    for (auto _ : state) {
+        EventMessage msg = EventMessage::FromString(str);
+        benchmark::DoNotOptimize(msg.IsValid());
+    }
+}
+BENCHMARK(BM_EventMessage_FromString);
+
+// ============================================================================
+// FindDirEntriesWithWildcard
+// ============================================================================
+
+static void BM_FindDirEntriesWithWildcard(benchmark::State& state)
+{
+    TempEntryDir dir(static_cast<int>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(FindDirEntriesWithWildcard(dir.GetPath(), "^event.*"));
+    }
+}
+BENCHMARK(BM_FindDirEntriesWithWildcard)->Arg(8)->Arg(32);
+
+static void BM_ScanDirEntries(benchmark::State& state)
+{
+    TempEntryDir dir(static_cast<int>(state.range(0)));
+    const std::string path = dir.GetPath().string();
+    std::vector<std::string> names;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ScanDirEntries(path, "event", names));
+    }
+}
+BENCHMARK(BM_ScanDirEntries)->Arg(8)->Arg(32);
+
+// ============================================================================
+// Config::GetArg
+// ============================================================================
+
+static void BM_ConfigGetArg(benchmark::State& state)
+{
+    fs::path config_file = fs::temp_directory_path() / ("idle_detect_bench_" + std::to_string(getpid()) + ".conf");
+    std::ofstream(config_file) << "debug=0\n";
+
+    BenchConfig config;
+    config.ReadAndUpdateConfig(config_file);
+
+    fs::remove(config_file);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::get<bool>(config.GetArg("write_metrics_file")));
+        benchmark::DoNotOptimize(std::get<fs::path>(config.GetArg("event_count_files_path")));
+    }
+}
+BENCHMARK(BM_ConfigGetArg);
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <benchmark/benchmark.h>
+#include <util.h>
+#include <x11_idle_monitor.h>
+
+// These need an X server, and skip without one. Run them against Xvfb with, for example,
+//   xvfb-run -a ./idle_detect_bench --benchmark_filter=X11
+
+namespace {
+
+//!
+//! \brief Whether DISPLAY is set, so that the benchmarks skip rather than log connection errors.
+//!
+bool HasDisplay()
+{
+    return GetEnvVariable("DISPLAY").has_value();
+}
+
+} // namespace
+
+// ============================================================================
+// X11 idle time: per-pass cost of each approach
+// ============================================================================
+
+// The previous per-pass query: open the display, query the extension, allocate the info, query, free and close.
+static void BM_X11_ScreenSaverReopen(benchmark::State& state)
+{
+    if (!HasDisplay()) {
+        state.SkipWithError("no X display");
+        return;
+    }
+
+    for (auto _ : state) {
+        Display* display = XOpenDisplay(nullptr);
+
+        if (!display) {
+            state.SkipWithError("could not open X display");
+            return;
+        }
+
+        int event_base = 0;
+        int error_base = 0;
+
+        if (!XScreenSaverQueryExtension(display, &event_base, &error_base)) {
+            XCloseDisplay(display);
+            state.SkipWithError("no XScreenSaver extension");
+            return;
+        }
+
+        XScreenSaverInfo* info = XScreenSaverAllocInfo();
+        XScreenSaverQueryInfo(display, DefaultRootWindow(display), info);
+        benchmark::DoNotOptimize(info->idle);
+        XFree(info);
+        XCloseDisplay(display);
+    }
+}
+BENCHMARK(BM_X11_ScreenSaverReopen)->Unit(benchmark::kMicrosecond);
+
+// The fallback: one XScreenSaverQueryInfo() round trip on the held connection.
+static void BM_X11_ScreenSaverCached(benchmark::State& state)
+{
+    X11IdleMonitor monitor;
+
+    if (!HasDisplay() || !monitor.Start() || monitor.QueryScreenSaverIdleMs() < 0) {
+        state.SkipWithError("no X display with the XScreenSaver extension");
+        return;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(monitor.QueryScreenSaverIdleMs());
+    }
+}
+BENCHMARK(BM_X11_ScreenSaverCached)->Unit(benchmark::kMicrosecond);
+
+// One IDLETIME counter read: the catch up read while active, once per threshold interval.
+static void BM_X11_IdleCounterQuery(benchmark::State& state)
+{
+    X11IdleMonitor monitor;
+
+    if (!HasDisplay() || !monitor.Start() || monitor.QueryIdleCounterMs() < 0) {
+        state.SkipWithError("no X display with the XSync IDLETIME counter");
+        return;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(monitor.QueryIdleCounterMs());
+    }
+}
+BENCHMARK(BM_X11_IdleCounterQuery)->Unit(benchmark::kMicrosecond);
+
+// The steady state pass with the alarms: drain the (empty) event queue and read the known state, no round trip.
+static void BM_X11_AlarmStateRead(benchmark::State& state)
+{
+    X11IdleMonitor monitor;
+    monitor.SetIdleLevels({300000});
+
+    if (!HasDisplay() || !monitor.Start() || !monitor.IsUsingAlarms()) {
+        state.SkipWithError("no X display with the XSync IDLETIME counter");
+        return;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(monitor.GetIdleSeconds());
+    }
+}
+BENCHMARK(BM_X11_AlarmStateRead)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,528 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <boinc_rpc.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+//! \brief Terminates each GUI RPC request and reply.
+constexpr char RPC_END = '\003';
+
+//! \brief Upper limit of a reply, far above the few hundred bytes of the replies used here.
+constexpr size_t MAX_REPLY_SIZE = 65536;
+
+int64_t SteadyNowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! \brief Milliseconds left until deadline_us, at least 0.
+int RemainingMs(int64_t deadline_us)
+{
+    int64_t remaining_us = deadline_us - SteadyNowMicros();
+
+    return remaining_us > 0 ? static_cast<int>((remaining_us + 999) / 1000) : 0;
+}
+
+//! \brief The text between <tag> and </tag> in xml, or nullopt.
+std::optional<std::string> ExtractElement(const std::string& xml, const std::string& tag)
+{
+    std::string open = "<" + tag + ">";
+    std::string close = "</" + tag + ">";
+
+    size_t begin = xml.find(open);
+
+    if (begin == std::string::npos) {
+        return std::nullopt;
+    }
+
+    begin += open.size();
+
+    size_t end = xml.find(close, begin);
+
+    if (end == std::string::npos) {
+        return std::nullopt;
+    }
+
+    return xml.substr(begin, end - begin);
+}
+
+// MD5, RFC 1321.
+
+constexpr std::array<uint32_t, 64> MD5_K = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+constexpr std::array<uint32_t, 64> MD5_SHIFTS = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+void Md5Block(const unsigned char* block, std::array<uint32_t, 4>& state)
+{
+    uint32_t m[16];
+
+    for (int i = 0; i < 16; ++i) {
+        m[i] = static_cast<uint32_t>(block[i * 4])
+               | static_cast<uint32_t>(block[i * 4 + 1]) << 8
+               | static_cast<uint32_t>(block[i * 4 + 2]) << 16
+               | static_cast<uint32_t>(block[i * 4 + 3]) << 24;
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        uint32_t f = 0;
+        uint32_t g = 0;
+
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+
+        uint32_t rotated = a + f + MD5_K[i] + m[g];
+
+        a = d;
+        d = c;
+        c = b;
+        b += (rotated << MD5_SHIFTS[i]) | (rotated >> (32 - MD5_SHIFTS[i]));
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+} // namespace
+
+std::string Md5Hex(const std::string& data)
+{
+    std::array<uint32_t, 4> state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+    std::string padded = data;
+    uint64_t bit_length = static_cast<uint64_t>(data.size()) * 8;
+
+    padded += static_cast<char>(0x80);
+
+    while (padded.size() % 64 != 56) {
+        padded += '\0';
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        padded += static_cast<char>((bit_length >> (8 * i)) & 0xff);
+    }
+
+    for (size_t offset = 0; offset < padded.size(); offset += 64) {
+        Md5Block(reinterpret_cast<const unsigned char*>(padded.data() + offset), state);
+    }
+
+    static const char hex_digits[] = "0123456789abcdef";
+    std::string hex;
+
+    for (uint32_t word : state) {
+        for (int i = 0; i < 4; ++i) {
+            unsigned char byte = (word >> (8 * i)) & 0xff;
+
+            hex += hex_digits[byte >> 4];
+            hex += hex_digits[byte & 0x0f];
+        }
+    }
+
+    return hex;
+}
+
+// Class BoincRpcClient
+
+BoincRpcClient::BoincRpcClient(int port, int timeout_ms)
+    : m_port(port)
+    , m_timeout_ms(std::max(timeout_ms, 1))
+    , m_fd(-1)
+    , m_has_password(false)
+{}
+
+BoincRpcClient::~BoincRpcClient()
+{
+    Disconnect();
+}
+
+void BoincRpcClient::SetPort(int port)
+{
+    if (port != m_port) {
+        Disconnect();
+    }
+
+    m_port = port;
+}
+
+void BoincRpcClient::SetPassword(const std::string& password)
+{
+    m_password = password;
+    m_has_password = true;
+}
+
+bool BoincRpcClient::SetRunMode(RunMode mode)
+{
+    int64_t start_us = SteadyNowMicros();
+
+    // One deadline for the whole call, so that the connect, the authentication and a retry together stay within the
+    // timeout.
+    int64_t deadline_us = start_us + static_cast<int64_t>(m_timeout_ms) * 1000;
+
+    std::string request = std::string("<set_run_mode>\n<") + RunModeToString(mode) + "/>\n"
+                          + "<duration>0</duration>\n</set_run_mode>\n";
+
+    // A held connection may have been closed by the client since the last call, e.g. by a restart, so a failure on one
+    // is retried once on a new connection.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = (m_fd != -1);
+
+        if (!reused && !Connect(deadline_us)) {
+            break;
+        }
+
+        std::string reply;
+
+        if (!Exchange(request, reply, deadline_us)) {
+            Disconnect();
+
+            if (reused && RemainingMs(deadline_us) > 0) {
+                debug_log("INFO: %s: Held BOINC GUI RPC connection failed. Reconnecting.", __func__);
+                continue;
+            }
+
+            break;
+        }
+
+        if (reply.find("<success/>") != std::string::npos) {
+            m_call_latency_us.Observe(SteadyNowMicros() - start_us);
+
+            debug_log("INFO: %s: BOINC run mode set to %s in %lld us.",
+                      __func__,
+                      RunModeToString(mode),
+                      SteadyNowMicros() - start_us);
+
+            return true;
+        }
+
+        error_log("%s: BOINC client did not set the run mode to %s: %s",
+                  __func__,
+                  RunModeToString(mode),
+                  ExtractElement(reply, "error").value_or(reply));
+        break;
+    }
+
+    m_failures.Increment();
+
+    return false;
+}
+
+void BoincRpcClient::Disconnect()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool BoincRpcClient::IsConnected() const
+{
+    return m_fd != -1;
+}
+
+uint64_t BoincRpcClient::GetConnectCount() const
+{
+    return m_connects.Get();
+}
+
+uint64_t BoincRpcClient::GetFailureCount() const
+{
+    return m_failures.Get();
+}
+
+const MetricHistogram& BoincRpcClient::GetCallLatencyHistogram() const
+{
+    return m_call_latency_us;
+}
+
+void BoincRpcClient::LogSummary() const
+{
+    if (m_call_latency_us.GetCount() == 0 && GetFailureCount() == 0) {
+        return;
+    }
+
+    normal_log("INFO: %s: %llu run mode calls, %llu failed, %llu connects, latency p50 %.0f us, p95 %.0f us",
+               __func__,
+               m_call_latency_us.GetCount() + GetFailureCount(),
+               GetFailureCount(),
+               GetConnectCount(),
+               m_call_latency_us.Quantile(0.50),
+               m_call_latency_us.Quantile(0.95));
+}
+
+std::optional<fs::path> BoincRpcClient::FindAuthFile()
+{
+    std::vector<fs::path> data_dirs;
+
+    std::optional<std::string> boinc_data_dir = GetEnvVariable("BOINC_DATA_DIR");
+
+    if (boinc_data_dir && !boinc_data_dir->empty()) {
+        data_dirs.emplace_back(*boinc_data_dir);
+    } else {
+        data_dirs = {"/var/lib/boinc", "/var/lib/boinc-client", "/var/snap/boinc/common"};
+
+        std::optional<std::string> home = GetEnvVariable("HOME");
+
+        if (home) {
+            data_dirs.push_back(fs::path(*home) / "BOINC");
+            data_dirs.push_back(fs::path(*home) / ".BOINC");
+            data_dirs.push_back(fs::path(*home) / ".var/app/edu.berkeley.BOINC/data");
+        }
+    }
+
+    for (const fs::path& data_dir : data_dirs) {
+        fs::path auth_file = data_dir / "gui_rpc_auth.cfg";
+
+        if (access(auth_file.c_str(), R_OK) == 0) {
+            return auth_file;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::string> BoincRpcClient::ReadPassword(const fs::path& auth_file)
+{
+    std::ifstream in(auth_file);
+
+    if (!in) {
+        return std::nullopt;
+    }
+
+    std::string password;
+    std::getline(in, password);
+
+    while (!password.empty() && std::isspace(static_cast<unsigned char>(password.back()))) {
+        password.pop_back();
+    }
+
+    return password;
+}
+
+const char* BoincRpcClient::RunModeToString(RunMode mode)
+{
+    switch (mode) {
+    case RUN_MODE_ALWAYS:
+        return "always";
+    case RUN_MODE_AUTO:
+        return "auto";
+    case RUN_MODE_NEVER:
+        return "never";
+    }
+
+    return "auto";
+}
+
+bool BoincRpcClient::Connect(int64_t deadline_us)
+{
+    std::string password = m_password;
+
+    if (!m_has_password) {
+        std::optional<fs::path> auth_file = FindAuthFile();
+        std::optional<std::string> file_password = auth_file ? ReadPassword(*auth_file) : std::nullopt;
+
+        if (!file_password) {
+            error_log("%s: Cannot locate a readable gui_rpc_auth.cfg. Set BOINC_DATA_DIR in the environment.",
+                      __func__);
+            return false;
+        }
+
+        password = *file_password;
+    }
+
+    m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (m_fd == -1) {
+        error_log("%s: socket() failed: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    // Each request is one small write that waits for its reply.
+    int no_delay = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(m_port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        int connect_errno = errno;
+
+        if (connect_errno == EINPROGRESS) {
+            pollfd fd = {m_fd, POLLOUT, 0};
+            socklen_t length = sizeof(connect_errno);
+
+            connect_errno = ETIMEDOUT;
+
+            if (poll(&fd, 1, RemainingMs(deadline_us)) == 1) {
+                getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &connect_errno, &length);
+            }
+        }
+
+        if (connect_errno != 0) {
+            error_log("%s: Cannot connect to the BOINC client on port %i: %s",
+                      __func__,
+                      m_port,
+                      strerror(connect_errno));
+            Disconnect();
+            return false;
+        }
+    }
+
+    // The client authorizes local connections without authentication when its password is empty.
+    if (!password.empty()) {
+        std::string reply;
+
+        if (!Exchange("<auth1/>\n", reply, deadline_us)) {
+            Disconnect();
+            return false;
+        }
+
+        std::optional<std::string> nonce = ExtractElement(reply, "nonce");
+
+        if (!nonce) {
+            error_log("%s: BOINC client sent no auth1 nonce.", __func__);
+            Disconnect();
+            return false;
+        }
+
+        std::string auth2 = "<auth2>\n<nonce_hash>" + Md5Hex(*nonce + password) + "</nonce_hash>\n</auth2>\n";
+
+        if (!Exchange(auth2, reply, deadline_us)) {
+            Disconnect();
+            return false;
+        }
+
+        if (reply.find("<authorized/>") == std::string::npos) {
+            error_log("%s: BOINC client rejected the GUI RPC password.", __func__);
+            Disconnect();
+            return false;
+        }
+    }
+
+    m_connects.Increment();
+
+    debug_log("INFO: %s: Connected to the BOINC client on port %i.", __func__, m_port);
+
+    return true;
+}
+
+bool BoincRpcClient::Exchange(const std::string& request, std::string& reply, int64_t deadline_us)
+{
+    std::string message = "<boinc_gui_rpc_request>\n" + request + "</boinc_gui_rpc_request>\n" + RPC_END;
+
+    size_t sent = 0;
+
+    while (sent < message.size()) {
+        ssize_t result = send(m_fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+
+        if (result > 0) {
+            sent += static_cast<size_t>(result);
+            continue;
+        }
+
+        if (result == -1 && (errno == EAGAIN || errno == EINTR)) {
+            pollfd fd = {m_fd, POLLOUT, 0};
+
+            if (poll(&fd, 1, RemainingMs(deadline_us)) > 0) {
+                continue;
+            }
+        }
+
+        debug_log("INFO: %s: GUI RPC send failed: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    reply.clear();
+
+    char buffer[1024];
+
+    while (true) {
+        ssize_t result = recv(m_fd, buffer, sizeof(buffer), 0);
+
+        if (result > 0) {
+            reply.append(buffer, static_cast<size_t>(result));
+
+            size_t end = reply.find(RPC_END);
+
+            if (end != std::string::npos) {
+                reply.resize(end);
+                return true;
+            }
+
+            if (reply.size() > MAX_REPLY_SIZE) {
+                error_log("%s: GUI RPC reply too large.", __func__);
+                return false;
+            }
+
+            continue;
+        }
+
+        if (result == -1 && (errno == EAGAIN || errno == EINTR)) {
+            pollfd fd = {m_fd, POLLIN, 0};
+
+            if (poll(&fd, 1, RemainingMs(deadline_us)) > 0) {
+                continue;
+            }
+
+            debug_log("INFO: %s: GUI RPC reply timed out.", __func__);
+            return false;
+        }
+
+        debug_log("INFO: %s: GUI RPC connection closed: %s", __func__, result == 0 ? "end of file" : strerror(errno));
+        return false;
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef BOINC_RPC_H
+#define BOINC_RPC_H
+
+#include <metrics.h>
+#include <util.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+//!
+//! \brief Computes the MD5 digest of data, as lowercase hex. Used for the BOINC GUI RPC auth2 nonce hash.
+//!
+std::string Md5Hex(const std::string& data);
+
+//!
+//! \brief The BoincRpcClient class sets the BOINC client's run mode over the GUI RPC protocol, in process, instead of
+//! running dc_pause or dc_unpause, which spawn a shell and boinccmd for each transition. It keeps one authenticated
+//! TCP connection to the client, opened on first use. If a call on a held connection fails, e.g. after a BOINC client
+//! restart, it reconnects and retries once.
+//!
+//! The password is read from gui_rpc_auth.cfg, found as the scripts do: $BOINC_DATA_DIR first, then the usual data
+//! directories. It is looked up again on each connect, so that a BOINC client installed or reconfigured later is found.
+//!
+//! A SetRunMode() call blocks for at most the timeout, including any connect, authentication and retry. A local client answers in well under a millisecond. It is used from the main
+//! loop thread.
+//!
+class BoincRpcClient
+{
+public:
+    enum RunMode {
+        RUN_MODE_ALWAYS,
+        RUN_MODE_AUTO,
+        RUN_MODE_NEVER
+    };
+
+    //!
+    //! \brief Constructor
+    //! \param port GUI RPC port on 127.0.0.1.
+    //! \param timeout_ms limit for each SetRunMode() call, including any connect, authentication and retry.
+    //!
+    explicit BoincRpcClient(int port = DEFAULT_PORT, int timeout_ms = DEFAULT_TIMEOUT_MS);
+
+    //! \brief Destructor. Closes the connection.
+    ~BoincRpcClient();
+
+    BoincRpcClient(const BoincRpcClient&) = delete;
+    BoincRpcClient& operator=(const BoincRpcClient&) = delete;
+
+    //! \brief Sets the port for the next connect.
+    void SetPort(int port);
+
+    //!
+    //! \brief Sets the password, instead of reading it from gui_rpc_auth.cfg. An empty password skips the
+    //! authentication, as the client allows for local connections when its password is empty.
+    //!
+    void SetPassword(const std::string& password);
+
+    //!
+    //! \brief Sets the client's run mode, with no duration, as boinccmd --set_run_mode does.
+    //! \return true if the client replied with success.
+    //!
+    bool SetRunMode(RunMode mode);
+
+    //! \brief Closes the connection, if open.
+    void Disconnect();
+
+    //! \brief Whether a connection is open.
+    bool IsConnected() const;
+
+    //! \brief Authenticated connections opened.
+    uint64_t GetConnectCount() const;
+
+    //! \brief Failed SetRunMode() calls.
+    uint64_t GetFailureCount() const;
+
+    //! \brief Latency of the successful SetRunMode() calls, including any connect, in microseconds.
+    const MetricHistogram& GetCallLatencyHistogram() const;
+
+    //! \brief Logs the counts and the call latency quantiles.
+    void LogSummary() const;
+
+    //!
+    //! \brief Finds a readable gui_rpc_auth.cfg: in $BOINC_DATA_DIR if set, otherwise in /var/lib/boinc,
+    //! /var/lib/boinc-client, /var/snap/boinc/common, ~/BOINC, ~/.BOINC and the flatpak data directory, in that order.
+    //!
+    static std::optional<fs::path> FindAuthFile();
+
+    //!
+    //! \brief Reads the password from an auth file: the first line, without trailing whitespace.
+    //! \return the password, or nullopt if the file cannot be read.
+    //!
+    static std::optional<std::string> ReadPassword(const fs::path& auth_file);
+
+    //! \brief The run mode element name, e.g. "never".
+    static const char* RunModeToString(RunMode mode);
+
+    //! \brief The BOINC client's default GUI RPC port.
+    static constexpr int DEFAULT_PORT = 31416;
+
+    //! \brief Default limit for each SetRunMode() call.
+    static constexpr int DEFAULT_TIMEOUT_MS = 1000;
+
+private:
+    int m_port;
+    int m_timeout_ms;
+    int m_fd;
+
+    bool m_has_password;
+    std::string m_password;
+
+    MetricCounter m_connects;
+    MetricCounter m_failures;
+    MetricHistogram m_call_latency_us;
+
+    //!
+    //! \brief Opens the connection and authenticates.
+    //! \param deadline_us steady clock time, in microseconds, by which the connect and authentication must finish.
+    //!
+    bool Connect(int64_t deadline_us);
+
+    //!
+    //! \brief Sends one request and reads its reply.
+    //! \param request the request elements, without the boinc_gui_rpc_request wrapper.
+    //! \param reply the reply, without the terminating \003.
+    //! \param deadline_us steady clock time, in microseconds, by which the reply must be read.
+    //! \return true if the reply was read.
+    //!
+    bool Exchange(const std::string& request, std::string& reply, int64_t deadline_us);
+};
+
+#endif // BOINC_RPC_H
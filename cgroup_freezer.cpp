@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <cgroup_freezer.h>
+#include <probes.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+int64_t SteadyNowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! \brief The frozen field of cgroup.events content, a "key value" line per field.
+std::optional<bool> ParseFrozenState(const std::string& content)
+{
+    std::istringstream lines(content);
+    std::string key;
+    int value = 0;
+
+    while (lines >> key >> value) {
+        if (key == "frozen") {
+            return value != 0;
+        }
+    }
+
+    return std::nullopt;
+}
+
+//! \brief Reads the whole of an open cgroup.events from the start. Rereading the fd rearms its POLLPRI notification.
+std::optional<bool> ReadFrozenStateFd(int fd)
+{
+    char buffer[512];
+    ssize_t result = pread(fd, buffer, sizeof(buffer) - 1, 0);
+
+    if (result < 0) {
+        return std::nullopt;
+    }
+
+    return ParseFrozenState(std::string(buffer, static_cast<size_t>(result)));
+}
+
+//! \brief Appends the pids in the cgroup.procs of directory and all of its descendants.
+void CollectProcesses(const fs::path& directory, std::set<pid_t>& pids)
+{
+    std::vector<fs::path> directories = {directory};
+    std::error_code ec;
+
+    for (fs::recursive_directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec)) {
+            directories.push_back(it->path());
+        }
+    }
+
+    for (const fs::path& cgroup : directories) {
+        std::ifstream procs(cgroup / "cgroup.procs");
+        pid_t pid = 0;
+
+        while (procs >> pid) {
+            pids.insert(pid);
+        }
+    }
+}
+
+} // namespace
+
+CgroupFreezer::CgroupFreezer(const fs::path& cgroup_root)
+    : m_cgroup_root(cgroup_root)
+    , m_confirm_timeout_ms(DEFAULT_CONFIRM_TIMEOUT_MS)
+    , m_frozen(false)
+{}
+
+bool CgroupFreezer::SetCgroup(const std::string& cgroup)
+{
+    m_cgroup_path.clear();
+
+    if (cgroup.empty()) {
+        return true;
+    }
+
+    fs::path path = fs::path(cgroup).is_absolute() ? fs::path(cgroup) : m_cgroup_root / cgroup;
+    std::error_code ec;
+
+    if (!fs::is_directory(path, ec)) {
+        error_log("%s: cgroup %s does not exist. The cgroup freezer is disabled.",
+                  __func__,
+                  path.string());
+        return false;
+    }
+
+    m_cgroup_path = path;
+
+    return true;
+}
+
+void CgroupFreezer::SetConfirmTimeout(int timeout_ms)
+{
+    m_confirm_timeout_ms = std::max(timeout_ms, 1);
+}
+
+bool CgroupFreezer::IsEnabled() const
+{
+    return !m_cgroup_path.empty();
+}
+
+const fs::path& CgroupFreezer::GetCgroupPath() const
+{
+    return m_cgroup_path;
+}
+
+bool CgroupFreezer::Freeze()
+{
+    m_freezes.Increment();
+
+    return SetFrozen(true, SIGSTOP);
+}
+
+bool CgroupFreezer::Thaw()
+{
+    m_thaws.Increment();
+
+    return SetFrozen(false, SIGCONT);
+}
+
+bool CgroupFreezer::IsFrozen() const
+{
+    return m_frozen;
+}
+
+uint64_t CgroupFreezer::GetFallbackCount() const
+{
+    return m_fallbacks.Get();
+}
+
+uint64_t CgroupFreezer::GetFailureCount() const
+{
+    return m_failures.Get();
+}
+
+const MetricHistogram& CgroupFreezer::GetConfirmLatencyHistogram() const
+{
+    return m_confirm_latency_us;
+}
+
+void CgroupFreezer::LogSummary() const
+{
+    if (m_freezes.Get() == 0 && m_thaws.Get() == 0) {
+        return;
+    }
+
+    normal_log("INFO: %s: %llu freezes, %llu thaws, %llu fell back to signals, %llu failed, confirmation p50 %.0f us, "
+               "p95 %.0f us",
+               __func__,
+               m_freezes.Get(),
+               m_thaws.Get(),
+               GetFallbackCount(),
+               GetFailureCount(),
+               m_confirm_latency_us.Quantile(0.50),
+               m_confirm_latency_us.Quantile(0.95));
+}
+
+std::optional<bool> CgroupFreezer::ReadFrozenState(const fs::path& events_file)
+{
+    std::ifstream in(events_file);
+
+    if (!in) {
+        return std::nullopt;
+    }
+
+    std::stringstream content;
+    content << in.rdbuf();
+
+    return ParseFrozenState(content.str());
+}
+
+bool CgroupFreezer::SetFrozen(bool frozen, int signum)
+{
+    if (!IsEnabled()) {
+        return false;
+    }
+
+    // Read only by the freeze probe, which is empty without USDT probes.
+    [[maybe_unused]] int64_t start_us = SteadyNowMicros();
+    [[maybe_unused]] bool fallback = false;
+    bool written = false;
+    bool succeeded = WriteFreezeAndConfirm(frozen, written);
+
+    if (!succeeded) {
+        m_fallbacks.Increment();
+        fallback = true;
+
+        normal_log("INFO: %s: Falling back to %s for the processes in cgroup %s.",
+                   __func__,
+                   frozen ? "SIGSTOP" : "SIGCONT",
+                   m_cgroup_path.string());
+
+        succeeded = SignalProcesses(signum);
+    } else if (!frozen && !m_stopped_pids.empty()) {
+        // Processes stopped by an earlier fallback stay stopped through a thaw of the cgroup.
+        succeeded = SignalProcesses(SIGCONT);
+    }
+
+    if (!succeeded) {
+        m_failures.Increment();
+
+        error_log("%s: Failed to %s cgroup %s.",
+                  __func__,
+                  frozen ? "freeze" : "thaw",
+                  m_cgroup_path.string());
+    }
+
+    // A partial freeze still leaves the cgroup or some of its processes frozen, so the shutdown must thaw it, as it
+    // must after a failed thaw.
+    m_frozen = frozen ? (succeeded || written || !m_stopped_pids.empty()) : !succeeded;
+
+    IDLE_DETECT_PROBE3(idle_detect, freeze, static_cast<int>(frozen), SteadyNowMicros() - start_us,
+                       static_cast<int>(fallback));
+
+    return succeeded;
+}
+
+bool CgroupFreezer::WriteFreezeAndConfirm(bool frozen, bool& written)
+{
+    written = false;
+
+    fs::path freeze_file = m_cgroup_path / "cgroup.freeze";
+    int freeze_fd = open(freeze_file.c_str(), O_WRONLY | O_CLOEXEC);
+
+    if (freeze_fd == -1) {
+        debug_log("INFO: %s: Cannot open %s: %s",
+                  __func__,
+                  freeze_file.string(),
+                  strerror(errno));
+        return false;
+    }
+
+    // Opened before the write, so that the state change cannot be missed between the write and the first read.
+    fs::path events_file = m_cgroup_path / "cgroup.events";
+    int events_fd = open(events_file.c_str(), O_RDONLY | O_CLOEXEC);
+    int events_errno = errno;
+
+    int64_t start_us = SteadyNowMicros();
+    written = (write(freeze_fd, frozen ? "1" : "0", 1) == 1);
+    int write_errno = errno;
+
+    close(freeze_fd);
+
+    if (!written || events_fd == -1) {
+        error_log("%s: Cannot %s: %s",
+                  __func__,
+                  !written ? ("write " + freeze_file.string()) : ("open " + events_file.string()),
+                  strerror(!written ? write_errno : events_errno));
+
+        if (events_fd != -1) {
+            close(events_fd);
+        }
+
+        return false;
+    }
+
+    int64_t deadline_us = start_us + static_cast<int64_t>(m_confirm_timeout_ms) * 1000;
+    bool confirmed = false;
+
+    while (true) {
+        if (ReadFrozenStateFd(events_fd) == frozen) {
+            confirmed = true;
+            break;
+        }
+
+        int64_t remaining_us = deadline_us - SteadyNowMicros();
+
+        if (remaining_us <= 0) {
+            break;
+        }
+
+        // The kernel signals a change of cgroup.events with POLLPRI.
+        pollfd fd = {events_fd, POLLPRI, 0};
+        poll(&fd, 1, static_cast<int>((remaining_us + 999) / 1000));
+    }
+
+    close(events_fd);
+
+    if (!confirmed) {
+        error_log("%s: cgroup %s was not %s within %i ms.",
+                  __func__,
+                  m_cgroup_path.string(),
+                  frozen ? "frozen" : "thawed",
+                  m_confirm_timeout_ms);
+        return false;
+    }
+
+    int64_t latency_us = SteadyNowMicros() - start_us;
+
+    m_confirm_latency_us.Observe(latency_us);
+
+    debug_log("INFO: %s: cgroup %s %s in %lld us.",
+              __func__,
+              m_cgroup_path.string(),
+              frozen ? "frozen" : "thawed",
+              latency_us);
+
+    return true;
+}
+
+bool CgroupFreezer::SignalProcesses(int signum)
+{
+    std::set<pid_t> pids;
+
+    CollectProcesses(m_cgroup_path, pids);
+
+    if (signum == SIGCONT) {
+        pids.insert(m_stopped_pids.begin(), m_stopped_pids.end());
+        m_stopped_pids.clear();
+    }
+
+    pid_t self = getpid();
+    bool all_delivered = true;
+
+    for (pid_t pid : pids) {
+        if (pid <= 0 || pid == self) {
+            continue;
+        }
+
+        if (kill(pid, signum) == 0) {
+            if (signum == SIGSTOP) {
+                m_stopped_pids.insert(pid);
+            }
+        } else if (errno != ESRCH) {
+            // ESRCH: it has exited since cgroup.procs was read.
+            error_log("%s: Cannot send signal %i to pid %i: %s",
+                      __func__,
+                      signum,
+                      pid,
+                      strerror(errno));
+
+            all_delivered = false;
+        }
+    }
+
+    debug_log("INFO: %s: Sent signal %i to %u processes in cgroup %s.",
+              __func__,
+              signum,
+              static_cast<unsigned int>(pids.size()),
+              m_cgroup_path.string());
+
+    return all_delivered;
+}
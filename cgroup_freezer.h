@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef CGROUP_FREEZER_H
+#define CGROUP_FREEZER_H
+
+#include <metrics.h>
+#include <util.h>
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+
+#include <sys/types.h>
+
+//!
+//! \brief The CgroupFreezer class pauses and resumes a DC workload by freezing and thawing its cgroup v2 subtree, e.g.
+//! system.slice/boinc-client.service, through cgroup.freeze. A freeze stops every task in the subtree at once, without
+//! the DC client's cooperation, so the pause takes effect within milliseconds of the transition to active.
+//!
+//! Freeze() and Thaw() write cgroup.freeze, then wait for the frozen state in cgroup.events, which the kernel signals
+//! with POLLPRI. If cgroup.freeze cannot be written, e.g. on cgroup v1 or without write access, or the state is not
+//! confirmed in time, they fall back to SIGSTOP and SIGCONT of the processes in the subtree's cgroup.procs.
+//!
+//! It is used from the main loop thread.
+//!
+class CgroupFreezer
+{
+public:
+    //!
+    //! \brief Constructor
+    //! \param cgroup_root the cgroup v2 mount point, which relative cgroup paths are resolved against.
+    //!
+    explicit CgroupFreezer(const fs::path& cgroup_root = DEFAULT_CGROUP_ROOT);
+
+    //!
+    //! \brief Sets the cgroup to freeze, as a path relative to the cgroup root or an absolute path. An empty cgroup
+    //! disables the freezer.
+    //! \return false if the cgroup directory does not exist. The freezer is then disabled.
+    //!
+    bool SetCgroup(const std::string& cgroup);
+
+    //! \brief Sets how long Freeze() and Thaw() wait for the state in cgroup.events before falling back to signals.
+    void SetConfirmTimeout(int timeout_ms);
+
+    //! \brief Whether a cgroup is set.
+    bool IsEnabled() const;
+
+    //! \brief The resolved cgroup directory.
+    const fs::path& GetCgroupPath() const;
+
+    //!
+    //! \brief Freezes the cgroup, or stops its processes.
+    //! \return true if the cgroup is frozen, or all of its processes were stopped.
+    //!
+    bool Freeze();
+
+    //!
+    //! \brief Thaws the cgroup, and continues the processes stopped by a fallback.
+    //! \return true if the cgroup is thawed, or all of its processes were continued.
+    //!
+    bool Thaw();
+
+    //!
+    //! \brief Whether the workload may be frozen: after a Freeze() that wrote cgroup.freeze or stopped a process, even
+    //! if it did not fully succeed, and after a Thaw() that failed. A Thaw() is then due at shutdown.
+    //!
+    bool IsFrozen() const;
+
+    //! \brief Freezes and thaws that fell back to the signals.
+    uint64_t GetFallbackCount() const;
+
+    //! \brief Freezes and thaws that failed.
+    uint64_t GetFailureCount() const;
+
+    //! \brief Time from the cgroup.freeze write to the confirmed state, in microseconds.
+    const MetricHistogram& GetConfirmLatencyHistogram() const;
+
+    //! \brief Logs the counts and the confirmation latency quantiles.
+    void LogSummary() const;
+
+    //!
+    //! \brief Reads the frozen field of a cgroup.events file.
+    //! \return the frozen state, or nullopt if the file cannot be read or has no frozen field.
+    //!
+    static std::optional<bool> ReadFrozenState(const fs::path& events_file);
+
+    //! \brief The usual cgroup v2 mount point.
+    static constexpr const char* DEFAULT_CGROUP_ROOT = "/sys/fs/cgroup";
+
+    //! \brief Default wait for the state in cgroup.events, in milliseconds.
+    static constexpr int DEFAULT_CONFIRM_TIMEOUT_MS = 100;
+
+private:
+    fs::path m_cgroup_root;
+    fs::path m_cgroup_path;
+    int m_confirm_timeout_ms;
+    bool m_frozen;
+
+    //! \brief Processes stopped by the fallback, to continue on the thaw.
+    std::set<pid_t> m_stopped_pids;
+
+    MetricCounter m_freezes;
+    MetricCounter m_thaws;
+    MetricCounter m_fallbacks;
+    MetricCounter m_failures;
+    MetricHistogram m_confirm_latency_us;
+
+    //! \brief Freezes or thaws the cgroup, falling back to signum.
+    bool SetFrozen(bool frozen, int signum);
+
+    //!
+    //! \brief Writes cgroup.freeze and waits for the state in cgroup.events.
+    //! \param written set true if cgroup.freeze was written, whether or not the state was then confirmed.
+    //! \return true if the state was confirmed.
+    //!
+    bool WriteFreezeAndConfirm(bool frozen, bool& written);
+
+    //!
+    //! \brief Sends signum to the processes in the cgroup subtree, except idle_detect itself.
+    //! \return true if every signal was delivered.
+    //!
+    bool SignalProcesses(int signum);
+};
+
+#endif // CGROUP_FREEZER_H
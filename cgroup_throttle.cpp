@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <cgroup_throttle.h>
+#include <probes.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+CgroupThrottle::CgroupThrottle(const fs::path& cgroup_root, int cpu_count)
+    : m_cgroup_root(cgroup_root)
+    , m_cpu_count(cpu_count > 0 ? cpu_count : std::max(static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)), 1))
+    , m_hysteresis_seconds(DEFAULT_HYSTERESIS_SECONDS)
+    , m_ramp_ms(DEFAULT_RAMP_MS)
+    , m_now_ms([]() {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch()).count());
+    })
+    , m_has_cpu_max(false)
+    , m_has_cpu_weight(false)
+    , m_has_io_weight(false)
+    , m_current_tier(-1)
+    , m_tier_start_ms(0)
+    , m_applied_cpu_percent(-1)
+    , m_ramping(false)
+    , m_ramp_from_percent(0)
+    , m_ramp_start_ms(0)
+    , m_next_step_ms(0)
+{}
+
+bool CgroupThrottle::SetCgroup(const std::string& cgroup)
+{
+    m_cgroup_path.clear();
+
+    if (cgroup.empty()) {
+        return true;
+    }
+
+    fs::path path = fs::path(cgroup).is_absolute() ? fs::path(cgroup) : m_cgroup_root / cgroup;
+    std::error_code ec;
+
+    if (!fs::is_directory(path, ec)) {
+        error_log("%s: cgroup %s does not exist. The throttle is disabled.",
+                  __func__,
+                  path.string());
+        return false;
+    }
+
+    m_cgroup_path = path;
+
+    // A control file exists only if the parent cgroup enables its controller for the children.
+    m_has_cpu_max = fs::exists(path / "cpu.max", ec);
+    m_has_cpu_weight = fs::exists(path / "cpu.weight", ec);
+    m_has_io_weight = fs::exists(path / "io.weight", ec);
+
+    if (!m_has_cpu_max || !m_has_cpu_weight) {
+        error_log("%s: cgroup %s has no cpu controller. Enable it in the parent's cgroup.subtree_control.",
+                  __func__,
+                  path.string());
+    }
+
+    if (!m_has_io_weight) {
+        normal_log("INFO: %s: cgroup %s has no io.weight. The tiers' io weights are not applied.",
+                   __func__,
+                   path.string());
+    }
+
+    return true;
+}
+
+void CgroupThrottle::SetTiers(const std::vector<Tier>& tiers)
+{
+    m_tiers = tiers;
+    m_tier_time_ms.assign(tiers.size(), 0);
+    m_current_tier = -1;
+    m_ramping = false;
+}
+
+const std::vector<CgroupThrottle::Tier>& CgroupThrottle::GetTiers() const
+{
+    return m_tiers;
+}
+
+void CgroupThrottle::SetHysteresis(int64_t hysteresis_seconds)
+{
+    m_hysteresis_seconds = std::max<int64_t>(hysteresis_seconds, 0);
+}
+
+void CgroupThrottle::SetRampDuration(int64_t ramp_ms)
+{
+    m_ramp_ms = std::max<int64_t>(ramp_ms, 0);
+}
+
+void CgroupThrottle::SetClock(std::function<int64_t()> now_ms)
+{
+    m_now_ms = std::move(now_ms);
+}
+
+bool CgroupThrottle::IsEnabled() const
+{
+    return !m_cgroup_path.empty() && !m_tiers.empty();
+}
+
+void CgroupThrottle::Update(int64_t idle_seconds)
+{
+    if (!IsEnabled()) {
+        return;
+    }
+
+    int target = TierForIdle(idle_seconds);
+
+    if (m_current_tier < 0 || target > m_current_tier) {
+        ApplyTier(target);
+        return;
+    }
+
+    if (target < m_current_tier) {
+        // A hysteresis at or above the tier's idle time would keep even an idle time of zero from stepping down.
+        int64_t tier_idle_seconds = m_tiers[m_current_tier].idle_seconds;
+        int64_t hysteresis_seconds = std::min(m_hysteresis_seconds, tier_idle_seconds - 1);
+
+        if (idle_seconds + hysteresis_seconds < tier_idle_seconds) {
+            ApplyTier(target);
+        }
+    }
+}
+
+void CgroupThrottle::Process()
+{
+    if (!m_ramping) {
+        return;
+    }
+
+    int64_t now_ms = m_now_ms();
+
+    if (now_ms < m_next_step_ms) {
+        return;
+    }
+
+    int target_percent = m_tiers[m_current_tier].cpu_percent;
+    int64_t elapsed_ms = now_ms - m_ramp_start_ms;
+    int cpu_percent = target_percent;
+
+    if (elapsed_ms < m_ramp_ms) {
+        cpu_percent = m_ramp_from_percent
+                      + static_cast<int>((target_percent - m_ramp_from_percent) * elapsed_ms / m_ramp_ms);
+        m_next_step_ms = now_ms + RAMP_STEP_MS;
+    } else {
+        m_ramping = false;
+
+        debug_log("INFO: %s: cpu.max ramp to %i%% complete.",
+                  __func__,
+                  target_percent);
+    }
+
+    if (cpu_percent != m_applied_cpu_percent) {
+        WriteCpuMax(cpu_percent);
+    }
+}
+
+int64_t CgroupThrottle::GetNextDeadlineMs() const
+{
+    if (!m_ramping) {
+        return -1;
+    }
+
+    return std::max<int64_t>(m_next_step_ms - m_now_ms(), 0);
+}
+
+int64_t CgroupThrottle::GetNextWaitMs(int64_t idle_seconds, bool resume_signalled, int64_t poll_interval_ms) const
+{
+    if (!IsEnabled() || m_current_tier < 0) {
+        return -1;
+    }
+
+    int64_t wait_ms = -1;
+
+    // The idle time grows by one second per second, so the next tier cannot apply before this.
+    if (m_current_tier + 1 < static_cast<int>(m_tiers.size()) && idle_seconds >= 0) {
+        wait_ms = std::max<int64_t>((m_tiers[m_current_tier + 1].idle_seconds - idle_seconds) * 1000, 0);
+    }
+
+    // Above the first tier the user's return must be seen at once, to drop the throttle back.
+    if (m_current_tier > 0 && !resume_signalled) {
+        wait_ms = (wait_ms < 0) ? poll_interval_ms : std::min(wait_ms, poll_interval_ms);
+    }
+
+    return wait_ms;
+}
+
+void CgroupThrottle::Release()
+{
+    if (m_cgroup_path.empty() || m_current_tier < 0) {
+        return;
+    }
+
+    m_ramping = false;
+
+    if (m_has_cpu_max) {
+        WriteControl("cpu.max", FormatCpuMax(100, m_cpu_count));
+    }
+
+    if (m_has_cpu_weight) {
+        WriteControl("cpu.weight", "100");
+    }
+
+    if (m_has_io_weight) {
+        WriteControl("io.weight", "default 100");
+    }
+
+    m_tier_time_ms[m_current_tier] += m_now_ms() - m_tier_start_ms;
+    m_current_tier = -1;
+    m_applied_cpu_percent = -1;
+}
+
+int CgroupThrottle::GetCurrentTier() const
+{
+    return m_current_tier;
+}
+
+int CgroupThrottle::GetAppliedCpuPercent() const
+{
+    return m_applied_cpu_percent;
+}
+
+uint64_t CgroupThrottle::GetTierChangeCount() const
+{
+    return m_tier_changes.Get();
+}
+
+uint64_t CgroupThrottle::GetWriteFailureCount() const
+{
+    return m_write_failures.Get();
+}
+
+void CgroupThrottle::LogSummary() const
+{
+    if (GetTierChangeCount() == 0) {
+        return;
+    }
+
+    std::string tier_times;
+
+    for (size_t tier = 0; tier < m_tier_time_ms.size(); ++tier) {
+        int64_t time_ms = m_tier_time_ms[tier];
+
+        if (static_cast<int>(tier) == m_current_tier) {
+            time_ms += m_now_ms() - m_tier_start_ms;
+        }
+
+        tier_times += tfm::format("%s%u: %lld s", tier ? ", " : "", static_cast<unsigned int>(tier), time_ms / 1000);
+    }
+
+    normal_log("INFO: %s: %llu tier changes, %llu failed writes, time in tiers %s",
+               __func__,
+               GetTierChangeCount(),
+               GetWriteFailureCount(),
+               tier_times);
+}
+
+std::optional<std::vector<CgroupThrottle::Tier>> CgroupThrottle::ParseTiers(const std::string& specification)
+{
+    std::vector<Tier> tiers;
+
+    for (const std::string& entry : StringSplit(specification, ",")) {
+        std::vector<std::string> fields = StringSplit(TrimString(entry), ":");
+
+        if (fields.size() != 4) {
+            error_log("%s: Tier '%s' does not have the four fields idle_seconds:cpu_percent:cpu_weight:io_weight.",
+                      __func__,
+                      entry);
+            return std::nullopt;
+        }
+
+        Tier tier {};
+
+        try {
+            tier.idle_seconds = ParseStringToInt(fields[0]);
+            tier.cpu_percent = ParseStringToInt(fields[1]);
+            tier.cpu_weight = ParseStringToInt(fields[2]);
+            tier.io_weight = ParseStringToInt(fields[3]);
+        } catch (std::exception& e) {
+            error_log("%s: Tier '%s' has an invalid value: %s",
+                      __func__,
+                      entry,
+                      e.what());
+            return std::nullopt;
+        }
+
+        if (tier.idle_seconds < 0
+            || tier.cpu_percent < 1 || tier.cpu_percent > 100
+            || tier.cpu_weight < 1 || tier.cpu_weight > 10000
+            || tier.io_weight < 1 || tier.io_weight > 10000) {
+            error_log("%s: Tier '%s' is out of range: cpu_percent must be 1 to 100, the weights 1 to 10000.",
+                      __func__,
+                      entry);
+            return std::nullopt;
+        }
+
+        if (tiers.empty() ? tier.idle_seconds != 0 : tier.idle_seconds <= tiers.back().idle_seconds) {
+            error_log("%s: Tier '%s' is out of order: the first tier's idle_seconds must be 0, and they must increase.",
+                      __func__,
+                      entry);
+            return std::nullopt;
+        }
+
+        tiers.push_back(tier);
+    }
+
+    return tiers;
+}
+
+std::string CgroupThrottle::FormatCpuMax(int cpu_percent, int cpu_count)
+{
+    if (cpu_percent >= 100) {
+        return tfm::format("max %lld", CPU_MAX_PERIOD_US);
+    }
+
+    // The kernel's smallest quota is 1 ms.
+    int64_t quota_us = std::max<int64_t>(CPU_MAX_PERIOD_US * cpu_count * cpu_percent / 100, 1000);
+
+    return tfm::format("%lld %lld", quota_us, CPU_MAX_PERIOD_US);
+}
+
+int CgroupThrottle::TierForIdle(int64_t idle_seconds) const
+{
+    int tier = 0;
+
+    while (tier + 1 < static_cast<int>(m_tiers.size()) && idle_seconds >= m_tiers[tier + 1].idle_seconds) {
+        ++tier;
+    }
+
+    return tier;
+}
+
+void CgroupThrottle::ApplyTier(int tier)
+{
+    int64_t now_ms = m_now_ms();
+    bool step_up = m_current_tier >= 0 && tier > m_current_tier;
+
+    if (m_current_tier >= 0) {
+        m_tier_time_ms[m_current_tier] += now_ms - m_tier_start_ms;
+        m_tier_changes.Increment();
+    }
+
+    normal_log("INFO: %s: Throttle tier %i -> %i.",
+               __func__,
+               m_current_tier,
+               tier);
+
+    m_current_tier = tier;
+    m_tier_start_ms = now_ms;
+
+    const Tier& controls = m_tiers[tier];
+
+    if (m_has_cpu_weight) {
+        WriteControl("cpu.weight", std::to_string(controls.cpu_weight));
+    }
+
+    if (m_has_io_weight) {
+        WriteControl("io.weight", "default " + std::to_string(controls.io_weight));
+    }
+
+    IDLE_DETECT_PROBE3(idle_detect, throttle_tier, tier, controls.cpu_percent, controls.cpu_weight);
+
+    if (step_up && m_ramp_ms > 0 && controls.cpu_percent > m_applied_cpu_percent) {
+        m_ramping = true;
+        m_ramp_from_percent = m_applied_cpu_percent;
+        m_ramp_start_ms = now_ms;
+        m_next_step_ms = now_ms + RAMP_STEP_MS;
+        return;
+    }
+
+    m_ramping = false;
+    WriteCpuMax(controls.cpu_percent);
+}
+
+void CgroupThrottle::WriteCpuMax(int cpu_percent)
+{
+    m_applied_cpu_percent = cpu_percent;
+
+    if (m_has_cpu_max) {
+        WriteControl("cpu.max", FormatCpuMax(cpu_percent, m_cpu_count));
+    }
+}
+
+bool CgroupThrottle::WriteControl(const char* file, const std::string& value)
+{
+    fs::path path = m_cgroup_path / file;
+    int fd = open(path.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+
+    if (fd == -1 || write(fd, value.data(), value.size()) != static_cast<ssize_t>(value.size())) {
+        int write_errno = errno;
+
+        if (fd != -1) {
+            close(fd);
+        }
+
+        m_write_failures.Increment();
+
+        error_log("%s: Cannot write '%s' to %s: %s",
+                  __func__,
+                  value,
+                  path.string(),
+                  strerror(write_errno));
+        return false;
+    }
+
+    close(fd);
+
+    debug_log("INFO: %s: Wrote '%s' to %s.",
+              __func__,
+              value,
+              path.string());
+
+    return true;
+}
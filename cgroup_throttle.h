@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef CGROUP_THROTTLE_H
+#define CGROUP_THROTTLE_H
+
+#include <metrics.h>
+#include <util.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+//!
+//! \brief The CgroupThrottle class throttles a DC workload by its cgroup v2 CPU and IO controls, in tiers of idle time,
+//! instead of the binary pause of the active and idle commands. E.g. the workload runs at 25% of the CPU with low
+//! weights while the user is active, at 50% after a minute of idle time, and unthrottled after fifteen minutes.
+//!
+//! Each tier sets cpu.max, as a percentage of all CPUs, and cpu.weight and io.weight. A tier applies from its idle time
+//! up to the next tier's. A step down, towards active, applies at once, since it protects the interactive session, but
+//! only once the idle time is hysteresis seconds below the tier's, so that a jittery idle time does not flap between
+//! tiers. A step up applies the weights at once, and ramps cpu.max to the tier's over the ramp duration, so that the
+//! CPU frequency and the fans do not jump the moment the user leaves.
+//!
+//! It is used from the main loop thread, which calls Update() on each pass, and Process() for the ramp steps.
+//!
+class CgroupThrottle
+{
+public:
+    //!
+    //! \brief The controls of a tier.
+    //!
+    struct Tier
+    {
+        int64_t idle_seconds; //!< Idle time from which the tier applies. The first tier's is 0.
+        int cpu_percent;      //!< cpu.max, as a percentage of all CPUs, 1 to 100. 100 is no limit.
+        int cpu_weight;       //!< cpu.weight, 1 to 10000. The kernel default is 100.
+        int io_weight;        //!< io.weight, 1 to 10000. The kernel default is 100.
+    };
+
+    //!
+    //! \brief Constructor
+    //! \param cgroup_root the cgroup v2 mount point, which relative cgroup paths are resolved against.
+    //! \param cpu_count CPUs that 100% of cpu.max covers. 0 uses the online CPUs.
+    //!
+    explicit CgroupThrottle(const fs::path& cgroup_root = DEFAULT_CGROUP_ROOT, int cpu_count = 0);
+
+    //!
+    //! \brief Sets the cgroup to throttle, as a path relative to the cgroup root or an absolute path. An empty cgroup
+    //! disables the throttle.
+    //! \return false if the cgroup directory does not exist. The throttle is then disabled.
+    //!
+    bool SetCgroup(const std::string& cgroup);
+
+    //! \brief Sets the tiers, as validated by ParseTiers().
+    void SetTiers(const std::vector<Tier>& tiers);
+
+    //! \brief The tiers.
+    const std::vector<Tier>& GetTiers() const;
+
+    //!
+    //! \brief Sets how far the idle time must fall below a tier's before a step down, in seconds. For a tier whose idle
+    //! time is not above it, it is reduced to one second less than the tier's, so that a zero idle time steps down.
+    //!
+    void SetHysteresis(int64_t hysteresis_seconds);
+
+    //! \brief Sets the duration of the cpu.max ramp of a step up. 0 steps at once.
+    void SetRampDuration(int64_t ramp_ms);
+
+    //! \brief Sets the steady clock in milliseconds. For the tests.
+    void SetClock(std::function<int64_t()> now_ms);
+
+    //! \brief Whether a cgroup and tiers are set.
+    bool IsEnabled() const;
+
+    //!
+    //! \brief Moves to the tier of the idle time, with the hysteresis for a step down.
+    //! \param idle_seconds effective idle time of the pass. From an event driven backend, it must not reach a tier's
+    //! idle time before the backend has reported the crossing, nor stay above it after the next input.
+    //!
+    void Update(int64_t idle_seconds);
+
+    //! \brief Writes the next ramp step if it is due. Does not block.
+    void Process();
+
+    //! \brief Time until the next ramp step, in milliseconds, or -1 if no ramp is in progress.
+    int64_t GetNextDeadlineMs() const;
+
+    //!
+    //! \brief Provides the longest wait before the next pass that keeps the tiers current.
+    //! \param idle_seconds effective idle time of the pass.
+    //! \param resume_signalled whether the resume wakes the main loop, i.e. idle with event driven sources.
+    //! \param poll_interval_ms the wait while the resume must be polled for, min_check_interval_ms.
+    //! \return the time until the idle time reaches the next tier's, and at most poll_interval_ms while throttled
+    //! above the first tier with the resume not signalled. -1 if no tier calls for a pass.
+    //!
+    int64_t GetNextWaitMs(int64_t idle_seconds, bool resume_signalled, int64_t poll_interval_ms) const;
+
+    //! \brief Restores the kernel defaults, no cpu.max limit and weights of 100.
+    void Release();
+
+    //! \brief Index of the current tier, or -1 before the first Update().
+    int GetCurrentTier() const;
+
+    //! \brief The cpu.max percentage last written, or -1.
+    int GetAppliedCpuPercent() const;
+
+    //! \brief Tier changes.
+    uint64_t GetTierChangeCount() const;
+
+    //! \brief Failed control file writes.
+    uint64_t GetWriteFailureCount() const;
+
+    //! \brief Logs the tier changes, the write failures and the time in each tier.
+    void LogSummary() const;
+
+    //!
+    //! \brief Parses the tiers of throttle_tiers: comma separated tiers of idle_seconds:cpu_percent:cpu_weight:io_weight,
+    //! e.g. "0:25:10:10,60:50:50:50,900:100:100:100". The first tier's idle time must be 0, and the idle times must
+    //! increase.
+    //! \return the tiers, or nullopt, with the error logged, if the specification is invalid.
+    //!
+    static std::optional<std::vector<Tier>> ParseTiers(const std::string& specification);
+
+    //! \brief The cpu.max value for a percentage of cpu_count CPUs, e.g. "max 100000" or "50000 100000".
+    static std::string FormatCpuMax(int cpu_percent, int cpu_count);
+
+    //! \brief The usual cgroup v2 mount point.
+    static constexpr const char* DEFAULT_CGROUP_ROOT = "/sys/fs/cgroup";
+
+    //! \brief The cpu.max period, in microseconds. The kernel default.
+    static constexpr int64_t CPU_MAX_PERIOD_US = 100000;
+
+    //! \brief Interval between the cpu.max writes of a ramp, in milliseconds.
+    static constexpr int64_t RAMP_STEP_MS = 1000;
+
+    //! \brief Default hysteresis of a step down, in seconds.
+    static constexpr int64_t DEFAULT_HYSTERESIS_SECONDS = 10;
+
+    //! \brief Default ramp duration of a step up, in milliseconds.
+    static constexpr int64_t DEFAULT_RAMP_MS = 30000;
+
+private:
+    fs::path m_cgroup_root;
+    fs::path m_cgroup_path;
+    int m_cpu_count;
+    std::vector<Tier> m_tiers;
+    int64_t m_hysteresis_seconds;
+    int64_t m_ramp_ms;
+    std::function<int64_t()> m_now_ms;
+
+    //! \brief Whether the cgroup has cpu.max, cpu.weight and io.weight, i.e. the controllers are enabled for it.
+    bool m_has_cpu_max;
+    bool m_has_cpu_weight;
+    bool m_has_io_weight;
+
+    int m_current_tier;
+    int64_t m_tier_start_ms;
+    int m_applied_cpu_percent;
+
+    bool m_ramping;
+    int m_ramp_from_percent;
+    int64_t m_ramp_start_ms;
+    int64_t m_next_step_ms;
+
+    MetricCounter m_tier_changes;
+    MetricCounter m_write_failures;
+
+    //! \brief Time spent in each tier before the current stay, in milliseconds.
+    std::vector<int64_t> m_tier_time_ms;
+
+    //! \brief The tier of the idle time, without the hysteresis.
+    int TierForIdle(int64_t idle_seconds) const;
+
+    //! \brief Moves to tier: writes its weights, and its cpu.max at once or by a ramp.
+    void ApplyTier(int tier);
+
+    //! \brief Writes cpu.max for cpu_percent.
+    void WriteCpuMax(int cpu_percent);
+
+    //! \brief Writes a control file of the cgroup. Returns false on failure, which is logged and counted.
+    bool WriteControl(const char* file, const std::string& value);
+};
+
+#endif // CGROUP_THROTTLE_H
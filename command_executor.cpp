@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <command_executor.h>
+#include <util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+
+#include <poll.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+//!
+//! \brief Opens a pidfd for pid, which is readable when it exits. The pidfd has close-on-exec set.
+//! \return the pidfd, or -1 if the kernel does not support pidfd_open() (before 5.3).
+//!
+int OpenPidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void) pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+} // namespace
+
+CommandExecutor::CommandExecutor(int64_t timeout_ms, int64_t min_dwell_ms)
+    : m_timeout_ms(std::max<int64_t>(timeout_ms, 1))
+    , m_min_dwell_ms(std::max<int64_t>(min_dwell_ms, 0))
+    , m_now_ms([]() {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch()).count());
+    })
+    , m_pid(-1)
+    , m_pidfd(-1)
+    , m_start_time_ms(0)
+    , m_kill_time_ms(-1)
+    , m_timed_out(false)
+    , m_has_pending(false)
+    , m_pending_request_time_ms(0)
+    , m_last_succeeded(false)
+    , m_last_start_time_ms(0)
+    , m_has_started(false)
+{}
+
+CommandExecutor::~CommandExecutor()
+{
+    Stop(0);
+}
+
+void CommandExecutor::SetTimeout(int64_t timeout_ms)
+{
+    m_timeout_ms = std::max<int64_t>(timeout_ms, 1);
+}
+
+void CommandExecutor::SetMinDwell(int64_t min_dwell_ms)
+{
+    m_min_dwell_ms = std::max<int64_t>(min_dwell_ms, 0);
+}
+
+void CommandExecutor::SetClock(std::function<int64_t()> now_ms)
+{
+    m_now_ms = std::move(now_ms);
+}
+
+void CommandExecutor::Request(const std::string& command)
+{
+    if (command.empty()) {
+        debug_log("INFO: %s: No command provided.",
+                  __func__);
+        return;
+    }
+
+    if (m_has_pending) {
+        m_superseded.Increment();
+
+        debug_log("INFO: %s: Pending command '%s' replaced by '%s' before it started.",
+                  __func__,
+                  m_pending_command,
+                  command);
+    }
+
+    m_pending_command = command;
+    m_pending_request_time_ms = m_now_ms();
+    m_has_pending = true;
+
+    Process();
+}
+
+void CommandExecutor::Process()
+{
+    if (m_pid != -1 && !Reap()) {
+        int64_t now_ms = m_now_ms();
+
+        if (m_kill_time_ms >= 0 && now_ms >= m_kill_time_ms) {
+            error_log("%s: Command '%s' did not exit after SIGTERM. Killing it.",
+                      __func__,
+                      m_running_command);
+
+            kill(-m_pid, SIGKILL);
+            m_kill_time_ms = -1;
+        } else if (!m_timed_out && now_ms - m_start_time_ms >= m_timeout_ms) {
+            error_log("%s: Command '%s' timed out after %lld ms. Terminating it.",
+                      __func__,
+                      m_running_command,
+                      m_timeout_ms);
+
+            m_timeouts.Increment();
+            m_timed_out = true;
+
+            // The command runs in its own process group, so this reaches the shell's children, e.g. boinccmd, too.
+            kill(-m_pid, SIGTERM);
+            m_kill_time_ms = now_ms + KILL_GRACE_MS;
+        }
+    }
+
+    StartPending();
+}
+
+void CommandExecutor::Stop(int64_t wait_ms)
+{
+    if (m_has_pending) {
+        normal_log("INFO: %s: Dropping pending command '%s'.",
+                   __func__,
+                   m_pending_command);
+
+        m_has_pending = false;
+    }
+
+    if (m_pid == -1) {
+        return;
+    }
+
+    int64_t deadline_ms = m_now_ms() + std::max<int64_t>(wait_ms, 0);
+
+    while (!Reap()) {
+        int64_t remaining_ms = deadline_ms - m_now_ms();
+
+        if (remaining_ms <= 0) {
+            normal_log("INFO: %s: Leaving command '%s' running.",
+                       __func__,
+                       m_running_command);
+
+            ClearRunning();
+            return;
+        }
+
+        if (m_pidfd != -1) {
+            pollfd fd = {m_pidfd, POLLIN, 0};
+            poll(&fd, 1, static_cast<int>(remaining_ms));
+        } else {
+            usleep(static_cast<useconds_t>(std::min(remaining_ms, NO_PIDFD_CHECK_INTERVAL_MS) * 1000));
+        }
+    }
+}
+
+void CommandExecutor::InvalidateApplied()
+{
+    m_last_succeeded = false;
+}
+
+int CommandExecutor::GetFd() const
+{
+    return m_pidfd;
+}
+
+int64_t CommandExecutor::GetNextDeadlineMs() const
+{
+    int64_t now_ms = m_now_ms();
+    int64_t wait_ms = -1;
+
+    auto consider = [&wait_ms](int64_t candidate_ms) {
+        candidate_ms = std::max<int64_t>(candidate_ms, 0);
+        wait_ms = (wait_ms < 0) ? candidate_ms : std::min(wait_ms, candidate_ms);
+    };
+
+    if (m_pid != -1) {
+        if (m_pidfd == -1) {
+            consider(NO_PIDFD_CHECK_INTERVAL_MS);
+        }
+
+        if (m_kill_time_ms >= 0) {
+            consider(m_kill_time_ms - now_ms);
+        } else if (!m_timed_out) {
+            consider(m_start_time_ms + m_timeout_ms - now_ms);
+        }
+    } else if (m_has_pending && m_has_started) {
+        consider(m_last_start_time_ms + m_min_dwell_ms - now_ms);
+    }
+
+    return wait_ms;
+}
+
+bool CommandExecutor::IsRunning() const
+{
+    return m_pid != -1;
+}
+
+bool CommandExecutor::HasPending() const
+{
+    return m_has_pending;
+}
+
+uint64_t CommandExecutor::GetStartedCount() const
+{
+    return m_started.Get();
+}
+
+uint64_t CommandExecutor::GetFailureCount() const
+{
+    return m_failures.Get();
+}
+
+uint64_t CommandExecutor::GetTimeoutCount() const
+{
+    return m_timeouts.Get();
+}
+
+uint64_t CommandExecutor::GetSupersededCount() const
+{
+    return m_superseded.Get();
+}
+
+const MetricHistogram& CommandExecutor::GetRunTimeHistogram() const
+{
+    return m_run_time_us;
+}
+
+const MetricHistogram& CommandExecutor::GetQueueDelayHistogram() const
+{
+    return m_queue_delay_us;
+}
+
+void CommandExecutor::LogSummary() const
+{
+    if (GetStartedCount() == 0 && GetSupersededCount() == 0) {
+        return;
+    }
+
+    normal_log("INFO: %s: %llu commands started, %llu failed, %llu timed out, %llu superseded, run time p50 %.0f us, "
+               "p95 %.0f us, queue delay p50 %.0f us, p95 %.0f us",
+               __func__,
+               GetStartedCount(),
+               GetFailureCount(),
+               GetTimeoutCount(),
+               GetSupersededCount(),
+               m_run_time_us.Quantile(0.50),
+               m_run_time_us.Quantile(0.95),
+               m_queue_delay_us.Quantile(0.50),
+               m_queue_delay_us.Quantile(0.95));
+}
+
+void CommandExecutor::StartPending()
+{
+    if (m_pid != -1 || !m_has_pending) {
+        return;
+    }
+
+    int64_t now_ms = m_now_ms();
+
+    if (m_has_started && now_ms - m_last_start_time_ms < m_min_dwell_ms) {
+        return;
+    }
+
+    m_has_pending = false;
+
+    // E.g. active then idle again within the dwell: the state the last command applied is the one wanted.
+    if (m_pending_command == m_last_command && m_last_succeeded) {
+        m_superseded.Increment();
+
+        debug_log("INFO: %s: Command '%s' already applied. Not running it again.",
+                  __func__,
+                  m_pending_command);
+        return;
+    }
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    // The child starts with no blocked signals and the default dispositions, whatever the daemon has set.
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+
+    for (int signum : {SIGINT, SIGTERM, SIGPIPE, SIGCHLD}) {
+        sigaddset(&signals, signum);
+    }
+
+    posix_spawnattr_setsigdefault(&attr, &signals);
+
+    // Its own process group, so that a timeout can signal the whole command.
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    std::string command = m_pending_command;
+    char sh[] = "sh";
+    char dash_c[] = "-c";
+    char* argv[] = {sh, dash_c, command.data(), nullptr};
+
+    pid_t pid = -1;
+    int result = posix_spawn(&pid, "/bin/sh", nullptr, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+
+    m_started.Increment();
+    m_queue_delay_us.Observe((now_ms - m_pending_request_time_ms) * 1000);
+    m_last_command = command;
+    m_last_start_time_ms = now_ms;
+    m_has_started = true;
+
+    if (result != 0) {
+        error_log("%s: Failed to start command '%s': %s",
+                  __func__,
+                  command,
+                  strerror(result));
+
+        m_failures.Increment();
+        m_last_succeeded = false;
+        return;
+    }
+
+    debug_log("INFO: %s: Started command '%s', pid %i.",
+              __func__,
+              command,
+              pid);
+
+    m_pid = pid;
+    m_pidfd = OpenPidfd(pid);
+    m_running_command = command;
+    m_start_time_ms = now_ms;
+    m_kill_time_ms = -1;
+    m_timed_out = false;
+
+    if (m_pidfd == -1) {
+        debug_log("INFO: %s: pidfd_open() failed: %s. Checking for the exit every %lld ms.",
+                  __func__,
+                  strerror(errno),
+                  NO_PIDFD_CHECK_INTERVAL_MS);
+    }
+}
+
+bool CommandExecutor::Reap()
+{
+    int status = 0;
+    pid_t result = waitpid(m_pid, &status, WNOHANG);
+
+    if (result == 0) {
+        return false;
+    }
+
+    if (result == -1) {
+        error_log("%s: waitpid() failed for command '%s': %s",
+                  __func__,
+                  m_running_command,
+                  strerror(errno));
+
+        m_failures.Increment();
+        m_last_succeeded = false;
+        ClearRunning();
+
+        return true;
+    }
+
+    HandleExit(status);
+
+    return true;
+}
+
+void CommandExecutor::HandleExit(int status)
+{
+    int64_t run_time_ms = m_now_ms() - m_start_time_ms;
+
+    m_run_time_us.Observe(run_time_ms * 1000);
+
+    bool succeeded = !m_timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if (succeeded) {
+        debug_log("INFO: %s: Command '%s' completed in %lld ms.",
+                  __func__,
+                  m_running_command,
+                  run_time_ms);
+    } else {
+        m_failures.Increment();
+
+        if (WIFEXITED(status)) {
+            error_log("%s: Command '%s' exited with code %i after %lld ms.",
+                      __func__,
+                      m_running_command,
+                      WEXITSTATUS(status),
+                      run_time_ms);
+        } else if (WIFSIGNALED(status)) {
+            error_log("%s: Command '%s' was terminated by signal %i after %lld ms.",
+                      __func__,
+                      m_running_command,
+                      WTERMSIG(status),
+                      run_time_ms);
+        }
+    }
+
+    m_last_succeeded = succeeded;
+    ClearRunning();
+}
+
+void CommandExecutor::ClearRunning()
+{
+    if (m_pidfd != -1) {
+        close(m_pidfd);
+        m_pidfd = -1;
+    }
+
+    m_pid = -1;
+    m_running_command.clear();
+    m_kill_time_ms = -1;
+    m_timed_out = false;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef COMMAND_EXECUTOR_H
+#define COMMAND_EXECUTOR_H
+
+#include <metrics.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <sys/types.h>
+
+//!
+//! \brief The CommandExecutor class runs the active and idle commands, one at a time. A command line is run by /bin/sh
+//! -c, started with posix_spawn() in its own process group, with the default signal mask and dispositions. The child is
+//! reaped through a pidfd, which the main loop polls with GetFd(), so there is no thread per command.
+//!
+//! Only the latest requested command runs: a request made while a command runs replaces any earlier pending one, and a
+//! pending command that the last successful one already applied is dropped. Commands start at least the minimum dwell
+//! apart, so that a flapping state cannot interleave the commands. A command that runs past the timeout has its process
+//! group terminated, and then killed.
+//!
+//! It is used from the main loop thread.
+//!
+class CommandExecutor
+{
+public:
+    //!
+    //! \brief Constructor
+    //! \param timeout_ms run time after which a command is terminated.
+    //! \param min_dwell_ms shortest time between the starts of two commands.
+    //!
+    explicit CommandExecutor(int64_t timeout_ms = DEFAULT_TIMEOUT_MS, int64_t min_dwell_ms = DEFAULT_MIN_DWELL_MS);
+
+    //! \brief Destructor. Calls Stop(0).
+    ~CommandExecutor();
+
+    CommandExecutor(const CommandExecutor&) = delete;
+    CommandExecutor& operator=(const CommandExecutor&) = delete;
+
+    //! \brief Sets the command timeout. At least 1 ms.
+    void SetTimeout(int64_t timeout_ms);
+
+    //! \brief Sets the minimum dwell between command starts. At least 0.
+    void SetMinDwell(int64_t min_dwell_ms);
+
+    //!
+    //! \brief Sets the monotonic clock, in milliseconds, for the timeouts and the dwell. The default is the steady
+    //! clock.
+    //!
+    void SetClock(std::function<int64_t()> now_ms);
+
+    //!
+    //! \brief Requests that the command run, replacing any pending request, and starts it if nothing runs and the dwell
+    //! has passed. An empty command is ignored.
+    //!
+    void Request(const std::string& command);
+
+    //!
+    //! \brief Reaps the running command if it has exited, terminates it if it has timed out, and starts the pending
+    //! command when it may. Does not block. Called by the main loop after each poll().
+    //!
+    void Process();
+
+    //!
+    //! \brief Waits up to wait_ms for the running command to exit, then leaves it running, detached. Drops any pending
+    //! command.
+    //!
+    void Stop(int64_t wait_ms);
+
+    //!
+    //! \brief Forgets that the last command succeeded, after the state it applied was changed another way, e.g. by the
+    //! BOINC GUI RPC client. A later request for the same command then runs instead of being dropped as applied.
+    //!
+    void InvalidateApplied();
+
+    //! \brief The pidfd of the running command, readable when it exits, or -1.
+    int GetFd() const;
+
+    //!
+    //! \brief Time until Process() has something to do without an event on GetFd(): the timeout, the end of the dwell of
+    //! a pending command, or the next check of a command run without a pidfd.
+    //! \return milliseconds, or -1 if none.
+    //!
+    int64_t GetNextDeadlineMs() const;
+
+    //! \brief Whether a command is running.
+    bool IsRunning() const;
+
+    //! \brief Whether a command is waiting to start.
+    bool HasPending() const;
+
+    //! \brief Commands started.
+    uint64_t GetStartedCount() const;
+
+    //! \brief Commands that failed to start, exited non-zero, were killed by a signal or timed out.
+    uint64_t GetFailureCount() const;
+
+    //! \brief Commands that timed out.
+    uint64_t GetTimeoutCount() const;
+
+    //! \brief Requests that were replaced or dropped without running.
+    uint64_t GetSupersededCount() const;
+
+    //! \brief Run time of the reaped commands, in microseconds.
+    const MetricHistogram& GetRunTimeHistogram() const;
+
+    //! \brief Time from the request to the start, in microseconds, including any dwell.
+    const MetricHistogram& GetQueueDelayHistogram() const;
+
+    //! \brief Logs the counts and the run time and queue delay quantiles.
+    void LogSummary() const;
+
+    //! \brief Default command timeout.
+    static constexpr int64_t DEFAULT_TIMEOUT_MS = 60000;
+
+    //! \brief Default minimum dwell between command starts.
+    static constexpr int64_t DEFAULT_MIN_DWELL_MS = 5000;
+
+    //! \brief Time between SIGTERM and SIGKILL of a timed out command.
+    static constexpr int64_t KILL_GRACE_MS = 2000;
+
+    //! \brief Interval of the exit checks of a command run without a pidfd, on kernels before 5.3.
+    static constexpr int64_t NO_PIDFD_CHECK_INTERVAL_MS = 100;
+
+private:
+    int64_t m_timeout_ms;
+    int64_t m_min_dwell_ms;
+    std::function<int64_t()> m_now_ms;
+
+    //! \brief Running command, or -1.
+    pid_t m_pid;
+    int m_pidfd;
+    std::string m_running_command;
+    int64_t m_start_time_ms;
+
+    //! \brief Time the SIGKILL is due after the SIGTERM of a timed out command, or -1.
+    int64_t m_kill_time_ms;
+    bool m_timed_out;
+
+    bool m_has_pending;
+    std::string m_pending_command;
+    int64_t m_pending_request_time_ms;
+
+    //! \brief Last command started, and whether it succeeded, for dropping a pending request it already applied.
+    std::string m_last_command;
+    bool m_last_succeeded;
+
+    //! \brief Start time of the last command, valid if m_has_started.
+    int64_t m_last_start_time_ms;
+    bool m_has_started;
+
+    MetricCounter m_started;
+    MetricCounter m_failures;
+    MetricCounter m_timeouts;
+    MetricCounter m_superseded;
+    MetricHistogram m_run_time_us;
+    MetricHistogram m_queue_delay_us;
+
+    //! \brief Starts the pending command if nothing runs and the dwell has passed.
+    void StartPending();
+
+    //! \brief Checks for the exit of the running command without blocking, and applies it.
+    //! \return true if it was reaped.
+    bool Reap();
+
+    //! \brief Applies the wait status of the reaped command.
+    void HandleExit(int status);
+
+    //! \brief Closes the pidfd and clears the running command.
+    void ClearRunning();
+};
+
+#endif // COMMAND_EXECUTOR_H
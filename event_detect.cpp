@@ -4,6 +4,7 @@
  * This code is licensed under the MIT license. See LICENSE.md in the repository.
  */
 
+#include <charconv>
 #include <cstring>
 #include <csignal>
 #include <cstdio>
@@ -21,6 +22,9 @@
 
 #include <release.h>
 #include <event_detect.h>
+#include <logger.h>
+#include <pressure.h>
+#include <probes.h>
 
 //!
 //! \brief pid file name for the application.
@@ -80,13 +84,22 @@ SharedMemoryTimestampExporter g_shmem_exporter(SHMEM_NAME_CONFIG);
 //!
 std::atomic<bool> g_shm_initialized_successfully = false;
 
+//!
+//! \brief Global metrics singleton.
+//!
+EventDetectMetrics g_metrics;
+
 // Class Monitor
 
 Monitor::Monitor()
     : m_interrupt_monitor(false)
     , m_event_device_paths()
+    , m_config_generation(0)
     , m_last_active_time(0)
     , m_initialized(false)
+    , m_shmem_exporter(nullptr)
+    , m_event_count_prev(0)
+    , m_traced_event_time_us(0)
 {}
 
 void Monitor::EventActivityMonitorThread()
@@ -94,8 +107,7 @@ void Monitor::EventActivityMonitorThread()
     debug_log("INFO: %s: started",
               __func__);
 
-    int64_t event_count_prev = 0;
-    int64_t event_count = 0;
+    PrepareLatencyCriticalThread();
 
     // Set the last active time to the current time at the start of monitoring. This is most likely correct
     // since actions will have to be taken on the system to start this program.
@@ -114,107 +126,166 @@ void Monitor::EventActivityMonitorThread()
 
         lock.unlock();
 
-        std::vector<fs::path> event_devices_prev = GetEventDevices();
+        Tick();
+    }
+}
+
+void Monitor::Tick()
+{
+    auto tick_start = std::chrono::steady_clock::now();
 
-        UpdateEventDevices();
+    RefreshCachedConfig();
 
-        std::vector<fs::path> event_devices = GetEventDevices();
+    bool event_devices_changed = UpdateEventDevices();
 
-        // Check if any recorder has lost its device.
-        bool device_lost = false;
-        for (const auto& recorder : g_event_recorders.GetEventRecorders()) {
-            if (recorder->IsDeviceLost()) {
-                normal_log("INFO: %s: Recorder for %s reported device lost.",
-                    __func__,
-                    recorder->GetEventDevicePath());
-                device_lost = true;
-                break;
-            }
+    // Check if any recorder has lost its device.
+    bool device_lost = false;
+    for (const auto& recorder : g_event_recorders.GetEventRecorders()) {
+        if (recorder->IsDeviceLost()) {
+            normal_log("INFO: %s: Recorder for %s reported device lost.",
+                __func__,
+                recorder->GetEventDevicePath());
+            device_lost = true;
+            break;
         }
+    }
 
-        if (m_initialized && (event_devices != event_devices_prev || device_lost)) {
-            normal_log("INFO: %s: Input event devices changed. Restarting recorder threads.",
-                __func__);
+    if (m_initialized && (event_devices_changed || device_lost)) {
+        normal_log("INFO: %s: Input event devices changed. Restarting recorder threads.",
+            __func__);
 
-            pthread_kill(g_main_thread_id, SIGHUP);
-            m_initialized = false;
-        } else {
-            m_initialized = true;
-        }
+        pthread_kill(g_main_thread_id, SIGHUP);
+        m_initialized = false;
+    } else {
+        m_initialized = true;
+    }
 
-        event_count = g_event_recorders.GetTotalEventCount();
+    int64_t event_count = g_event_recorders.GetTotalEventCount();
 
-        debug_log("INFO: %s: loop: event_count = %lld",
-                  __func__,
-                  event_count);
+    debug_log("INFO: %s: loop: event_count = %lld",
+              __func__,
+              event_count);
 
-        if (event_count != event_count_prev) {
-            m_last_active_time = GetUnixEpochTime();
-            event_count_prev = event_count;
-        }
+    int64_t pending_event_time_us = 0;
 
-        debug_log("INFO: %s: loop: input devices last_active_time = %lld: %s",
-                  __func__,
-                  m_last_active_time.load(),
-                  FormatISO8601DateTime(m_last_active_time.load()));
+    if (event_count != m_event_count_prev) {
+        m_last_active_time = GetUnixEpochTime();
+        m_event_count_prev = event_count;
 
-        // This will be zero if tty monitoring is not active, but that is ok, because the max
-        // of the tty monitoring last active and the event monitoring last active is used.
-        int64_t tty_last_active_time = g_tty_monitor.GetLastTtyActiveTime();
+        pending_event_time_us = g_event_recorders.GetLatestEventTimeMicros();
+    }
 
-        debug_log("INFO: %s: loop: ttys last_active_time = %lld: %s",
-                  __func__,
-                  tty_last_active_time,
-                  FormatISO8601DateTime(tty_last_active_time));
+    int64_t input_last_active_time = m_last_active_time.load();
 
-        m_last_active_time = std::max(m_last_active_time.load(), tty_last_active_time);
+    debug_log("INFO: %s: loop: input devices last_active_time = %lld: %s",
+              __func__,
+              input_last_active_time,
+              FormatISO8601DateTime(input_last_active_time));
 
-        int64_t last_idle_detect_active_time = g_idle_detect_monitor.GetLastIdleDetectActiveTime();
+    // This will be zero if tty monitoring is not active, but that is ok, because the max
+    // of the tty monitoring last active and the event monitoring last active is used.
+    int64_t tty_last_active_time = g_tty_monitor.GetLastTtyActiveTime();
 
-        debug_log("INFO: %s: loop: idle detect last_active_time = %lld: %s",
-                  __func__,
-                  last_idle_detect_active_time,
-                  FormatISO8601DateTime(last_idle_detect_active_time));
+    debug_log("INFO: %s: loop: ttys last_active_time = %lld: %s",
+              __func__,
+              tty_last_active_time,
+              FormatISO8601DateTime(tty_last_active_time));
 
-        // Update member variable.
-        m_last_active_time = std::max(m_last_active_time.load(), last_idle_detect_active_time);
+    m_last_active_time = std::max(m_last_active_time.load(), tty_last_active_time);
 
-         // Get final values for export
-        int64_t current_last_active = m_last_active_time.load();
-        int64_t update_time = GetUnixEpochTime();
+    int64_t last_idle_detect_active_time = g_idle_detect_monitor.GetLastIdleDetectActiveTime();
 
-        if (g_idle_detect_monitor.GetState() == IdleDetectMonitor::State::FORCED_IDLE) {
-            current_last_active = 0;
-        } else if (g_idle_detect_monitor.GetState() == IdleDetectMonitor::State::FORCED_ACTIVE) {
-            current_last_active = update_time;
-        }
+    debug_log("INFO: %s: loop: idle detect last_active_time = %lld: %s",
+              __func__,
+              last_idle_detect_active_time,
+              FormatISO8601DateTime(last_idle_detect_active_time));
 
-        debug_log("INFO: %s: loop: overall last_active time %lld: update time %s, state %s",
-                  __func__,
-                  current_last_active,
-                  FormatISO8601DateTime(current_last_active),
-                  g_idle_detect_monitor.StateToString());
+    // Update member variable.
+    m_last_active_time = std::max(m_last_active_time.load(), last_idle_detect_active_time);
 
-        if (g_shm_initialized_successfully.load(std::memory_order_relaxed)) {
-            if (!g_shmem_exporter.UpdateTimestamps(update_time, current_last_active)) {
-                error_log("%s: Failed to update shared memory timestamp.", __func__);
-            } else {
-                debug_log("INFO: %s: Updated shmem: update=%lld, last_active=%lld",
-                          __func__, (long long)update_time, (long long)current_last_active);
-            }
+     // Get final values for export
+    int64_t current_last_active = m_last_active_time.load();
+    int64_t update_time = GetUnixEpochTime();
+
+    if (g_idle_detect_monitor.GetState() == IdleDetectMonitor::State::FORCED_IDLE) {
+        current_last_active = 0;
+    } else if (g_idle_detect_monitor.GetState() == IdleDetectMonitor::State::FORCED_ACTIVE) {
+        current_last_active = update_time;
+    }
+
+    IDLE_DETECT_PROBE5(event_detect, monitor_aggregate,
+                       input_last_active_time, tty_last_active_time, last_idle_detect_active_time,
+                       current_last_active, static_cast<int>(g_idle_detect_monitor.GetState()));
+
+    debug_log("INFO: %s: loop: overall last_active time %lld: update time %s, state %s",
+              __func__,
+              current_last_active,
+              FormatISO8601DateTime(current_last_active),
+              g_idle_detect_monitor.StateToString());
+
+    if (SharedMemoryTimestampExporter* exporter = m_shmem_exporter.load(); exporter != nullptr) {
+        bool shmem_updated = exporter->UpdateTimestamps(update_time, current_last_active);
+
+        IDLE_DETECT_PROBE3(event_detect, shmem_publish,
+                           update_time, current_last_active, static_cast<int>(shmem_updated));
+
+        if (!shmem_updated) {
+            g_metrics.m_shmem_update_failures.Increment();
+            error_log("%s: Failed to update shared memory timestamp.", __func__);
+        } else {
+            g_metrics.m_shmem_updates.Increment();
+
+            debug_log("INFO: %s: Updated shmem: update=%lld, last_active=%lld",
+                      __func__, (long long)update_time, (long long)current_last_active);
         }
+    }
+
+    bool write_last_active_time_to_file = std::get<bool>(g_config.GetArg("write_last_active_time_to_file"));
 
-        bool write_last_active_time_to_file = std::get<bool>(g_config.GetArg("write_last_active_time_to_file"));
+    if (write_last_active_time_to_file) {
+        WriteLastActiveTimeToFile(m_last_active_time_filepath);
+    }
 
-        if (write_last_active_time_to_file) {
-            fs::path event_data_path = std::get<fs::path>(g_config.GetArg("event_count_files_path"));
-            std::string last_active_time_cpp_filename = std::get<std::string>(g_config.GetArg("last_active_time_cpp_filename"));
+    // The new last active time is now visible to idle_detect. Record the end-to-end latencies.
+    int64_t publish_time_us = GetUnixEpochTimeMicros();
 
-            fs::path last_active_time_filepath = event_data_path / last_active_time_cpp_filename;
+    if (pending_event_time_us > m_traced_event_time_us) {
+        int64_t latency_us = publish_time_us - pending_event_time_us;
 
-            WriteLastActiveTimeToFile(last_active_time_filepath);
+        if (latency_us >= 0) {
+            g_metrics.m_latency_input_to_publish_us.Observe(latency_us);
+            g_metrics.m_trace.AddSpan("input_to_publish", "monitor", pending_event_time_us, latency_us);
         }
+
+        m_traced_event_time_us = pending_event_time_us;
     }
+
+    if (int64_t send_time_us = g_idle_detect_monitor.TakePendingSendTimeMicros(); send_time_us > 0) {
+        int64_t latency_us = publish_time_us - send_time_us;
+
+        if (latency_us >= 0) {
+            g_metrics.m_latency_pipe_to_publish_us.Observe(latency_us);
+            g_metrics.m_trace.AddSpan("pipe_to_publish", "monitor", send_time_us, latency_us);
+        }
+    }
+
+    g_metrics.m_monitor_tick_duration_us.Observe(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                     std::chrono::steady_clock::now() - tick_start).count());
+    g_metrics.m_monitor_ticks.Increment();
+
+    if (std::get<bool>(g_config.GetArg("write_metrics_file"))) {
+        g_metrics.WriteMetricsFile(m_metrics_filepath);
+    }
+
+    // The trace is rewritten once a minute rather than every tick, as it can hold many spans.
+    if (g_metrics.m_trace.IsEnabled() && g_metrics.m_monitor_ticks.Get() % 60 == 0) {
+        g_metrics.WriteLatencyTraceFile();
+    }
+}
+
+void Monitor::SetTimestampExporter(SharedMemoryTimestampExporter* exporter)
+{
+    m_shmem_exporter = exporter;
 }
 
 bool Monitor::IsInitialized() const
@@ -227,32 +298,56 @@ int64_t Monitor::GetLastActiveTime() const
     return m_last_active_time.load();
 }
 
-std::vector<fs::path> Monitor::EnumerateEventDevices()
+void Monitor::RefreshCachedConfig()
 {
-    debug_log("INFO: %s: started",
-              __func__);
+    uint64_t config_generation = g_config.GetGeneration();
+
+    if (config_generation == m_config_generation) {
+        return;
+    }
 
-    std::vector<fs::path> event_devices;
+    fs::path event_data_path = std::get<fs::path>(g_config.GetArg("event_count_files_path"));
 
-    fs::path event_device_path = "/sys/class/input";
+    m_input_class_dir = (std::get<fs::path>(g_config.GetArg("sysfs_root")) / "class/input").string();
+    m_last_active_time_filepath = event_data_path / std::get<std::string>(g_config.GetArg("last_active_time_cpp_filename"));
+    m_metrics_filepath = event_data_path / std::get<std::string>(g_config.GetArg("metrics_filename"));
 
-    std::vector<fs::path> event_device_candidates = FindDirEntriesWithWildcard(event_device_path, "event.*");
+    m_config_generation = config_generation;
+}
+
+void Monitor::ScanEventDevices()
+{
+    debug_log("INFO: %s: started",
+              __func__);
+
+    ScanDirEntries(m_input_class_dir, "event", m_scan_entries);
 
     debug_log("INFO: %s: event_device_candidates.size() = %u",
               __func__,
-              event_device_candidates.size());
+              m_scan_entries.size());
+
+    size_t device_count = 0;
 
-    for (const auto& event_device : event_device_candidates) {
-        std::stringstream message;
+    for (const auto& event_device : m_scan_entries) {
+        m_scan_path.assign(m_input_class_dir).append("/").append(event_device).append("/device");
 
-        if (FindDirEntriesWithWildcard(event_device / "device", "mouse.*").empty()) {
+        if (!DirHasEntryWithPrefix(m_scan_path, "mouse")) {
             continue;
         }
 
-        event_devices.push_back(event_device);
+        // Assign into the existing strings to reuse their storage.
+        if (device_count < m_scan_device_names.size()) {
+            m_scan_device_names[device_count] = event_device;
+        } else {
+            m_scan_device_names.push_back(event_device);
+        }
+
+        ++device_count;
     }
 
-    if (event_devices.empty()) {
+    m_scan_device_names.resize(device_count);
+
+    if (m_scan_device_names.empty()) {
         error_log("%s: No pointing devices identified to monitor. Exiting.",
                   __func__);
 
@@ -262,35 +357,42 @@ std::vector<fs::path> Monitor::EnumerateEventDevices()
 
     debug_log("INFO: %s: event_devices.size() = %u",
               __func__,
-              event_devices.size());
-
-    return event_devices;
+              m_scan_device_names.size());
 }
 
 void Monitor::WriteLastActiveTimeToFile(const fs::path& last_active_time_filepath)
 {
+    // Formatted into a stack buffer and written with POSIX calls rather than through an ofstream, so that the write
+    // every tick does not allocate.
+    char buffer[32];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer) - 1, m_last_active_time.load()).ptr;
+    *end++ = '\n';
+
     // Open the file for writing (overwrites)
-    std::ofstream output_file(last_active_time_filepath);
+    int fd = open(last_active_time_filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
 
-    if (!output_file.is_open()) {
+    if (fd < 0) {
         error_log("%s: Could not open file %s for writing.",
                   __func__,
                   last_active_time_filepath);
 
         g_exit_code = 1;
-        Shutdown();;
+        Shutdown();
+        return;
     }
 
-    output_file << m_last_active_time << std::endl;
+    ssize_t size = end - buffer;
+    bool written = (write(fd, buffer, size) == size);
 
-    if (!output_file.good()) {
+    close(fd);
+
+    if (!written) {
         error_log("%s: Error writing to file %s.",
                   __func__,
                   last_active_time_filepath);
-        output_file.close();
 
         g_exit_code = 1;
-        Shutdown();;
+        Shutdown();
     }
 }
 
@@ -301,14 +403,29 @@ std::vector<fs::path> Monitor::GetEventDevices() const
     return m_event_device_paths;
 }
 
-void Monitor::UpdateEventDevices()
+bool Monitor::UpdateEventDevices()
 {
     debug_log("INFO: %s: started",
               __func__);
 
+    ScanEventDevices();
+
     std::unique_lock<std::mutex> lock(mtx_event_monitor);
 
-    m_event_device_paths = EnumerateEventDevices();
+    if (m_scan_device_names == m_event_device_names) {
+        return false;
+    }
+
+    // The previous names go to the scan buffer, which is overwritten by the next scan.
+    m_event_device_names.swap(m_scan_device_names);
+
+    m_event_device_paths.clear();
+
+    for (const auto& event_device_name : m_event_device_names) {
+        m_event_device_paths.push_back(fs::path(m_input_class_dir) / event_device_name);
+    }
+
+    return true;
 }
 
 
@@ -352,12 +469,40 @@ int64_t InputEventRecorders::GetTotalEventCount() const
     return tally;
 }
 
+int64_t InputEventRecorders::GetLatestEventTimeMicros() const
+{
+    int64_t latest = 0;
+
+    for (auto& event_recorder : m_event_recorder_ptrs) {
+        latest = std::max(latest, event_recorder->GetLastEventTimeMicros());
+    }
+
+    return latest;
+}
+
+
+// Class LibevdevEventSource
+
+LibevdevEventSource::LibevdevEventSource(struct libevdev* dev)
+    : m_dev(dev)
+{}
+
+int LibevdevEventSource::NextEvent(bool sync_mode, input_event& ev)
+{
+    return libevdev_next_event(m_dev, sync_mode ? LIBEVDEV_READ_FLAG_SYNC : LIBEVDEV_READ_FLAG_NORMAL, &ev);
+}
+
+// The InputEventSource status values are defined to be libevdev's, so that the libevdev return is passed through as is.
+static_assert(static_cast<int>(InputEventSource::READ_SUCCESS) == static_cast<int>(LIBEVDEV_READ_STATUS_SUCCESS));
+static_assert(static_cast<int>(InputEventSource::READ_SYNC) == static_cast<int>(LIBEVDEV_READ_STATUS_SYNC));
+
 
 // Class InputEventRecorders::EventRecorder
 
 InputEventRecorders::EventRecorder::EventRecorder(fs::path event_device_path)
     : m_event_device_path(event_device_path)
     , m_event_count(0)
+    , m_last_event_time_us(0)
     , m_device_lost(false)
 {}
 
@@ -379,6 +524,16 @@ int64_t InputEventRecorders::EventRecorder::GetEventCount() const
     return m_event_count.load();
 }
 
+int64_t InputEventRecorders::EventRecorder::GetLastEventTime() const
+{
+    return m_last_event_time_us.load(std::memory_order_relaxed) / 1000000;
+}
+
+int64_t InputEventRecorders::EventRecorder::GetLastEventTimeMicros() const
+{
+    return m_last_event_time_us.load(std::memory_order_relaxed);
+}
+
 bool InputEventRecorders::EventRecorder::IsDeviceLost() const
 {
     return m_device_lost.load();
@@ -389,11 +544,13 @@ void InputEventRecorders::EventRecorder::EventActivityRecorderThread()
     debug_log("INFO: %s: started",
               __func__);
 
+    PrepareLatencyCriticalThread();
+
     debug_log("INFO: %s: GetEventDevicePath() = %s",
               __func__,
               GetEventDevicePath());
 
-    fs::path device_access_path = "/dev/input" / GetEventDevicePath().filename();
+    fs::path device_access_path = std::get<fs::path>(g_config.GetArg("dev_root")) / "input" / GetEventDevicePath().filename();
 
     debug_log("INFO: %s: device_access_path = %s",
               __func__,
@@ -436,7 +593,7 @@ void InputEventRecorders::EventRecorder::EventActivityRecorderThread()
                   libevdev_get_uniq(dev));
     }
 
-    struct input_event ev;
+    LibevdevEventSource source(dev);
 
     while (g_exit_code == 0) {
         std::unique_lock<std::mutex> lock(g_event_recorders.mtx_event_recorder_threads);
@@ -453,55 +610,63 @@ void InputEventRecorders::EventRecorder::EventActivityRecorderThread()
                   __func__,
                   GetEventDevicePath());
 
-        int libevdev_mode_flag = LIBEVDEV_READ_FLAG_NORMAL;
-        while (true) {
-            rc = libevdev_next_event(dev, libevdev_mode_flag /* | LIBEVDEV_READ_FLAG_BLOCKING */, &ev);
-
-            if (rc == LIBEVDEV_READ_STATUS_SUCCESS) {
-                ++m_event_count;
-
-                libevdev_mode_flag = LIBEVDEV_READ_FLAG_NORMAL;
-            } else if (rc == LIBEVDEV_READ_STATUS_SYNC) {
-                // We only need to count events to detect activity.
-                ++m_event_count;
+        // Drain the device. We only need to count events to detect activity, so sync events count too. The tally and
+        // the input-to-read latency are updated once per batch rather than per event to keep the read loop cheap.
+        InputEventBatch batch = ReadInputEventBatch(source);
 
-                libevdev_mode_flag = LIBEVDEV_READ_FLAG_SYNC;
-
-            } else if (rc == -EAGAIN) {
-                // No event available, break to the outer loop to listen for signals
-                break;
-            } else if (rc == -ENODEV) {
-                // Device disconnected. Set flag for the monitor thread to trigger re-enumeration
-                // and exit the outer loop — there is nothing more to do on this fd.
-                error_log("%s: Device %s disconnected",
-                          __func__,
-                          device_access_path);
-                m_device_lost = true;
-                goto cleanup;
-            } else {
-                error_log("%s: reading event: %s",
-                          __func__,
-                          strerror(-rc));
+        RecordBatch(batch);
 
-                // We will break from the read loop and hopefully when it is reentered after 1 sec from the
-                // outer thread loop, the error will clear.
-                break;
-            }
+        if (batch.status == -ENODEV) {
+            // Device disconnected. Set flag for the monitor thread to trigger re-enumeration
+            // and exit the outer loop — there is nothing more to do on this fd.
+            error_log("%s: Device %s disconnected",
+                      __func__,
+                      device_access_path);
+            m_device_lost = true;
+            break;
+        } else if (batch.status != -EAGAIN) {
+            // When the read loop is reentered after 1 sec from the outer thread loop, the error will hopefully
+            // have cleared.
+            error_log("%s: reading event: %s",
+                      __func__,
+                      strerror(-batch.status));
         }
     }
 
-cleanup:
     // Cleanup
     libevdev_free(dev);
     close(fd);
 }
 
+void InputEventRecorders::EventRecorder::RecordBatch(const InputEventBatch& batch)
+{
+    if (batch.events <= 0) {
+        return;
+    }
+
+    m_event_count.fetch_add(batch.events);
+    m_last_event_time_us.store(batch.last_event_us, std::memory_order_relaxed);
+
+    IDLE_DETECT_PROBE3(event_detect, recorder_batch,
+                       m_event_device_path.filename().c_str(), batch.events, batch.last_event_us);
+
+    int64_t latency_us = GetUnixEpochTimeMicros() - batch.last_event_us;
+
+    // A negative value means the realtime clock stepped; skip the sample.
+    if (latency_us >= 0) {
+        g_metrics.m_latency_input_to_read_us.Observe(latency_us);
+        g_metrics.m_trace.AddSpan("input_to_read", m_event_device_path.filename().native(), batch.last_event_us,
+                                  latency_us);
+    }
+}
+
 
 // Class TtyMonitor
 
 TtyMonitor::TtyMonitor()
     : m_interrupt_tty_monitor(false)
     , m_tty_device_paths()
+    , m_config_generation(0)
     , m_ttys()
     , m_last_ttys_active_time(0)
     , m_initialized(false)
@@ -519,15 +684,28 @@ void TtyMonitor::UpdateTtyDevices()
     debug_log("INFO: %s: started",
               __func__);
 
-    std::vector<fs::path> tty_device_paths = EnumerateTtyDevices();
+    ScanTtyDevices();
 
-    if (tty_device_paths != m_tty_device_paths) {
-        m_initialized = false;
-        m_tty_device_paths = tty_device_paths;
-    } else {
+    if (m_scan_pts_names == m_pts_names && m_scan_tty_names == m_tty_names) {
         m_initialized = true;
+        return;
+    }
+
+    m_initialized = false;
+
+    // The previous names go to the scan buffers, which are overwritten by the next scan.
+    m_pts_names.swap(m_scan_pts_names);
+    m_tty_names.swap(m_scan_tty_names);
+
+    m_tty_device_paths.clear();
+
+    for (const auto& pts_name : m_pts_names) {
+        m_tty_device_paths.push_back(fs::path(m_pts_dir) / pts_name);
     }
 
+    for (const auto& tty_name : m_tty_names) {
+        m_tty_device_paths.push_back(fs::path(m_dev_dir) / tty_name);
+    }
 }
 
 bool TtyMonitor::IsInitialized() const
@@ -541,50 +719,43 @@ int64_t TtyMonitor::GetLastTtyActiveTime() const
 }
 
 
-std::vector<fs::path> TtyMonitor::EnumerateTtyDevices()
+void TtyMonitor::ScanTtyDevices()
 {
     debug_log("INFO: %s: started",
               __func__);
 
-    std::vector<fs::path> ptss = FindDirEntriesWithWildcard(fs::path {"/dev/pts"}, ".*");
+    if (uint64_t config_generation = g_config.GetGeneration(); config_generation != m_config_generation) {
+        fs::path dev_root = std::get<fs::path>(g_config.GetArg("dev_root"));
+
+        m_dev_dir = dev_root.string();
+        m_pts_dir = (dev_root / "pts").string();
+        m_config_generation = config_generation;
+    }
+
+    ScanDirEntries(m_pts_dir, "", m_scan_pts_names);
 
     debug_log("INFO: %s: ptss.size() = %u",
               __func__,
-              ptss.size());
+              m_scan_pts_names.size());
 
-    std::vector<fs::path> ttys = FindDirEntriesWithWildcard(fs::path {"/dev"}, "tty.*");
+    ScanDirEntries(m_dev_dir, "tty", m_scan_tty_names);
 
     debug_log("INFO: %s: ttys.size() = %u",
               __func__,
-              ttys.size());
-
-    ptss.insert(ptss.end(), ttys.begin(), ttys.end());
+              m_scan_tty_names.size());
 
     debug_log("INFO: %s: total terminal sessions to monitor = %u",
               __func__,
-              ptss.size());
+              m_scan_pts_names.size() + m_scan_tty_names.size());
 
-    if (ptss.empty()) {
+    if (m_scan_pts_names.empty() && m_scan_tty_names.empty()) {
         error_log("%s: No ptys/ttys identified to monitor.",
                   __func__);
     }
-
-    return ptss;
 }
 
 void TtyMonitor::TtyMonitorThread()
 {
-    std::vector<fs::path> tty_device_paths_prev;
-
-    // Critical section block
-    {
-        std::unique_lock<std::mutex> lock(mtx_tty_monitor);
-
-        tty_device_paths_prev = m_tty_device_paths;
-    }
-
-    int64_t last_ttys_active_time = 0;
-
     while (true) {
         debug_log("INFO: %s: tty monitor thread loop at top of iteration",
                   __func__);
@@ -598,39 +769,45 @@ void TtyMonitor::TtyMonitorThread()
 
         lock.unlock();
 
-        // Critical section block
-        {
-            std::unique_lock<std::mutex> lock(mtx_tty_monitor);
+        Tick();
+    }
+}
 
-            UpdateTtyDevices();
+void TtyMonitor::Tick()
+{
+    std::unique_lock<std::mutex> lock(mtx_tty_monitor);
 
-            if (!IsInitialized()) {
-                m_ttys.clear();
+    UpdateTtyDevices();
 
-                for (const auto& entry : m_tty_device_paths) {
-                    Tty tty(entry);
+    if (!IsInitialized()) {
+        m_ttys.clear();
 
-                    m_ttys.push_back(tty);
-                }
+        for (const auto& entry : m_tty_device_paths) {
+            Tty tty(entry);
 
-                m_initialized = true;
-            }
+            m_ttys.push_back(tty);
+        }
 
-            for (auto& entry : m_ttys) {
-                struct stat sbuf;
+        m_initialized = true;
+    }
 
-                if (stat(entry.m_tty_device_path.c_str(), &sbuf) == 0){
-                    entry.m_tty_last_active_time = sbuf.st_atime;
-                }
+    int64_t last_ttys_active_time = m_last_ttys_active_time;
 
-                // last_tty_active_time MUST be monotonic. It cannot go backwards. This is important, because terminals sometimes
-                // disappear.
-                last_ttys_active_time = std::max(entry.m_tty_last_active_time, last_ttys_active_time);
-            }
+    for (auto& entry : m_ttys) {
+        struct stat sbuf;
+
+        if (stat(entry.m_tty_device_path.c_str(), &sbuf) == 0){
+            entry.m_tty_last_active_time = sbuf.st_atime;
         }
 
-        m_last_ttys_active_time = last_ttys_active_time;
+        // last_tty_active_time MUST be monotonic. It cannot go backwards. This is important, because terminals sometimes
+        // disappear.
+        last_ttys_active_time = std::max(entry.m_tty_last_active_time, last_ttys_active_time);
     }
+
+    g_metrics.m_ttys_monitored.Set(static_cast<int64_t>(m_ttys.size()));
+
+    m_last_ttys_active_time = last_ttys_active_time;
 }
 
 TtyMonitor::Tty::Tty(const fs::path& tty_device_path)
@@ -644,6 +821,7 @@ TtyMonitor::Tty::Tty(const fs::path& tty_device_path)
 IdleDetectMonitor::IdleDetectMonitor()
     : m_interrupt_idle_detect_monitor(false)
     , m_last_idle_detect_active_time(0)
+    , m_pending_send_time_us(0)
     , m_state(UNKNOWN)
 {}
 
@@ -699,8 +877,6 @@ void IdleDetectMonitor::IdleDetectMonitorThread()
     m_initialized = true;
     m_state = NORMAL;
 
-    int64_t last_idle_detect_active_time = 0;
-
     while (g_exit_code == 0) {
         std::unique_lock<std::mutex> lock(mtx_idle_detect_monitor_thread);
         cv_idle_detect_monitor_thread.wait_for(lock, std::chrono::milliseconds(100),
@@ -743,81 +919,25 @@ void IdleDetectMonitor::IdleDetectMonitorThread()
                     bytes_read = read(fd, buffer, sizeof(buffer) - 1);
 
                     if (bytes_read > 0) {
-                        buffer[bytes_read] = '\0';
-                        std::string event_data(buffer);
+                        std::string_view event_data(buffer, bytes_read);
                         debug_log("INFO: %s: Received data: %s", __func__,
                                   event_data);
 
-                        std::stringstream ss(event_data);
-                        std::string segment;
-                        std::vector<std::string> parts;
-                        while (std::getline(ss, segment, ':')) {
-                            parts.push_back(segment);
-                        }
-
-                        if (parts.size() == 2) {
-                            try {
-                                EventMessage event(TrimString(parts[0]), TrimString(parts[1]));
-
-                                debug_log("INFO: %s: event.m_timestamp = %lld, event.m_event_type = %s",
-                                          __func__,
-                                          event.m_timestamp,
-                                          event.EventTypeToString());
-
-                                if (event.IsValid()) {
-                                    last_idle_detect_active_time = event.m_timestamp;
-
-                                    debug_log("INFO: %s: Valid activity event received with timestamp %lld",
-                                              __func__,
-                                              last_idle_detect_active_time);
-
-                                    // last_idle_detect_active_time MUST be monotonic. It cannot go backwards.
-                                    m_last_idle_detect_active_time = std::max(m_last_idle_detect_active_time.load(),
-                                                                              last_idle_detect_active_time);
-
-                                    if (event.m_event_type == EventMessage::USER_UNFORCE) {
-                                        m_state = NORMAL;
-                                    } else if (event.m_event_type == EventMessage::USER_FORCE_IDLE) {
-                                        m_state = FORCED_IDLE;
-                                    } else if (event.m_event_type == EventMessage::USER_FORCE_ACTIVE) {
-                                        m_state = FORCED_ACTIVE;
-                                    }
-
-                                    debug_log("INFO: %s: Current idle detect monitor last active time %lld, state %s",
-                                              __func__,
-                                              m_last_idle_detect_active_time,
-                                              StateToString());
-                                } else {
-                                    error_log("%s: Invalid event data received: %s",
-                                              __func__,
-                                              event_data);
-                                }
-                            } catch (const std::invalid_argument& e) {
-                                error_log("%s: Error parsing timestamp: %s in data %s",
-                                          __func__,
-                                          e.what(),
-                                          event_data);
-                            } catch (const std::out_of_range& e) {
-                                error_log("%s: Timestamp out of range: %s in data %s",
-                                          __func__,
-                                          e.what(),
-                                          event_data);
-                            }
-                        } else if (bytes_read == 0) {
-                            // Pipe closed by writers, sleep a bit to avoid spinning
-                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                        } else if (bytes_read < 0) {
-                            if (errno == EINTR) {
-                                // Interrupted by a signal, this is expected during shutdown
-                                debug_log("INFO: %s: Read interrupted by signal.",
-                                          __func__);
-                                break;
-                            } else {
-                                error_log("%s: Error reading from named pipe: %s",
-                                          __func__,
-                                          strerror(errno));
-                                break;
-                            }
+                        ProcessMessage(event_data);
+                    } else if (bytes_read == 0) {
+                        // Pipe closed by writers, sleep a bit to avoid spinning
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    } else if (bytes_read < 0) {
+                        if (errno == EINTR) {
+                            // Interrupted by a signal, this is expected during shutdown
+                            debug_log("INFO: %s: Read interrupted by signal.",
+                                      __func__);
+                            break;
+                        } else {
+                            error_log("%s: Error reading from named pipe: %s",
+                                      __func__,
+                                      strerror(errno));
+                            break;
                         }
                     }
                 } else if (ret < 0) {
@@ -846,6 +966,89 @@ void IdleDetectMonitor::IdleDetectMonitorThread()
     }
 }
 
+void IdleDetectMonitor::ProcessMessage(std::string_view event_data)
+{
+    try {
+        // The optional third field is the sender timestamp in microseconds, used for latency
+        // tracing. A message with the wrong number of fields parses as invalid.
+        EventMessage event = EventMessage::FromString(event_data);
+
+        debug_log("INFO: %s: event.m_timestamp = %lld, event.m_event_type = %s",
+                  __func__,
+                  event.m_timestamp,
+                  event.EventTypeToString());
+
+        if (event.IsValid()) {
+            g_metrics.m_pipe_messages_accepted.Increment();
+
+            IDLE_DETECT_PROBE3(event_detect, pipe_message_accepted,
+                               event.m_timestamp, static_cast<int>(event.m_event_type),
+                               event.m_send_time_us);
+
+            if (event.m_send_time_us > 0) {
+                int64_t latency_us = GetUnixEpochTimeMicros() - event.m_send_time_us;
+
+                if (latency_us >= 0) {
+                    g_metrics.m_latency_pipe_transit_us.Observe(latency_us);
+                    g_metrics.m_trace.AddSpan("pipe_transit", "idle_detect_pipe",
+                                              event.m_send_time_us, latency_us);
+                }
+
+                m_pending_send_time_us = event.m_send_time_us;
+            }
+
+            int64_t last_idle_detect_active_time = event.m_timestamp;
+
+            debug_log("INFO: %s: Valid activity event received with timestamp %lld",
+                      __func__,
+                      last_idle_detect_active_time);
+
+            // last_idle_detect_active_time MUST be monotonic. It cannot go backwards.
+            m_last_idle_detect_active_time = std::max(m_last_idle_detect_active_time.load(),
+                                                      last_idle_detect_active_time);
+
+            if (event.m_event_type == EventMessage::USER_UNFORCE) {
+                m_state = NORMAL;
+            } else if (event.m_event_type == EventMessage::USER_FORCE_IDLE) {
+                m_state = FORCED_IDLE;
+            } else if (event.m_event_type == EventMessage::USER_FORCE_ACTIVE) {
+                m_state = FORCED_ACTIVE;
+            }
+
+            debug_log("INFO: %s: Current idle detect monitor last active time %lld, state %s",
+                      __func__,
+                      m_last_idle_detect_active_time,
+                      StateToString());
+        } else {
+            g_metrics.m_pipe_messages_rejected.Increment();
+
+            IDLE_DETECT_PROBE1(event_detect, pipe_message_rejected, std::string(event_data).c_str());
+
+            error_log("%s: Invalid event data received: %s",
+                      __func__,
+                      event_data);
+        }
+    } catch (const std::invalid_argument& e) {
+        g_metrics.m_pipe_messages_rejected.Increment();
+
+        IDLE_DETECT_PROBE1(event_detect, pipe_message_rejected, std::string(event_data).c_str());
+
+        error_log("%s: Error parsing timestamp: %s in data %s",
+                  __func__,
+                  e.what(),
+                  event_data);
+    } catch (const std::out_of_range& e) {
+        g_metrics.m_pipe_messages_rejected.Increment();
+
+        IDLE_DETECT_PROBE1(event_detect, pipe_message_rejected, std::string(event_data).c_str());
+
+        error_log("%s: Timestamp out of range: %s in data %s",
+                  __func__,
+                  e.what(),
+                  event_data);
+    }
+}
+
 bool IdleDetectMonitor::IsInitialized() const
 {
     return m_initialized.load();
@@ -856,6 +1059,11 @@ int64_t IdleDetectMonitor::GetLastIdleDetectActiveTime() const
     return m_last_idle_detect_active_time.load();
 }
 
+int64_t IdleDetectMonitor::TakePendingSendTimeMicros()
+{
+    return m_pending_send_time_us.exchange(0);
+}
+
 IdleDetectMonitor::State IdleDetectMonitor::GetState() const
 {
     return m_state.load();
@@ -921,6 +1129,26 @@ void EventDetectConfig::ProcessArgs()
 
     m_config.insert(std::make_pair("event_count_files_path", event_data_path));
 
+    // sysfs_root and dev_root
+
+    // The roots of the sysfs and device trees that are scanned for input devices and ptys/ttys. These are only changed
+    // from "/sys" and "/dev" to run against a fake tree in testing.
+
+    fs::path sysfs_root = "/sys";
+    fs::path dev_root = "/dev";
+
+    try {
+        sysfs_root = fs::path(GetArgString("sysfs_root", "/sys"));
+        dev_root = fs::path(GetArgString("dev_root", "/dev"));
+    } catch (std::exception& e){
+        error_log("%s: sysfs_root or dev_root parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    m_config.insert(std::make_pair("sysfs_root", sysfs_root));
+    m_config.insert(std::make_pair("dev_root", dev_root));
+
     // write_last_active_time_to_file
 
     bool last_active_time_to_file = false;
@@ -986,164 +1214,220 @@ void EventDetectConfig::ProcessArgs()
     }
 
     m_config.insert(std::make_pair("use_shared_memory", use_shm));
-}
 
+    // write_metrics_file
 
-// SharedMemoryTimestampExporter class
+    std::string write_metrics_file_arg = GetArgString("write_metrics_file", "false");
 
-SharedMemoryTimestampExporter::SharedMemoryTimestampExporter(const std::string& name) :
-    m_shm_name(name),
-    m_shm_fd(-1),
-    m_mapped_ptr(nullptr),
-    m_size(sizeof(std::atomic<int64_t>[2])), // <-- Use size of array
-    m_is_creator(false),
-    m_is_initialized(false)
-{
-    if (m_shm_name.empty() || m_shm_name[0] != '/') {
-        error_log("ERROR: %s: Shared memory name '%s' must be non-empty and start with '/'", __func__, m_shm_name.c_str());
+    if (write_metrics_file_arg == "1" || ToLower(write_metrics_file_arg) == "true") {
+        m_config.insert(std::make_pair("write_metrics_file", true));
+    } else if (write_metrics_file_arg == "0" || ToLower(write_metrics_file_arg) == "false") {
+        m_config.insert(std::make_pair("write_metrics_file", false));
+    } else {
+        error_log("%s: write_metrics_file parameter in config file has invalid value: %s; defaulting to false.",
+                  __func__,
+                  write_metrics_file_arg);
+        m_config.insert(std::make_pair("write_metrics_file", false));
     }
-}
 
-SharedMemoryTimestampExporter::~SharedMemoryTimestampExporter() {
-    Cleanup(); // Unmap memory
-    // Unlinking happens explicitly via UnlinkSegment() during shutdown now
-}
+    // metrics_filename
 
-bool SharedMemoryTimestampExporter::CreateOrOpen(mode_t mode) {
-    if (m_is_initialized.load()) {
-        debug_log("INFO: %s: Shared memory %s already initialized.", __func__, m_shm_name.c_str());
-        return true;
-    }
-    debug_log("INFO: %s: Initializing shared memory segment %s for atomic int64_t[2]", __func__, m_shm_name.c_str());
+    std::string metrics_filename = GetArgString("metrics_filename", "event_detect_metrics.prom");
 
-    Cleanup(); // Ensure clean state
+    m_config.insert(std::make_pair("metrics_filename", metrics_filename));
 
-    std::unique_lock<std::mutex> lock(mtx_shmem);
+    // write_latency_trace
 
-    m_is_creator = false;
+    std::string write_latency_trace_arg = GetArgString("write_latency_trace", "false");
 
-    // 1. Create or open RW
-    errno = 0;
-    m_shm_fd = shm_open(m_shm_name.c_str(), O_CREAT | O_RDWR, mode);
-    if (m_shm_fd == -1) {
-        error_log("ERROR: %s: shm_open failed for %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
-        return false;
+    if (write_latency_trace_arg == "1" || ToLower(write_latency_trace_arg) == "true") {
+        m_config.insert(std::make_pair("write_latency_trace", true));
+    } else if (write_latency_trace_arg == "0" || ToLower(write_latency_trace_arg) == "false") {
+        m_config.insert(std::make_pair("write_latency_trace", false));
+    } else {
+        error_log("%s: write_latency_trace parameter in config file has invalid value: %s; defaulting to false.",
+                  __func__,
+                  write_latency_trace_arg);
+        m_config.insert(std::make_pair("write_latency_trace", false));
     }
 
-    // 2. Check current size, truncate if necessary
-    struct stat shm_stat;
-    errno = 0;
-    if (fstat(m_shm_fd, &shm_stat) == -1) {
-        error_log("ERROR: %s: fstat failed for shm fd %d: %s", __func__, m_shm_fd, strerror(errno));
-        close(m_shm_fd); m_shm_fd = -1;
-        return false;
-    }
+    // latency_trace_filename
 
-    if (shm_stat.st_size != (off_t)m_size) {
-        debug_log("INFO: %s: Shm %s has size %ld, resizing to %zu bytes.",
-                  __func__, m_shm_name.c_str(), (long)shm_stat.st_size, m_size);
-        m_is_creator = true; // We determined the size
-        errno = 0;
-        if (ftruncate(m_shm_fd, m_size) == -1) { // <-- Truncate to array size
-            error_log("ERROR: %s: ftruncate failed for shm %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
-            close(m_shm_fd); m_shm_fd = -1;
-            shm_unlink(m_shm_name.c_str()); // Clean up object we tried to create/resize
-            return false;
-        }
+    std::string latency_trace_filename = GetArgString("latency_trace_filename", "event_detect_latency_trace.json");
+
+    m_config.insert(std::make_pair("latency_trace_filename", latency_trace_filename));
+
+    // pressure_resilient
+
+    std::string pressure_resilient_arg = GetArgString("pressure_resilient", "false");
+
+    if (pressure_resilient_arg == "1" || ToLower(pressure_resilient_arg) == "true") {
+        m_config.insert(std::make_pair("pressure_resilient", true));
+    } else if (pressure_resilient_arg == "0" || ToLower(pressure_resilient_arg) == "false") {
+        m_config.insert(std::make_pair("pressure_resilient", false));
     } else {
-        debug_log("INFO: %s: Shm %s exists with correct size.", __func__, m_shm_name.c_str());
-        // If size was already correct, we didn't necessarily create it
-        // Let's assume creator status only if we truncated.
+        error_log("%s: pressure_resilient parameter in config file has invalid value: %s; defaulting to false.",
+                  __func__,
+                  pressure_resilient_arg);
+        m_config.insert(std::make_pair("pressure_resilient", false));
     }
 
-    // 3. Map memory RW
-    errno = 0;
-    void* mapped_mem = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_shm_fd, 0); // <-- Map array size
+    // oom_score_adj
 
-    // 4. Close FD immediately after mmap
-    close(m_shm_fd);
-    m_shm_fd = -1;
+    int oom_score_adj = 0;
 
-    if (mapped_mem == MAP_FAILED) {
-        error_log("ERROR: %s: mmap failed for shm %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
-        // If we created/resized it, unlink it.
-        if (m_is_creator) shm_unlink(m_shm_name.c_str());
-        return false;
+    try {
+        oom_score_adj = ParseStringToInt(GetArgString("oom_score_adj", "0"));
+    } catch (std::exception& e) {
+        error_log("%s: oom_score_adj in config file has invalid value: %s",
+                  __func__,
+                  e.what());
     }
 
-    // 5. Store pointer, initialize if we created/resized it
-    m_mapped_ptr = static_cast<int64_t*>(mapped_mem);
-    if (m_is_creator) {
-        int64_t initial_time = GetUnixEpochTime();
-        m_mapped_ptr[0] = initial_time; // update_time
-        m_mapped_ptr[1] = initial_time; // last_active_time
-        debug_log("INFO: %s: Shared memory segment %s initialized. update=%lld, last_active=%lld",
-                  __func__, m_shm_name.c_str(), (long long)initial_time, (long long)initial_time);
-    } else {
-        debug_log("INFO: %s: Shared memory segment %s mapped.", __func__, m_shm_name.c_str());
+    if (oom_score_adj < -1000 || oom_score_adj > 1000) {
+        error_log("%s: oom_score_adj in config file is out of range (-1000 to 1000): %i; leaving it unchanged.",
+                  __func__,
+                  oom_score_adj);
+
+        oom_score_adj = 0;
     }
 
-    m_is_initialized.store(true);
-    return true;
-}
+    m_config.insert(std::make_pair("oom_score_adj", oom_score_adj));
 
-bool SharedMemoryTimestampExporter::UpdateTimestamps(int64_t update_time, int64_t last_active_time) {
-    std::unique_lock<std::mutex> lock(mtx_shmem);
+    // realtime_priority
 
-    if (!m_is_initialized.load() || m_mapped_ptr == nullptr) {
-        return false;
+    int realtime_priority = 0;
+
+    try {
+        realtime_priority = ParseStringToInt(GetArgString("realtime_priority", "0"));
+    } catch (std::exception& e) {
+        error_log("%s: realtime_priority in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (realtime_priority < 0 || realtime_priority > 99) {
+        error_log("%s: realtime_priority in config file is out of range (0 to 99): %i; disabling.",
+                  __func__,
+                  realtime_priority);
+
+        realtime_priority = 0;
     }
-    // Use relaxed memory order: assumes readers don't need strict ordering
-    // relative to other non-atomic operations in this thread. Atomicity
-    // of the store itself is guaranteed.
-    m_mapped_ptr[0] = update_time;      // Store update_time at index 0
-    m_mapped_ptr[1] = last_active_time; // Store last_active_time at index 1
-    return true;
-}
 
-bool SharedMemoryTimestampExporter::IsInitialized() const {
-    return m_is_initialized.load();
+    m_config.insert(std::make_pair("realtime_priority", realtime_priority));
 }
 
-void SharedMemoryTimestampExporter::Cleanup() { // Renamed from Close
-    std::unique_lock<std::mutex> lock(mtx_shmem);
 
-    if (m_mapped_ptr != nullptr) {
-        debug_log("DEBUG: %s: Unmapping shared memory %s...", __func__, m_shm_name.c_str());
-        if (munmap(m_mapped_ptr, m_size) == -1) { // <-- Use correct size
-            error_log("ERROR: %s: munmap failed for %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
-        } else {
-            debug_log("DEBUG: %s: Shared memory %s unmapped.", __func__, m_shm_name.c_str());
-        }
-        m_mapped_ptr = nullptr;
+// EventDetectMetrics class
+
+std::string EventDetectMetrics::ToPrometheusText()
+{
+    PrometheusTextBuilder builder;
+
+    builder.AddFamily("event_detect_device_events_total", "counter",
+                      "Input events read from each monitored pointing device.");
+
+    for (const auto& recorder : g_event_recorders.GetEventRecorders()) {
+        builder.AddSample("event_detect_device_events_total",
+                          recorder->GetEventCount(),
+                          PrometheusTextBuilder::LabelPair("device", recorder->GetEventDevicePath().filename()));
     }
-    // Close FD just in case it was left open somehow (shouldn't happen)
-    if (m_shm_fd != -1) {
-        debug_log("WARNING: %s: Shared memory FD %d was open during cleanup, closing.", __func__, m_shm_fd);
-        close(m_shm_fd);
-        m_shm_fd = -1;
+
+    builder.AddFamily("event_detect_device_last_event_time_seconds", "gauge",
+                      "Kernel timestamp of the last input event read from each monitored device.");
+
+    for (const auto& recorder : g_event_recorders.GetEventRecorders()) {
+        builder.AddSample("event_detect_device_last_event_time_seconds",
+                          recorder->GetLastEventTime(),
+                          PrometheusTextBuilder::LabelPair("device", recorder->GetEventDevicePath().filename()));
     }
-    m_is_initialized.store(false); // Mark as uninitialized after cleanup
+
+    builder.AddFamily("event_detect_monitor_ticks_total", "counter", "Completed monitor thread iterations.");
+    builder.AddSample("event_detect_monitor_ticks_total", m_monitor_ticks.Get());
+
+    builder.AddHistogram("event_detect_monitor_tick_duration_seconds",
+                         "Work time of each monitor thread iteration, excluding the wait.",
+                         m_monitor_tick_duration_us,
+                         1e-6);
+
+    builder.AddHistogram("event_detect_latency_input_to_read_seconds",
+                         "Latency from the kernel input event timestamp to the recorder thread reading the event.",
+                         m_latency_input_to_read_us,
+                         1e-6);
+
+    builder.AddHistogram("event_detect_latency_input_to_publish_seconds",
+                         "Latency from the kernel input event timestamp to publication of the new last active time.",
+                         m_latency_input_to_publish_us,
+                         1e-6);
+
+    builder.AddHistogram("event_detect_latency_pipe_transit_seconds",
+                         "Latency from idle_detect sending a pipe message to event_detect receiving it.",
+                         m_latency_pipe_transit_us,
+                         1e-6);
+
+    builder.AddHistogram("event_detect_latency_pipe_to_publish_seconds",
+                         "Latency from idle_detect sending a pipe message to publication of the result.",
+                         m_latency_pipe_to_publish_us,
+                         1e-6);
+
+    builder.AddFamily("event_detect_last_active_time_seconds", "gauge", "Aggregated last active time.");
+    builder.AddSample("event_detect_last_active_time_seconds", g_event_monitor.GetLastActiveTime());
+
+    builder.AddFamily("event_detect_ttys_monitored", "gauge", "Number of ptys/ttys monitored.");
+    builder.AddSample("event_detect_ttys_monitored", m_ttys_monitored.Get());
+
+    builder.AddFamily("event_detect_pipe_messages_total", "counter",
+                      "Messages received from idle_detect instances on the event registration pipe.");
+    builder.AddSample("event_detect_pipe_messages_total", m_pipe_messages_accepted.Get(),
+                      PrometheusTextBuilder::LabelPair("result", "accepted"));
+    builder.AddSample("event_detect_pipe_messages_total", m_pipe_messages_rejected.Get(),
+                      PrometheusTextBuilder::LabelPair("result", "rejected"));
+
+    builder.AddFamily("event_detect_shmem_updates_total", "counter", "Shared memory timestamp updates.");
+    builder.AddSample("event_detect_shmem_updates_total", m_shmem_updates.Get(),
+                      PrometheusTextBuilder::LabelPair("result", "success"));
+    builder.AddSample("event_detect_shmem_updates_total", m_shmem_update_failures.Get(),
+                      PrometheusTextBuilder::LabelPair("result", "failure"));
+
+    builder.AddFamily("event_detect_forced_state", "gauge",
+                      "Current state override set via idle_detect. Exactly one state has the value 1.");
+
+    IdleDetectMonitor::State current_state = g_idle_detect_monitor.GetState();
+
+    for (const auto& state : {IdleDetectMonitor::UNKNOWN, IdleDetectMonitor::NORMAL,
+                              IdleDetectMonitor::FORCED_ACTIVE, IdleDetectMonitor::FORCED_IDLE}) {
+        builder.AddSample("event_detect_forced_state", static_cast<int64_t>(state == current_state),
+                          PrometheusTextBuilder::LabelPair("state", IdleDetectMonitor::StateToString(state)));
+    }
+
+    builder.AddFamily("event_detect_log_messages_dropped_total", "counter",
+                      "Log messages not written, by reason.");
+    builder.AddSample("event_detect_log_messages_dropped_total", g_logger.GetOverflowCount(),
+                      PrometheusTextBuilder::LabelPair("reason", "overflow"));
+    builder.AddSample("event_detect_log_messages_dropped_total", g_logger.GetRateLimitedCount(),
+                      PrometheusTextBuilder::LabelPair("reason", "rate_limit"));
+    builder.AddSample("event_detect_log_messages_dropped_total", g_logger.GetDedupSuppressedCount(),
+                      PrometheusTextBuilder::LabelPair("reason", "duplicate"));
+
+    return builder.GetText();
 }
 
-bool SharedMemoryTimestampExporter::UnlinkSegment() {
-    std::unique_lock<std::mutex> lock(mtx_shmem);
+void EventDetectMetrics::WriteMetricsFile(const fs::path& filepath)
+{
+    // Failures are logged by WriteFileAtomically. Metrics are diagnostic only, so a failure is not fatal.
+    WriteFileAtomically(filepath, ToPrometheusText());
+}
 
-    debug_log("INFO: %s: Requesting unlink for shared memory %s...", __func__, m_shm_name.c_str());
-    errno = 0;
-    if (shm_unlink(m_shm_name.c_str()) == -1) {
-        if (errno != ENOENT) { // Ignore "No such file or directory"
-            error_log("ERROR: %s: shm_unlink failed for %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
-            return false; // Unlink failed
-        } else {
-            debug_log("DEBUG: %s: Shared memory segment %s already unlinked (ENOENT).", __func__, m_shm_name.c_str());
-        }
-    } else {
-        debug_log("INFO: %s: Shared memory segment %s unlinked successfully.", __func__, m_shm_name.c_str());
-    }
-    return true; // Unlink succeeded or segment was already gone
+void EventDetectMetrics::WriteLatencyTraceFile()
+{
+    fs::path event_data_path = std::get<fs::path>(g_config.GetArg("event_count_files_path"));
+    std::string latency_trace_filename = std::get<std::string>(g_config.GetArg("latency_trace_filename"));
+
+    // Failures are logged by WriteFileAtomically. The trace is diagnostic only, so a failure is not fatal.
+    m_trace.WriteTraceFile(event_data_path / latency_trace_filename);
 }
 
+
 void EventDetect::Shutdown(const int& exit_code)
 {
     g_exit_code = exit_code;
@@ -1151,6 +1435,17 @@ void EventDetect::Shutdown(const int& exit_code)
     pthread_kill(g_main_thread_id, SIGTERM);
 }
 
+void EventDetect::PrepareLatencyCriticalThread()
+{
+    if (std::get<bool>(g_config.GetArg("pressure_resilient"))) {
+        PrefaultThreadStack();
+    }
+
+    if (int realtime_priority = std::get<int>(g_config.GetArg("realtime_priority")); realtime_priority > 0) {
+        SetThreadRealtimePriority(realtime_priority);
+    }
+}
+
 
 // Global scope functions. Note these do not have declarations in the event_detect.h file.
 
@@ -1326,6 +1621,20 @@ void CleanUpFiles(int sig)
         }
     }
 
+    std::string metrics_filename = std::get<std::string>(g_config.GetArg("metrics_filename"));
+
+    fs::path metrics_path = event_data_path / metrics_filename;
+
+    if ((sig == SIGINT || sig == SIGTERM) && fs::exists(metrics_path)) {
+        try {
+            fs::remove(metrics_path);
+        } catch (FileSystemException& e) {
+            normal_log("WARNING: %s: metrics file could not be removed: %s",
+                __func__,
+                e.what());
+        }
+    }
+
     fs::path pipe_path = event_data_path / "event_registration_pipe";
 
     if ((sig == SIGINT || sig == SIGTERM) && fs::exists(pipe_path)) {
@@ -1359,6 +1668,7 @@ void CleanUpFiles(int sig)
     }
 }
 
+#ifndef EVENT_DETECT_NO_MAIN
 //!
 //! \brief This is the main function for event_detect
 //! \param argc
@@ -1406,6 +1716,8 @@ int main(int argc, char* argv[])
     // Populate g_debug from the config to avoid having to call the heavyweight GetArg in each log function call.
     g_debug = std::get<bool>(g_config.GetArg("debug"));
 
+    g_metrics.m_trace.SetEnabled(std::get<bool>(g_config.GetArg("write_latency_trace")));
+
     pid_t current_pid = getpid();
 
     fs::path data_dir_path = std::get<fs::path>(g_config.GetArg("event_count_files_path"));
@@ -1464,6 +1776,10 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    // Start the asynchronous logger. This is done after the signal mask is set so the logger thread inherits it and
+    // the signals above continue to be delivered to sigwait() in this thread.
+    g_logger.Start();
+
     normal_log("INFO: %s: event_detect C++ program, %s, started, pid %i",
         __func__,
         g_version,
@@ -1473,6 +1789,16 @@ int main(int argc, char* argv[])
               __func__,
               g_main_thread_id);
 
+    // Pressure resilience. This is done before any of the worker threads or the shared memory segment are created, so
+    // that with MCL_FUTURE they are locked too.
+    if (int oom_score_adj = std::get<int>(g_config.GetArg("oom_score_adj")); oom_score_adj != 0) {
+        SetOomScoreAdj(oom_score_adj);
+    }
+
+    if (std::get<bool>(g_config.GetArg("pressure_resilient"))) {
+        LockProcessMemory();
+    }
+
     // --- shmem setupg ---
     bool use_shared_memory = false; // Local variable for main scope
     try {
@@ -1485,6 +1811,7 @@ int main(int argc, char* argv[])
         if (g_shmem_exporter.CreateOrOpen(0664)) {
             normal_log("INFO: %s: Shared memory exporter initialized successfully (%s).", __func__, SHMEM_NAME_CONFIG);
             g_shm_initialized_successfully.store(true); // Set global flag
+            g_event_monitor.SetTimestampExporter(&g_shmem_exporter);
         } else {
             error_log("%s: Failed to initialize shared memory exporter. Shared memory export disabled.", __func__);
             // Continue without shared memory export
@@ -1598,9 +1925,17 @@ int main(int argc, char* argv[])
 
             CleanUpFiles(sig);
 
+            // Unlike the other data files the trace is left in place at shutdown for offline analysis.
+            if (g_metrics.m_trace.IsEnabled()) {
+                g_metrics.WriteLatencyTraceFile();
+            }
+
             break;
         }
     }
 
+    g_logger.Stop();
+
     return g_exit_code;
 }
+#endif // EVENT_DETECT_NO_MAIN
@@ -13,8 +13,14 @@
 #include <thread>
 #include <filesystem>
 
+#include <input_source.h>
+#include <metrics.h>
+#include <shmem.h>
+#include <trace.h>
 #include <util.h>
 
+struct libevdev;
+
 namespace EventDetect {
 
 //!
@@ -55,15 +61,31 @@ public:
     std::vector<fs::path> GetEventDevices() const;
 
     //!
-    //! \brief This calls the private method EnumerateEventDevices() and updates the m_event_device_paths private member.
+    //! \brief This calls the private method ScanEventDevices() and, if the devices found differ from the current ones,
+    //! updates the m_event_device_paths private member. In the steady state (no change) this does not allocate.
+    //! \return true if the input event devices changed.
     //!
-    void UpdateEventDevices();
+    bool UpdateEventDevices();
 
     //!
     //! \brief This is the function that is the entry point for the event activity monitor worker thread.
     //!
     void EventActivityMonitorThread();
 
+    //!
+    //! \brief Runs one monitor cycle: checks the input devices, aggregates the input, tty and idle_detect activity times,
+    //! and publishes the result. The monitor thread calls this once a second. The simulation tests call it directly
+    //! against a SimulatedClock.
+    //!
+    void Tick();
+
+    //!
+    //! \brief Sets the shared memory exporter the monitor publishes to. This is done by main() once the segment has been
+    //! created.
+    //! \param exporter initialized exporter, or nullptr to stop publishing. Not owned.
+    //!
+    void SetTimestampExporter(SharedMemoryTimestampExporter* exporter);
+
     //!
     //! \brief Provides a flag to indicate whether the monitor has been initialized. This is used in main in the application
     //! control paths.
@@ -80,10 +102,15 @@ public:
 private:
     //!
     //! \brief This is a private method to determine the input event devices to monitor. In particular we only want to monitor
-    //! pointing devices (mice).
-    //! \return
+    //! pointing devices (mice). The names of the devices found (e.g. event3) are left in m_scan_device_names. This reuses the
+    //! scan buffers, so that it does not allocate in the steady state.
     //!
-    static std::vector<fs::path> EnumerateEventDevices();
+    void ScanEventDevices();
+
+    //!
+    //! \brief Refreshes the config values cached by the monitor if the config has been re-read since the last call.
+    //!
+    void RefreshCachedConfig();
 
     //!
     //! \brief This is the whole point of the application. This writes out the last active time determined by the monitor
@@ -107,6 +134,29 @@ private:
     //!
     std::vector<fs::path> m_event_device_paths;
 
+    //!
+    //! \brief Holds the names of the input event devices in m_event_device_paths, in the same (sorted) order. The scan
+    //! result is compared to this.
+    //!
+    std::vector<std::string> m_event_device_names;
+
+    //!
+    //! \brief Scan buffers reused by ScanEventDevices(): the entries of the input class directory, the names of the pointing
+    //! devices among them, and the path being checked. Only accessed by the monitor thread.
+    //!
+    std::vector<std::string> m_scan_entries;
+    std::vector<std::string> m_scan_device_names;
+    std::string m_scan_path;
+
+    //!
+    //! \brief Config values cached by RefreshCachedConfig(), so that Tick() does not rebuild them every second. Only
+    //! accessed by the monitor thread.
+    //!
+    uint64_t m_config_generation;
+    std::string m_input_class_dir;
+    fs::path m_last_active_time_filepath;
+    fs::path m_metrics_filepath;
+
     //!
     //! \brief holds the last active time determined by the monitor. This is an atomic, which means it can be written to/read from
     //! without holding the mtx_event_monitor lock.
@@ -118,6 +168,41 @@ private:
     //! method.
     //!
     std::atomic<bool> m_initialized;
+
+    //!
+    //! \brief The shared memory exporter published to by Tick(), nullptr if shared memory is not in use.
+    //!
+    std::atomic<SharedMemoryTimestampExporter*> m_shmem_exporter;
+
+    //!
+    //! \brief The total event count seen by the previous Tick(). Only accessed by the monitor thread.
+    //!
+    int64_t m_event_count_prev;
+
+    //!
+    //! \brief Kernel timestamp of the latest input event whose publication has been traced. Only accessed by the monitor
+    //! thread.
+    //!
+    int64_t m_traced_event_time_us;
+};
+
+//!
+//! \brief The LibevdevEventSource class is the production InputEventSource for the event recorders. It reads from an evdev
+//! device through libevdev, which handles SYN_DROPPED resynchronization of the device state.
+//!
+class LibevdevEventSource : public InputEventSource
+{
+public:
+    //!
+    //! \brief Constructor.
+    //! \param dev initialized libevdev device. Not owned.
+    //!
+    explicit LibevdevEventSource(struct libevdev* dev);
+
+    int NextEvent(bool sync_mode, input_event& ev) override;
+
+private:
+    struct libevdev* m_dev;
 };
 
 //!
@@ -175,6 +260,20 @@ public:
         //!
         int64_t GetEventCount() const;
 
+        //!
+        //! \brief Returns the time of the most recent event read from the device, taken from the kernel input_event
+        //! timestamp.
+        //! \return Unix Epoch time in seconds, 0 if no event has been seen.
+        //!
+        int64_t GetLastEventTime() const;
+
+        //!
+        //! \brief Returns the kernel timestamp of the most recent event read from the device, in microseconds. This is
+        //! the start of the activity-to-publish latency trace.
+        //! \return Unix Epoch time in microseconds, 0 if no event has been seen.
+        //!
+        int64_t GetLastEventTimeMicros() const;
+
         //!
         //! \brief Returns whether the device has been lost (disconnected).
         //! \return true if the device reported ENODEV
@@ -186,6 +285,14 @@ public:
         //!
         void EventActivityRecorderThread();
 
+        //!
+        //! \brief Accounts a batch of events read from the device: the event tally, the last event time, and the
+        //! input-to-read latency. Called by the recorder thread after each read, and by the simulation tests to inject
+        //! input activity.
+        //! \param batch
+        //!
+        void RecordBatch(const InputEventBatch& batch);
+
     private:
         //!
         //! \brief This is the mutex member that provides lock control for the individual event recorder.
@@ -198,9 +305,15 @@ public:
         fs::path m_event_device_path;
 
         //!
-        //! \brief Atomic that holds the current event tally for the monitored device.
+        //! \brief Atomic that holds the current event tally for the monitored device. This and m_last_event_time_us are
+        //! written only by the recorder thread and are kept on their own cache line, away from the mutex and path.
         //!
-        std::atomic<int64_t> m_event_count;
+        alignas(METRICS_CACHE_LINE_SIZE) std::atomic<int64_t> m_event_count;
+
+        //!
+        //! \brief Atomic that holds the kernel timestamp (microseconds) of the last event read from the device.
+        //!
+        std::atomic<int64_t> m_last_event_time_us;
 
         //!
         //! \brief Atomic flag set when the device is disconnected (ENODEV). Checked by the monitor thread
@@ -215,6 +328,12 @@ public:
     //!
     int64_t GetTotalEventCount() const;
 
+    //!
+    //! \brief Provides the most recent kernel event timestamp across all monitored devices.
+    //! \return Unix Epoch time in microseconds, 0 if no event has been seen.
+    //!
+    int64_t GetLatestEventTimeMicros() const;
+
     //!
     //! \brief Returns a reference to the event recorder objects thread pool.
     //! \return vector of smart shared pointers to the event recorders
@@ -271,7 +390,8 @@ public:
     std::vector<fs::path> GetTtyDevices() const;
 
     //!
-    //! \brief Initializes/Updates the pts/tty device paths to monitor.
+    //! \brief Initializes/Updates the pts/tty device paths to monitor. In the steady state (no change) this does not
+    //! allocate.
     //!
     void UpdateTtyDevices();
 
@@ -280,6 +400,12 @@ public:
     //!
     void TtyMonitorThread();
 
+    //!
+    //! \brief Runs one tty monitor cycle: refreshes the pts/tty inventory and updates the last active time from their
+    //! access times. The tty monitor thread calls this once a second.
+    //!
+    void Tick();
+
     //!
     //! \brief Provides a flag to indicate whether the monitor has been initialized. This is used in main in the application
     //! control paths.
@@ -319,10 +445,9 @@ public:
 
 private:
     //!
-    //! \brief Provides the enumerated pts/tty devices.
-    //! \return std::vector<fs::path> of enumerated pts/tty devices.
+    //! \brief Scans for pts/tty devices into m_scan_pts_names and m_scan_tty_names, reusing their storage.
     //!
-    static std::vector<fs::path> EnumerateTtyDevices();
+    void ScanTtyDevices();
 
     //!
     //! \brief This is the mutex member that provides lock control for the tty monitor object. This is used to ensure the
@@ -341,6 +466,26 @@ private:
     //!
     std::vector<fs::path> m_tty_device_paths;
 
+    //!
+    //! \brief The names of the monitored devices under dev_root/pts and the tty* devices under dev_root, as last scanned.
+    //! The scan result is compared to these.
+    //!
+    std::vector<std::string> m_pts_names;
+    std::vector<std::string> m_tty_names;
+
+    //!
+    //! \brief Scan buffers reused by ScanTtyDevices().
+    //!
+    std::vector<std::string> m_scan_pts_names;
+    std::vector<std::string> m_scan_tty_names;
+
+    //!
+    //! \brief The dev_root and dev_root/pts directories, cached until the config is re-read.
+    //!
+    uint64_t m_config_generation;
+    std::string m_dev_dir;
+    std::string m_pts_dir;
+
     //!
     //! \brief std::vector holding the tty objects.
     //!
@@ -391,6 +536,13 @@ public:
     //!
     void IdleDetectMonitorThread();
 
+    //!
+    //! \brief Parses and applies one message received from an idle_detect instance: updates the last active time and the
+    //! forced state. Invalid messages are counted and logged.
+    //! \param event_data message in the EventMessage::ToString() format. Valid messages are processed without allocating.
+    //!
+    void ProcessMessage(std::string_view event_data);
+
     //!
     //! \brief Provides a flag to indicate whether the monitor has been initialized. This is used in main in the application
     //! control paths.
@@ -410,6 +562,13 @@ public:
     //!
     State GetState() const;
 
+    //!
+    //! \brief Returns and clears the sender timestamp of the most recent pipe message applied since the last call. The
+    //! monitor thread calls this after publishing to record the pipe-to-publish latency.
+    //! \return Unix Epoch time in microseconds, 0 if no traced message is pending.
+    //!
+    int64_t TakePendingSendTimeMicros();
+
     //!
     //! \brief Returns the string representation of the input state enum value.
     //! \param State enum state
@@ -440,6 +599,11 @@ private:
     //!
     std::atomic<int64_t> m_last_idle_detect_active_time;
 
+    //!
+    //! \brief Sender timestamp (microseconds) of the most recent traced pipe message not yet published by the monitor.
+    //!
+    std::atomic<int64_t> m_pending_send_time_us;
+
     //!
     //! \brief Holds the current state of the idle monitor. NORMAL means idle detect follows the normal threshold (trigger) rules
     //! for idle detection. FORCED_ACTIVE means the user has forced the system to be active and FORCED_IDLE means the user has
@@ -455,82 +619,93 @@ private:
     std::atomic<bool> m_initialized;
 };
 
-/**
- * @brief Manages a POSIX shared memory segment for exporting timestamps.
- * Stores an array of two int64_t: {update_time, last_active_time}.
- * Handles creation, mapping, updating, and cleanup via RAII.
- */
-class SharedMemoryTimestampExporter {
+//!
+//! \brief The EventDetectMetrics class holds the lock-free, cache line aligned counters that describe what event_detect
+//! is doing, and renders them together with the per-device recorder counts in Prometheus text format. It is a
+//! singleton. The metrics file is written by the monitor thread each tick if write_metrics_file is enabled.
+//!
+class EventDetectMetrics
+{
 public:
-    /**
-     * @brief Construct with the desired shared memory name.
-     * @param name Must start with '/' (e.g., "/idle_detect_shmem").
-     */
-    explicit SharedMemoryTimestampExporter(const std::string& name);
-
-    /**
-     * @brief Destructor handles unmapping and potentially unlinking the shared memory.
-     */
-    ~SharedMemoryTimestampExporter();
-
-    // Prevent copying/moving
-    SharedMemoryTimestampExporter(const SharedMemoryTimestampExporter&) = delete;
-    SharedMemoryTimestampExporter& operator=(const SharedMemoryTimestampExporter&) = delete;
-    SharedMemoryTimestampExporter(SharedMemoryTimestampExporter&&) = delete;
-    SharedMemoryTimestampExporter& operator=(SharedMemoryTimestampExporter&&) = delete;
-
-    /**
-     * @brief Creates (if necessary) and opens the shared memory segment,
-     * sets its size (to sizeof(int64_t[2])), and maps it for writing.
-     * Must be called before UpdateTimestamps or IsInitialized.
-     * @param mode Permissions (e.g., 0666 or 0660) to use if creating the segment.
-     * @return True on success, false on any failure (shm_open, ftruncate, mmap).
-     */
-    bool CreateOrOpen(mode_t mode = 0666);
-
-    /**
-     * @brief Updates both timestamps in the mapped shared memory.
-     * @param update_time The timestamp of the current update cycle.
-     * @param last_active_time The calculated overall last active time.
-     * @return True if updated successfully, false if not initialized or pointer is invalid.
-     */
-    // *** SIGNATURE CHANGED ***
-    bool UpdateTimestamps(int64_t update_time, int64_t last_active_time);
-
-    /**
-     * @brief Checks if the shared memory was successfully initialized (opened and mapped).
-     * @return True if initialized and ready for updates, false otherwise.
-     */
-    bool IsInitialized() const;
+    //!
+    //! \brief Number of completed monitor ticks.
+    //!
+    MetricCounter m_monitor_ticks;
 
-    /**
-     * @brief Explicitly unlinks the shared memory segment.
-     * Call during clean shutdown if desired. Idempotent.
-     * @return True if unlink succeeded or segment already gone, false on error.
-     */
-    bool UnlinkSegment();
+    //!
+    //! \brief Duration of the work done in each monitor tick in microseconds, excluding the wait.
+    //!
+    MetricHistogram m_monitor_tick_duration_us;
 
-private:
-    /**
-     * @brief Performs resource cleanup (munmap). Called by destructor.
-     */
-    void Cleanup();
-
-    //!
-    //! \brief This protects against multiple threads in the event_detect process from simultaneously accessing
-    //! and writing to the shared memory segment. It does NOT protect from another process encountering a torn
-    //! read. I would prefer to use a pthread_mutex_t in the shmem data structure and manege the mutex across
-    //! the writer and reader, but the BOINC architect does not believe this is necessary in practice given the small
-    //! size and low frequency of writing and reading.
-    //!
-    std::mutex mtx_shmem;
-
-    std::string m_shm_name;
-    int m_shm_fd;
-    int64_t* m_mapped_ptr;             // Pointer to the start of the int64_t[2] array
-    const size_t m_size;               // Size of the int64_t[2] array
-    bool m_is_creator;                 // Did this instance create/resize the segment?
-    std::atomic<bool> m_is_initialized;
+    //!
+    //! \brief Number of ptys/ttys currently monitored.
+    //!
+    MetricGauge m_ttys_monitored;
+
+    //!
+    //! \brief Number of messages from idle_detect instances received on the pipe that were valid and applied.
+    //!
+    MetricCounter m_pipe_messages_accepted;
+
+    //!
+    //! \brief Number of messages received on the pipe that were malformed or invalid.
+    //!
+    MetricCounter m_pipe_messages_rejected;
+
+    //!
+    //! \brief Number of successful shared memory timestamp updates.
+    //!
+    MetricCounter m_shmem_updates;
+
+    //!
+    //! \brief Number of failed shared memory timestamp updates.
+    //!
+    MetricCounter m_shmem_update_failures;
+
+    //!
+    //! \brief Latency from the kernel input event timestamp to the recorder thread reading the event, in microseconds.
+    //!
+    MetricHistogram m_latency_input_to_read_us;
+
+    //!
+    //! \brief Latency from the kernel input event timestamp to the new last active time being published to shared
+    //! memory (or the last active time file) by the monitor thread, in microseconds.
+    //!
+    MetricHistogram m_latency_input_to_publish_us;
+
+    //!
+    //! \brief Latency from idle_detect sending a pipe message to event_detect receiving it, in microseconds. Only
+    //! recorded for messages that carry the optional sender timestamp.
+    //!
+    MetricHistogram m_latency_pipe_transit_us;
+
+    //!
+    //! \brief Latency from idle_detect sending a pipe message to the result being published by the monitor thread, in
+    //! microseconds.
+    //!
+    MetricHistogram m_latency_pipe_to_publish_us;
+
+    //!
+    //! \brief Span buffer for the optional Chrome/Perfetto latency trace. Enabled by write_latency_trace.
+    //!
+    ChromeTraceBuffer m_trace;
+
+    //!
+    //! \brief Renders all metrics in Prometheus text exposition format.
+    //! \return text
+    //!
+    std::string ToPrometheusText();
+
+    //!
+    //! \brief Atomically rewrites the metrics file.
+    //! \param filepath
+    //!
+    void WriteMetricsFile(const fs::path& filepath);
+
+    //!
+    //! \brief Atomically rewrites the Chrome/Perfetto latency trace file in the event_count_files_path.
+    //!
+    void WriteLatencyTraceFile();
 };
 
 //!
@@ -539,6 +714,14 @@ private:
 //!
 void Shutdown(const int &exit_code = 0);
 
+//!
+//! \brief Applies the pressure resilience settings to the calling thread: pre-faults its stack if pressure_resilient is
+//! set, and moves it to SCHED_FIFO if realtime_priority is non-zero. Called at the start of the event monitor and
+//! recorder threads only, which are the threads on the input to publish path. Not for the tty and idle_detect monitor
+//! threads: the latter reads a FIFO that other users can write to, and a flood of writes must not run a real time loop.
+//!
+void PrepareLatencyCriticalThread();
+
 } // namespace event_detect
 
 //!
@@ -550,4 +733,15 @@ class EventDetectConfig : public Config
     void ProcessArgs() override;
 };
 
+// Process-wide singletons defined in event_detect.cpp. They are declared here so that the simulation tests, which build
+// event_detect.cpp without main() (EVENT_DETECT_NO_MAIN), can drive them.
+
+extern std::atomic<int> g_exit_code;
+extern EventDetectConfig g_config;
+extern EventDetect::Monitor g_event_monitor;
+extern EventDetect::TtyMonitor g_tty_monitor;
+extern EventDetect::IdleDetectMonitor g_idle_detect_monitor;
+extern EventDetect::InputEventRecorders g_event_recorders;
+extern EventDetect::EventDetectMetrics g_metrics;
+
 #endif // EVENT_DETECT_H
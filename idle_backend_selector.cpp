@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <idle_backend_selector.h>
+#include <util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+IdleBackendSelector::IdleBackendSelector(int max_failures, int probe_samples)
+    : m_now_us([]() {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch()).count());
+    })
+    , m_max_failures(std::max(max_failures, 1))
+    , m_probe_samples(std::max(probe_samples, 1))
+    , m_selected(-1)
+    , m_consecutive_failures(0)
+    , m_probe_count(0)
+{}
+
+void IdleBackendSelector::AddBackend(Backend backend)
+{
+    m_backends.push_back(std::move(backend));
+}
+
+void IdleBackendSelector::SetWaitForQueries(std::function<void()> wait_for_queries)
+{
+    m_wait_for_queries = std::move(wait_for_queries);
+}
+
+void IdleBackendSelector::SetClock(std::function<int64_t()> now_us)
+{
+    m_now_us = std::move(now_us);
+}
+
+void IdleBackendSelector::SetProbeCallback(std::function<void(const IdleBackendSelector&)> on_probe)
+{
+    m_on_probe = std::move(on_probe);
+}
+
+void IdleBackendSelector::SetMaxFailures(int max_failures)
+{
+    m_max_failures = std::max(max_failures, 1);
+}
+
+bool IdleBackendSelector::Probe()
+{
+    m_probe_results.clear();
+    m_selected = -1;
+    m_consecutive_failures = 0;
+    ++m_probe_count;
+
+    for (const Backend& backend : m_backends) {
+        m_probe_results.push_back(ProbeBackend(backend));
+    }
+
+    // The fastest valid backend, any that is not a last resort first. Latencies within LATENCY_MARGIN_US are ties,
+    // which go to the first registered, so that timing noise does not decide between two cached reads.
+    for (bool last_resort : {false, true}) {
+        for (size_t i = 0; i < m_probe_results.size(); ++i) {
+            const ProbeResult& result = m_probe_results[i];
+
+            if (!result.valid || result.last_resort != last_resort) {
+                continue;
+            }
+
+            if (m_selected < 0 || result.latency_us + LATENCY_MARGIN_US < m_probe_results[m_selected].latency_us) {
+                m_selected = static_cast<int>(i);
+            }
+        }
+
+        if (m_selected >= 0) {
+            break;
+        }
+    }
+
+    if (m_on_probe) {
+        m_on_probe(*this);
+    }
+
+    return m_selected >= 0;
+}
+
+void IdleBackendSelector::StartPass()
+{
+    if (m_probe_count == 0 || (m_selected >= 0 && !m_backends[m_selected].is_candidate())) {
+        Probe();
+    }
+
+    if (m_selected >= 0 && m_backends[m_selected].start_query) {
+        m_backends[m_selected].start_query();
+    }
+}
+
+int64_t IdleBackendSelector::GetIdleSeconds()
+{
+    int64_t idle_seconds = (m_selected >= 0) ? m_backends[m_selected].read() : -1;
+
+    if (idle_seconds >= 0) {
+        m_consecutive_failures = 0;
+
+        return idle_seconds;
+    }
+
+    // Without a selection, the passes count as failures too, so that the probe is retried at the same rate.
+    ++m_consecutive_failures;
+
+    debug_log("INFO: %s: Idle backend %s failed (%i of %i).",
+              __func__,
+              GetSelectedName(),
+              m_consecutive_failures,
+              m_max_failures);
+
+    if (m_consecutive_failures < m_max_failures) {
+        return -1;
+    }
+
+    if (!Probe()) {
+        return -1;
+    }
+
+    return m_probe_results[m_selected].idle_seconds;
+}
+
+bool IdleBackendSelector::HasSelection() const
+{
+    return m_selected >= 0;
+}
+
+const char* IdleBackendSelector::GetSelectedName() const
+{
+    return m_selected >= 0 ? m_backends[m_selected].name.c_str() : "none";
+}
+
+bool IdleBackendSelector::IsSelectedEventDriven() const
+{
+    return m_selected >= 0 && m_backends[m_selected].is_event_driven && m_backends[m_selected].is_event_driven();
+}
+
+bool IdleBackendSelector::IsSelectedReportingLevels() const
+{
+    return IsSelectedEventDriven() && m_backends[m_selected].reports_levels;
+}
+
+const std::vector<IdleBackendSelector::ProbeResult>& IdleBackendSelector::GetProbeResults() const
+{
+    return m_probe_results;
+}
+
+uint64_t IdleBackendSelector::GetProbeCount() const
+{
+    return m_probe_count;
+}
+
+int IdleBackendSelector::GetConsecutiveFailures() const
+{
+    return m_consecutive_failures;
+}
+
+std::string IdleBackendSelector::StatusToString() const
+{
+    std::stringstream out;
+
+    out << "selected_backend=" << GetSelectedName() << "\n";
+    out << "probe_count=" << m_probe_count << "\n";
+
+    for (const ProbeResult& result : m_probe_results) {
+        out << result.name << "_candidate=" << (result.candidate ? 1 : 0) << "\n";
+
+        if (!result.candidate) {
+            continue;
+        }
+
+        out << result.name << "_valid=" << (result.valid ? 1 : 0) << "\n";
+        out << result.name << "_latency_us=" << result.latency_us << "\n";
+        out << result.name << "_idle_seconds=" << result.idle_seconds << "\n";
+    }
+
+    return out.str();
+}
+
+IdleBackendSelector::ProbeResult IdleBackendSelector::ProbeBackend(const Backend& backend)
+{
+    ProbeResult result;
+
+    result.name = backend.name;
+    result.last_resort = backend.last_resort;
+    result.candidate = backend.is_candidate();
+
+    if (!result.candidate) {
+        return result;
+    }
+
+    std::vector<int64_t> latencies_us;
+    result.valid = true;
+
+    for (int i = 0; i < m_probe_samples; ++i) {
+        int64_t start_us = m_now_us();
+
+        if (backend.start_query) {
+            backend.start_query();
+
+            if (m_wait_for_queries) {
+                m_wait_for_queries();
+            }
+        }
+
+        int64_t idle_seconds = backend.read();
+
+        latencies_us.push_back(m_now_us() - start_us);
+
+        if (idle_seconds < 0) {
+            result.valid = false;
+            break;
+        }
+
+        result.idle_seconds = idle_seconds;
+    }
+
+    std::sort(latencies_us.begin(), latencies_us.end());
+    result.latency_us = latencies_us[latencies_us.size() / 2];
+
+    return result;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef IDLE_BACKEND_SELECTOR_H
+#define IDLE_BACKEND_SELECTOR_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//!
+//! \brief The IdleBackendSelector class picks the idle time backend that GetIdleTimeSeconds() uses. A probe calls each
+//! backend that applies to the session a few times, measures the latency and checks that each call succeeds. The
+//! fastest backend that succeeded is selected, preferring any that is not a last resort. The selection is then locked
+//! in: each pass calls only that backend. It is probed again when the backend has failed a number of passes in a row,
+//! or no longer applies to the session, e.g. when ksmserver registers late at login.
+//!
+//! The backends are callbacks, so that this holds no session state of its own. It is used from the main loop thread.
+//!
+class IdleBackendSelector
+{
+public:
+    //!
+    //! \brief One idle time backend.
+    //!
+    struct Backend
+    {
+        //! \brief Name, as used by the backend_call USDT probe, e.g. "gnome_mutter_dbus".
+        std::string name;
+
+        //! \brief Only selected if no other backend works, e.g. the logind IdleHint.
+        bool last_resort = false;
+
+        //! \brief Whether the backend applies to the current session.
+        std::function<bool()> is_candidate;
+
+        //! \brief Starts any asynchronous query the read needs, without waiting. May be empty.
+        std::function<void()> start_query;
+
+        //! \brief Reads the idle time in seconds, -1 on error.
+        std::function<int64_t()> read;
+
+        //!
+        //! \brief Whether the backend currently reports its idle transitions as events, so that the main loop need not
+        //! poll it. May be empty, for a backend that is always polled.
+        //!
+        std::function<bool()> is_event_driven;
+
+        //!
+        //! \brief Whether the events of the event driven backend include each idle level it was given, e.g. the
+        //! throttle tiers, and the input above the first. The logind IdleHint only reports the desktop's own timeout.
+        //!
+        bool reports_levels = false;
+    };
+
+    //!
+    //! \brief Result of probing one backend.
+    //!
+    struct ProbeResult
+    {
+        std::string name;
+        bool candidate = false;
+        bool valid = false;
+        bool last_resort = false;
+        int64_t latency_us = -1;
+        int64_t idle_seconds = -1;
+    };
+
+    //!
+    //! \brief Constructor
+    //! \param max_failures consecutive failed passes of the selected backend before a re-probe. At least 1.
+    //! \param probe_samples calls per backend in a probe. The median latency is used. At least 1.
+    //!
+    explicit IdleBackendSelector(int max_failures = DEFAULT_MAX_FAILURES, int probe_samples = DEFAULT_PROBE_SAMPLES);
+
+    //! \brief Adds a backend. Registration order is the preference between backends of about the same latency.
+    void AddBackend(Backend backend);
+
+    //!
+    //! \brief Sets the function that waits for the queries started by start_query, e.g. SessionBus::WaitForQueries().
+    //!
+    void SetWaitForQueries(std::function<void()> wait_for_queries);
+
+    //!
+    //! \brief Sets the clock for the latency measurements, in microseconds. The default is the steady clock.
+    //!
+    void SetClock(std::function<int64_t()> now_us);
+
+    //!
+    //! \brief Sets the function called after each probe, e.g. to log and write the status.
+    //!
+    void SetProbeCallback(std::function<void(const IdleBackendSelector&)> on_probe);
+
+    //! \brief Sets the consecutive failures before a re-probe.
+    void SetMaxFailures(int max_failures);
+
+    //!
+    //! \brief Probes every backend and selects one.
+    //! \return true if a backend was selected.
+    //!
+    bool Probe();
+
+    //!
+    //! \brief Starts the pass: probes if there is no selection yet, or the selected backend no longer applies, and
+    //! starts the selected backend's query.
+    //!
+    void StartPass();
+
+    //!
+    //! \brief Reads the idle time from the selected backend. A failure counts towards the re-probe. On the failure that
+    //! reaches max_failures, the backends are probed again and the new selection's probed value is returned.
+    //! \return idle time in seconds, or -1 on error or with no backend selected.
+    //!
+    int64_t GetIdleSeconds();
+
+    //! \brief Whether a backend is selected.
+    bool HasSelection() const;
+
+    //! \brief Name of the selected backend, or "none".
+    const char* GetSelectedName() const;
+
+    //! \brief Whether a backend is selected and reports its idle transitions as events.
+    bool IsSelectedEventDriven() const;
+
+    //! \brief Whether the selected backend is event driven and reports the crossing of each of its idle levels.
+    bool IsSelectedReportingLevels() const;
+
+    //! \brief Results of the last probe, in registration order.
+    const std::vector<ProbeResult>& GetProbeResults() const;
+
+    //! \brief Number of probes run.
+    uint64_t GetProbeCount() const;
+
+    //! \brief Consecutive failures of the selected backend.
+    int GetConsecutiveFailures() const;
+
+    //!
+    //! \brief Renders the selection and the last probe's results as key=value lines, the format of the config files.
+    //!
+    std::string StatusToString() const;
+
+    //! \brief Default consecutive failures before a re-probe.
+    static constexpr int DEFAULT_MAX_FAILURES = 3;
+
+    //! \brief Default calls per backend in a probe.
+    static constexpr int DEFAULT_PROBE_SAMPLES = 3;
+
+    //! \brief Latency difference, in microseconds, below which the first registered backend is preferred.
+    static constexpr int64_t LATENCY_MARGIN_US = 100;
+
+private:
+    std::vector<Backend> m_backends;
+    std::vector<ProbeResult> m_probe_results;
+    std::function<void()> m_wait_for_queries;
+    std::function<int64_t()> m_now_us;
+    std::function<void(const IdleBackendSelector&)> m_on_probe;
+
+    int m_max_failures;
+    int m_probe_samples;
+
+    //! \brief Index of the selected backend, -1 if none.
+    int m_selected;
+
+    int m_consecutive_failures;
+    uint64_t m_probe_count;
+
+    //! \brief Probes one backend.
+    ProbeResult ProbeBackend(const Backend& backend);
+};
+
+#endif // IDLE_BACKEND_SELECTOR_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <idle_check_scheduler.h>
+#include <util.h>
+
+#include <algorithm>
+
+namespace {
+
+//! \brief Wait histogram bucket upper bounds, in milliseconds.
+const std::vector<int64_t>& WaitMillisecondBounds()
+{
+    static const std::vector<int64_t> bounds = {
+        1, 5, 10, 25, 50, 100, 250, 500,
+        1000, 2500, 5000, 10000, 30000, 60000, 300000
+    };
+
+    return bounds;
+}
+
+//! \brief Detection latency histogram bucket upper bounds, in milliseconds. The latencies are whole seconds.
+const std::vector<int64_t>& LatencyMillisecondBounds()
+{
+    static const std::vector<int64_t> bounds = {
+        0, 1000, 2000, 3000, 5000, 10000, 30000, 60000
+    };
+
+    return bounds;
+}
+
+} // namespace
+
+IdleCheckScheduler::IdleCheckScheduler(int64_t min_interval_ms, int64_t max_interval_ms)
+    : m_min_interval_ms(1)
+    , m_max_interval_ms(1)
+    , m_threshold_seconds(0)
+    , m_wait_ms(WaitMillisecondBounds())
+    , m_idle_latency_ms(LatencyMillisecondBounds())
+    , m_active_latency_ms(LatencyMillisecondBounds())
+{
+    SetBounds(min_interval_ms, max_interval_ms);
+}
+
+void IdleCheckScheduler::SetBounds(int64_t min_interval_ms, int64_t max_interval_ms)
+{
+    m_min_interval_ms = std::max<int64_t>(min_interval_ms, 1);
+    m_max_interval_ms = std::max(max_interval_ms, m_min_interval_ms);
+}
+
+void IdleCheckScheduler::SetThreshold(int64_t threshold_seconds)
+{
+    m_threshold_seconds = threshold_seconds;
+}
+
+int64_t IdleCheckScheduler::GetNextWaitMs(int64_t idle_seconds, bool event_driven) const
+{
+    if (idle_seconds < 0) {
+        return std::clamp(UNKNOWN_IDLE_RETRY_MS, m_min_interval_ms, m_max_interval_ms);
+    }
+
+    if (idle_seconds >= m_threshold_seconds) {
+        return event_driven ? m_max_interval_ms : m_min_interval_ms;
+    }
+
+    // One second early, so that the last active time sent to event_detect is refreshed before event_detect could see
+    // the session as idle, and so that the crossing itself is caught at the minimum interval.
+    int64_t until_threshold_ms = (m_threshold_seconds - idle_seconds - 1) * 1000;
+
+    return std::clamp(until_threshold_ms, m_min_interval_ms, m_max_interval_ms);
+}
+
+void IdleCheckScheduler::RecordWakeup(int64_t waited_ms, bool by_event)
+{
+    if (by_event) {
+        m_event_wakeups.Increment();
+    } else {
+        m_timeout_wakeups.Increment();
+    }
+
+    m_wait_ms.Observe(waited_ms);
+}
+
+void IdleCheckScheduler::RecordTransition(bool to_idle, int64_t idle_seconds)
+{
+    if (to_idle) {
+        m_idle_latency_ms.Observe(std::max<int64_t>(idle_seconds - m_threshold_seconds, 0) * 1000);
+    } else {
+        m_active_latency_ms.Observe(std::max<int64_t>(idle_seconds, 0) * 1000);
+    }
+}
+
+uint64_t IdleCheckScheduler::GetEventWakeups() const
+{
+    return m_event_wakeups.Get();
+}
+
+uint64_t IdleCheckScheduler::GetTimeoutWakeups() const
+{
+    return m_timeout_wakeups.Get();
+}
+
+const MetricHistogram& IdleCheckScheduler::GetWaitHistogram() const
+{
+    return m_wait_ms;
+}
+
+const MetricHistogram& IdleCheckScheduler::GetIdleLatencyHistogram() const
+{
+    return m_idle_latency_ms;
+}
+
+const MetricHistogram& IdleCheckScheduler::GetActiveLatencyHistogram() const
+{
+    return m_active_latency_ms;
+}
+
+void IdleCheckScheduler::LogSummary() const
+{
+    normal_log("INFO: %s: %llu wakeups by event, %llu by timeout, wait p50 %.0f ms, p95 %.0f ms",
+               __func__,
+               GetEventWakeups(),
+               GetTimeoutWakeups(),
+               m_wait_ms.Quantile(0.50),
+               m_wait_ms.Quantile(0.95));
+
+    normal_log("INFO: %s: detection latency: %llu idle transitions, p50 %.0f ms, p95 %.0f ms; "
+               "%llu active transitions, p50 %.0f ms, p95 %.0f ms",
+               __func__,
+               m_idle_latency_ms.GetCount(),
+               m_idle_latency_ms.Quantile(0.50),
+               m_idle_latency_ms.Quantile(0.95),
+               m_active_latency_ms.GetCount(),
+               m_active_latency_ms.Quantile(0.50),
+               m_active_latency_ms.Quantile(0.95));
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef IDLE_CHECK_SCHEDULER_H
+#define IDLE_CHECK_SCHEDULER_H
+
+#include <metrics.h>
+
+#include <cstdint>
+
+//!
+//! \brief The IdleCheckScheduler class sets how long the idle_detect main loop waits before the next pass, from the idle
+//! time of the last one. The idle time grows by at most one second per second, so while active the next pass can wait
+//! until one second before the threshold could be reached. While idle, the sources that must be polled are checked
+//! every min_interval_ms, so that the resume is seen at once. The sources that report transitions as events are left to
+//! wake the main loop.
+//!
+//! It also measures the wakeups and the transition detection latency. It is used from the main loop thread.
+//!
+class IdleCheckScheduler
+{
+public:
+    //!
+    //! \brief Constructor
+    //! \param min_interval_ms shortest wait, used while idle by sources that must be polled and near the threshold.
+    //! \param max_interval_ms longest wait.
+    //!
+    explicit IdleCheckScheduler(int64_t min_interval_ms = DEFAULT_MIN_INTERVAL_MS,
+                                int64_t max_interval_ms = DEFAULT_MAX_INTERVAL_MS);
+
+    //! \brief Sets the interval bounds. The minimum is at least 1 ms and the maximum at least the minimum.
+    void SetBounds(int64_t min_interval_ms, int64_t max_interval_ms);
+
+    //! \brief Sets the idle threshold, inactivity_time_trigger, in seconds.
+    void SetThreshold(int64_t threshold_seconds);
+
+    //!
+    //! \brief Provides the wait before the next pass.
+    //! \param idle_seconds idle time of the last pass, before any control override. Negative if it was not determined.
+    //! \param event_driven whether every source of the pass reports its transitions as events.
+    //! \return wait in milliseconds, within the bounds.
+    //!
+    int64_t GetNextWaitMs(int64_t idle_seconds, bool event_driven) const;
+
+    //!
+    //! \brief Records the end of a wait.
+    //! \param waited_ms actual wait in milliseconds.
+    //! \param by_event true if an event ended the wait, false for the timeout.
+    //!
+    void RecordWakeup(int64_t waited_ms, bool by_event);
+
+    //!
+    //! \brief Records a transition detected by a pass. To idle, the latency is the idle time past the threshold. To
+    //! active, it is the idle time reported at the resume, i.e. the time since the input. Both have the one second
+    //! resolution of the idle sources.
+    //! \param to_idle
+    //! \param idle_seconds effective idle time of the pass.
+    //!
+    void RecordTransition(bool to_idle, int64_t idle_seconds);
+
+    //! \brief Wakeups ended by an event.
+    uint64_t GetEventWakeups() const;
+
+    //! \brief Wakeups ended by the timeout.
+    uint64_t GetTimeoutWakeups() const;
+
+    //! \brief Wait durations, in milliseconds.
+    const MetricHistogram& GetWaitHistogram() const;
+
+    //! \brief Idle transition detection latency, in milliseconds.
+    const MetricHistogram& GetIdleLatencyHistogram() const;
+
+    //! \brief Active transition detection latency, in milliseconds.
+    const MetricHistogram& GetActiveLatencyHistogram() const;
+
+    //! \brief Logs the wakeup counts and the wait and latency quantiles.
+    void LogSummary() const;
+
+    //! \brief Default shortest wait.
+    static constexpr int64_t DEFAULT_MIN_INTERVAL_MS = 250;
+
+    //! \brief Default longest wait.
+    static constexpr int64_t DEFAULT_MAX_INTERVAL_MS = 60000;
+
+    //! \brief Wait after a pass that could not determine the idle time.
+    static constexpr int64_t UNKNOWN_IDLE_RETRY_MS = 1000;
+
+    //! \brief Interval between the LogSummary() reports of the main loop, in seconds.
+    static constexpr int REPORT_INTERVAL_SECONDS = 3600;
+
+private:
+    int64_t m_min_interval_ms;
+    int64_t m_max_interval_ms;
+    int64_t m_threshold_seconds;
+
+    MetricCounter m_event_wakeups;
+    MetricCounter m_timeout_wakeups;
+    MetricHistogram m_wait_ms;
+    MetricHistogram m_idle_latency_ms;
+    MetricHistogram m_active_latency_ms;
+};
+
+#endif // IDLE_CHECK_SCHEDULER_H
@@ -5,11 +5,21 @@
  */
 
 #include <idle_detect.h>
+#include <idle_backend_selector.h>
+#include <idle_check_scheduler.h>
+#include <command_executor.h>
+#include <boinc_rpc.h>
+#include <cgroup_freezer.h>
+#include <cgroup_throttle.h>
+#include <logger.h>
+#include <probes.h>
+#include <shmem.h>
 #include <optional>
 #include <util.h> // Includes tinyformat.h, filesystem, etc.
 #include <release.h>
 
 // Standard Libs
+#include <algorithm>   // For std::min, std::max
 #include <cstdlib>     // For getenv(), system()
 #include <cstdint>     // For int64_t, uint64_t
 #include <cstring>     // For strcmp, strerror
@@ -22,17 +32,19 @@
 #include <variant>     // For std::get
 #include <cerrno>      // For errno
 #include <future>      // For std::async in Stop() timeout
+#include <iterator>    // For std::size
+#include <limits>      // For std::numeric_limits
 #include <filesystem> // Needed for first-run config copy logic
 
 // Platform Specific Libs
-#include <X11/Xlib.h>
-#include <X11/extensions/scrnsaver.h>
+#include <x11_idle_monitor.h> // Xlib, XSync and XScreenSaver
 #include <unistd.h>    // For pipe, read, write, close, getenv, sleep
 #include <sys/types.h> // Usually included by others
 #include <sys/mman.h>   // For mmap, munmap, shm_open
 #include <sys/stat.h>   // For mode constants with shm_open
 #include <sys/wait.h>  // Usually included by others
 #include <poll.h>      // For poll()
+#include <sys/eventfd.h> // For eventfd()
 #include <fcntl.h>     // For O_NONBLOCK, O_CLOEXEC
 #include <wayland-client.h>
 #include "ext-idle-notify-v1-protocol.h" // Generated header
@@ -50,14 +62,56 @@ IdleDetect::IdleDetectControlMonitor g_idle_detect_control_monitor;
 //! Global idle_detect event monitor singleton for Wayland idle detection for non-KDE, non-GNOME sessions
 IdleDetect::WaylandIdleMonitor g_wayland_idle_monitor;
 
+//! Global session bus connection singleton for the D-Bus idle time and inhibition queries
+IdleDetect::SessionBus g_session_bus;
+
+//! Global X display connection singleton for the X11 idle time
+X11IdleMonitor g_x11_idle_monitor;
+
+//! Global system bus singleton for the systemd-logind session IdleHint, the last resort idle source
+IdleDetect::LogindIdleMonitor g_logind_idle_monitor;
+
+//! Global selector singleton for the idle backend GetIdleTimeSeconds() uses
+IdleBackendSelector g_idle_backend_selector;
+
+//! Global idle check scheduler singleton for the main loop's wait between passes
+IdleCheckScheduler g_idle_check_scheduler;
+
+//! Global command executor singleton for the serialized active and idle commands
+CommandExecutor g_command_executor;
+
+//! Global BOINC GUI RPC client singleton for the run mode changes with use_boinc_rpc
+BoincRpcClient g_boinc_rpc_client;
+
+//! Global cgroup freezer singleton for the DC workload pause with freeze_cgroup
+CgroupFreezer g_cgroup_freezer;
+
+//! Global cgroup throttle singleton for the DC workload throttle tiers with throttle_cgroup
+CgroupThrottle g_cgroup_throttle;
+
 //! Global flag for signal handling
 std::atomic<bool> g_shutdown_requested = false;
 
+//! Last signal received, 0 if none since it was logged. Logged by the main loop, since logging is not async-signal-safe
+std::atomic<int> g_received_signal = 0;
+
 //! Global flag for exit code
 std::atomic<int> g_exit_code;
 
-const int MAX_X_CONNECT_RETRIES = 6;  // e.g., 6 attempts
-const int X_RETRY_DELAY_MS = 500;     // e.g., 500ms between attempts (~3 sec total)
+//! Longest a pass waits for the D-Bus idle and inhibition query replies, in milliseconds
+const int DBUS_QUERY_DEADLINE_MS = 250;
+
+//! eventfd written by the SIGINT/SIGTERM handler, so that the main loop's poll() returns for the shutdown
+int g_shutdown_wakeup_fd = -1;
+
+//! Capacity reserved for the main loop's poll() fds: its own, and those of the session bus and logind GMainContexts
+const size_t MAIN_LOOP_POLL_FDS_RESERVED = 16;
+
+//! Longest wait at shutdown for a running active or idle command to finish, in milliseconds
+const int64_t COMMAND_SHUTDOWN_WAIT_MS = 5000;
+
+//! Default throttle tiers: active at 25% of the CPUs with low weights, 50% after a minute, unthrottled after 15 minutes
+const char* const DEFAULT_THROTTLE_TIERS = "0:25:10:10,60:50:50:50,900:100:100:100";
 
 //! \brief Function to safely get XDG_RUNTIME_DIR environment variable.
 std::optional<std::string> GetXdgRuntimeDir() {
@@ -145,6 +199,21 @@ void IdleDetectConfig::ProcessArgs()
                   execute_dc_control_scripts_arg);
     }
 
+    // pipe_send_timestamps
+
+    std::string pipe_send_timestamps_arg = GetArgString("pipe_send_timestamps", "false");
+
+    if (pipe_send_timestamps_arg == "1" || ToLower(pipe_send_timestamps_arg) == "true") {
+        m_config.insert(std::make_pair("pipe_send_timestamps", true));
+    } else if (pipe_send_timestamps_arg == "0" || ToLower(pipe_send_timestamps_arg) == "false") {
+        m_config.insert(std::make_pair("pipe_send_timestamps", false));
+    } else {
+        error_log("%s: pipe_send_timestamps parameter in config file has invalid value: %s",
+                  __func__,
+                  pipe_send_timestamps_arg);
+        m_config.insert(std::make_pair("pipe_send_timestamps", false));
+    }
+
     // last_active_time_cpp_filename
 
     std::string last_active_time_cpp_filename = GetArgString("last_active_time_cpp_filename", "last_active_time.dat");
@@ -169,6 +238,232 @@ void IdleDetectConfig::ProcessArgs()
 
     m_config.insert(std::make_pair("inactivity_time_trigger", inactivity_time_trigger));
 
+    // backend_reprobe_failures
+
+    int backend_reprobe_failures = IdleBackendSelector::DEFAULT_MAX_FAILURES;
+
+    try {
+        backend_reprobe_failures = ParseStringToInt(GetArgString("backend_reprobe_failures",
+                                                                 std::to_string(IdleBackendSelector::DEFAULT_MAX_FAILURES)));
+    } catch (std::exception& e) {
+        error_log("%s: backend_reprobe_failures parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (backend_reprobe_failures < 1) {
+        error_log("%s: backend_reprobe_failures parameter in config file must be at least 1; using 1.",
+                  __func__);
+
+        backend_reprobe_failures = 1;
+    }
+
+    m_config.insert(std::make_pair("backend_reprobe_failures", backend_reprobe_failures));
+
+    // min_check_interval_ms
+
+    int min_check_interval_ms = static_cast<int>(IdleCheckScheduler::DEFAULT_MIN_INTERVAL_MS);
+
+    try {
+        min_check_interval_ms = ParseStringToInt(GetArgString("min_check_interval_ms",
+                                                              std::to_string(min_check_interval_ms)));
+    } catch (std::exception& e) {
+        error_log("%s: min_check_interval_ms parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (min_check_interval_ms < 10 || min_check_interval_ms > 1000) {
+        error_log("%s: min_check_interval_ms parameter in config file must be between 10 and 1000; using %i.",
+                  __func__,
+                  std::clamp(min_check_interval_ms, 10, 1000));
+
+        min_check_interval_ms = std::clamp(min_check_interval_ms, 10, 1000);
+    }
+
+    m_config.insert(std::make_pair("min_check_interval_ms", min_check_interval_ms));
+
+    // max_check_interval_seconds
+
+    int max_check_interval_seconds = static_cast<int>(IdleCheckScheduler::DEFAULT_MAX_INTERVAL_MS / 1000);
+
+    try {
+        max_check_interval_seconds = ParseStringToInt(GetArgString("max_check_interval_seconds",
+                                                                   std::to_string(max_check_interval_seconds)));
+    } catch (std::exception& e) {
+        error_log("%s: max_check_interval_seconds parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (max_check_interval_seconds < 1) {
+        error_log("%s: max_check_interval_seconds parameter in config file must be at least 1; using 1.",
+                  __func__);
+
+        max_check_interval_seconds = 1;
+    }
+
+    m_config.insert(std::make_pair("max_check_interval_seconds", max_check_interval_seconds));
+
+    // command_timeout_seconds
+
+    int command_timeout_seconds = static_cast<int>(CommandExecutor::DEFAULT_TIMEOUT_MS / 1000);
+
+    try {
+        command_timeout_seconds = ParseStringToInt(GetArgString("command_timeout_seconds",
+                                                                std::to_string(command_timeout_seconds)));
+    } catch (std::exception& e) {
+        error_log("%s: command_timeout_seconds parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (command_timeout_seconds < 1) {
+        error_log("%s: command_timeout_seconds parameter in config file must be at least 1; using 1.",
+                  __func__);
+
+        command_timeout_seconds = 1;
+    }
+
+    m_config.insert(std::make_pair("command_timeout_seconds", command_timeout_seconds));
+
+    // command_min_dwell_seconds
+
+    int command_min_dwell_seconds = static_cast<int>(CommandExecutor::DEFAULT_MIN_DWELL_MS / 1000);
+
+    try {
+        command_min_dwell_seconds = ParseStringToInt(GetArgString("command_min_dwell_seconds",
+                                                                  std::to_string(command_min_dwell_seconds)));
+    } catch (std::exception& e) {
+        error_log("%s: command_min_dwell_seconds parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (command_min_dwell_seconds < 0) {
+        error_log("%s: command_min_dwell_seconds parameter in config file must not be negative; using 0.",
+                  __func__);
+
+        command_min_dwell_seconds = 0;
+    }
+
+    m_config.insert(std::make_pair("command_min_dwell_seconds", command_min_dwell_seconds));
+
+    // use_boinc_rpc
+
+    std::string use_boinc_rpc_arg = GetArgString("use_boinc_rpc", "false");
+
+    if (use_boinc_rpc_arg == "1" || ToLower(use_boinc_rpc_arg) == "true") {
+        m_config.insert(std::make_pair("use_boinc_rpc", true));
+    } else if (use_boinc_rpc_arg == "0" || ToLower(use_boinc_rpc_arg) == "false") {
+        m_config.insert(std::make_pair("use_boinc_rpc", false));
+    } else {
+        error_log("%s: use_boinc_rpc parameter in config file has invalid value: %s",
+                  __func__,
+                  use_boinc_rpc_arg);
+    }
+
+    // boinc_rpc_port
+
+    int boinc_rpc_port = BoincRpcClient::DEFAULT_PORT;
+
+    try {
+        boinc_rpc_port = ParseStringToInt(GetArgString("boinc_rpc_port", std::to_string(boinc_rpc_port)));
+    } catch (std::exception& e) {
+        error_log("%s: boinc_rpc_port parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (boinc_rpc_port < 1 || boinc_rpc_port > 65535) {
+        error_log("%s: boinc_rpc_port parameter in config file must be between 1 and 65535; using %i.",
+                  __func__,
+                  BoincRpcClient::DEFAULT_PORT);
+
+        boinc_rpc_port = BoincRpcClient::DEFAULT_PORT;
+    }
+
+    m_config.insert(std::make_pair("boinc_rpc_port", boinc_rpc_port));
+
+    // freeze_cgroup
+
+    m_config.insert(std::make_pair("freeze_cgroup", GetArgString("freeze_cgroup", "")));
+
+    // freeze_confirm_timeout_ms
+
+    int freeze_confirm_timeout_ms = CgroupFreezer::DEFAULT_CONFIRM_TIMEOUT_MS;
+
+    try {
+        freeze_confirm_timeout_ms = ParseStringToInt(GetArgString("freeze_confirm_timeout_ms",
+                                                                  std::to_string(freeze_confirm_timeout_ms)));
+    } catch (std::exception& e) {
+        error_log("%s: freeze_confirm_timeout_ms parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (freeze_confirm_timeout_ms < 1 || freeze_confirm_timeout_ms > 5000) {
+        error_log("%s: freeze_confirm_timeout_ms parameter in config file must be between 1 and 5000; using %i.",
+                  __func__,
+                  std::clamp(freeze_confirm_timeout_ms, 1, 5000));
+
+        freeze_confirm_timeout_ms = std::clamp(freeze_confirm_timeout_ms, 1, 5000);
+    }
+
+    m_config.insert(std::make_pair("freeze_confirm_timeout_ms", freeze_confirm_timeout_ms));
+
+    // throttle_cgroup
+
+    m_config.insert(std::make_pair("throttle_cgroup", GetArgString("throttle_cgroup", "")));
+
+    // throttle_tiers
+
+    m_config.insert(std::make_pair("throttle_tiers", GetArgString("throttle_tiers", DEFAULT_THROTTLE_TIERS)));
+
+    // throttle_hysteresis_seconds
+
+    int throttle_hysteresis_seconds = static_cast<int>(CgroupThrottle::DEFAULT_HYSTERESIS_SECONDS);
+
+    try {
+        throttle_hysteresis_seconds = ParseStringToInt(GetArgString("throttle_hysteresis_seconds",
+                                                                    std::to_string(throttle_hysteresis_seconds)));
+    } catch (std::exception& e) {
+        error_log("%s: throttle_hysteresis_seconds parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (throttle_hysteresis_seconds < 0) {
+        error_log("%s: throttle_hysteresis_seconds parameter in config file must not be negative; using 0.",
+                  __func__);
+
+        throttle_hysteresis_seconds = 0;
+    }
+
+    m_config.insert(std::make_pair("throttle_hysteresis_seconds", throttle_hysteresis_seconds));
+
+    // throttle_ramp_seconds
+
+    int throttle_ramp_seconds = static_cast<int>(CgroupThrottle::DEFAULT_RAMP_MS / 1000);
+
+    try {
+        throttle_ramp_seconds = ParseStringToInt(GetArgString("throttle_ramp_seconds",
+                                                              std::to_string(throttle_ramp_seconds)));
+    } catch (std::exception& e) {
+        error_log("%s: throttle_ramp_seconds parameter in config file has invalid value: %s",
+                  __func__,
+                  e.what());
+    }
+
+    if (throttle_ramp_seconds < 0) {
+        error_log("%s: throttle_ramp_seconds parameter in config file must not be negative; using 0.",
+                  __func__);
+
+        throttle_ramp_seconds = 0;
+    }
+
+    m_config.insert(std::make_pair("throttle_ramp_seconds", throttle_ramp_seconds));
+
     // active_command
 
     m_config.insert(std::make_pair("active_command", GetArgString("active_command", "")));
@@ -186,11 +481,6 @@ namespace IdleDetect {
 //!
 int DEFAULT_IDLE_THRESHOLD_SECONDS = 0;
 
-//!
-//! \brief DEFAULT_CHECK_INTERVAL_SECONDS is set at 1 second and is not configurable.
-//!
-constexpr int DEFAULT_CHECK_INTERVAL_SECONDS = 1;
-
 //!
 //! \brief Helper function to determine whether GUI session is Wayland.
 //! \return true if GUI session is Wayland.
@@ -240,46 +530,17 @@ static int64_t ReadLastActiveTimeFile(const fs::path& file_path) {
 //! \return
 //!
 static int64_t ReadTimestampViaShmem(const std::string& shm_name) {
-    if (shm_name.empty() || shm_name[0] != '/') {
-        error_log("%s: Invalid shared memory name provided: %s", __func__, shm_name.c_str());
-        return -1;
-    }
     debug_log("INFO: %s: Attempting to read timestamp from shm: %s", __func__, shm_name.c_str());
 
-    const size_t shmem_size = sizeof(int64_t[2]);
-    int shm_fd = -1;
-    void* mapped_mem = MAP_FAILED;
-    int64_t* shm_ptr = nullptr;
+    int64_t update_time = -1;
     int64_t last_active_timestamp = -1;
 
-    errno = 0;
-    shm_fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
-    if (shm_fd == -1) {
-        if (errno != ENOENT) {
-            error_log("%s: shm_open(RO) failed for '%s': %s (%d)", __func__, shm_name.c_str(), strerror(errno), errno);
-        }
-        else { debug_log("INFO: %s: Shared memory '%s' not found (ENOENT).", __func__, shm_name.c_str()); }
-        return -1;
-    }
-
-    errno = 0;
-    mapped_mem = mmap(nullptr, shmem_size, PROT_READ, MAP_SHARED, shm_fd, 0);
-    close(shm_fd);
-
-    if (mapped_mem == MAP_FAILED) {
-        error_log("%s: mmap(RO) failed for shm '%s': %s (%d)", __func__, shm_name.c_str(), strerror(errno), errno);
+    if (!ReadSharedMemoryTimestamps(shm_name, update_time, last_active_timestamp)) {
         return -1;
     }
 
-    shm_ptr = static_cast<int64_t*>(mapped_mem);
-    last_active_timestamp = shm_ptr[1]; // Read index [1]
     debug_log("INFO: %s: Read last_active %lld from shm %s", __func__, (int64_t)last_active_timestamp, shm_name.c_str());
 
-    errno = 0;
-    if (munmap(mapped_mem, shmem_size) == -1) {
-        normal_log("WARN: %s: munmap failed for shm '%s': %s (%d)", __func__, shm_name.c_str(), strerror(errno), errno);
-    }
-
     return last_active_timestamp;
 }
 
@@ -288,43 +549,57 @@ static int64_t ReadTimestampViaShmem(const std::string& shm_name) {
  *
  * @param pipe_path The full path to the event_detect named pipe.
  * @param the last active time to send to event_detect
+ * @param event_type
+ * @param send_timestamp whether to append the send time in microseconds for event_detect latency tracing. Requires
+ * an event_detect that accepts the optional third field.
  */
 void SendPipeNotification(const std::filesystem::path& pipe_path,
                           const int64_t& last_active_time,
-                          const EventMessage::EventType& event_type = EventMessage::EventType::USER_ACTIVE) {
+                          const EventMessage::EventType& event_type = EventMessage::EventType::USER_ACTIVE,
+                          bool send_timestamp = false) {
     // Construct the message payload using EventMessage format
     EventMessage msg(last_active_time, event_type);
+
+    if (send_timestamp) {
+        msg.m_send_time_us = GetUnixEpochTimeMicros();
+    }
+
     if (!msg.IsValid()) {
         error_log("%s: Failed to construct valid EventMessage.",
                   __func__);
         return;
     }
 
-    std::string message_str = msg.ToString() + "\n"; // Add newline for pipe message termination
+    // The message is formatted into a stack buffer and written with POSIX calls rather than through an ofstream, so
+    // that sending does not allocate.
+    char message[EventMessage::MAX_CHARS + 1];
+    size_t message_size = msg.ToChars(message, EventMessage::MAX_CHARS);
+
+    message[message_size++] = '\n'; // Add newline for pipe message termination
 
     debug_log("INFO: %s: Attempting to send message: %s",
               __func__,
-              TrimString(message_str));
+              std::string_view(message, message_size - 1));
+
+    struct stat pipe_stat;
 
-    std::error_code error_code;
-    if (!std::filesystem::exists(pipe_path, error_code) || error_code) {
+    if (stat(pipe_path.c_str(), &pipe_stat) != 0) {
         error_log("%s: Pipe '%s' does not exist or cannot be accessed. Is event_detect running?",
                   __func__,
                   pipe_path);
         return;
     }
 
-    if (!std::filesystem::is_fifo(pipe_path, error_code) || error_code) {
+    if (!S_ISFIFO(pipe_stat.st_mode)) {
         error_log("%s: Path '%s' is not a named pipe (FIFO).",
                   __func__,
                   pipe_path);
         return;
     }
 
-    // variable_name is snake_case
-    std::ofstream pipe_stream(pipe_path, std::ios::out);
+    int pipe_fd = open(pipe_path.c_str(), O_WRONLY | O_CLOEXEC);
 
-    if (!pipe_stream.is_open()) {
+    if (pipe_fd < 0) {
         error_log("%s: Failed to open pipe '%s' for writing: %s",
                   __func__,
                   pipe_path,
@@ -332,10 +607,11 @@ void SendPipeNotification(const std::filesystem::path& pipe_path,
         return;
     }
 
-    pipe_stream << message_str;
-    pipe_stream.flush();
+    ssize_t bytes_written = write(pipe_fd, message, message_size);
 
-    if (pipe_stream.fail()) {
+    close(pipe_fd);
+
+    if (bytes_written != static_cast<ssize_t>(message_size)) {
         error_log("%s: Failed to write message to pipe '%s'. Pipe full or other error?",
                   __func__,
                   pipe_path);
@@ -360,475 +636,324 @@ static bool IsTtySession() {
 }
 
 //!
-//! \brief Helper function to get idle time from KDE DBus interface for KDE sessions, either X or Wayland.
+//! \brief Helper function to get idle time from KDE DBus interface for KDE sessions, either X or Wayland. This reads the
+//! reply to the asynchronous org.kde.ksmserver GetSessionIdleTime query started by GetIdleTimeSeconds().
 //! \return int64_t idle time in seconds. -1 for error.
 //!
 static int64_t GetIdleTimeKdeDBus() {
-    debug_log("INFO: %s: Querying org.kde.ksmserver GetSessionIdleTime via D-Bus.", __func__);
-
-    GDBusConnection* connection = nullptr;
-    GError* dbus_error = nullptr;
-    GVariant* dbus_result = nullptr;
-    int64_t idle_time_seconds = -1; // Default to error/unknown
-
-    connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &dbus_error);
-    if (!connection) {
-        if (dbus_error) {
-            error_log("%s: Failed to connect to session bus for KDE idle query: %s", __func__, dbus_error->message);
-            g_error_free(dbus_error);
-        } else {
-            error_log("%s: Failed to connect to session bus for KDE idle query (unknown error).", __func__);
-        }
-        return -1; // Return error
-    }
-
-    const char* service_name = "org.kde.ksmserver";
-    const char* object_path = "/ScreenSaver"; // As determined by user testing
-    const char* interface_name = "org.freedesktop.ScreenSaver";
-    const char* method_name = "GetSessionIdleTime";
-
-    dbus_result = g_dbus_connection_call_sync(connection,
-                                              service_name, object_path, interface_name, method_name,
-                                              nullptr, // No input parameters
-                                              G_VARIANT_TYPE("(u)"), // Expect uint32 reply type 'u'
-                                              G_DBUS_CALL_FLAGS_NONE,
-                                              5000, // Timeout 5 sec — ksmserver can be slow to register at login
-                                              nullptr, // Cancellable
-                                              &dbus_error);
-
-    if (dbus_error) {
-        // Error during D-Bus call
-        error_log("%s: Error calling %s on %s: %s", __func__, method_name, interface_name, dbus_error->message);
-        g_error_free(dbus_error);
-        idle_time_seconds = -1; // Error
-    } else if (dbus_result) {
-        // Call succeeded, unpack the result
-        uint32_t idle_time_ms = 0; // <--- FIX: Use uint32_t to store result
-        g_variant_get(dbus_result, "(u)", &idle_time_ms); // <--- FIX: Unpack type 'u'
-
-        // Convert milliseconds to seconds
-        idle_time_seconds = static_cast<int64_t>(idle_time_ms / 1000);
-
-        // FIX: Use %u format specifier for uint32_t in log message
-        debug_log("INFO: %s: ksmserver GetSessionIdleTime reported: %u ms (%lld seconds)",
+    bool stale = false;
+    int64_t idle_time_seconds = g_session_bus.GetIdleSeconds(SessionBus::KDE_KSMSERVER, stale);
+
+    if (idle_time_seconds < 0) {
+        error_log("%s: No idle time from org.kde.ksmserver GetSessionIdleTime.", __func__);
+    } else if (stale) {
+        debug_log("INFO: %s: ksmserver GetSessionIdleTime reply is late, using the last known value aged to "
+                  "%lld seconds (stale).",
                   __func__,
-                  idle_time_ms, // Pass uint32_t directly
-                  (int64_t)idle_time_seconds); // Cast int64_t for %lld
-
-        g_variant_unref(dbus_result); // Clean up reply variant
+                  idle_time_seconds);
     } else {
-        // Should not happen if error is null, but handle defensively
-        error_log("%s: Call to %s on %s returned no result and no error.", __func__, method_name, interface_name);
-        idle_time_seconds = -1; // Treat as error
+        debug_log("INFO: %s: ksmserver GetSessionIdleTime reported: %lld seconds",
+                  __func__,
+                  idle_time_seconds);
     }
 
-    g_object_unref(connection); // Clean up connection reference
     return idle_time_seconds;
 }
 
 //!
 //! \brief Checks for screen idle inhibition on KDE Plasma 6 via the PowerManagement PolicyAgent D-Bus interface.
 //! This is needed because ext_idle_notifier_v1 may not reflect D-Bus-level inhibitions (e.g. from video players
-//! using org.freedesktop.ScreenSaver.Inhibit). The HasInhibition(1) call checks for ChangeScreenSettings inhibitions
-//! (type 1), which prevent screen idle/blanking.
+//! using org.freedesktop.ScreenSaver.Inhibit). The state is HasInhibition(1), i.e. ChangeScreenSettings inhibitions
+//! (type 1), which prevent screen idle/blanking. It is tracked by g_session_bus from the InhibitionsChanged signal, so
+//! this makes no D-Bus call.
 //! \return true if screen idle is inhibited, false otherwise (including on D-Bus errors).
 //!
 static bool CheckKdeInhibition() {
-    debug_log("INFO: %s: Checking KDE screen idle inhibitions via PolicyAgent D-Bus HasInhibition.", __func__);
-
-    GDBusConnection* connection = nullptr;
-    GError* dbus_error = nullptr;
-    GVariant* dbus_result = nullptr;
-    bool is_inhibited = false;
-
-    connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &dbus_error);
-    if (!connection) {
-        if (dbus_error) {
-            debug_log("INFO: %s: Cannot connect to session bus for KDE inhibit check: %s", __func__, dbus_error->message);
-            g_error_free(dbus_error);
-        } else {
-            debug_log("INFO: %s: Cannot connect to session bus for KDE inhibit check (unknown error).", __func__);
-        }
-        return false;
-    }
-
-    const char* service_name = "org.kde.Solid.PowerManagement";
-    const char* object_path = "/org/kde/Solid/PowerManagement/PolicyAgent";
-    const char* interface_name = "org.kde.Solid.PowerManagement.PolicyAgent";
-    const char* method_name = "HasInhibition";
-
-    // Type 1 = ChangeScreenSettings (prevents screen idle/blanking)
-    guint32 inhibition_type = 1;
+    bool is_inhibited = g_session_bus.IsInhibited(SessionBus::KDE_POWER_MANAGEMENT);
 
-    dbus_result = g_dbus_connection_call_sync(connection,
-                                              service_name, object_path, interface_name, method_name,
-                                              g_variant_new("(u)", inhibition_type),
-                                              G_VARIANT_TYPE("(b)"),
-                                              G_DBUS_CALL_FLAGS_NONE,
-                                              500, // Timeout (ms)
-                                              nullptr, &dbus_error);
+    debug_log("INFO: %s: KDE PolicyAgent screen idle inhibited: %s",
+              __func__, is_inhibited ? "true" : "false");
 
-    if (dbus_error) {
-        debug_log("INFO: %s: Error calling %s: %s (Perhaps not KDE or method unavailable?)",
-                  __func__, method_name, dbus_error->message);
-        g_error_free(dbus_error);
-        is_inhibited = false;
-    } else if (dbus_result) {
-        gboolean inhibited_result = FALSE;
-        g_variant_get(dbus_result, "(b)", &inhibited_result);
-        is_inhibited = (inhibited_result == TRUE);
-        debug_log("INFO: %s: PolicyAgent.HasInhibition(type=%u) returned: %s",
-                  __func__, inhibition_type, is_inhibited ? "true" : "false");
-        g_variant_unref(dbus_result);
-    } else {
-        error_log("%s: Call to %s returned null result without error.", __func__, method_name);
-        is_inhibited = false;
-    }
-
-    g_object_unref(connection);
     return is_inhibited;
 }
 
 //!
-//! \brief This helper function checks for idle inhibited on Gnome sessions and works for both Gnome X and Wayland.
-//! \return
+//! \brief This helper function checks for idle inhibited on Gnome sessions and works for both Gnome X and Wayland. The
+//! state is IsInhibited for the logout, user-switch, suspend and idle flags. It is tracked by g_session_bus from the
+//! InhibitorAdded and InhibitorRemoved signals, so this makes no D-Bus call.
+//! \return true if inhibited, false otherwise (including on non-GNOME sessions and D-Bus errors).
 //!
 static bool CheckGnomeInhibition() {
-    // This function assumes it might be called even if not strictly a GNOME session,
-    // relying on the D-Bus call to fail gracefully if the service/method isn't present.
-    debug_log("INFO: %s: Checking GNOME session inhibitions via D-Bus IsInhibited.", __func__);
-
-    GDBusConnection* connection = nullptr;
-    GError* dbus_error = nullptr;
-    GVariant* dbus_result = nullptr;
-    bool is_inhibited = false; // Default: not inhibited
-
-    connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &dbus_error);
-    if (!connection) {
-        if (dbus_error) {
-            // This error is expected on non-Gnome, log as debug
-            debug_log("INFO: %s: Cannot connect to session bus for GNOME inhibit check: %s", __func__, dbus_error->message);
-            g_error_free(dbus_error);
-        } else {
-            debug_log("INFO: %s: Cannot connect to session bus for GNOME inhibit check (unknown error).", __func__);
-        }
-        return false; // Cannot determine state, assume not inhibited
-    }
-
-    // Flags: 1=logout, 2=user-switch, 4=suspend, 8=idle. Check if any are active.
-    guint32 flags_to_check = 1 | 2 | 4 | 8; // = 15
-
-    const char* service_name = "org.gnome.SessionManager";
-    const char* object_path = "/org/gnome/SessionManager";
-    const char* interface_name = "org.gnome.SessionManager";
-    const char* method_name = "IsInhibited";
+    bool is_inhibited = g_session_bus.IsInhibited(SessionBus::GNOME_SESSION_MANAGER);
 
-    dbus_result = g_dbus_connection_call_sync(connection,
-                                              service_name, object_path, interface_name, method_name,
-                                              g_variant_new("(u)", flags_to_check), // Input flags
-                                              G_VARIANT_TYPE("(b)"), // Expect boolean reply
-                                              G_DBUS_CALL_FLAGS_NONE,
-                                              500, // Timeout (ms)
-                                              nullptr, &dbus_error);
-
-    if (dbus_error) {
-        // Method likely doesn't exist or failed - expected on non-Gnome/older Gnome
-        debug_log("INFO: %s: Error calling %s: %s (Perhaps not GNOME or method unavailable?)",
-                  __func__, method_name, dbus_error->message);
-        g_error_free(dbus_error);
-        is_inhibited = false; // Assume not inhibited if call fails
-    } else if (dbus_result) {
-        gboolean inhibited_result = FALSE;
-        g_variant_get(dbus_result, "(b)", &inhibited_result);
-        is_inhibited = (inhibited_result == TRUE);
-        debug_log("INFO: %s: org.gnome.SessionManager.IsInhibited(flags=%u) returned: %s",
-                  __func__, flags_to_check, is_inhibited ? "true" : "false");
-        g_variant_unref(dbus_result);
-    } else {
-        // Null result without error is strange
-        error_log("%s: Call to %s returned null result without error.", __func__, method_name);
-        is_inhibited = false; // Assume not inhibited
-    }
+    debug_log("INFO: %s: GNOME session inhibited: %s",
+              __func__, is_inhibited ? "true" : "false");
 
-    g_object_unref(connection);
     return is_inhibited;
 }
 
 //!
 //! \brief This is the D-Bus implementation for Gnome Mutter. Note that it does NOT take into account
-//! idle inhibit, unlike the corresponding KDE D-Bus call.
+//! idle inhibit, unlike the corresponding KDE D-Bus call. This reads the idle state g_session_bus tracks from its
+//! Mutter IdleMonitor idle and user active watches, or, where the watches are unavailable, the reply to the
+//! asynchronous GetIdletime query started by GetIdleTimeSeconds().
 //! \return int64_t idle time in seconds. -1 for error.
 //!
 static int64_t GetIdleTimeWaylandGnomeViaDBus() {
-    // Assumes IsGnomeSession() has already confirmed this is appropriate to call
-    debug_log("INFO: %s: Querying GNOME Mutter IdleMonitor via D-Bus.",
-              __func__);
-
-    GDBusConnection* connection = nullptr;
-    GError* dbus_error = nullptr;
-    GVariant* dbus_result = nullptr;
-    int64_t idle_time_seconds = 0; // Default to 0 (active)
-
-    connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &dbus_error);
-    if (!connection) {
-        if (dbus_error) {
-            error_log("%s: Error connecting to session bus for Gnome idle query: %s",
-                      __func__,
-                      dbus_error->message);
-            g_error_free(dbus_error);
-        } else {
-            error_log("%s: Error connecting to session bus for Gnome idle query (unknown error).",
-                      __func__);
-        }
-        return -1; // Return -1 on connection error
+    if (!g_session_bus.HasOwner(SessionBus::GNOME_MUTTER_IDLE_MONITOR)) {
+        debug_log("INFO: %s: org.gnome.Mutter.IdleMonitor is not running.",
+                  __func__);
+        return -1;
     }
 
-    // D-Bus details for getting idle time from Mutter
-    const char* service_name = "org.gnome.Mutter.IdleMonitor";
-    const char* object_path = "/org/gnome/Mutter/IdleMonitor/Core";
-    const char* interface_name = "org.gnome.Mutter.IdleMonitor";
-    const char* method_name = "GetIdletime";
-
-    dbus_result = g_dbus_connection_call_sync(connection,
-                                              service_name, object_path, interface_name, method_name,
-                                              nullptr, G_VARIANT_TYPE("(t)"), G_DBUS_CALL_FLAGS_NONE,
-                                              500, nullptr, &dbus_error);
+    bool stale = false;
+    int64_t idle_time_seconds = g_session_bus.GetIdleSeconds(SessionBus::GNOME_MUTTER_IDLE_MONITOR, stale);
 
-    if (dbus_error) {
-        error_log("%s: Error calling %s on %s: %s",
+    if (idle_time_seconds < 0) {
+        error_log("%s: No idle time from org.gnome.Mutter.IdleMonitor GetIdletime.",
+                  __func__);
+    } else if (g_session_bus.IsWatchingMutterIdle()) {
+        debug_log("INFO: %s: Mutter IdleMonitor watches report idle time: %lld seconds",
                   __func__,
-                  method_name,
-                  interface_name,
-                  dbus_error->message);
-        g_error_free(dbus_error);
-        return -1;
-    } else if (dbus_result) {
-        uint64_t idle_time_ms = 0;
-        g_variant_get(dbus_result, "(t)", &idle_time_ms);
-        idle_time_seconds = static_cast<int64_t>(idle_time_ms / 1000);
-        debug_log("INFO: %s: Mutter IdleMonitor reported idle time: %llu ms (%lld seconds)",
+                  idle_time_seconds);
+    } else if (stale) {
+        debug_log("INFO: %s: Mutter IdleMonitor reply is late, using the last known value aged to %lld seconds "
+                  "(stale).",
                   __func__,
-                  idle_time_ms,
                   idle_time_seconds);
-        g_variant_unref(dbus_result);
     } else {
-        error_log("%s: Call to %s on %s returned no result and no error.",
+        debug_log("INFO: %s: Mutter IdleMonitor reported idle time: %lld seconds",
                   __func__,
-                  method_name,
-                  interface_name);
-        return -1;
+                  idle_time_seconds);
     }
 
-    g_object_unref(connection);
-
     return idle_time_seconds;
 }
 
 //!
-//! \brief This determines whether the GUI session is KDE.
+//! \brief This determines whether the GUI session is KDE, from whether org.kde.ksmserver has an owner on the session
+//! bus. The owner is tracked by g_session_bus from NameOwnerChanged signals, so this makes no D-Bus call.
 //! \return true if KDE session, false otherwise.
 //!
 static bool IsKdeSession() {
-    // Checking for KSMServer D-Bus service might be more reliable than env vars
-    GDBusConnection* connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
-    if (!connection) return false; // Cannot check if bus unavailable
-
-    GError* error = nullptr;
-    GVariant* result = g_dbus_connection_call_sync(connection,
-                                                   "org.freedesktop.DBus", // Standard service
-                                                   "/org/freedesktop/DBus", // Standard path
-                                                   "org.freedesktop.DBus",   // Standard interface
-                                                   "NameHasOwner",           // Method
-                                                   g_variant_new("(s)", "org.kde.ksmserver"), // Parameter: service name
-                                                   G_VARIANT_TYPE("(b)"),    // Reply: boolean
-                                                   G_DBUS_CALL_FLAGS_NONE,
-                                                   500, // Short timeout
-                                                   nullptr, &error);
-    bool has_owner = false;
-    if (error) {
-        debug_log("INFO: %s: Error checking D-Bus owner for org.kde.ksmserver: %s", __func__, error->message);
-        g_error_free(error);
-    } else if (result) {
-        g_variant_get(result, "(b)", &has_owner);
-        g_variant_unref(result);
-    }
-    g_object_unref(connection);
+    bool has_owner = g_session_bus.HasOwner(SessionBus::KDE_KSMSERVER);
+
     debug_log("INFO: %s: org.kde.ksmserver D-Bus service running? %s", __func__, has_owner ? "Yes" : "No");
+
     return has_owner;
-    // Alternative: Keep using getenv("KDE_SESSION_VERSION") if preferred/reliable
-    // const char* kdeSession = getenv("KDE_SESSION_VERSION");
-    // return (kdeSession != nullptr && strlen(kdeSession) > 0);
 }
 
 //!
-//! \brief Helper function for X11 XScreenSaver query
+//! \brief Helper function for the X11 idle time, from g_x11_idle_monitor's held X connection: the XSync IDLETIME
+//! alarms where available, otherwise an XScreenSaver query. The display is opened on first use.
 //! \return int64_t idle time in seconds. -1 for error.
 //!
-static int64_t GetIdleTimeXss() {
-    debug_log("INFO: %s: Using XScreenSaver.", __func__);
-    Display* display = nullptr;
-
-    for (int attempt = 1; attempt <= MAX_X_CONNECT_RETRIES; ++attempt) {
-        display = XOpenDisplay(nullptr);
-        if (display) break;
-        if (attempt < MAX_X_CONNECT_RETRIES) {
-            error_log("WARNING: %s: Could not open X display (attempt %d/%d). Retrying...", __func__, attempt, MAX_X_CONNECT_RETRIES);
-            std::this_thread::sleep_for(std::chrono::milliseconds(X_RETRY_DELAY_MS));
-        } else {
-            error_log("%s: Could not open X display after %d attempts.", __func__, MAX_X_CONNECT_RETRIES);
-            return -1;
-        }
-    }
-
-    int event_base, error_base;
-    if (!XScreenSaverQueryExtension(display, &event_base, &error_base)) {
-        error_log("%s: XScreenSaver extension unavailable.", __func__);
-        XCloseDisplay(display);
-        return -1;
-    }
-    XScreenSaverInfo* info = XScreenSaverAllocInfo();
-    if (!info) {
-        error_log("%s: Could not allocate XScreenSaverInfo.", __func__);
-        XCloseDisplay(display);
+static int64_t GetIdleTimeX11() {
+    if (!g_x11_idle_monitor.IsAvailable() && !g_x11_idle_monitor.Start()) {
         return -1;
     }
-    Window root = DefaultRootWindow(display);
-    XScreenSaverQueryInfo(display, root, info);
-    int64_t idle_time_ms = info->idle;
-    XFree(info);
-    XCloseDisplay(display);
-    int64_t idle_time_seconds = idle_time_ms / 1000;
-    debug_log("INFO: %s: XScreenSaver reported: %lld ms (%lld seconds)", __func__, (int64_t)idle_time_ms, (int64_t)idle_time_seconds);
+
+    int64_t idle_time_seconds = g_x11_idle_monitor.GetIdleSeconds();
+
+    debug_log("INFO: %s: %s reported: %lld seconds",
+              __func__,
+              g_x11_idle_monitor.IsUsingAlarms() ? "XSync IDLETIME" : "XScreenSaver",
+              idle_time_seconds);
+
     return idle_time_seconds;
 }
 
 //!
-//! \brief This function determines the LOCAL session idle time using appropriate fallback logic based on the current
-//! API layout for GUI environments.
-//! \return int64_t idle time in seconds. -1 for error, -2 if tty session only.
+//! \brief Helper function for the idle time from the systemd-logind IdleHint of the session, tracked by
+//! g_logind_idle_monitor from PropertiesChanged signals, so this makes no D-Bus call. This is the last resort when the
+//! session type's own source fails, and is only available where the desktop sets the hint.
+//! \return int64_t idle time in seconds. -1 for error, or if the hint is not managed.
 //!
-int64_t GetIdleTimeSeconds() {
-    if (IsTtySession()) {
-        debug_log("INFO: %s: TTY session detected, idle check not applicable.", __func__);
-        // Returns -2 to indicate that idle_detect should use event_detect regardless of the config setting.
-        // (Tty monitoring is done in event_detect.)
+static int64_t GetIdleTimeLogind() {
+    int64_t idle_time_seconds = g_logind_idle_monitor.GetIdleSeconds();
 
-        return -2;
-    }
+    debug_log("INFO: %s: logind IdleHint reported: %lld seconds",
+              __func__,
+              idle_time_seconds);
 
-    if (IsKdeSession()) {
-        if (IsWaylandSession()) {
-            // KDE Wayland (Plasma 6+): ksmserver GetSessionIdleTime is removed and
-            // org.freedesktop.ScreenSaver.GetSessionIdleTime returns "not supported" on Wayland.
-            // Use ext_idle_notifier_v1 for idle time with a separate D-Bus inhibition check via
-            // the PowerManagement PolicyAgent, since ext_idle_notifier_v1 may not reflect D-Bus-level
-            // inhibitions from applications using org.freedesktop.ScreenSaver.Inhibit.
-            debug_log("INFO: %s: KDE Wayland session detected. Using ext_idle_notifier_v1 with PolicyAgent inhibition check.",
-                      __func__);
+    return idle_time_seconds;
+}
 
-            if (CheckKdeInhibition()) {
-                debug_log("INFO: %s: KDE screen idle is inhibited, returning 0 idle seconds.", __func__);
-                return 0;
-            }
-
-            if (g_wayland_idle_monitor.IsAvailable()) {
-                return g_wayland_idle_monitor.GetIdleSeconds();
-            }
+//!
+//! \brief Calls one idle time or inhibition backend and fires the idle_detect:backend_call USDT probe with the backend
+//! name, the result and the call latency in microseconds. Without USDT probes this is just the call.
+//! \param backend name of the backend, e.g. "gnome_mutter_dbus"
+//! \param fn backend call
+//! \return the backend result
+//!
+template <typename Fn>
+static auto CallIdleBackend([[maybe_unused]] const char* backend, Fn&& fn) -> decltype(fn()) {
+#ifdef IDLE_DETECT_ENABLE_USDT_PROBES
+    auto start = std::chrono::steady_clock::now();
+    auto result = fn();
+    int64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - start).count();
+
+    IDLE_DETECT_PROBE3(idle_detect, backend_call, backend, static_cast<int64_t>(result), latency_us);
+
+    return result;
+#else
+    return fn();
+#endif
+}
 
-            error_log("ERROR: %s: WaylandIdleMonitor not available for KDE Wayland session.", __func__);
-            return -1;
-        } else {
-            // KDE X11 (Plasma 5 or Plasma 6 on X11): ksmserver D-Bus method handles inhibition
-            // internally by periodically resetting the idle time returned.
-            debug_log("INFO: %s: KDE X11 session detected. Using KDE D-Bus method.", __func__);
-            return GetIdleTimeKdeDBus();
+//!
+//! \brief Logs the results of an idle backend probe and writes them to the status file,
+//! $XDG_RUNTIME_DIR/idle_detect_backend_status, as key=value lines.
+//! \param selector the selector that probed.
+//!
+static void HandleIdleBackendProbe(const IdleBackendSelector& selector) {
+    for (const IdleBackendSelector::ProbeResult& result : selector.GetProbeResults()) {
+        if (!result.candidate) {
+            continue;
         }
-    } else if (IsWaylandSession()) { // Non-KDE Wayland (Try GNOME D-Bus for both idle time and inhibition)
-        debug_log("INFO: %s: Non-KDE Wayland session. Checking GNOME D-Bus idle time and inhibition.", __func__);
 
-        // 1. Try GNOME D-Bus inhibition check first
-        if (CheckGnomeInhibition()) { // This returns false if call fails.
-            debug_log("INFO: %s: GNOME session is inhibited (Wayland), returning 0 idle seconds.", __func__);
+        normal_log("INFO: %s: Probed idle backend %s: %s, %lld us, %lld idle seconds.",
+                   __func__,
+                   result.name,
+                   result.valid ? "valid" : "failed",
+                   result.latency_us,
+                   result.idle_seconds);
+    }
 
-            return 0; // Treat as active if inhibited
-        } else {
-            // 2. Not inhibited (or check failed), try GNOME Mutter D-Bus for idle time
-            debug_log("INFO: %s: No GNOME inhibition detected. Querying Mutter D-Bus idle time...", __func__);
-            int64_t gnome_input_idle = GetIdleTimeWaylandGnomeViaDBus(); // Returns >= 0 or -1
-            if (gnome_input_idle >= 0) {
-                // Successfully got input idle time from Mutter
-                debug_log("INFO: %s: Using GNOME D-Bus for idle time.", __func__);
-                return gnome_input_idle;
-            } else {
-                // 3. Mutter D-Bus failed (maybe not Gnome?), try standard Wayland protocol as last resort
-                debug_log("INFO: %s: GNOME D-Bus failed. Trying WaylandIdleMonitor (ext-idle-notify-v1)...", __func__);
-                if (g_wayland_idle_monitor.IsAvailable()) { // Check if Wayland monitor started successfully
-                    debug_log("INFO: %s: Using WaylandIdleMonitor as final Wayland fallback.", __func__);
-                    return g_wayland_idle_monitor.GetIdleSeconds(); // Get state from monitor thread
-                } else {
-                    error_log("ERROR: %s: No working idle detection method found for this Wayland session.", __func__);
-                    return -1; // Signal failure
-                }
-            }
-        }
+    if (selector.HasSelection()) {
+        normal_log("INFO: %s: Selected idle backend %s.",
+                   __func__,
+                   selector.GetSelectedName());
     } else {
-        // Non-KDE X11 session
-        debug_log("INFO: %s: Non-KDE X11 session. Checking XSS idle time and GNOME D-Bus inhibition.", __func__);
-        if (CheckGnomeInhibition()) { // Also check inhibition for X11 (might be Gnome on X11)
-            debug_log("INFO: %s: GNOME session is inhibited (X11), returning 0 idle seconds.", __func__);
-            return 0; // Treat as active if inhibited
-        } else {
-            // Not inhibited, get input idle time from XScreenSaver
-            return GetIdleTimeXss(); // Returns >= 0 on success, -1 on error
-        }
+        error_log("%s: No idle backend available. Probing again after %i failed passes.",
+                  __func__,
+                  std::get<int>(g_config.GetArg("backend_reprobe_failures")));
+    }
+
+    std::optional<std::string> xdg_runtime_dir = GetXdgRuntimeDir();
+
+    if (xdg_runtime_dir) {
+        // Failures are logged by WriteFileAtomically. The status is diagnostic only, so a failure is not fatal.
+        WriteFileAtomically(fs::path(*xdg_runtime_dir) / "idle_detect_backend_status", selector.StatusToString());
     }
 }
 
-/**
- * @brief Executes a shell command string in the background (detached thread).
- * @param command The command string to execute via /bin/sh -c.
- */
-void ExecuteCommandBackground(const std::string& command) {
-    if (command.empty()) {
-        debug_log("INFO: %s: No command provided.",
-                  __func__);
-        return;
+//!
+//! \brief Registers the idle backends with g_idle_backend_selector, in order of preference, with the session types each
+//! applies to. Inhibition is checked separately in GetIdleTimeSeconds().
+//!
+static void RegisterIdleBackends() {
+    g_idle_backend_selector.SetMaxFailures(std::get<int>(g_config.GetArg("backend_reprobe_failures")));
+    g_idle_backend_selector.SetWaitForQueries([] { g_session_bus.WaitForQueries(DBUS_QUERY_DEADLINE_MS); });
+    g_idle_backend_selector.SetProbeCallback(HandleIdleBackendProbe);
+
+    // KDE X11 (Plasma 5 or Plasma 6 on X11): ksmserver handles inhibition internally by periodically resetting the
+    // idle time returned.
+    g_idle_backend_selector.AddBackend({"kde_dbus",
+                                        false,
+                                        [] { return IsKdeSession() && !IsWaylandSession(); },
+                                        [] { g_session_bus.StartQuery(SessionBus::KDE_KSMSERVER); },
+                                        GetIdleTimeKdeDBus,
+                                        nullptr});
+
+    // Non-KDE Wayland: Mutter. The query is skipped while the Mutter idle watches track the state.
+    g_idle_backend_selector.AddBackend({"gnome_mutter_dbus",
+                                        false,
+                                        [] { return !IsKdeSession() && IsWaylandSession(); },
+                                        [] { g_session_bus.StartQuery(SessionBus::GNOME_MUTTER_IDLE_MONITOR); },
+                                        GetIdleTimeWaylandGnomeViaDBus,
+                                        [] { return g_session_bus.IsWatchingMutterIdle(); },
+                                        true});
+
+    // Any Wayland session with ext_idle_notifier_v1. This is the only idle source on KDE Wayland (Plasma 6+), where
+    // ksmserver GetSessionIdleTime is removed and org.freedesktop.ScreenSaver.GetSessionIdleTime is not supported.
+    g_idle_backend_selector.AddBackend({"wayland_ext_idle_notify",
+                                        false,
+                                        [] { return IsWaylandSession() && g_wayland_idle_monitor.IsAvailable(); },
+                                        nullptr,
+                                        [] { return g_wayland_idle_monitor.GetIdleSeconds(); },
+                                        [] { return g_wayland_idle_monitor.HasLevelNotifications(); },
+                                        true});
+
+    // Non-KDE X11.
+    g_idle_backend_selector.AddBackend({"x11",
+                                        false,
+                                        [] { return !IsKdeSession() && !IsWaylandSession(); },
+                                        nullptr,
+                                        GetIdleTimeX11,
+                                        [] { return g_x11_idle_monitor.IsUsingAlarms(); },
+                                        true});
+
+    // Any session, where the desktop sets the hint. The hint only reports the desktop's own idle timeout.
+    g_idle_backend_selector.AddBackend({"logind",
+                                        true,
+                                        [] { return g_logind_idle_monitor.IsAvailable(); },
+                                        nullptr,
+                                        GetIdleTimeLogind,
+                                        [] { return true; }});
+}
+
+//!
+//! \brief This function determines the LOCAL session idle time from the idle backend selected by
+//! g_idle_backend_selector, after the inhibition check for the session type. The backends are probed on the first call,
+//! and again after backend_reprobe_failures failed passes in a row.
+//! \return int64_t idle time in seconds. -1 for error, -2 if tty session only.
+//!
+int64_t GetIdleTimeSeconds() {
+    if (IsTtySession()) {
+        debug_log("INFO: %s: TTY session detected, idle check not applicable.", __func__);
+        // Returns -2 to indicate that idle_detect should use event_detect regardless of the config setting.
+        // (Tty monitoring is done in event_detect.)
+
+        return -2;
     }
 
-    debug_log("INFO: %s: Executing background command: %s",
-              __func__,
-              command);
-    try {
-        // Launch system() in a detached thread. The lambda captures command by value.
-        std::thread([command]() {
-            int ret = std::system(command.c_str());
-            // Optional: Log result if needed, but tricky as thread is detached.
-            // This log might appear long after the main thread has moved on.
-            if (ret != 0) {
-                // Use thread-safe logging if available or be cautious
-                // error_log("Background command '%s' exited with code %d", command, ret);
-                // For now, maybe skip logging from detached thread.
-            }
-        }).detach();
-    } catch (const std::system_error& e) {
-        error_log("%s: Failed to launch background command thread: %s",
-                  __func__,
-                  e.what());
-    } catch (...) {
-        error_log("%s: Unknown error launching background command thread.",
-                  __func__);
+    // Apply any service owner changes, e.g. ksmserver registering late at login, and start the inhibition queries the
+    // inhibitor change signals call for.
+    g_session_bus.ProcessPendingSignals();
+    g_logind_idle_monitor.ProcessPendingSignals();
+
+    // Start the selected backend's idle time query, if it has one, so that it runs concurrently with any inhibition
+    // query, then wait for the replies up to the deadline. A slow service cannot hold up the pass for longer than that:
+    // its last known value is used instead.
+    g_idle_backend_selector.StartPass();
+    g_session_bus.WaitForQueries(DBUS_QUERY_DEADLINE_MS);
+
+    if (IsKdeSession()) {
+        // KDE Wayland: ext_idle_notifier_v1 may not reflect D-Bus-level inhibitions from applications using
+        // org.freedesktop.ScreenSaver.Inhibit, so check the PowerManagement PolicyAgent. On KDE X11, ksmserver
+        // handles inhibition itself.
+        if (IsWaylandSession() && CallIdleBackend("kde_inhibition", CheckKdeInhibition)) {
+            debug_log("INFO: %s: KDE screen idle is inhibited, returning 0 idle seconds.", __func__);
+            return 0;
+        }
+    } else if (CallIdleBackend("gnome_inhibition", CheckGnomeInhibition)) { // This returns false if call fails.
+        // Might be GNOME on Wayland or X11.
+        debug_log("INFO: %s: GNOME session is inhibited, returning 0 idle seconds.", __func__);
+
+        return 0; // Treat as active if inhibited
     }
+
+    return CallIdleBackend(g_idle_backend_selector.GetSelectedName(),
+                           [] { return g_idle_backend_selector.GetIdleSeconds(); });
 }
 
 IdleDetectControlMonitor::IdleDetectControlMonitor()
-    : m_interrupt_idle_detect_control_monitor(false)
-    , m_state(UNKNOWN)
+    : m_state(UNKNOWN)
+    , m_fd(-1)
 {}
 
-void IdleDetectControlMonitor::IdleDetectControlMonitorThread()
+IdleDetectControlMonitor::~IdleDetectControlMonitor()
 {
-    debug_log("INFO: %s: started.",
-              __func__);
+    Stop();
+}
+
+bool IdleDetectControlMonitor::Start()
+{
+    if (m_fd != -1) {
+        return true;
+    }
 
     bool idle_detect_control_pipe_initialized = false;
 
@@ -857,10 +982,9 @@ void IdleDetectControlMonitor::IdleDetectControlMonitorThread()
     }
 
     if (!idle_detect_control_pipe_initialized) {
-        error_log("%s: Failed to create named pipe for idle_detect control. Exiting.",
+        error_log("%s: Failed to create named pipe for idle_detect control.",
                   __func__);
-        Shutdown(1);
-        return;
+        return false;
     }
 
     // Note the mode above combined with the umask does not always result in the right permissions,
@@ -879,169 +1003,135 @@ void IdleDetectControlMonitor::IdleDetectControlMonitorThread()
                   __func__,
                   idle_detect_control_pipe_path.string().c_str(),
                   ec.message().c_str()); // Use the error_code's message
-        Shutdown(1);
-        return;
+        return false;
     } else {
         debug_log("%s: Successfully set permissions on %s to 0600.",
                   __func__, idle_detect_control_pipe_path.string().c_str());
     }
 
-    int fd = -1;
-    char buffer[256];
-    ssize_t bytes_read;
-    const int poll_timeout_ms = 100;
+    // Read-write, so that this is a writer too. The open then does not wait for a writer, and the pipe does not report
+    // a hangup each time a control script closes it.
+    m_fd = open(idle_detect_control_pipe_path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if (m_fd == -1) {
+        error_log("%s: Error opening named pipe %s: %s",
+                  __func__,
+                  idle_detect_control_pipe_path.string(),
+                  strerror(errno));
+        return false;
+    }
 
-    m_initialized = true;
     m_state = NORMAL;
 
-    while (g_exit_code == 0) {
-        std::unique_lock<std::mutex> lock(mtx_idle_detect_control_monitor_thread);
-        cv_idle_detect_control_monitor_thread.wait_for(lock, std::chrono::milliseconds(100),
-                                                       []{ return g_idle_detect_control_monitor.m_interrupt_idle_detect_control_monitor.load(); });
+    debug_log("INFO: %s: Opened control pipe %s.",
+              __func__,
+              idle_detect_control_pipe_path.string());
 
-        if (g_idle_detect_control_monitor.m_interrupt_idle_detect_control_monitor) {
-            break;
-        }
+    return true;
+}
 
-        lock.unlock();
+void IdleDetectControlMonitor::Stop()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
 
-        // Only execute this if the pipe isn't already open in non-blocking mode.
-        if (fd == -1) {
-            fd = open(idle_detect_control_pipe_path.c_str(), O_RDONLY | O_NONBLOCK);
-            if (fd == -1) {
-                if (errno != ENXIO) { // No process has the pipe open for writing
-                    error_log("%s: Error opening named pipe for reading (non-blocking): %s",
-                              __func__,
-                              strerror(errno));
-                    // Consider a longer sleep here to avoid rapid retries on other errors
-                    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                }
-                continue; // Try to open again in the next iteration
-            } else {
-                debug_log("INFO: %s: Successfully opened pipe for reading (non-blocking).",
-                          __func__);
-            }
-        }
+int IdleDetectControlMonitor::GetFd() const
+{
+    return m_fd;
+}
 
-        if (fd != -1) {
-            struct pollfd fds[1];
-            fds[0].fd = fd;
-            fds[0].events = POLLIN;
-            fds[0].revents = 0;
-
-            int ret = poll(fds, 1, poll_timeout_ms);
-
-            if (ret > 0) {
-                if (fds[0].revents & POLLIN) {
-                    bytes_read = read(fd, buffer, sizeof(buffer) - 1);
-
-                    if (bytes_read > 0) {
-                        buffer[bytes_read] = '\0';
-                        std::string event_data(buffer);
-                        debug_log("INFO: %s: Received data: %s", __func__,
-                                  event_data);
-
-                        std::stringstream ss(event_data);
-                        std::string segment;
-                        std::vector<std::string> parts;
-                        while (std::getline(ss, segment, ':')) {
-                            parts.push_back(segment);
-                        }
-
-                        if (parts.size() == 2) {
-                            try {
-                                EventMessage event(TrimString(parts[0]), TrimString(parts[1]));
-
-                                debug_log("INFO: %s: event.m_timestamp = %lld, event.m_event_type = %s",
-                                          __func__,
-                                          event.m_timestamp,
-                                          event.EventTypeToString());
-
-                                if (event.IsValid()) {
-                                    debug_log("INFO: %s: Valid override event received with timestamp %lld",
-                                              __func__,
-                                              event.m_timestamp);
-
-                                    if (event.m_event_type == EventMessage::USER_UNFORCE) {
-                                        m_state = NORMAL;
-                                    } else if (event.m_event_type == EventMessage::USER_FORCE_IDLE) {
-                                        m_state = FORCED_IDLE;
-                                    } else if (event.m_event_type == EventMessage::USER_FORCE_ACTIVE) {
-                                        m_state = FORCED_ACTIVE;
-                                    }
-
-                                    debug_log("INFO: %s: Current idle detect monitor override time %lld, state %s",
-                                              __func__,
-                                              event.m_timestamp,
-                                              StateToString());
-                                } else {
-                                    error_log("%s: Invalid event data received: %s",
-                                              __func__,
-                                              event_data);
-                                }
-                            } catch (const std::invalid_argument& e) {
-                                error_log("%s: Error parsing timestamp: %s in data %s",
-                                          __func__,
-                                          e.what(),
-                                          event_data);
-                            } catch (const std::out_of_range& e) {
-                                error_log("%s: Timestamp out of range: %s in data %s",
-                                          __func__,
-                                          e.what(),
-                                          event_data);
-                            }
-                        } else if (bytes_read == 0) {
-                            // Pipe closed by writers, sleep a bit to avoid spinning
-                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                        } else if (bytes_read < 0) {
-                            if (errno == EINTR) {
-                                // Interrupted by a signal, this is expected during shutdown
-                                debug_log("INFO: %s: Read interrupted by signal.",
-                                          __func__);
-                                break;
-                            } else {
-                                error_log("%s: Error reading from named pipe: %s",
-                                          __func__,
-                                          strerror(errno));
-                                break;
-                            }
-                        }
-                    }
-                } else if (ret < 0) {
-                    error_log("%s: Error in poll() for pipe read: %s",
-                              __func__,
-                              strerror(errno));
+bool IdleDetectControlMonitor::ProcessPendingInput()
+{
+    if (m_fd == -1) {
+        return false;
+    }
 
-                    g_exit_code = 1;
-                    break;
-                } // ret = 0 means poll timeed out. Allow while loop to iterate.
+    State previous_state = m_state;
+    char buffer[256];
+
+    while (true) {
+        ssize_t bytes_read = read(m_fd, buffer, sizeof(buffer) - 1);
+
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                error_log("%s: Error reading from named pipe: %s",
+                          __func__,
+                          strerror(errno));
             }
+
+            break;
         }
-    }
 
-    if (fd != -1) {
-        close(fd);
-    }
+        if (bytes_read == 0) {
+            break;
+        }
+
+        std::string_view event_data(buffer, bytes_read);
+        debug_log("INFO: %s: Received data: %s", __func__,
+                  event_data);
+
+        try {
+            EventMessage event = EventMessage::FromString(event_data);
 
-    debug_log("INFO: %s: thread exiting.",
-              __func__);
+            debug_log("INFO: %s: event.m_timestamp = %lld, event.m_event_type = %s",
+                      __func__,
+                      event.m_timestamp,
+                      event.EventTypeToString());
+
+            if (event.IsValid()) {
+                debug_log("INFO: %s: Valid override event received with timestamp %lld",
+                          __func__,
+                          event.m_timestamp);
+
+                if (event.m_event_type == EventMessage::USER_UNFORCE) {
+                    m_state = NORMAL;
+                } else if (event.m_event_type == EventMessage::USER_FORCE_IDLE) {
+                    m_state = FORCED_IDLE;
+                } else if (event.m_event_type == EventMessage::USER_FORCE_ACTIVE) {
+                    m_state = FORCED_ACTIVE;
+                }
 
-    // If g_exit_code was set to 1 above then the thread is in abnormal state at exit and the rest of the
-    // application needs to be shutdown.
-    if (g_exit_code == 1) {
-        Shutdown(1);
+                debug_log("INFO: %s: Current idle detect monitor override time %lld, state %s",
+                          __func__,
+                          event.m_timestamp,
+                          StateToString());
+            } else {
+                error_log("%s: Invalid event data received: %s",
+                          __func__,
+                          event_data);
+            }
+        } catch (const std::invalid_argument& e) {
+            error_log("%s: Error parsing timestamp: %s in data %s",
+                      __func__,
+                      e.what(),
+                      event_data);
+        } catch (const std::out_of_range& e) {
+            error_log("%s: Timestamp out of range: %s in data %s",
+                      __func__,
+                      e.what(),
+                      event_data);
+        }
     }
+
+    return m_state != previous_state;
 }
 
 bool IdleDetectControlMonitor::IsInitialized() const
 {
-    return m_initialized.load();
+    return m_fd != -1;
 }
 
 
 IdleDetectControlMonitor::State IdleDetectControlMonitor::GetState() const
 {
-    return m_state.load();
+    return m_state;
 }
 
 std::string IdleDetectControlMonitor::StateToString(const State& status)
@@ -1087,18 +1177,11 @@ WaylandIdleMonitor::WaylandIdleMonitor() :
     m_idle_notifier(nullptr),
     m_seat_id(0),
     m_idle_notifier_id(0),
-    m_is_idle(false), // Start assuming active
-    m_idle_start_time(0),
-    m_interrupt_monitor(false),
+    m_pass_needed(false),
     m_initialized(false),
     m_display(nullptr),
-    m_registry(nullptr),
-    m_idle_notification(nullptr),
-    m_notification_timeout_ms(0)
-{
-    m_interrupt_pipe_fd[0] = -1; // read end
-    m_interrupt_pipe_fd[1] = -1; // write end
-}
+    m_registry(nullptr)
+{}
 
 // Destructor
 WaylandIdleMonitor::~WaylandIdleMonitor() {
@@ -1106,26 +1189,38 @@ WaylandIdleMonitor::~WaylandIdleMonitor() {
 }
 
 // Start method
-bool WaylandIdleMonitor::Start(int notification_timeout_ms) {
+bool WaylandIdleMonitor::Start(int notification_timeout_ms, const std::vector<int64_t>& level_timeouts_ms) {
     normal_log("INFO: %s: Starting Wayland idle monitor.", __func__); // Use log for start/stop
-    if (m_initialized.load()) {
+    if (m_initialized) {
         debug_log("INFO: %s: Monitor already initialized.", __func__);
         return true; // Already running
     }
 
-    m_notification_timeout_ms = notification_timeout_ms;
+    // One notification per level of the tracker, in increasing order. The transitions of the level notifications call
+    // for a main loop pass, and those of the activity notification, if it is not also a level one, do not.
+    std::vector<int64_t> levels_ms = level_timeouts_ms;
+    levels_ms.push_back(notification_timeout_ms);
 
-    // Create pipe for interrupting poll() before initializing Wayland
-    // pipe2 is Linux-specific, use pipe() for broader POSIX if needed
-    if (pipe2(m_interrupt_pipe_fd, O_CLOEXEC | O_NONBLOCK) == -1) {
-        error_log("%s: Failed to create interrupt pipe: %s (%d)", __func__, strerror(errno), errno);
-        return false;
+    m_idle_tracker.SetLevels(levels_ms);
+
+    const std::vector<int64_t>& levels = m_idle_tracker.GetLevels();
+
+    m_notifications.clear();
+    m_notifications.reserve(levels.size());
+
+    for (size_t level = 0; level < levels.size(); ++level) {
+        Notification notification;
+
+        notification.monitor = this;
+        notification.timeout_ms = static_cast<int>(levels[level]);
+        notification.needs_pass = (std::find(level_timeouts_ms.begin(), level_timeouts_ms.end(), levels[level])
+                                   != level_timeouts_ms.end());
+        notification.level = static_cast<int>(level);
+
+        m_notifications.push_back(notification);
     }
 
-    // Reset state flags
-    m_interrupt_monitor.store(false);
-    m_is_idle.store(false);
-    m_idle_start_time.store(0);
+    m_pass_needed = false;
 
     // Initialize Wayland connection, get initial state, and subscribe
     // Includes retries internally now
@@ -1140,87 +1235,34 @@ bool WaylandIdleMonitor::Start(int notification_timeout_ms) {
         goto start_failed;
     }
 
-    // Create the specific idle notification request object
-    CreateIdleNotification();
-    if (!m_idle_notification) {
-        error_log("%s: Failed to create Wayland idle notification object.", __func__);
-        goto start_failed;
-    }
-
-    // If Wayland setup okay, start the thread to run the event loop
-    try {
-        m_monitor_thread = std::thread(&WaylandIdleMonitor::WaylandMonitorThread, this);
-    } catch (const std::system_error& e) {
-        error_log("%s: Failed to start Wayland monitor thread: %s", __func__, e.what());
-        goto start_failed;
-    } catch (...) {
-        error_log("%s: Unknown error starting Wayland monitor thread.", __func__);
+    // Create the specific idle notification request objects
+    if (!CreateIdleNotifications()) {
+        error_log("%s: Failed to create Wayland idle notification objects.", __func__);
         goto start_failed;
     }
 
-    m_initialized.store(true); // Set initialized only after thread starts successfully
+    // The events are read and dispatched by the main loop, from PrepareRead() and FinishRead().
+    m_initialized = true;
     normal_log("INFO: %s: Wayland idle monitor started successfully.", __func__);
     return true;
 
 start_failed:
     CleanupWayland();
-    if (m_interrupt_pipe_fd[0] != -1) { close(m_interrupt_pipe_fd[0]); m_interrupt_pipe_fd[0] = -1; }
-    if (m_interrupt_pipe_fd[1] != -1) { close(m_interrupt_pipe_fd[1]); m_interrupt_pipe_fd[1] = -1; }
-    m_initialized.store(false);
+    m_initialized = false;
     return false;
 }
 
 // Stop method
 void WaylandIdleMonitor::Stop() {
-    normal_log("INFO: %s: Stopping Wayland idle monitor...", __func__);
-
-    // Use exchange to prevent concurrent Stop calls and get previous state
-    if (m_interrupt_monitor.exchange(true)) {
-        debug_log("INFO: %s: Stop already in progress or completed.", __func__);
-        // Join attempt with timeout in case thread is stuck
-        if(m_monitor_thread.joinable() && m_monitor_thread.get_id() != std::this_thread::get_id()) {
-            auto future = std::async(std::launch::async, &std::thread::join, &m_monitor_thread);
-            if (future.wait_for(std::chrono::seconds(1)) == std::future_status::timeout) {
-                error_log("%s: Timed out waiting for Wayland thread join during concurrent stop.", __func__);
-            }
-        }
+    if (!m_initialized && !m_display) {
         return;
     }
 
-    // Signal the monitor thread to wake up from poll() by writing to the pipe
-    if (m_interrupt_pipe_fd[1] != -1) {
-        char buf = 'X'; // Data doesn't matter, just the event causing poll to wake
-        ssize_t written = write(m_interrupt_pipe_fd[1], &buf, 1);
-        if (written <= 0 && errno != EAGAIN) {
-            error_log("%s: Failed to write to interrupt pipe: %s (%d)", __func__, strerror(errno), errno);
-        } else {
-            debug_log("INFO: %s: Sent interrupt signal via pipe.", __func__);
-        }
-    } else {
-        error_log("WARN: %s: Interrupt pipe write fd invalid during Stop().", __func__);
-    }
-
-    // Join the thread (wait for it to finish)
-    if (m_monitor_thread.joinable() && m_monitor_thread.get_id() != std::this_thread::get_id()) {
-        debug_log("INFO: %s: Joining Wayland monitor thread...", __func__);
-        try {
-            m_monitor_thread.join();
-            debug_log("INFO: %s: Wayland monitor thread joined.", __func__);
-        } catch (const std::system_error& e) {
-            error_log("%s: Error joining Wayland monitor thread: %s", __func__, e.what());
-        }
-    } else if (m_monitor_thread.get_id() == std::this_thread::get_id()) {
-        error_log("WARN: %s: Stop() called from within the Wayland monitor thread!", __func__);
-    }
+    normal_log("INFO: %s: Stopping Wayland idle monitor...", __func__);
 
-    // Clean up Wayland resources *after* thread has stopped using them
     CleanupWayland();
 
-    // Close interrupt pipe FDs (owned by Start()/Stop(), not CleanupWayland())
-    if (m_interrupt_pipe_fd[0] != -1) { close(m_interrupt_pipe_fd[0]); m_interrupt_pipe_fd[0] = -1; }
-    if (m_interrupt_pipe_fd[1] != -1) { close(m_interrupt_pipe_fd[1]); m_interrupt_pipe_fd[1] = -1; }
-
-    m_initialized.store(false); // Mark as no longer initialized
+    m_initialized = false; // Mark as no longer initialized
     normal_log("INFO: %s: Wayland idle monitor stopped.", __func__);
 }
 
@@ -1302,282 +1344,1802 @@ bool WaylandIdleMonitor::InitializeWayland() {
 
 void WaylandIdleMonitor::CleanupWayland() {
     // Only log if resources might actually exist
-    if (m_display || m_registry || m_seat || m_idle_notifier || m_idle_notification || m_interrupt_pipe_fd[0] != -1) {
+    if (m_display || m_registry || m_seat || m_idle_notifier
+        || (!m_notifications.empty() && m_notifications[0].object)) {
         debug_log("INFO: %s: Cleaning up Wayland resources.", __func__);
     } else {
         // Nothing to clean
         return;
     }
 
-    // Destroy specific notification first
-    if (m_idle_notification) {
-        ext_idle_notification_v1_destroy(m_idle_notification);
-        m_idle_notification = nullptr;
-    }
-    // Destroy/release globals
-    if (m_idle_notifier) { m_idle_notifier = nullptr; } // Global, no destroy in spec
-    if (m_seat) {
-        // Check version before calling release (available since v5)
-        if (wl_proxy_get_version((struct wl_proxy *)m_seat) >= WL_SEAT_RELEASE_SINCE_VERSION) {
-            wl_seat_release(m_seat);
+    // Destroy specific notifications first
+    for (Notification& notification : m_notifications) {
+        if (notification.object) {
+            ext_idle_notification_v1_destroy(notification.object);
+            notification.object = nullptr;
+        }
+    }
+    // Destroy/release globals
+    if (m_idle_notifier) { m_idle_notifier = nullptr; } // Global, no destroy in spec
+    if (m_seat) {
+        // Check version before calling release (available since v5)
+        if (wl_proxy_get_version((struct wl_proxy *)m_seat) >= WL_SEAT_RELEASE_SINCE_VERSION) {
+            wl_seat_release(m_seat);
+        }
+        // Even without release, we destroy the proxy reference below implicitly or explicitly?
+        // Wayland client library usually handles proxy destruction when display is disconnected/destroyed.
+        // Setting pointer to null is sufficient here.
+        m_seat = nullptr;
+    }
+    // Destroy registry
+    if (m_registry) { wl_registry_destroy(m_registry); m_registry = nullptr; }
+    // Disconnect display
+    if (m_display) {
+        wl_display_flush(m_display); // Flush remaining requests if possible
+        wl_display_disconnect(m_display);
+        m_display = nullptr;
+    }
+    // m_is_initialized is set in Stop() AFTER cleanup is done.
+}
+
+// CreateIdleNotifications
+bool WaylandIdleMonitor::CreateIdleNotifications() {
+    if (!m_idle_notifier || !m_seat || m_notifications.empty() || m_notifications[0].object) {
+        debug_log("INFO: %s: Cannot create idle notifications (missing deps or already exist).", __func__);
+        return false;
+    }
+
+    for (Notification& notification : m_notifications) {
+        notification.object = ext_idle_notifier_v1_get_idle_notification(m_idle_notifier, notification.timeout_ms,
+                                                                          m_seat);
+
+        if (!notification.object) {
+            error_log("%s: ext_idle_notifier_v1_get_idle_notification failed (timeout %d ms).",
+                      __func__,
+                      notification.timeout_ms);
+            return false;
+        }
+
+        ext_idle_notification_v1_add_listener(notification.object,
+                                              (const ext_idle_notification_v1_listener*)c_idle_notification_listener_ptr,
+                                              &notification);
+        // Reset state when creating notification
+        notification.is_idle = false;
+
+        debug_log("INFO: %s: Created idle notification object (timeout %d ms).", __func__, notification.timeout_ms);
+    }
+
+    if (wl_display_flush(m_display) == -1) {
+        error_log("%s: wl_display_flush failed after adding notification listeners.", __func__);
+    }
+
+    // A notification's timeout runs from its creation, so the idle time is counted from there until an event.
+    m_idle_tracker.SetInput();
+
+    return true;
+}
+
+// PrepareRead
+int WaylandIdleMonitor::PrepareRead() {
+    if (!m_initialized || !m_display) {
+        return -1;
+    }
+
+    // Dispatch the events already queued, which would otherwise wait for the next input on the fd.
+    while (wl_display_prepare_read(m_display) != 0) {
+        if (wl_display_dispatch_pending(m_display) == -1) {
+            error_log("%s: wl_display_dispatch_pending() failed. Stopping the Wayland idle monitor.", __func__);
+            Stop();
+            return -1;
+        }
+    }
+
+    // Flush requests so that the compositor has them before the main loop blocks.
+    if (wl_display_flush(m_display) == -1 && errno != EAGAIN) {
+        error_log("%s: wl_display_flush() failed: %s (%d). Stopping the Wayland idle monitor.",
+                  __func__,
+                  strerror(errno),
+                  errno);
+        wl_display_cancel_read(m_display);
+        Stop();
+        return -1;
+    }
+
+    return wl_display_get_fd(m_display);
+}
+
+// FinishRead
+bool WaylandIdleMonitor::FinishRead(short revents) {
+    if (!m_initialized || !m_display) {
+        return false;
+    }
+
+    if (revents & (POLLERR | POLLHUP)) {
+        error_log("%s: Error/Hangup on Wayland display FD. Stopping the Wayland idle monitor.", __func__);
+        wl_display_cancel_read(m_display);
+        Stop();
+        return true;
+    }
+
+    if (revents & POLLIN) {
+        if (wl_display_read_events(m_display) == -1) {
+            error_log("%s: wl_display_read_events() failed. Stopping the Wayland idle monitor.", __func__);
+            Stop();
+            return true;
+        }
+    } else {
+        wl_display_cancel_read(m_display);
+    }
+
+    // Dispatch the read events, which trigger the callbacks.
+    if (wl_display_dispatch_pending(m_display) == -1) {
+        error_log("%s: wl_display_dispatch_pending() failed after read. Stopping the Wayland idle monitor.", __func__);
+        Stop();
+        return true;
+    }
+
+    bool pass_needed = m_pass_needed;
+    m_pass_needed = false;
+
+    return pass_needed;
+}
+
+// IsAvailable getter
+bool WaylandIdleMonitor::IsAvailable() const {
+    return m_initialized;
+}
+
+// IsIdle getter
+bool WaylandIdleMonitor::IsIdle() const {
+    return m_idle_tracker.IsAboveFirstLevel();
+}
+
+bool WaylandIdleMonitor::HasLevelNotifications() const {
+    return m_initialized
+           && std::any_of(m_notifications.begin(), m_notifications.end(), [](const Notification& notification) {
+                  return notification.needs_pass;
+              });
+}
+
+// GetIdleSeconds getter
+int64_t WaylandIdleMonitor::GetIdleSeconds() const {
+    if (!m_initialized) {
+        return -1; // Indicate not available rather than 0 (active)
+    }
+
+    // The compositor's crossing of each timeout decides the level, even if the activity notification's idle start is a
+    // little later.
+    int64_t idle_ms = m_idle_tracker.GetIdleMs();
+
+    return idle_ms < 0 ? -1 : idle_ms / 1000;
+}
+
+// --- Static Listener Implementations (C-linkage required) ---
+extern "C" {
+
+void WaylandIdleMonitor_HandleGlobal(void *data, wl_registry *registry, uint32_t name,
+                                     const char *interface, uint32_t version)
+{
+    WaylandIdleMonitor *monitor = static_cast<WaylandIdleMonitor*>(data);
+    debug_log("INFO: %s: Global: %s v%u (name %u)", __func__, interface, version, name);
+
+    if (strcmp(interface, wl_seat_interface.name) == 0) {
+        monitor->m_seat_id = name;
+        monitor->m_seat = static_cast<wl_seat*>(
+            wl_registry_bind(registry, name, &wl_seat_interface, std::min(version, 5u)) // Request v5 for release
+            );
+        debug_log("INFO: %s: Bound wl_seat (name %u) version %u.", __func__, name, wl_proxy_get_version((wl_proxy*)monitor->m_seat));
+    } else if (strcmp(interface, ext_idle_notifier_v1_interface.name) == 0) {
+        monitor->m_idle_notifier_id = name;
+        monitor->m_idle_notifier = static_cast<ext_idle_notifier_v1*>(
+            wl_registry_bind(registry, name, &ext_idle_notifier_v1_interface, std::min(version, 1u)) // Request v1 or v2? Start with 1.
+            );
+        debug_log("INFO: %s: Bound %s (name %u) version %u.",
+                  __func__,
+                  ext_idle_notifier_v1_interface.name,
+                  name,
+                  wl_proxy_get_version((wl_proxy*)monitor->m_idle_notifier));
+    }
+}
+
+void WaylandIdleMonitor_HandleGlobalRemove(void *data, wl_registry * /* registry */, uint32_t name)
+{
+    WaylandIdleMonitor *monitor = static_cast<WaylandIdleMonitor*>(data);
+    debug_log("INFO: %s: Wayland global removed: %u", __func__, name);
+    if (name == monitor->m_seat_id) {
+        error_log("WARN: %s: Monitored wl_seat (name %u) was removed!", __func__, name);
+        monitor->m_seat = nullptr; // Mark as gone, maybe trigger re-init?
+        monitor->m_seat_id = 0;
+    } else if (name == monitor->m_idle_notifier_id) {
+        error_log("WARN: %s: Idle notifier global (name %u) was removed!", __func__, name);
+        monitor->m_idle_notifier = nullptr; // Mark as gone
+        monitor->m_idle_notifier_id = 0;
+    }
+}
+
+void WaylandIdleMonitor_HandleIdled(void *data, ext_idle_notification_v1 * /* notification */)
+{
+    WaylandIdleMonitor::Notification *notification = static_cast<WaylandIdleMonitor::Notification*>(data);
+    if (!notification->is_idle) { // Only update time on transition
+        notification->is_idle = true;
+        // The idle period started when the input stopped, one timeout before the event.
+        notification->monitor->m_idle_tracker.SetLevelReached(notification->level);
+        debug_log("INFO: %s: Wayland Idle state (%d ms notification) entered.",
+                  __func__,
+                  notification->timeout_ms);
+
+        if (notification->needs_pass) {
+            notification->monitor->m_pass_needed = true;
+        }
+    }
+}
+
+void WaylandIdleMonitor_HandleResumed(void *data, ext_idle_notification_v1 * /* notification */)
+{
+    WaylandIdleMonitor::Notification *notification = static_cast<WaylandIdleMonitor::Notification*>(data);
+    if (notification->is_idle) { // Only update time on transition
+        notification->is_idle = false;
+        notification->monitor->m_idle_tracker.SetInput();
+        debug_log("INFO: %s: Wayland Idle state (%d ms notification) exited (resumed).",
+                  __func__,
+                  notification->timeout_ms);
+
+        if (notification->needs_pass) {
+            notification->monitor->m_pass_needed = true;
+        }
+    }
+}
+
+// Define the actual static listener structs using positional initialization
+const struct wl_registry_listener g_registry_listener = {
+    /* .global = */ WaylandIdleMonitor_HandleGlobal,
+    /* .global_remove = */ WaylandIdleMonitor_HandleGlobalRemove
+};
+
+const struct ext_idle_notification_v1_listener g_idle_notification_listener = {
+    /* .idled = */ WaylandIdleMonitor_HandleIdled,
+    /* .resumed = */ WaylandIdleMonitor_HandleResumed
+};
+
+} // extern "C"
+
+
+// SessionBus class
+
+namespace {
+
+//!
+//! \brief Bus name, object path and interface of each SessionBus::Service, in enum order, and its query: the method, its
+//! uint32 argument if any, the reply type and the call timeout.
+//!
+struct SessionBusServiceInfo
+{
+    const char* name;
+    const char* object_path;
+    const char* interface_name;
+    const char* method;
+    bool has_argument;
+    guint32 argument;
+    const char* reply_type;
+    int timeout_ms;
+};
+
+constexpr SessionBusServiceInfo SESSION_BUS_SERVICES[SessionBus::SERVICE_COUNT] = {
+    // Timeout 5 sec — ksmserver can be slow to register at login
+    {"org.kde.ksmserver", "/ScreenSaver", "org.freedesktop.ScreenSaver",
+     "GetSessionIdleTime", false, 0, "(u)", 5000},
+    // Type 1 = ChangeScreenSettings (prevents screen idle/blanking)
+    {"org.kde.Solid.PowerManagement", "/org/kde/Solid/PowerManagement/PolicyAgent",
+     "org.kde.Solid.PowerManagement.PolicyAgent",
+     "HasInhibition", true, 1, "(b)", 500},
+    // Flags: 1=logout, 2=user-switch, 4=suspend, 8=idle. Check if any are active.
+    {"org.gnome.SessionManager", "/org/gnome/SessionManager", "org.gnome.SessionManager",
+     "IsInhibited", true, 1 | 2 | 4 | 8, "(b)", 500},
+    {"org.gnome.Mutter.IdleMonitor", "/org/gnome/Mutter/IdleMonitor/Core", "org.gnome.Mutter.IdleMonitor",
+     "GetIdletime", false, 0, "(t)", 500}
+};
+
+//!
+//! \brief Wakes a blocking g_main_context_iteration() in SessionBus at its deadline.
+//!
+gboolean SessionBus_HandleTimeout(gpointer data)
+{
+    *static_cast<bool*>(data) = true;
+
+    return G_SOURCE_REMOVE;
+}
+
+//!
+//! \brief Runs g_main_context_iteration() on context until done() or timeout_ms have passed.
+//!
+template <typename Done>
+void SessionBus_IterateUntil(GMainContext* context, int timeout_ms, Done&& done)
+{
+    if (done()) {
+        return;
+    }
+
+    bool timed_out = false;
+    GSource* timeout = g_timeout_source_new(timeout_ms);
+    g_source_set_callback(timeout, SessionBus_HandleTimeout, &timed_out, nullptr);
+    g_source_attach(timeout, context);
+
+    while (!timed_out && !done()) {
+        g_main_context_iteration(context, TRUE);
+    }
+
+    g_source_destroy(timeout);
+    g_source_unref(timeout);
+}
+
+//!
+//! \brief The inhibitor change signals, as service, member.
+//!
+struct SessionBusInhibitionSignal
+{
+    SessionBus::Service service;
+    const char* member;
+};
+
+constexpr SessionBusInhibitionSignal SESSION_BUS_INHIBITION_SIGNALS[] = {
+    {SessionBus::KDE_POWER_MANAGEMENT, "InhibitionsChanged"},
+    {SessionBus::GNOME_SESSION_MANAGER, "InhibitorAdded"},
+    {SessionBus::GNOME_SESSION_MANAGER, "InhibitorRemoved"}
+};
+
+static_assert(std::size(SESSION_BUS_INHIBITION_SIGNALS) == SessionBus::INHIBITION_SIGNAL_COUNT);
+
+//!
+//! \brief Completes a Mutter AddIdleWatch or AddUserActiveWatch call.
+//! \param cancelled set true if the call was cancelled by SessionBus::Stop().
+//! \return the watch id, or 0 if the call failed. Failures other than cancellation are logged.
+//!
+guint32 SessionBus_FinishAddWatch(GObject* source_object, GAsyncResult* result, const char* method, bool& cancelled)
+{
+    GError* dbus_error = nullptr;
+    GVariant* dbus_result = g_dbus_proxy_call_finish(reinterpret_cast<GDBusProxy*>(source_object), result, &dbus_error);
+
+    cancelled = false;
+
+    if (dbus_error) {
+        cancelled = g_error_matches(dbus_error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+        if (!cancelled) {
+            error_log("%s: Error calling %s on org.gnome.Mutter.IdleMonitor: %s",
+                      __func__,
+                      method,
+                      dbus_error->message);
+        }
+
+        g_error_free(dbus_error);
+
+        return 0;
+    }
+
+    guint32 watch_id = 0;
+
+    if (g_variant_is_of_type(dbus_result, G_VARIANT_TYPE("(u)"))) {
+        g_variant_get(dbus_result, "(u)", &watch_id);
+    } else {
+        error_log("%s: Unexpected reply type %s from org.gnome.Mutter.IdleMonitor.%s",
+                  __func__,
+                  g_variant_get_type_string(dbus_result),
+                  method);
+    }
+
+    g_variant_unref(dbus_result);
+
+    return watch_id;
+}
+
+} // namespace
+
+SessionBus::SessionBus()
+    : m_context(nullptr)
+    , m_connection(nullptr)
+    , m_cancellable(nullptr)
+    , m_pass_start_time(0)
+    , m_next_connect_time(0)
+    , m_next_latency_report_time(0)
+    , m_idle_watch_state(IDLE_WATCH_NONE)
+    , m_active_watch_id(0)
+    , m_active_watch_adding(false)
+    , m_watch_calls_in_flight(0)
+    , m_watch_fired_signal_id(0)
+{
+    m_idle_tracker.SetClock([]() { return static_cast<int64_t>(g_get_monotonic_time() / 1000); });
+
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        m_watch_ids[i] = 0;
+        m_proxies[i] = nullptr;
+        m_has_owner[i] = false;
+        m_owner_known[i] = false;
+        m_queries[i].session_bus = this;
+        m_queries[i].service = static_cast<Service>(i);
+    }
+
+    for (int i = 0; i < INHIBITION_SIGNAL_COUNT; ++i) {
+        m_signal_ids[i] = 0;
+    }
+}
+
+SessionBus::~SessionBus()
+{
+    Stop();
+}
+
+const char* SessionBus::ServiceName(Service service)
+{
+    return SESSION_BUS_SERVICES[service].name;
+}
+
+void SessionBus::SetIdleWatchLevels(const std::vector<int64_t>& levels_ms)
+{
+    m_idle_tracker.SetLevels(levels_ms);
+    m_idle_watches.assign(m_idle_tracker.GetLevels().size(), IdleWatch());
+
+    for (size_t level = 0; level < m_idle_watches.size(); ++level) {
+        m_idle_watches[level].session_bus = this;
+        m_idle_watches[level].level = static_cast<int>(level);
+    }
+}
+
+bool SessionBus::Start()
+{
+    if (m_connection) {
+        return true;
+    }
+
+    m_next_connect_time = g_get_monotonic_time() + static_cast<int64_t>(RECONNECT_INTERVAL_SECONDS) * 1000000;
+
+    GError* dbus_error = nullptr;
+
+    m_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, &dbus_error);
+
+    if (!m_connection) {
+        error_log("%s: Failed to connect to session bus: %s. D-Bus idle sources unavailable, retrying in %i seconds.",
+                  __func__,
+                  dbus_error ? dbus_error->message : "unknown error",
+                  RECONNECT_INTERVAL_SECONDS);
+
+        g_clear_error(&dbus_error);
+
+        return false;
+    }
+
+    // Handle a closed connection by reconnecting in ProcessPendingSignals() rather than by exiting.
+    g_dbus_connection_set_exit_on_close(m_connection, FALSE);
+
+    if (!m_context) {
+        m_context = g_main_context_new();
+    }
+
+    m_cancellable = g_cancellable_new();
+
+    if (m_next_latency_report_time == 0) {
+        m_next_latency_report_time = g_get_monotonic_time()
+                                     + static_cast<int64_t>(LATENCY_REPORT_INTERVAL_SECONDS) * 1000000;
+    }
+
+    // The name watches and proxies dispatch their signal handlers on the thread default context at creation.
+    g_main_context_push_thread_default(m_context);
+
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        const SessionBusServiceInfo& info = SESSION_BUS_SERVICES[i];
+
+        m_has_owner[i] = false;
+        m_owner_known[i] = false;
+
+        m_watch_ids[i] = g_bus_watch_name_on_connection(m_connection, info.name, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                        HandleNameAppeared, HandleNameVanished, this, nullptr);
+
+        // The proxy calls are plain method calls. Properties and signals of the services are not used, and the
+        // services must not be activated just because idle_detect asks.
+        m_proxies[i] = g_dbus_proxy_new_sync(m_connection,
+                                             static_cast<GDBusProxyFlags>(G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES
+                                                                          | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS
+                                                                          | G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START),
+                                             nullptr, info.name, info.object_path, info.interface_name,
+                                             nullptr, &dbus_error);
+
+        if (!m_proxies[i]) {
+            error_log("%s: Failed to create D-Bus proxy for %s: %s",
+                      __func__,
+                      info.name,
+                      dbus_error ? dbus_error->message : "unknown error");
+
+            g_clear_error(&dbus_error);
+        }
+    }
+
+    // Track inhibition from the inhibitor change signals. The signals only say that something changed, so each one marks
+    // the state for a single re-query in ProcessPendingSignals().
+    for (int i = 0; i < INHIBITION_SIGNAL_COUNT; ++i) {
+        const SessionBusServiceInfo& info = SESSION_BUS_SERVICES[SESSION_BUS_INHIBITION_SIGNALS[i].service];
+
+        m_signal_ids[i] = g_dbus_connection_signal_subscribe(m_connection, info.name, info.interface_name,
+                                                             SESSION_BUS_INHIBITION_SIGNALS[i].member,
+                                                             info.object_path, nullptr, G_DBUS_SIGNAL_FLAGS_NONE,
+                                                             HandleInhibitionSignal, this, nullptr);
+    }
+
+    // Mutter emits WatchFired for every client's watches. The handler picks out idle_detect's by id.
+    const SessionBusServiceInfo& mutter = SESSION_BUS_SERVICES[GNOME_MUTTER_IDLE_MONITOR];
+
+    m_watch_fired_signal_id = g_dbus_connection_signal_subscribe(m_connection, mutter.name, mutter.interface_name,
+                                                                 "WatchFired", mutter.object_path, nullptr,
+                                                                 G_DBUS_SIGNAL_FLAGS_NONE, HandleWatchFired, this,
+                                                                 nullptr);
+
+    g_main_context_pop_thread_default(m_context);
+
+    // Wait for the initial owner of each name, so that the first idle query sees the session type.
+    SessionBus_IterateUntil(m_context, 1000, [this]() {
+        for (int i = 0; i < SERVICE_COUNT; ++i) {
+            if (!m_owner_known[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    });
+
+    // Full inhibition query after (re)connecting. Changes after this come from the signals.
+    StartStaleInhibitionQueries();
+    StartIdleWatches();
+    WaitForQueries(1000);
+
+    normal_log("INFO: %s: Connected to session bus as %s.",
+               __func__,
+               g_dbus_connection_get_unique_name(m_connection));
+
+    return true;
+}
+
+void SessionBus::Stop()
+{
+    // Mutter drops the watches of a client that leaves the bus, but remove them while the connection is still up.
+    if (m_connection && !g_dbus_connection_is_closed(m_connection) && m_has_owner[GNOME_MUTTER_IDLE_MONITOR]
+        && m_proxies[GNOME_MUTTER_IDLE_MONITOR]) {
+        std::vector<unsigned int> watch_ids {m_active_watch_id};
+
+        for (const IdleWatch& watch : m_idle_watches) {
+            watch_ids.push_back(watch.id);
+        }
+
+        for (unsigned int watch_id : watch_ids) {
+            if (watch_id == 0) {
+                continue;
+            }
+
+            GVariant* dbus_result = g_dbus_proxy_call_sync(m_proxies[GNOME_MUTTER_IDLE_MONITOR], "RemoveWatch",
+                                                           g_variant_new("(u)", watch_id), G_DBUS_CALL_FLAGS_NONE,
+                                                           SESSION_BUS_SERVICES[GNOME_MUTTER_IDLE_MONITOR].timeout_ms,
+                                                           nullptr, nullptr);
+
+            if (dbus_result) {
+                g_variant_unref(dbus_result);
+            }
+        }
+    }
+
+    if (m_cancellable) {
+        // The cancelled replies still arrive, on m_context, and must be dispatched while this object is intact.
+        g_cancellable_cancel(m_cancellable);
+
+        SessionBus_IterateUntil(m_context, 1000, [this]() {
+            return !AnyQueryInFlight() && m_watch_calls_in_flight == 0;
+        });
+
+        g_object_unref(m_cancellable);
+        m_cancellable = nullptr;
+    }
+
+    for (int i = 0; i < INHIBITION_SIGNAL_COUNT; ++i) {
+        if (m_signal_ids[i] != 0) {
+            g_dbus_connection_signal_unsubscribe(m_connection, m_signal_ids[i]);
+            m_signal_ids[i] = 0;
+        }
+    }
+
+    if (m_watch_fired_signal_id != 0) {
+        g_dbus_connection_signal_unsubscribe(m_connection, m_watch_fired_signal_id);
+        m_watch_fired_signal_id = 0;
+    }
+
+    ResetIdleWatches();
+
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        if (m_watch_ids[i] != 0) {
+            g_bus_unwatch_name(m_watch_ids[i]);
+            m_watch_ids[i] = 0;
+        }
+
+        if (m_proxies[i]) {
+            g_object_unref(m_proxies[i]);
+            m_proxies[i] = nullptr;
+        }
+
+        m_has_owner[i] = false;
+        m_owner_known[i] = false;
+
+        Query& query = m_queries[i];
+
+        query.in_flight = false;
+        query.stale = false;
+        query.has_value = false;
+    }
+
+    if (m_connection) {
+        g_object_unref(m_connection);
+        m_connection = nullptr;
+    }
+
+    if (m_context) {
+        // Run any callbacks queued by the unwatches before the context goes.
+        while (g_main_context_iteration(m_context, FALSE)) {}
+
+        g_main_context_unref(m_context);
+        m_context = nullptr;
+    }
+}
+
+bool SessionBus::IsAvailable() const
+{
+    return m_connection != nullptr;
+}
+
+GMainContext* SessionBus::GetContext() const
+{
+    return m_context;
+}
+
+void SessionBus::ProcessPendingSignals()
+{
+    m_pass_start_time = g_get_monotonic_time();
+
+    if (m_connection && g_dbus_connection_is_closed(m_connection)) {
+        error_log("%s: Session bus connection closed. Reconnecting.",
+                  __func__);
+
+        Stop();
+
+        // Try to reconnect straight away once.
+        m_next_connect_time = 0;
+    }
+
+    if (!m_connection) {
+        if (m_pass_start_time >= m_next_connect_time) {
+            Start();
+        }
+
+        return;
+    }
+
+    while (g_main_context_iteration(m_context, FALSE)) {}
+
+    StartStaleInhibitionQueries();
+    StartIdleWatches();
+
+    if (m_pass_start_time >= m_next_latency_report_time) {
+        LogQueryLatency();
+
+        m_next_latency_report_time = m_pass_start_time + static_cast<int64_t>(LATENCY_REPORT_INTERVAL_SECONDS) * 1000000;
+    }
+}
+
+bool SessionBus::HasOwner(Service service) const
+{
+    return m_has_owner[service];
+}
+
+void SessionBus::StartQuery(Service service)
+{
+    Query& query = m_queries[service];
+
+    if (query.in_flight || !m_has_owner[service] || !m_proxies[service]) {
+        return;
+    }
+
+    if (service == GNOME_MUTTER_IDLE_MONITOR && !IsMutterIdleQueryNeeded()) {
+        return;
+    }
+
+    const SessionBusServiceInfo& info = SESSION_BUS_SERVICES[service];
+
+    query.in_flight = true;
+    query.stale = false;
+    query.start_time = g_get_monotonic_time();
+
+    // The reply is dispatched on the thread default context at the time of the call.
+    g_main_context_push_thread_default(m_context);
+
+    g_dbus_proxy_call(m_proxies[service], info.method,
+                      info.has_argument ? g_variant_new("(u)", info.argument) : nullptr,
+                      G_DBUS_CALL_FLAGS_NONE, info.timeout_ms, m_cancellable, HandleQueryReply, &query);
+
+    g_main_context_pop_thread_default(m_context);
+}
+
+void SessionBus::WaitForQueries(int deadline_ms)
+{
+    if (!m_context) {
+        return;
+    }
+
+    SessionBus_IterateUntil(m_context, deadline_ms, [this]() { return !AnyQueryInFlight(); });
+
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        if (m_queries[i].in_flight) {
+            ++m_queries[i].deadline_misses;
+
+            debug_log("INFO: %s: %s.%s did not reply within %i ms, using the last known value.",
+                      __func__,
+                      ServiceName(static_cast<Service>(i)),
+                      SESSION_BUS_SERVICES[i].method,
+                      deadline_ms);
+        }
+    }
+}
+
+int64_t SessionBus::GetIdleSeconds(Service service, bool& stale) const
+{
+    const Query& query = m_queries[service];
+
+    stale = false;
+
+    // Below the watch interval there may have been input since the last known. Reporting 0 instead would pass
+    // "active now" to event_detect each pass, which would then keep the combined idle time from ever reaching the
+    // threshold. The tracker caps the time instead, and the idle watch makes the threshold decision.
+    if (service == GNOME_MUTTER_IDLE_MONITOR && IsWatchingMutterIdle()) {
+        return m_idle_tracker.GetIdleMs() / 1000;
+    }
+
+    if (!query.has_value) {
+        return -1;
+    }
+
+    if (query.value_time >= m_pass_start_time) {
+        return query.value / 1000;
+    }
+
+    // No reply this pass. Assume no input since the last one.
+    stale = true;
+
+    return (query.value + (g_get_monotonic_time() - query.value_time) / 1000) / 1000;
+}
+
+bool SessionBus::IsWatchingMutterIdle() const
+{
+    return m_idle_watch_state == IDLE_WATCH_ADDED && m_idle_tracker.IsKnown();
+}
+
+bool SessionBus::IsMutterIdleQueryNeeded() const
+{
+    return !IsWatchingMutterIdle() || m_idle_tracker.IsRefreshNeeded();
+}
+
+bool SessionBus::IsInhibited(Service service) const
+{
+    if (service != KDE_POWER_MANAGEMENT && service != GNOME_SESSION_MANAGER) {
+        return false;
+    }
+
+    const Query& query = m_queries[service];
+
+    return m_has_owner[service] && query.has_value && query.value != 0;
+}
+
+void SessionBus::LogQueryLatency() const
+{
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        const Query& query = m_queries[i];
+
+        if (query.latency.GetCount() == 0 && query.deadline_misses == 0) {
+            continue;
+        }
+
+        normal_log("INFO: %s: %s.%s: %llu replies, %llu deadline misses, latency p50 %.0f us, p95 %.0f us, "
+                   "p99 %.0f us",
+                   __func__,
+                   ServiceName(static_cast<Service>(i)),
+                   SESSION_BUS_SERVICES[i].method,
+                   query.latency.GetCount(),
+                   query.deadline_misses,
+                   query.latency.Quantile(0.50),
+                   query.latency.Quantile(0.95),
+                   query.latency.Quantile(0.99));
+    }
+}
+
+void SessionBus::StartStaleInhibitionQueries()
+{
+    for (Service service : {KDE_POWER_MANAGEMENT, GNOME_SESSION_MANAGER}) {
+        if (m_queries[service].stale) {
+            StartQuery(service);
+        }
+    }
+}
+
+bool SessionBus::AnyQueryInFlight() const
+{
+    for (const Query& query : m_queries) {
+        if (query.in_flight) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SessionBus::StartIdleWatches()
+{
+    if (m_idle_watch_state != IDLE_WATCH_NONE || m_idle_watches.empty() || !m_has_owner[GNOME_MUTTER_IDLE_MONITOR]
+        || !m_proxies[GNOME_MUTTER_IDLE_MONITOR]) {
+        return;
+    }
+
+    m_idle_watch_state = IDLE_WATCH_ADDING;
+
+    const std::vector<int64_t>& levels_ms = m_idle_tracker.GetLevels();
+
+    g_main_context_push_thread_default(m_context);
+
+    for (IdleWatch& watch : m_idle_watches) {
+        ++m_watch_calls_in_flight;
+
+        g_dbus_proxy_call(m_proxies[GNOME_MUTTER_IDLE_MONITOR], "AddIdleWatch",
+                          g_variant_new("(t)", static_cast<guint64>(levels_ms[watch.level])), G_DBUS_CALL_FLAGS_NONE,
+                          SESSION_BUS_SERVICES[GNOME_MUTTER_IDLE_MONITOR].timeout_ms, m_cancellable,
+                          HandleAddIdleWatchReply, &watch);
+    }
+
+    g_main_context_pop_thread_default(m_context);
+}
+
+void SessionBus::ResetIdleWatches()
+{
+    m_idle_watch_state = IDLE_WATCH_NONE;
+
+    for (IdleWatch& watch : m_idle_watches) {
+        watch.id = 0;
+    }
+
+    m_active_watch_id = 0;
+    m_active_watch_adding = false;
+    m_idle_tracker.Reset();
+}
+
+void SessionBus::StartUserActiveWatch()
+{
+    if (!m_proxies[GNOME_MUTTER_IDLE_MONITOR]) {
+        return;
+    }
+
+    m_active_watch_adding = true;
+    ++m_watch_calls_in_flight;
+
+    g_main_context_push_thread_default(m_context);
+
+    g_dbus_proxy_call(m_proxies[GNOME_MUTTER_IDLE_MONITOR], "AddUserActiveWatch", nullptr, G_DBUS_CALL_FLAGS_NONE,
+                      SESSION_BUS_SERVICES[GNOME_MUTTER_IDLE_MONITOR].timeout_ms, m_cancellable,
+                      HandleAddUserActiveWatchReply, this);
+
+    g_main_context_pop_thread_default(m_context);
+}
+
+void SessionBus::UpdateWatchedIdleState(bool was_known, int previous_level)
+{
+    if (was_known && m_idle_tracker.GetLevel() == previous_level) {
+        return;
+    }
+
+    if (m_idle_tracker.IsAboveFirstLevel()) {
+        debug_log("INFO: %s: Mutter idle watches report idle time at %lld ms.",
+                  __func__,
+                  m_idle_tracker.GetLevels()[m_idle_tracker.GetLevel()]);
+    } else {
+        debug_log("INFO: %s: Mutter idle watches report input.",
+                  __func__);
+    }
+
+    // The user active watch fires once, on the next input after it is added, so it is added each time the idle time
+    // reaches the first level. One left over from a period that a GetIdletime reply ended still fires on the next
+    // input.
+    if (m_idle_tracker.IsAboveFirstLevel() && m_active_watch_id == 0 && !m_active_watch_adding) {
+        StartUserActiveWatch();
+    }
+}
+
+void SessionBus::SetOwner(const char* name, bool has_owner)
+{
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        if (strcmp(name, SESSION_BUS_SERVICES[i].name) == 0) {
+            if (m_owner_known[i] && m_has_owner[i] != has_owner) {
+                normal_log("INFO: %s: D-Bus service %s %s.",
+                           __func__,
+                           name,
+                           has_owner ? "appeared" : "vanished");
+            }
+
+            m_has_owner[i] = has_owner;
+            m_owner_known[i] = true;
+
+            // A (re)started service has a new set of inhibitors and a new idle counter, and one that has gone has
+            // neither.
+            m_queries[i].stale = has_owner;
+            m_queries[i].has_value = false;
+
+            // The watches belong to the previous owner. They are added again on the next pass.
+            if (i == GNOME_MUTTER_IDLE_MONITOR) {
+                ResetIdleWatches();
+            }
+
+            return;
+        }
+    }
+}
+
+void SessionBus::HandleNameAppeared(GDBusConnection* /* connection */, const char* name, const char* name_owner,
+                                    void* user_data)
+{
+    debug_log("INFO: %s: %s is owned by %s",
+              __func__,
+              name,
+              name_owner);
+
+    static_cast<SessionBus*>(user_data)->SetOwner(name, true);
+}
+
+void SessionBus::HandleNameVanished(GDBusConnection* /* connection */, const char* name, void* user_data)
+{
+    debug_log("INFO: %s: %s has no owner",
+              __func__,
+              name);
+
+    static_cast<SessionBus*>(user_data)->SetOwner(name, false);
+}
+
+void SessionBus::HandleInhibitionSignal(GDBusConnection* /* connection */, const char* /* sender_name */,
+                                        const char* /* object_path */, const char* interface_name,
+                                        const char* signal_name, GVariant* /* parameters */, void* user_data)
+{
+    SessionBus* session_bus = static_cast<SessionBus*>(user_data);
+
+    debug_log("INFO: %s: %s.%s received",
+              __func__,
+              interface_name,
+              signal_name);
+
+    for (int i = 0; i < SERVICE_COUNT; ++i) {
+        if (strcmp(interface_name, SESSION_BUS_SERVICES[i].interface_name) == 0) {
+            session_bus->m_queries[i].stale = true;
+        }
+    }
+}
+
+void SessionBus::HandleQueryReply(GObject* source_object, GAsyncResult* result, void* user_data)
+{
+    Query& query = *static_cast<Query*>(user_data);
+    const SessionBusServiceInfo& info = SESSION_BUS_SERVICES[query.service];
+
+    GError* dbus_error = nullptr;
+    GVariant* dbus_result = g_dbus_proxy_call_finish(reinterpret_cast<GDBusProxy*>(source_object), result, &dbus_error);
+
+    int64_t now = g_get_monotonic_time();
+
+    query.in_flight = false;
+
+    if (dbus_error) {
+        if (!g_error_matches(dbus_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            // Method likely doesn't exist or failed - expected on older desktops
+            debug_log("INFO: %s: Error calling %s on %s: %s",
+                      __func__,
+                      info.method,
+                      info.name,
+                      dbus_error->message);
+
+            query.has_value = false;
+        }
+
+        g_error_free(dbus_error);
+
+        return;
+    }
+
+    int64_t latency_us = now - query.start_time;
+
+    query.latency.Observe(latency_us);
+
+    if (!g_variant_is_of_type(dbus_result, G_VARIANT_TYPE(info.reply_type))) {
+        error_log("%s: Unexpected reply type %s from %s.%s",
+                  __func__,
+                  g_variant_get_type_string(dbus_result),
+                  info.name,
+                  info.method);
+
+        query.has_value = false;
+    } else {
+        bool had_value = query.has_value;
+        int64_t previous_value = query.value;
+
+        if (info.reply_type[1] == 'b') {
+            gboolean value = FALSE;
+            g_variant_get(dbus_result, "(b)", &value);
+            query.value = (value == TRUE);
+        } else if (info.reply_type[1] == 'u') {
+            guint32 value = 0;
+            g_variant_get(dbus_result, "(u)", &value);
+            query.value = value;
+        } else {
+            guint64 value = 0;
+            g_variant_get(dbus_result, "(t)", &value);
+            query.value = static_cast<int64_t>(value);
+        }
+
+        query.has_value = true;
+        query.value_time = now;
+
+        IDLE_DETECT_PROBE3(idle_detect, dbus_reply, info.name, query.value, latency_us);
+
+        // The first GetIdletime reply after the idle watch is added gives the state the watches then track. Later
+        // replies, while active, catch up with the input since the last known.
+        SessionBus* session_bus = query.session_bus;
+
+        if (query.service == GNOME_MUTTER_IDLE_MONITOR && session_bus->m_idle_watch_state == IDLE_WATCH_ADDED) {
+            IdleStateTracker& tracker = session_bus->m_idle_tracker;
+            bool was_known = tracker.IsKnown();
+            int previous_level = tracker.GetLevel();
+
+            tracker.RecordIdleTime(query.value, query.start_time / 1000);
+            session_bus->UpdateWatchedIdleState(was_known, previous_level);
+        }
+
+        if (info.reply_type[1] == 'b' && (!had_value || query.value != previous_value)) {
+            normal_log("INFO: %s: %s(%u) on %s is now %s.",
+                       __func__,
+                       info.method,
+                       info.argument,
+                       info.name,
+                       query.value ? "true" : "false");
+        }
+    }
+
+    g_variant_unref(dbus_result);
+}
+
+void SessionBus::HandleWatchFired(GDBusConnection* /* connection */, const char* /* sender_name */,
+                                  const char* /* object_path */, const char* /* interface_name */,
+                                  const char* /* signal_name */, GVariant* parameters, void* user_data)
+{
+    SessionBus* session_bus = static_cast<SessionBus*>(user_data);
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(u)"))) {
+        return;
+    }
+
+    guint32 watch_id = 0;
+    g_variant_get(parameters, "(u)", &watch_id);
+
+    // After a failed AddUserActiveWatch the state comes from polling, even though the idle watch is still there.
+    if (watch_id == 0 || session_bus->m_idle_watch_state != IDLE_WATCH_ADDED) {
+        return;
+    }
+
+    IdleStateTracker& tracker = session_bus->m_idle_tracker;
+    bool was_known = tracker.IsKnown();
+    int previous_level = tracker.GetLevel();
+
+    auto idle_watch = std::find_if(session_bus->m_idle_watches.begin(), session_bus->m_idle_watches.end(),
+                                   [watch_id](const IdleWatch& watch) { return watch.id == watch_id; });
+
+    if (idle_watch != session_bus->m_idle_watches.end()) {
+        // The idle time has just reached the watch interval.
+        tracker.SetLevelReached(idle_watch->level);
+    } else if (watch_id == session_bus->m_active_watch_id) {
+        session_bus->m_active_watch_id = 0;
+        tracker.SetInput();
+    } else {
+        return;
+    }
+
+    session_bus->UpdateWatchedIdleState(was_known, previous_level);
+}
+
+void SessionBus::HandleAddIdleWatchReply(GObject* source_object, GAsyncResult* result, void* user_data)
+{
+    IdleWatch* watch = static_cast<IdleWatch*>(user_data);
+    SessionBus* session_bus = watch->session_bus;
+    bool cancelled = false;
+
+    --session_bus->m_watch_calls_in_flight;
+
+    guint32 watch_id = SessionBus_FinishAddWatch(source_object, result, "AddIdleWatch", cancelled);
+
+    // Mutter went away in the meantime, or Stop() reset the state. After another watch failed, this one is still kept,
+    // so that Stop() removes it.
+    if (session_bus->m_idle_watch_state != IDLE_WATCH_ADDING
+        && session_bus->m_idle_watch_state != IDLE_WATCH_UNAVAILABLE) {
+        return;
+    }
+
+    watch->id = watch_id;
+
+    if (session_bus->m_idle_watch_state != IDLE_WATCH_ADDING) {
+        return;
+    }
+
+    if (watch_id == 0) {
+        if (!cancelled) {
+            normal_log("INFO: %s: Mutter idle watches unavailable, polling GetIdletime instead.",
+                       __func__);
+        }
+
+        session_bus->m_idle_watch_state = cancelled ? IDLE_WATCH_NONE : IDLE_WATCH_UNAVAILABLE;
+
+        return;
+    }
+
+    for (const IdleWatch& other : session_bus->m_idle_watches) {
+        if (other.id == 0) {
+            return;
+        }
+    }
+
+    session_bus->m_idle_watch_state = IDLE_WATCH_ADDED;
+    session_bus->m_idle_tracker.Reset();
+
+    std::string levels;
+
+    for (int64_t level_ms : session_bus->m_idle_tracker.GetLevels()) {
+        levels += tfm::format("%s%lld", levels.empty() ? "" : ", ", level_ms);
+    }
+
+    normal_log("INFO: %s: Tracking Mutter idle state with idle watches at %s ms.",
+               __func__,
+               levels);
+}
+
+void SessionBus::HandleAddUserActiveWatchReply(GObject* source_object, GAsyncResult* result, void* user_data)
+{
+    SessionBus* session_bus = static_cast<SessionBus*>(user_data);
+    bool cancelled = false;
+
+    --session_bus->m_watch_calls_in_flight;
+    session_bus->m_active_watch_adding = false;
+
+    guint32 watch_id = SessionBus_FinishAddWatch(source_object, result, "AddUserActiveWatch", cancelled);
+
+    // Mutter went away in the meantime, or Stop() reset the state.
+    if (session_bus->m_idle_watch_state != IDLE_WATCH_ADDED) {
+        return;
+    }
+
+    if (watch_id == 0) {
+        if (!cancelled) {
+            // Without the user active watch the return to active would go unnoticed.
+            normal_log("INFO: %s: Mutter user active watch unavailable, polling GetIdletime instead.",
+                       __func__);
+
+            session_bus->m_idle_watch_state = IDLE_WATCH_UNAVAILABLE;
+        }
+
+        return;
+    }
+
+    session_bus->m_active_watch_id = watch_id;
+}
+
+
+namespace {
+
+//! \brief systemd-logind service name, manager object and interfaces.
+constexpr const char* LOGIND_SERVICE = "org.freedesktop.login1";
+constexpr const char* LOGIND_MANAGER_PATH = "/org/freedesktop/login1";
+constexpr const char* LOGIND_MANAGER_INTERFACE = "org.freedesktop.login1.Manager";
+constexpr const char* LOGIND_SESSION_INTERFACE = "org.freedesktop.login1.Session";
+
+//! \brief Timeout of the logind calls in Start(), in milliseconds.
+constexpr int LOGIND_CALL_TIMEOUT_MS = 1000;
+
+//!
+//! \brief Calls a logind method that returns an object path, or gets the User Display property, a (so) in a variant.
+//! \return the object path, or empty on error or if there is none.
+//!
+std::string LogindIdleMonitor_CallForPath(GDBusConnection* connection, const char* object_path,
+                                          const char* interface_name, const char* method, GVariant* parameters,
+                                          const GVariantType* reply_type)
+{
+    GError* dbus_error = nullptr;
+
+    GVariant* dbus_result = g_dbus_connection_call_sync(connection, LOGIND_SERVICE, object_path, interface_name,
+                                                        method, parameters, reply_type, G_DBUS_CALL_FLAGS_NONE,
+                                                        LOGIND_CALL_TIMEOUT_MS, nullptr, &dbus_error);
+
+    if (!dbus_result) {
+        debug_log("INFO: %s: logind %s failed: %s",
+                  __func__,
+                  method,
+                  dbus_error ? dbus_error->message : "unknown error");
+
+        g_clear_error(&dbus_error);
+
+        return std::string {};
+    }
+
+    std::string path;
+    const gchar* path_str = nullptr;
+
+    if (g_variant_is_of_type(dbus_result, G_VARIANT_TYPE("(o)"))) {
+        g_variant_get(dbus_result, "(&o)", &path_str);
+        path = path_str;
+    } else {
+        // Properties.Get of User.Display: (v) holding (so), the session id and path. "/" is no display session.
+        GVariant* value = nullptr;
+
+        g_variant_get(dbus_result, "(v)", &value);
+
+        if (value && g_variant_is_of_type(value, G_VARIANT_TYPE("(so)"))) {
+            g_variant_get(value, "(&s&o)", nullptr, &path_str);
+
+            if (path_str && strcmp(path_str, "/") != 0) {
+                path = path_str;
+            }
+        }
+
+        if (value) {
+            g_variant_unref(value);
+        }
+    }
+
+    g_variant_unref(dbus_result);
+
+    return path;
+}
+
+} // namespace
+
+LogindIdleMonitor::LogindIdleMonitor()
+    : m_context(nullptr)
+    , m_connection(nullptr)
+    , m_session_proxy(nullptr)
+    , m_start_requested(false)
+    , m_hint_in_use(false)
+    , m_idle_hint(false)
+    , m_idle_since(0)
+    , m_next_connect_time(0)
+{}
+
+LogindIdleMonitor::~LogindIdleMonitor()
+{
+    Stop();
+}
+
+bool LogindIdleMonitor::Start()
+{
+    if (m_session_proxy) {
+        return true;
+    }
+
+    m_start_requested = true;
+    m_next_connect_time = g_get_monotonic_time() + static_cast<int64_t>(RECONNECT_INTERVAL_SECONDS) * 1000000;
+
+    GError* dbus_error = nullptr;
+
+    if (!m_connection) {
+        m_connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &dbus_error);
+
+        if (!m_connection) {
+            error_log("%s: Failed to connect to system bus: %s. logind idle hint unavailable.",
+                      __func__,
+                      dbus_error ? dbus_error->message : "unknown error");
+
+            g_clear_error(&dbus_error);
+
+            return false;
+        }
+
+        g_dbus_connection_set_exit_on_close(m_connection, FALSE);
+    }
+
+    std::string session_path = FindSessionObjectPath();
+
+    if (session_path.empty()) {
+        debug_log("INFO: %s: No logind session found for idle_detect. Retrying in %i seconds.",
+                  __func__,
+                  RECONNECT_INTERVAL_SECONDS);
+
+        return false;
+    }
+
+    if (!m_context) {
+        m_context = g_main_context_new();
+    }
+
+    // The proxy connects its PropertiesChanged subscription, which keeps the cached properties current, on the thread
+    // default context at creation.
+    g_main_context_push_thread_default(m_context);
+
+    m_session_proxy = g_dbus_proxy_new_sync(m_connection, G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START, nullptr,
+                                            LOGIND_SERVICE, session_path.c_str(), LOGIND_SESSION_INTERFACE,
+                                            nullptr, &dbus_error);
+
+    g_main_context_pop_thread_default(m_context);
+
+    if (!m_session_proxy) {
+        error_log("%s: Failed to create D-Bus proxy for logind session %s: %s",
+                  __func__,
+                  session_path,
+                  dbus_error ? dbus_error->message : "unknown error");
+
+        g_clear_error(&dbus_error);
+
+        return false;
+    }
+
+    m_hint_in_use = false;
+
+    if (!ReadHint()) {
+        error_log("%s: logind session %s has no IdleHint property.",
+                  __func__,
+                  session_path);
+
+        Stop();
+
+        return false;
+    }
+
+    normal_log("INFO: %s: Tracking logind IdleHint of session %s (currently %s).",
+               __func__,
+               session_path,
+               m_idle_hint ? "idle" : "active");
+
+    return true;
+}
+
+void LogindIdleMonitor::Stop()
+{
+    if (m_session_proxy) {
+        g_object_unref(m_session_proxy);
+        m_session_proxy = nullptr;
+    }
+
+    if (m_connection) {
+        g_object_unref(m_connection);
+        m_connection = nullptr;
+    }
+
+    if (m_context) {
+        // Run any callbacks queued by the unsubscribe before the context goes.
+        while (g_main_context_iteration(m_context, FALSE)) {}
+
+        g_main_context_unref(m_context);
+        m_context = nullptr;
+    }
+
+    m_hint_in_use = false;
+    m_idle_hint = false;
+}
+
+bool LogindIdleMonitor::IsAvailable() const
+{
+    return m_session_proxy != nullptr;
+}
+
+GMainContext* LogindIdleMonitor::GetContext() const
+{
+    return m_context;
+}
+
+void LogindIdleMonitor::ProcessPendingSignals()
+{
+    if (m_connection && g_dbus_connection_is_closed(m_connection)) {
+        error_log("%s: System bus connection closed.",
+                  __func__);
+
+        Stop();
+    }
+
+    if (!m_session_proxy) {
+        if (m_start_requested && g_get_monotonic_time() >= m_next_connect_time) {
+            Start();
+        }
+
+        return;
+    }
+
+    while (g_main_context_iteration(m_context, FALSE)) {}
+
+    bool idle_hint = m_idle_hint;
+    int64_t idle_since = m_idle_since;
+
+    if (!ReadHint()) {
+        return;
+    }
+
+    if (m_idle_hint != idle_hint || m_idle_since != idle_since) {
+        debug_log("INFO: %s: logind IdleHint changed to %s.",
+                  __func__,
+                  m_idle_hint ? "idle" : "active");
+    }
+}
+
+int64_t LogindIdleMonitor::GetIdleSeconds() const
+{
+    if (!m_session_proxy || !m_hint_in_use || m_idle_since <= 0) {
+        return -1;
+    }
+
+    // The hint is clear from the last input until the desktop's idle delay, which need not match the threshold, and
+    // says nothing of the input in between. So only the set hint carries an idle time. A value pinned below the
+    // threshold instead would change the last active time sent to event_detect, and schedule the next pass at the
+    // minimum interval, on every pass.
+    if (!m_idle_hint) {
+        return 0;
+    }
+
+    // logind stamps IdleSinceHintMonotonic when the hint is set, at the desktop's idle delay, not at the last input. So
+    // this idle time is short by that delay, which logind does not publish, and the transition to idle and the throttle
+    // tiers come that much later than with an input source.
+    return std::max<int64_t>(g_get_monotonic_time() - m_idle_since, 0) / 1000000;
+}
+
+std::string LogindIdleMonitor::FindSessionObjectPath()
+{
+    std::string path;
+
+    // 1. The session idle_detect was started in, e.g. by the user manager's environment.
+    std::optional<std::string> session_id = GetEnvVariable("XDG_SESSION_ID");
+
+    if (session_id && !session_id->empty()) {
+        path = LogindIdleMonitor_CallForPath(m_connection, LOGIND_MANAGER_PATH, LOGIND_MANAGER_INTERFACE,
+                                             "GetSession", g_variant_new("(s)", session_id->c_str()),
+                                             G_VARIANT_TYPE("(o)"));
+    }
+
+    // 2. The session of the process.
+    if (path.empty()) {
+        path = LogindIdleMonitor_CallForPath(m_connection, LOGIND_MANAGER_PATH, LOGIND_MANAGER_INTERFACE,
+                                             "GetSessionByPID",
+                                             g_variant_new("(u)", static_cast<guint32>(getpid())),
+                                             G_VARIANT_TYPE("(o)"));
+    }
+
+    // 3. A user service is in no session, so use the user's display session.
+    if (path.empty()) {
+        std::string user_path = LogindIdleMonitor_CallForPath(m_connection, LOGIND_MANAGER_PATH,
+                                                              LOGIND_MANAGER_INTERFACE, "GetUser",
+                                                              g_variant_new("(u)", static_cast<guint32>(getuid())),
+                                                              G_VARIANT_TYPE("(o)"));
+
+        if (!user_path.empty()) {
+            path = LogindIdleMonitor_CallForPath(m_connection, user_path.c_str(), "org.freedesktop.DBus.Properties",
+                                                 "Get", g_variant_new("(ss)", "org.freedesktop.login1.User",
+                                                                      "Display"),
+                                                 G_VARIANT_TYPE("(v)"));
+        }
+    }
+
+    return path;
+}
+
+bool LogindIdleMonitor::ReadHint()
+{
+    GVariant* hint = g_dbus_proxy_get_cached_property(m_session_proxy, "IdleHint");
+    GVariant* since = g_dbus_proxy_get_cached_property(m_session_proxy, "IdleSinceHintMonotonic");
+
+    bool ok = (hint && since);
+
+    if (ok) {
+        bool idle_hint = g_variant_get_boolean(hint);
+        int64_t idle_since = static_cast<int64_t>(g_variant_get_uint64(since));
+
+        // A desktop that does not manage the hint leaves it clear from login, with no change of its time.
+        if (idle_hint || (m_idle_since != 0 && idle_since != m_idle_since)) {
+            m_hint_in_use = true;
         }
-        // Even without release, we destroy the proxy reference below implicitly or explicitly?
-        // Wayland client library usually handles proxy destruction when display is disconnected/destroyed.
-        // Setting pointer to null is sufficient here.
-        m_seat = nullptr;
+
+        m_idle_hint = idle_hint;
+        m_idle_since = idle_since;
     }
-    // Destroy registry
-    if (m_registry) { wl_registry_destroy(m_registry); m_registry = nullptr; }
-    // Disconnect display
-    if (m_display) {
-        wl_display_flush(m_display); // Flush remaining requests if possible
-        wl_display_disconnect(m_display);
-        m_display = nullptr;
+
+    if (hint) {
+        g_variant_unref(hint);
     }
-    // Note: Interrupt pipe FDs are NOT closed here. They are owned by Start()/Stop(), not by the
-    // Wayland connection lifecycle. CleanupWayland() is called from InitializeWayland() retry loops
-    // where the pipe must survive across attempts.
 
-    // m_is_initialized is set in Stop() AFTER cleanup is done.
+    if (since) {
+        g_variant_unref(since);
+    }
+
+    return ok;
 }
 
-// CreateIdleNotification
-void WaylandIdleMonitor::CreateIdleNotification() {
-    if (!m_idle_notifier || !m_seat || m_idle_notification) {
-        debug_log("INFO: %s: Cannot create idle notification (missing deps or already exists).", __func__);
-        return;
+} // namespace IdleDetect
+
+//!
+//! \brief Signal handler
+//! \param signum
+//!
+void HandleSignal(int signum) {
+    // Only lock free atomics and write() here, which are async-signal-safe. The logger takes a lock and allocates, so
+    // the main loop logs the signal with LogReceivedSignal().
+    g_received_signal.store(signum);
+
+    if (signum == SIGINT || signum == SIGTERM) {
+        g_shutdown_requested.store(true);
     }
-    m_idle_notification = ext_idle_notifier_v1_get_idle_notification(
-        m_idle_notifier, m_notification_timeout_ms, m_seat);
 
-    if (!m_idle_notification) {
-        error_log("%s: ext_idle_notifier_v1_get_idle_notification failed.", __func__);
-        return;
+    // Wake the main loop's poll().
+    if (g_shutdown_wakeup_fd != -1) {
+        uint64_t wakeup = 1;
+        [[maybe_unused]] ssize_t written = write(g_shutdown_wakeup_fd, &wakeup, sizeof(wakeup));
     }
-    ext_idle_notification_v1_add_listener(m_idle_notification,
-                                          (const ext_idle_notification_v1_listener*)c_idle_notification_listener_ptr,
-                                          this);
-    // Reset state when creating notification
-    m_is_idle.store(false);
-    m_idle_start_time.store(0);
+}
 
-    if (wl_display_flush(m_display) == -1) {
-        error_log("%s: wl_display_flush failed after adding notification listener.", __func__);
+//!
+//! \brief Logs the signal HandleSignal() last received, once. Called from the main loop.
+//!
+static void LogReceivedSignal()
+{
+    int signum = g_received_signal.exchange(0);
+
+    if (signum == SIGINT || signum == SIGTERM) {
+        normal_log("INFO: %s: Received signal %d. Requesting shutdown.",
+                   __func__,
+                   signum);
+    } else if (signum != 0) {
+        normal_log("INFO: %s: Received unexpected signal %d.",
+                   __func__,
+                   signum);
     }
-    debug_log("INFO: %s: Created idle notification object (timeout %d ms).", __func__, m_notification_timeout_ms);
 }
 
-// WaylandMonitorThread (using poll)
-void WaylandIdleMonitor::WaylandMonitorThread() {
-    debug_log("INFO: %s: Wayland monitor thread started.", __func__);
+//!
+//! \brief The GMainContext of a D-Bus client, polled by WaitForMainLoopEvent() with the main loop's own fds.
+//!
+struct PolledContext
+{
+    GMainContext* context = nullptr;
+    gint max_priority = 0;
+    std::vector<GPollFD> fds;
 
-    if (!m_display || m_interrupt_pipe_fd[0] == -1) {
-        error_log("CRITICAL: %s: Wayland display or interrupt pipe not ready. Exiting thread.", __func__);
-        m_initialized.store(false); // Mark as failed
-        return;
+    //! \brief Index of the context's first fd in the poll() array.
+    size_t first = 0;
+
+    //! \brief Whether the context was acquired for this iteration. Only then is it checked, dispatched and released.
+    bool acquired = false;
+};
+
+//!
+//! \brief Waits for the next event that calls for a main loop pass: an idle transition reported by the Wayland, X11 or
+//! D-Bus idle sources, a control state change, or the shutdown request. The D-Bus signals are dispatched here as they
+//! arrive, so that the pass sees them already applied. Other events on the fds, e.g. the Wayland activity notification,
+//! are handled without a pass.
+//! \param timeout_ms longest wait, in milliseconds.
+//! \return true if woken by an event, false on the timeout.
+//!
+static bool WaitForMainLoopEvent(int64_t timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    // Kept across calls and cleared, not freed, on each iteration, so that a wakeup allocates nothing once the capacity
+    // has been reached.
+    static std::vector<pollfd> fds;
+    static PolledContext polled_contexts[2];
+
+    if (fds.capacity() == 0) {
+        fds.reserve(MAIN_LOOP_POLL_FDS_RESERVED);
     }
 
-    struct pollfd fds[2];
-    fds[0].fd = wl_display_get_fd(m_display);
-    fds[0].events = POLLIN | POLLERR | POLLHUP;
-    fds[1].fd = m_interrupt_pipe_fd[0]; // Interrupt pipe read end
-    fds[1].events = POLLIN | POLLERR | POLLHUP;
+    polled_contexts[0].context = g_session_bus.GetContext();
+    polled_contexts[1].context = g_logind_idle_monitor.GetContext();
 
-    int poll_ret;
+    while (!g_shutdown_requested.load()) {
+        int64_t remaining_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   deadline - std::chrono::steady_clock::now()).count();
 
-    while (!m_interrupt_monitor.load(std::memory_order_relaxed)) {
-        // Prepare read BEFORE blocking in poll
-        while (wl_display_prepare_read(m_display) != 0) {
-            // Dispatch pending events that arrived before prepare_read locked the queue
-            if (wl_display_dispatch_pending(m_display) == -1) {
-                error_log("%s: wl_display_dispatch_pending() failed in prepare loop. Exiting thread.", __func__);
-                goto thread_exit; // Use goto for central exit point? Or just return?
-            }
+        if (remaining_ms <= 0) {
+            return false;
         }
 
-        // Flush requests to ensure server gets listener setups etc. before we block
-        if (wl_display_flush(m_display) == -1 && errno != EAGAIN) {
-            error_log("%s: wl_display_flush() failed: %s (%d). Exiting thread.", __func__, strerror(errno), errno);
-            wl_display_cancel_read(m_display);
-            goto thread_exit;
+        // The alarm events already in the Xlib queue are not signalled on the fd again.
+        if (g_x11_idle_monitor.ProcessPendingEvents()) {
+            return true;
         }
 
-        // Block in poll() until Wayland FD has events OR interrupt pipe is written/closed
-        poll_ret = poll(fds, 2, -1); // No timeout
+        int timeout = static_cast<int>(remaining_ms);
+
+        fds.clear();
+        fds.push_back({g_shutdown_wakeup_fd, POLLIN, 0});
+
+        const size_t control_index = fds.size();
+        fds.push_back({g_idle_detect_control_monitor.GetFd(), POLLIN, 0});
 
-        if (poll_ret < 0) {
-            if (errno == EINTR) { continue; } // Interrupted by unrelated signal
-            error_log("%s: poll() failed: %s (%d). Exiting thread.", __func__, strerror(errno), errno);
-            wl_display_cancel_read(m_display); // Need to cancel before error exit? Yes.
-            goto thread_exit;
+        const size_t x11_index = fds.size();
+        fds.push_back({g_x11_idle_monitor.GetFd(), POLLIN, 0});
+
+        // The running command's exit, and its timeout or the end of the dwell of a pending one.
+        fds.push_back({g_command_executor.GetFd(), POLLIN, 0});
+
+        int64_t command_deadline_ms = g_command_executor.GetNextDeadlineMs();
+
+        if (command_deadline_ms >= 0) {
+            timeout = static_cast<int>(std::min<int64_t>(timeout, command_deadline_ms));
         }
 
-        // Check for interrupt first
-        if (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) {
-            debug_log("INFO: %s: Interrupt or pipe error detected.", __func__);
-            if (fds[1].revents & POLLIN) { // Drain pipe if readable
-                char buf[8]; [[maybe_unused]] ssize_t drain = read(m_interrupt_pipe_fd[0], buf, sizeof(buf));
-            }
-            wl_display_cancel_read(m_display); // Cancel Wayland read preparation
-            break; // Exit loop on interrupt
+        int64_t throttle_deadline_ms = g_cgroup_throttle.GetNextDeadlineMs();
+
+        if (throttle_deadline_ms >= 0) {
+            timeout = static_cast<int>(std::min<int64_t>(timeout, throttle_deadline_ms));
         }
 
-        // Check for Wayland events or errors on Wayland FD
-        if (fds[0].revents & (POLLERR | POLLHUP)) {
-            error_log("%s: Error/Hangup on Wayland display FD. Exiting thread.", __func__);
-            // Don't need to cancel read if FD is likely dead
-            goto thread_exit;
+        for (PolledContext& polled : polled_contexts) {
+            polled.fds.clear();
+            polled.acquired = polled.context && g_main_context_acquire(polled.context);
+
+            if (!polled.acquired) {
+                continue;
+            }
+
+            if (g_main_context_prepare(polled.context, &polled.max_priority)) {
+                timeout = 0; // A source is ready already.
+            }
+
+            gint context_timeout = -1;
+            gint n_fds = g_main_context_query(polled.context, polled.max_priority, &context_timeout, nullptr, 0);
+
+            polled.fds.resize(n_fds);
+
+            if (n_fds > 0) {
+                g_main_context_query(polled.context, polled.max_priority, &context_timeout, polled.fds.data(), n_fds);
+            }
+
+            if (context_timeout >= 0) {
+                timeout = std::min(timeout, static_cast<int>(context_timeout));
+            }
+
+            polled.first = fds.size();
+
+            for (const GPollFD& fd : polled.fds) {
+                fds.push_back({fd.fd, static_cast<short>(fd.events), 0});
+            }
         }
 
-        // If we woke up for Wayland FD, read events
-        if (fds[0].revents & POLLIN) {
-            if (wl_display_read_events(m_display) == -1) {
-                error_log("%s: wl_display_read_events() failed. Exiting thread.", __func__);
-                goto thread_exit;
+        // Last, as each prepared read must be followed by FinishRead().
+        const size_t wayland_index = fds.size();
+        fds.push_back({g_wayland_idle_monitor.PrepareRead(), POLLIN, 0});
+
+        // poll() ignores the negative fds of the sources that are not up.
+        int ready = poll(fds.data(), fds.size(), timeout);
+
+        if (ready < 0) {
+            if (errno != EINTR) {
+                error_log("%s: poll() failed: %s (%d)", __func__, strerror(errno), errno);
             }
-            // Dispatch the read events which trigger callbacks
-            if (wl_display_dispatch_pending(m_display) == -1) {
-                error_log("%s: wl_display_dispatch_pending() failed after read. Exiting thread.", __func__);
-                goto thread_exit;
+
+            for (pollfd& fd : fds) {
+                fd.revents = 0;
             }
-        } else {
-            // Woke up but not for Wayland FD (shouldn't happen with poll=-1 unless interrupted)
-            wl_display_cancel_read(m_display);
         }
 
-        // Re-check interrupt flag after dispatching events
-        if (m_interrupt_monitor.load(std::memory_order_relaxed)) {
-            debug_log("INFO: %s: Interrupt detected after event dispatch.", __func__);
-            break;
+        bool pass_needed = false;
+
+        if (fds[wayland_index].fd != -1 && g_wayland_idle_monitor.FinishRead(fds[wayland_index].revents)) {
+            debug_log("INFO: %s: Woken for a Wayland idle transition.", __func__);
+            pass_needed = true;
         }
-    } // end while
 
-thread_exit:
-    debug_log("INFO: %s: Wayland monitor thread exiting.", __func__);
-    // Cleanup of Wayland resources happens in Stop() or ~WaylandIdleMonitor()
-    // which is called after this thread is joined.
-}
+        for (PolledContext& polled : polled_contexts) {
+            if (!polled.acquired) {
+                continue;
+            }
 
-// IsAvailable getter
-bool WaylandIdleMonitor::IsAvailable() const {
-    return m_initialized.load();
-}
+            for (size_t i = 0; i < polled.fds.size(); ++i) {
+                polled.fds[i].revents = static_cast<unsigned short>(fds[polled.first + i].revents);
+            }
 
-// IsIdle getter
-bool WaylandIdleMonitor::IsIdle() const {
-    return m_is_idle.load(std::memory_order_relaxed);
-}
+            if (g_main_context_check(polled.context,
+                                     polled.max_priority,
+                                     polled.fds.data(),
+                                     static_cast<gint>(polled.fds.size()))) {
+                g_main_context_dispatch(polled.context);
+                debug_log("INFO: %s: Woken for a D-Bus signal.", __func__);
+                pass_needed = true;
+            }
 
-// GetIdleSeconds getter
-int64_t WaylandIdleMonitor::GetIdleSeconds() const {
-    if (!m_initialized.load()) {
-        return -1; // Indicate not available rather than 0 (active)
-    }
-    if (m_is_idle.load(std::memory_order_relaxed)) {
-        int64_t start_time = m_idle_start_time.load(std::memory_order_relaxed);
-        int64_t current_time = GetUnixEpochTime(); // Assumed thread-safe
-        return (current_time > start_time) ? (current_time - start_time) : 0;
-    } else {
-        return 0; // Active
-    }
-}
+            g_main_context_release(polled.context);
+            polled.acquired = false;
+        }
 
-// --- Static Listener Implementations (C-linkage required) ---
-extern "C" {
+        if (fds[control_index].revents && g_idle_detect_control_monitor.ProcessPendingInput()) {
+            debug_log("INFO: %s: Woken for a control state change.", __func__);
+            pass_needed = true;
+        }
 
-void WaylandIdleMonitor_HandleGlobal(void *data, wl_registry *registry, uint32_t name,
-                                     const char *interface, uint32_t version)
-{
-    WaylandIdleMonitor *monitor = static_cast<WaylandIdleMonitor*>(data);
-    debug_log("INFO: %s: Global: %s v%u (name %u)", __func__, interface, version, name);
+        if (fds[x11_index].revents && g_x11_idle_monitor.ProcessPendingEvents()) {
+            debug_log("INFO: %s: Woken for an X11 idle transition.", __func__);
+            pass_needed = true;
+        }
 
-    if (strcmp(interface, wl_seat_interface.name) == 0) {
-        monitor->m_seat_id = name;
-        monitor->m_seat = static_cast<wl_seat*>(
-            wl_registry_bind(registry, name, &wl_seat_interface, std::min(version, 5u)) // Request v5 for release
-            );
-        debug_log("INFO: %s: Bound wl_seat (name %u) version %u.", __func__, name, wl_proxy_get_version((wl_proxy*)monitor->m_seat));
-    } else if (strcmp(interface, ext_idle_notifier_v1_interface.name) == 0) {
-        monitor->m_idle_notifier_id = name;
-        monitor->m_idle_notifier = static_cast<ext_idle_notifier_v1*>(
-            wl_registry_bind(registry, name, &ext_idle_notifier_v1_interface, std::min(version, 1u)) // Request v1 or v2? Start with 1.
-            );
-        debug_log("INFO: %s: Bound %s (name %u) version %u.",
-                  __func__,
-                  ext_idle_notifier_v1_interface.name,
-                  name,
-                  wl_proxy_get_version((wl_proxy*)monitor->m_idle_notifier));
-    }
-}
+        // Need no pass: neither the command's state nor the ramp's is the session's.
+        g_command_executor.Process();
+        g_cgroup_throttle.Process();
 
-void WaylandIdleMonitor_HandleGlobalRemove(void *data, wl_registry * /* registry */, uint32_t name)
-{
-    WaylandIdleMonitor *monitor = static_cast<WaylandIdleMonitor*>(data);
-    debug_log("INFO: %s: Wayland global removed: %u", __func__, name);
-    if (name == monitor->m_seat_id) {
-        error_log("WARN: %s: Monitored wl_seat (name %u) was removed!", __func__, name);
-        monitor->m_seat = nullptr; // Mark as gone, maybe trigger re-init?
-        monitor->m_seat_id = 0;
-    } else if (name == monitor->m_idle_notifier_id) {
-        error_log("WARN: %s: Idle notifier global (name %u) was removed!", __func__, name);
-        monitor->m_idle_notifier = nullptr; // Mark as gone
-        monitor->m_idle_notifier_id = 0;
-    }
-}
+        if (fds[0].revents) {
+            uint64_t wakeup = 0;
+            [[maybe_unused]] ssize_t bytes_read = read(g_shutdown_wakeup_fd, &wakeup, sizeof(wakeup));
 
-void WaylandIdleMonitor_HandleIdled(void *data, ext_idle_notification_v1 * /* notification */)
-{
-    WaylandIdleMonitor *monitor = static_cast<WaylandIdleMonitor*>(data);
-    if (!monitor->m_is_idle.exchange(true, std::memory_order_relaxed)) { // Only update time on transition
-        monitor->m_idle_start_time.store(GetUnixEpochTime(), std::memory_order_relaxed);
-        debug_log("INFO: %s: Wayland Idle state entered at %lld", __func__, monitor->m_idle_start_time.load(std::memory_order_relaxed));
+            LogReceivedSignal();
+        }
+
+        if (pass_needed) {
+            return true;
+        }
     }
+
+    debug_log("INFO: %s: Shutdown requested during wait.", __func__);
+
+    return true;
 }
 
-void WaylandIdleMonitor_HandleResumed(void *data, ext_idle_notification_v1 * /* notification */)
+//!
+//! \brief Applies an idle or active transition to the DC workload: with freeze_cgroup, by thawing or freezing its
+//! cgroup. Otherwise, or if that fails, and with execute_dc_control_scripts: with use_boinc_rpc, by setting the BOINC
+//! run mode over the GUI RPC, otherwise, or if that fails, by requesting the idle or active command.
+//! \param idle whether the session became idle.
+//! \param command the idle or active command.
+//! \param use_boinc_rpc whether to try the GUI RPC before the command.
+//! \param execute_commands whether to apply the transition through the DC client, execute_dc_control_scripts.
+//!
+static void ApplyTransition(bool idle, const std::string& command, bool use_boinc_rpc, bool execute_commands)
 {
-    WaylandIdleMonitor *monitor = static_cast<WaylandIdleMonitor*>(data);
-    if (monitor->m_is_idle.exchange(false, std::memory_order_relaxed)) { // Only update time on transition
-        monitor->m_idle_start_time.store(0, std::memory_order_relaxed);
-        debug_log("INFO: %s: Wayland Idle state exited (resumed).", __func__);
-    }
-}
+    if (g_cgroup_freezer.IsEnabled()) {
+        if (idle ? g_cgroup_freezer.Thaw() : g_cgroup_freezer.Freeze()) {
+            return;
+        }
 
-// Define the actual static listener structs using positional initialization
-const struct wl_registry_listener g_registry_listener = {
-    /* .global = */ WaylandIdleMonitor_HandleGlobal,
-    /* .global_remove = */ WaylandIdleMonitor_HandleGlobalRemove
-};
+        if (execute_commands) {
+            error_log("%s: cgroup %s failed. Falling back to the DC client.",
+                      __func__,
+                      idle ? "thaw" : "freeze");
+        }
+    }
 
-const struct ext_idle_notification_v1_listener g_idle_notification_listener = {
-    /* .idled = */ WaylandIdleMonitor_HandleIdled,
-    /* .resumed = */ WaylandIdleMonitor_HandleResumed
-};
+    if (!execute_commands) {
+        return;
+    }
 
-} // extern "C"
+    // A running or waiting command would apply its state after the RPC, so the RPC waits its turn behind it, as a
+    // command would.
+    if (use_boinc_rpc && !g_command_executor.IsRunning() && !g_command_executor.HasPending()) {
+        if (g_boinc_rpc_client.SetRunMode(idle ? BoincRpcClient::RUN_MODE_ALWAYS : BoincRpcClient::RUN_MODE_NEVER)) {
+            // The command that last succeeded no longer describes the client's state.
+            g_command_executor.InvalidateApplied();
+            return;
+        }
 
+        error_log("%s: BOINC GUI RPC run mode change failed. Falling back to the %s command.",
+                  __func__,
+                  idle ? "idle" : "active");
+    }
 
-} // namespace IdleDetect
+    g_command_executor.Request(command);
+}
 
 //!
-//! \brief Signal handler
-//! \param signum
+//! \brief Thaws the freeze cgroup and restores the kernel defaults in the throttle cgroup, so that the workload is not
+//! left frozen or throttled without idle_detect. Does nothing the second time. Called in the shutdown sequence, and
+//! registered with std::atexit() for an exit that skips it, e.g. Xlib's on the loss of the X connection before libX11
+//! 1.8.
 //!
-void HandleSignal(int signum) {
-    if (signum == SIGINT || signum == SIGTERM) {
-        // Use log() here as it's presumably safe enough during shutdown signal
-        normal_log("INFO: %s: Received signal %d. Requesting shutdown.",
-            __func__,
-            signum);
-        g_shutdown_requested.store(true);
-
-        g_idle_detect_control_monitor.m_interrupt_idle_detect_control_monitor.store(true);
-        g_idle_detect_control_monitor.cv_idle_detect_control_monitor_thread.notify_all();
-    } else {
-        normal_log("INFO: %s: Received unexpected signal %d.",
-            __func__,
-            signum);
+static void ReleaseCgroupControls()
+{
+    if (g_cgroup_freezer.IsFrozen()) {
+        normal_log("INFO: %s: Thawing cgroup %s.", __func__, g_cgroup_freezer.GetCgroupPath().string());
+        g_cgroup_freezer.Thaw();
     }
+
+    g_cgroup_throttle.Release();
 }
 
 // Helper function to get the user's config path
@@ -1691,15 +3253,27 @@ int main(int argc, char* argv[])
     // --- Get Relevant Config Values ---
     // (variable_names are snake_case)
     int idle_threshold_seconds = 0;
-    int check_interval_seconds = IdleDetect::DEFAULT_CHECK_INTERVAL_SECONDS;
+    int min_check_interval_ms = static_cast<int>(IdleCheckScheduler::DEFAULT_MIN_INTERVAL_MS);
+    int max_check_interval_seconds = static_cast<int>(IdleCheckScheduler::DEFAULT_MAX_INTERVAL_MS / 1000);
+    int command_timeout_seconds = static_cast<int>(CommandExecutor::DEFAULT_TIMEOUT_MS / 1000);
+    int command_min_dwell_seconds = static_cast<int>(CommandExecutor::DEFAULT_MIN_DWELL_MS / 1000);
     bool should_update_event_detect = true;
     fs::path event_data_path;
     bool execute_dc_control_scripts = true;
+    bool use_boinc_rpc = false;
+    std::string freeze_cgroup;
+    std::string throttle_cgroup;
+    std::string throttle_tiers;
+    int throttle_hysteresis_seconds = static_cast<int>(CgroupThrottle::DEFAULT_HYSTERESIS_SECONDS);
+    int throttle_ramp_seconds = static_cast<int>(CgroupThrottle::DEFAULT_RAMP_MS / 1000);
+    int freeze_confirm_timeout_ms = CgroupFreezer::DEFAULT_CONFIRM_TIMEOUT_MS;
+    int boinc_rpc_port = BoincRpcClient::DEFAULT_PORT;
     std::string active_command;
     std::string idle_command;
     std::string shmem_name = "/event_detect_last_active"; // Default
     bool use_event_detect = true; // This flag now controls fallback via file OR shmem
     std::string last_active_time_cpp_filename;
+    bool pipe_send_timestamps = false;
 
     try {
         idle_threshold_seconds = std::get<int>(g_config.GetArg("inactivity_time_trigger"));
@@ -1708,9 +3282,22 @@ int main(int argc, char* argv[])
         active_command = std::get<std::string>(g_config.GetArg("active_command"));
         idle_command = std::get<std::string>(g_config.GetArg("idle_command"));
         execute_dc_control_scripts = std::get<bool>(g_config.GetArg("execute_dc_control_scripts"));
+        use_boinc_rpc = std::get<bool>(g_config.GetArg("use_boinc_rpc"));
+        boinc_rpc_port = std::get<int>(g_config.GetArg("boinc_rpc_port"));
+        freeze_cgroup = std::get<std::string>(g_config.GetArg("freeze_cgroup"));
+        freeze_confirm_timeout_ms = std::get<int>(g_config.GetArg("freeze_confirm_timeout_ms"));
+        throttle_cgroup = std::get<std::string>(g_config.GetArg("throttle_cgroup"));
+        throttle_tiers = std::get<std::string>(g_config.GetArg("throttle_tiers"));
+        throttle_hysteresis_seconds = std::get<int>(g_config.GetArg("throttle_hysteresis_seconds"));
+        throttle_ramp_seconds = std::get<int>(g_config.GetArg("throttle_ramp_seconds"));
         shmem_name = std::get<std::string>(g_config.GetArg("shmem_name"));
         use_event_detect = std::get<bool>(g_config.GetArg("use_event_detect"));
         last_active_time_cpp_filename = std::get<std::string>(g_config.GetArg("last_active_time_cpp_filename"));
+        pipe_send_timestamps = std::get<bool>(g_config.GetArg("pipe_send_timestamps"));
+        min_check_interval_ms = std::get<int>(g_config.GetArg("min_check_interval_ms"));
+        command_timeout_seconds = std::get<int>(g_config.GetArg("command_timeout_seconds"));
+        command_min_dwell_seconds = std::get<int>(g_config.GetArg("command_min_dwell_seconds"));
+        max_check_interval_seconds = std::get<int>(g_config.GetArg("max_check_interval_seconds"));
     } catch (const std::bad_variant_access& e) {
         error_log("%s: Configuration value missing or has wrong type: %s. Using defaults where possible.",
                   __func__,
@@ -1726,6 +3313,16 @@ int main(int argc, char* argv[])
 
     // --- Signal Handling Setup ---
     g_shutdown_requested = false;
+
+    // Created before the handlers are installed, which write it to wake the main loop.
+    g_shutdown_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_shutdown_wakeup_fd == -1) {
+        error_log("%s: Failed to create the shutdown eventfd: %s",
+                  __func__,
+                  strerror(errno));
+        return 1;
+    }
+
     struct sigaction action;
     memset(&action, 0, sizeof(struct sigaction));
     action.sa_handler = HandleSignal;
@@ -1741,6 +3338,10 @@ int main(int argc, char* argv[])
     // Optional: Ignore SIGPIPE if writing to pipe fails often
     // signal(SIGPIPE, SIG_IGN);
 
+    // From here on log output is written by the asynchronous logger thread, so a slow journal or stdout cannot stall
+    // the main loop or the Wayland callbacks.
+    g_logger.Start();
+
     pid_t current_pid = getpid();
 
     normal_log("INFO: %s: idle_detect C++ program, %s, started, pid %i",
@@ -1748,10 +3349,53 @@ int main(int argc, char* argv[])
         g_version,
         current_pid);
 
-    debug_log("INFO: %s: Idle threshold: %d seconds, Check interval: %d seconds",
+    g_idle_check_scheduler.SetBounds(min_check_interval_ms, static_cast<int64_t>(max_check_interval_seconds) * 1000);
+    g_idle_check_scheduler.SetThreshold(idle_threshold_seconds);
+    g_command_executor.SetTimeout(static_cast<int64_t>(command_timeout_seconds) * 1000);
+    g_command_executor.SetMinDwell(static_cast<int64_t>(command_min_dwell_seconds) * 1000);
+    g_boinc_rpc_client.SetPort(boinc_rpc_port);
+    g_cgroup_freezer.SetConfirmTimeout(freeze_confirm_timeout_ms);
+    g_cgroup_freezer.SetCgroup(freeze_cgroup);
+
+    if (!throttle_cgroup.empty()) {
+        std::optional<std::vector<CgroupThrottle::Tier>> tiers = CgroupThrottle::ParseTiers(throttle_tiers);
+
+        if (tiers) {
+            g_cgroup_throttle.SetTiers(*tiers);
+            g_cgroup_throttle.SetHysteresis(throttle_hysteresis_seconds);
+
+            if (tiers->size() > 1 && throttle_hysteresis_seconds >= (*tiers)[1].idle_seconds) {
+                normal_log("WARN: %s: throttle_hysteresis_seconds %d is not below the second tier's idle time of %lld "
+                           "seconds. It is reduced for the tiers it is not below, so that the return to active still "
+                           "steps down.",
+                           __func__,
+                           throttle_hysteresis_seconds,
+                           (*tiers)[1].idle_seconds);
+            }
+            g_cgroup_throttle.SetRampDuration(static_cast<int64_t>(throttle_ramp_seconds) * 1000);
+            g_cgroup_throttle.SetCgroup(throttle_cgroup);
+        } else {
+            error_log("%s: throttle_tiers is invalid. The throttle is disabled.", __func__);
+        }
+    }
+
+    // The idle levels whose crossings the event driven backends report: the threshold, and each throttle tier, so that
+    // the idle time a tier is chosen from does not reach it before its event, nor stay above it after the next input.
+    std::vector<int64_t> idle_levels_ms {static_cast<int64_t>(idle_threshold_seconds) * 1000};
+
+    if (g_cgroup_throttle.IsEnabled()) {
+        for (const CgroupThrottle::Tier& tier : g_cgroup_throttle.GetTiers()) {
+            idle_levels_ms.push_back(tier.idle_seconds * 1000);
+        }
+    }
+
+    std::atexit(ReleaseCgroupControls);
+
+    debug_log("INFO: %s: Idle threshold: %d seconds, Check interval: %d ms to %d seconds",
               __func__,
               idle_threshold_seconds,
-              check_interval_seconds);
+              min_check_interval_ms,
+              max_check_interval_seconds);
     debug_log("INFO: %s: Update event_detect: %s, Pipe path: %s",
               __func__,
               should_update_event_detect ? "true" : "false",
@@ -1759,40 +3403,38 @@ int main(int argc, char* argv[])
     debug_log("INFO: %s: Execute dc control scripts: %s",
               __func__,
               execute_dc_control_scripts ? "true" : "false");
+    debug_log("INFO: %s: Use BOINC GUI RPC: %s, port %d",
+              __func__,
+              use_boinc_rpc ? "true" : "false",
+              boinc_rpc_port);
+    debug_log("INFO: %s: Freeze cgroup: '%s', confirmation timeout %d ms",
+              __func__,
+              g_cgroup_freezer.GetCgroupPath().string(),
+              freeze_confirm_timeout_ms);
+    debug_log("INFO: %s: Throttle: %s, tiers '%s', hysteresis %d seconds, ramp %d seconds",
+              __func__,
+              g_cgroup_throttle.IsEnabled() ? throttle_cgroup : "disabled",
+              throttle_tiers,
+              throttle_hysteresis_seconds,
+              throttle_ramp_seconds);
     debug_log("INFO: %s: Active command: '%s'",
               __func__,
               active_command);
     debug_log("INFO: %s: Idle command: '%s'",
               __func__,
               idle_command);
-
-    // --- Start Idle Detect Control Monitor Thread ---
-    normal_log("INFO: %s: Starting Idle Detect Control Monitor thread...", __func__);
-    // Reset interrupt flag *before* starting thread
-    g_idle_detect_control_monitor.m_interrupt_idle_detect_control_monitor.store(false);
-    bool control_monitor_started = false;
-    try {
-        // Launch the thread using the member function pointer and the global instance
-        g_idle_detect_control_monitor.m_idle_detect_control_monitor_thread =
-            std::thread(&IdleDetect::IdleDetectControlMonitor::IdleDetectControlMonitorThread,
-                        std::ref(g_idle_detect_control_monitor));
-        control_monitor_started = true; // Assume success if no exception
-        // Wait a very short time to allow pipe creation/initialization perhaps
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        if (!g_idle_detect_control_monitor.IsInitialized()) {
-            normal_log("WARN: %s: Control monitor thread started but not initialized quickly.", __func__);
-        } else {
-            debug_log("INFO: %s: Control monitor thread started and initialized.", __func__);
-        }
-    } catch (const std::system_error& e) {
-        error_log("%s: Failed to start Idle Detect Control Monitor thread: %s. Exiting.", __func__, e.what());
-        // Stop other monitors if started (e.g., Wayland) before exiting
-        // if (wayland_monitor_started) { g_wayland_idle_monitor.Stop(); }
-        return 1;
-    } catch (...) {
-        error_log("%s: Unknown error starting Idle Detect Control Monitor thread. Exiting.", __func__);
-        // if (wayland_monitor_started) { g_wayland_idle_monitor.Stop(); }
-        return 1;
+    debug_log("INFO: %s: Command timeout: %d seconds, minimum dwell: %d seconds",
+              __func__,
+              command_timeout_seconds,
+              command_min_dwell_seconds);
+
+    // --- Start Idle Detect Control Monitor ---
+    // The control pipe is read by the main loop. Without it the forced states are unavailable, but idle detection works.
+    normal_log("INFO: %s: Starting Idle Detect Control Monitor...", __func__);
+    if (g_idle_detect_control_monitor.Start()) {
+        debug_log("INFO: %s: Control monitor started and initialized.", __func__);
+    } else {
+        normal_log("WARN: %s: Control monitor not initialized. Forced idle/active states are unavailable.", __func__);
     }
 
     // Start Wayland Monitor AFTER control monitor (if Wayland session)
@@ -1800,7 +3442,8 @@ int main(int argc, char* argv[])
     if (IdleDetect::IsWaylandSession()) {
         int notification_timeout_ms = 1000;
         debug_log("INFO: %s: Attempting Wayland idle monitor (timeout %dms)...", __func__, notification_timeout_ms);
-        if (g_wayland_idle_monitor.Start(notification_timeout_ms)) {
+        // The level notifications let the compositor report the crossing of each idle level directly.
+        if (g_wayland_idle_monitor.Start(notification_timeout_ms, idle_levels_ms)) {
             debug_log("INFO: %s: Wayland idle monitor started successfully.", __func__);
             wayland_monitor_started = true; // Track success
         } else {
@@ -1809,6 +3452,17 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Connect to the session bus for the D-Bus idle time and inhibition queries. A tty session makes none.
+    if (!IdleDetect::IsTtySession()) {
+        g_session_bus.SetIdleWatchLevels(idle_levels_ms);
+        g_x11_idle_monitor.SetIdleLevels(idle_levels_ms);
+        g_session_bus.Start();
+        g_logind_idle_monitor.Start();
+
+        // The backends are probed on the first GetIdleTimeSeconds() call, with all of the monitors above started.
+        IdleDetect::RegisterIdleBackends();
+    }
+
     // --- Main Loop ---
     bool first_check = true;
     bool was_previously_idle = false; // Track state changes
@@ -1818,6 +3472,8 @@ int main(int argc, char* argv[])
     int64_t effective_last_active_time_prev = 0;
     int64_t effective_last_active_time = 0;
     bool using_event_detect_as_only_source = false;
+    auto next_cadence_report_time = std::chrono::steady_clock::now()
+                                    + std::chrono::seconds(IdleCheckScheduler::REPORT_INTERVAL_SECONDS);
 
     while (!g_shutdown_requested.load()) {
         int64_t idle_seconds = IdleDetect::GetIdleTimeSeconds();
@@ -1840,20 +3496,8 @@ int main(int argc, char* argv[])
 
             if (shmem_timestamp >= 0) { // Use >= 0 check, as 0 might be valid initial state
                 int64_t current_time = GetUnixEpochTime();
-                int64_t calculated_idle = current_time - shmem_timestamp;
-                calculated_idle = (calculated_idle > 0) ? calculated_idle : 0; // Ensure non-negative
-
-                // If idle_seconds is < 0, this indicates an error state from IdleDetect::GetIdleTimeSeconds(), or
-                // tty only session if -2, in which case the value of idle_seconds should not be used directly.
-                // If idle_seconds is >= 0, it indicates a valid idle time from GUI session.
-                // If shmem_timestamp == 0, it indicates that force_idle was set via event_detect directly, and we should use the
-                // calculated idle time. This is important to capture force_idle injected directly into event_detect via a script
-                // from a service. Note this has the same effect as setting FORCED_IDLE in the control monitor.
-                if (idle_seconds >= 0 && shmem_timestamp > 0) {
-                    idle_seconds = std::min(idle_seconds, calculated_idle);
-                } else {
-                    idle_seconds = calculated_idle;
-                }
+
+                idle_seconds = CombineIdleSeconds(idle_seconds, shmem_timestamp, current_time);
 
                 debug_log("INFO: %s: idle time including info from event_detect via shmem: %lld seconds "
                           "(current: %lld, shmem: %lld)",
@@ -1870,20 +3514,8 @@ int main(int argc, char* argv[])
                 int64_t file_timestamp = IdleDetect::ReadLastActiveTimeFile(dat_file_path);
                 if (file_timestamp > 0) {
                     int64_t current_time = GetUnixEpochTime();
-                    int64_t calculated_idle = current_time - file_timestamp;
-                    calculated_idle = (calculated_idle > 0) ? calculated_idle : 0; // Ensure non-negative
-
-                    // If idle_seconds is < 0, this indicates an error state from IdleDetect::GetIdleTimeSeconds(), or
-                    // tty only session if -2, in which case the value of idle_seconds should not be used directly.
-                    // If idle_seconds is >= 0, it indicates a valid idle time from GUI session.
-                    // If file_timestamp == 0, it indicates that force_idle was set via event_detect directly, and we should use the
-                    // calculated idle time. This is important to capture force_idle injected directly into event_detect via a script
-                    // from a service. Note this has the same effect as setting FORCED_IDLE in the control monitor.
-                    if (idle_seconds >= 0 && file_timestamp > 0) {
-                        idle_seconds = std::min(idle_seconds, calculated_idle);
-                    } else {
-                        idle_seconds = calculated_idle;
-                    }
+
+                    idle_seconds = CombineIdleSeconds(idle_seconds, file_timestamp, current_time);
 
                     debug_log("INFO: %s: idle time including info from event_detect via file: %lld seconds "
                               "(current: %lld, file: %lld)",
@@ -1899,6 +3531,9 @@ int main(int argc, char* argv[])
             }
         }
 
+        // The idle time the next wait is scheduled from, before the substitution below and any control override.
+        const int64_t measured_idle_seconds = idle_seconds;
+
         if (idle_seconds < 0) {
             error_log("%s: Idle time could not be determined from any available source. Assuming active.",
                       __func__);
@@ -1928,17 +3563,35 @@ int main(int argc, char* argv[])
                   (int64_t)idle_seconds,
                   is_currently_idle ? "Idle" : "Active");
 
+        // --- Throttle tiers ---
+        // A forced state applies the first or the last tier.
+        int64_t throttle_idle_seconds = idle_seconds;
+
+        if (control_state == IdleDetect::IdleDetectControlMonitor::FORCED_IDLE) {
+            throttle_idle_seconds = std::numeric_limits<int64_t>::max();
+        } else if (control_state == IdleDetect::IdleDetectControlMonitor::FORCED_ACTIVE) {
+            throttle_idle_seconds = 0;
+        }
+
+        g_cgroup_throttle.Update(throttle_idle_seconds);
+
         // --- Handle State Change for Commands ---
         if (is_currently_idle != was_previously_idle || first_check) {
+            IDLE_DETECT_PROBE3(idle_detect, state_change,
+                               static_cast<int>(is_currently_idle), idle_seconds, static_cast<int>(control_state));
+
+            // A forced transition is not detected, so it has no detection latency.
+            if (!first_check && control_state == IdleDetect::IdleDetectControlMonitor::NORMAL) {
+                g_idle_check_scheduler.RecordTransition(is_currently_idle, idle_seconds);
+            }
+
             if (is_currently_idle) {
                 // Became Idle
                 normal_log("INFO: %s: User became idle (%llds >= %ds).",
                     __func__,
                     (int64_t)idle_seconds, idle_threshold_seconds);
 
-                if (execute_dc_control_scripts) {
-                    IdleDetect::ExecuteCommandBackground(idle_command);
-                }
+                ApplyTransition(true, idle_command, use_boinc_rpc, execute_dc_control_scripts);
             } else {
                 // Became Active
                 normal_log("INFO: %s: User became active (%llds < %ds).",
@@ -1946,9 +3599,7 @@ int main(int argc, char* argv[])
                     (int64_t)idle_seconds,
                     idle_threshold_seconds);
 
-                if (execute_dc_control_scripts) {
-                    IdleDetect::ExecuteCommandBackground(active_command);
-                }
+                ApplyTransition(false, active_command, use_boinc_rpc, execute_dc_control_scripts);
             }
 
             was_previously_idle = is_currently_idle; // Update previous state
@@ -2000,22 +3651,48 @@ int main(int argc, char* argv[])
                           IdleDetect::IdleDetectControlMonitor::StateToString(control_state));
             }
 
-            IdleDetect::SendPipeNotification(event_registration_pipe_path, event_timestamp, event_type);
+            IdleDetect::SendPipeNotification(event_registration_pipe_path, event_timestamp, event_type,
+                                             pipe_send_timestamps);
 
             effective_last_active_time_prev = effective_last_active_time;
 
         }
 
-        // Sleep for the check interval, but check for shutdown periodically
-        // This loop sleeps for check_interval_seconds total, checking every 100ms
-        auto wake_up_time = std::chrono::steady_clock::now() + std::chrono::seconds(check_interval_seconds);
-        while (std::chrono::steady_clock::now() < wake_up_time) {
-            if (g_shutdown_requested.load()) {
-                debug_log("INFO: %s: Shutdown requested during sleep interval.",
-                          __func__);
-                break; // Exit inner sleep loop
+        // Wait for the next event, or until the next pass that cannot be signalled. While idle, event_detect's shared
+        // memory and a backend without events must be polled for the resume.
+        bool event_driven = !use_event_detect
+                            && !using_event_detect_as_only_source
+                            && g_idle_backend_selector.IsSelectedEventDriven();
+        int64_t wait_ms = g_idle_check_scheduler.GetNextWaitMs(measured_idle_seconds, event_driven);
+
+        // A backend that reports the tier levels wakes the loop for each tier crossing and for the input above the
+        // first tier, so only the ramp steps need a deadline. Otherwise, the next tier and the resume are waited for.
+        if (!event_driven || !g_idle_backend_selector.IsSelectedReportingLevels()) {
+            int64_t throttle_wait_ms = g_cgroup_throttle.GetNextWaitMs(throttle_idle_seconds,
+                                                                       is_currently_idle && event_driven,
+                                                                       min_check_interval_ms);
+
+            if (throttle_wait_ms >= 0) {
+                wait_ms = std::min(wait_ms, throttle_wait_ms);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        auto wait_start = std::chrono::steady_clock::now();
+        bool woken_by_event = WaitForMainLoopEvent(wait_ms);
+        int64_t waited_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now() - wait_start).count();
+
+        g_idle_check_scheduler.RecordWakeup(waited_ms, woken_by_event);
+        IDLE_DETECT_PROBE3(idle_detect, wakeup, wait_ms, waited_ms, static_cast<int>(woken_by_event));
+
+        if (wait_start >= next_cadence_report_time) {
+            g_idle_check_scheduler.LogSummary();
+            g_command_executor.LogSummary();
+            g_boinc_rpc_client.LogSummary();
+            g_cgroup_freezer.LogSummary();
+            g_cgroup_throttle.LogSummary();
+
+            next_cadence_report_time = wait_start + std::chrono::seconds(IdleCheckScheduler::REPORT_INTERVAL_SECONDS);
         }
 
         if (g_shutdown_requested.load()) {
@@ -2023,6 +3700,9 @@ int main(int argc, char* argv[])
         }
     } // End main loop
 
+    // A signal during a pass ends the loop without a wait to log it.
+    LogReceivedSignal();
+
     normal_log("INFO: %s: Shutdown requested. Cleaning up...",
         __func__);
 
@@ -2031,24 +3711,38 @@ int main(int argc, char* argv[])
     // --- Stop Wayland monitor ---
     if (wayland_monitor_started) {
         normal_log("INFO: %s: Stopping Wayland idle monitor...", __func__);
-        g_wayland_idle_monitor.Stop(); // Stop calls interrupt pipe write + join
+        g_wayland_idle_monitor.Stop();
         normal_log("INFO: %s: Wayland idle monitor stopped.", __func__);
     }
 
-    // --- Stop Idle Detect Control Monitor thread ---
-    if (control_monitor_started && g_idle_detect_control_monitor.m_idle_detect_control_monitor_thread.joinable()) {
-        normal_log("INFO: %s: Stopping Idle Detect Control Monitor thread...", __func__);
-        // Flag should have been set by HandleSignal
-        g_idle_detect_control_monitor.m_interrupt_idle_detect_control_monitor.store(true);
-        g_idle_detect_control_monitor.cv_idle_detect_control_monitor_thread.notify_all();
-        try {
-            g_idle_detect_control_monitor.m_idle_detect_control_monitor_thread.join();
-            normal_log("INFO: %s: Idle Detect Control Monitor thread stopped.", __func__);
-        } catch (const std::system_error& e) {
-            error_log("%s: Error joining control monitor thread: %s", __func__, e.what());
-        }
-    }
+    g_session_bus.LogQueryLatency();
+    g_idle_check_scheduler.LogSummary();
+    g_command_executor.LogSummary();
+    g_boinc_rpc_client.LogSummary();
+    g_boinc_rpc_client.Disconnect();
+
+    // The workload must not stay frozen or throttled without idle_detect to release it.
+    g_cgroup_throttle.LogSummary();
+    ReleaseCgroupControls();
+    g_cgroup_freezer.LogSummary();
+
+    g_session_bus.Stop();
+    g_logind_idle_monitor.Stop();
+    g_x11_idle_monitor.Stop();
+
+    // Let a running command finish, e.g. a dc_pause started by the last transition, but not hold up the stop.
+    g_command_executor.Stop(COMMAND_SHUTDOWN_WAIT_MS);
+
+    // --- Stop Idle Detect Control Monitor ---
+    g_idle_detect_control_monitor.Stop();
+
+    int shutdown_wakeup_fd = g_shutdown_wakeup_fd;
+    g_shutdown_wakeup_fd = -1;
+    close(shutdown_wakeup_fd);
 
     normal_log("Idle Detect shutdown complete.");
+
+    g_logger.Stop();
+
     return g_exit_code.load();
 }
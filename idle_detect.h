@@ -7,9 +7,9 @@
 #ifndef IDLE_DETECT_H
 #define IDLE_DETECT_H
 
-#include <condition_variable>
 #include <cstdint> // For int64_t
-#include <thread>
+#include <idle_state_tracker.h>
+#include <metrics.h>
 #include <util.h>
 
 // Forward declare Wayland types
@@ -19,14 +19,25 @@ struct wl_seat;
 struct ext_idle_notifier_v1;
 struct ext_idle_notification_v1;
 
+// Forward declare GLib/GIO types
+typedef struct _GDBusConnection GDBusConnection;
+typedef struct _GDBusProxy GDBusProxy;
+typedef struct _GMainContext GMainContext;
+typedef struct _GVariant GVariant;
+typedef struct _GVariantType GVariantType;
+typedef struct _GError GError;
+typedef struct _GCancellable GCancellable;
+typedef struct _GObject GObject;
+typedef struct _GAsyncResult GAsyncResult;
+
 namespace IdleDetect {
 // Function to get the user's idle time in seconds
 int64_t GetIdleTimeSeconds();
 
 //!
-//! \brief The IdleDetectControlMonitor class is a singleton that monitors the idle_detect control pipe. It is used to
-//! allow the override of the state of the idle_detect monitor. It is a singleton and has one instantiated thread. Note
-//! that a message of the override is propagated to event_detect.
+//! \brief The IdleDetectControlMonitor class is a singleton that reads the idle_detect control pipe. It is used to
+//! allow the override of the state of the idle_detect monitor. The pipe is read from the main loop, which polls GetFd().
+//! Note that a message of the override is propagated to event_detect.
 //!
 class IdleDetectControlMonitor
 {
@@ -38,28 +49,31 @@ public:
         FORCED_IDLE
     };
 
-    //!
-    //! \brief Holds the actual idle_detect monitor thread.
-    //!
-    std::thread m_idle_detect_control_monitor_thread;
+    //! Constructor.
+    IdleDetectControlMonitor();
 
-    //!
-    //! \brief Condition variable for control/synchronization of the idle_detect monitor threads.
-    //!
-    std::condition_variable cv_idle_detect_control_monitor_thread;
+    //! Destructor.
+    ~IdleDetectControlMonitor();
 
     //!
-    //! \brief Atomic boolean that interrupts the idle_detect monitor thread.
+    //! \brief Creates the control pipe in XDG_RUNTIME_DIR if it does not exist, with mode 0600, and opens it for
+    //! non-blocking reads. It is opened read-write, so that it always has a writer and does not report a hangup when a
+    //! control script closes it.
+    //! \return true if the pipe is open.
     //!
-    std::atomic<bool> m_interrupt_idle_detect_control_monitor;
+    bool Start();
 
-    //! Constructor.
-    IdleDetectControlMonitor();
+    //! \brief Closes the control pipe.
+    void Stop();
+
+    //! \brief The control pipe fd, for polling, or -1 if not open.
+    int GetFd() const;
 
     //!
-    //! \brief Method to instantiate the tty monitor thread.
+    //! \brief Reads and applies the pending override messages without blocking.
+    //! \return true if the state changed.
     //!
-    void IdleDetectControlMonitorThread();
+    bool ProcessPendingInput();
 
     //!
     //! \brief Provides a flag to indicate whether the monitor has been initialized. This is used in main in the application
@@ -88,40 +102,49 @@ public:
     std::string StateToString() const;
 
 private:
-    //!
-    //! \brief This is the mutex member that provides lock control for the tty monitor object. This is used to ensure the
-    //! tty monitor is thread-safe.
-    //!
-    mutable std::mutex mtx_idle_detect_control_monitor;
-
-    //!
-    //! \brief This provides lock control for the tty monitor worker thread itself.
-    //!
-    mutable std::mutex mtx_idle_detect_control_monitor_thread;
-
     //!
     //! \brief Holds the current state of the idle monitor. NORMAL means idle detect follows the normal threshold (trigger) rules
     //! for idle detection. FORCED_ACTIVE means the user has forced the system to be active and FORCED_IDLE means the user has
     //! forced the system to be idle. The state is set by the event_detect process and is used to determine the ultimate
     //! last active time.
     //!
-    std::atomic<State> m_state;
+    State m_state;
 
-    //!
-    //! \brief This holds the flag as to whether the tty monitor has been initialized and is provided by the IsInitialized() public
-    //! method.
-    //!
-    std::atomic<bool> m_initialized;
+    //! \brief The control pipe fd, -1 if not open.
+    int m_fd;
 };
 
 //!
 //! \brief The WaylandIdleMonitor class implements the ext_idle_notifier_v1 protocol to monitor idle state in Wayland.
-//! The intent is to properly handle idle detection in Wayland sessions other than KDE or GNOME. This class is a singleton and has
-//! one instantiated thread. It is used to monitor the idle state of the Wayland session.
+//! The intent is to properly handle idle detection in Wayland sessions other than KDE or GNOME. This class is a singleton.
+//! It has no thread of its own: the main loop polls the display fd between PrepareRead() and FinishRead(), which
+//! dispatch the events.
+//!
+//! It holds a short idle notification that tracks activity and gives the idle start time, and one at each idle level,
+//! e.g. the idle threshold and the throttle tiers, so that the compositor itself reports each crossing. The transitions
+//! of the level notifications call for a main loop pass.
 //!
 class WaylandIdleMonitor
 {
 public:
+    //!
+    //! \brief One ext_idle_notification_v1 object and its state. This is the listener data of its callbacks.
+    //!
+    struct Notification
+    {
+        WaylandIdleMonitor* monitor = nullptr;
+        ext_idle_notification_v1* object = nullptr;
+        int timeout_ms = 0;
+
+        //! \brief Whether the transitions call for a main loop pass.
+        bool needs_pass = false;
+
+        //! \brief Index of the timeout in the levels of the monitor's m_idle_tracker.
+        int level = -1;
+
+        bool is_idle = false;
+    };
+
     //! \brief Constructor
     WaylandIdleMonitor();
 
@@ -134,8 +157,14 @@ public:
     WaylandIdleMonitor(WaylandIdleMonitor&&) = delete;
     WaylandIdleMonitor& operator=(WaylandIdleMonitor&&) = delete;
 
+    //!
     //! \brief Initializes the Wayland display and registry, and starts the idle notifier.
-    bool Start(int notification_timeout_ms);
+    //! \param notification_timeout_ms timeout of the activity notification.
+    //! \param level_timeouts_ms timeouts of the level notifications, e.g. inactivity_time_trigger and the throttle
+    //! tiers. Those that are not positive, or repeat another timeout, are dropped.
+    //! \return true if started.
+    //!
+    bool Start(int notification_timeout_ms, const std::vector<int64_t>& level_timeouts_ms = {});
 
     //! \brief Stops the Wayland idle monitor and cleans up resources.
     void Stop();
@@ -143,42 +172,61 @@ public:
     //! \brief Checks if the Wayland idle monitor is available.
     bool IsAvailable() const;
 
-    //! \brief Provides the number of seconds the session has been idle via the ext_idle_notifier_v1 protocol.
+    //!
+    //! \brief Provides the number of seconds the session has been idle via the ext_idle_notifier_v1 protocol: the idle
+    //! time of the IdleStateTracker the notifications drive, with the notification timeouts as its levels. This is 0
+    //! while active, since the activity notification's timeout is below a second. Once a notification has fired it is
+    //! at least its timeout, and below the timeout of the next until that fires.
+    //! \return idle time in seconds, or -1 if not available.
+    //!
     int64_t GetIdleSeconds() const;
 
-    //! \brief Checks if the Wayland session is idle.
+    //! \brief Checks if the Wayland session is idle, i.e. the first notification has fired.
     bool IsIdle() const;
 
+    //! \brief Whether the monitor is up with level notifications, so that the crossings are reported as events.
+    bool HasLevelNotifications() const;
+
+    //!
+    //! \brief Dispatches the events already read, flushes the requests and prepares to read the display fd. Each call
+    //! that returns an fd must be followed by FinishRead().
+    //! \return the display fd to poll for input, or -1 if not available.
+    //!
+    int PrepareRead();
+
+    //!
+    //! \brief Reads the display fd if poll() reported it readable, otherwise cancels the read, and dispatches the
+    //! events. On a display error the monitor stops, and IsAvailable() is then false.
+    //! \param revents the poll() revents of the display fd.
+    //! \return true if a transition calls for a main loop pass.
+    //!
+    bool FinishRead(short revents);
+
 public: // Accessible to static C callbacks
     wl_seat* m_seat;
     ext_idle_notifier_v1* m_idle_notifier;
     uint32_t m_seat_id;
     uint32_t m_idle_notifier_id;
-    std::atomic<bool> m_is_idle;
-    std::atomic<int64_t> m_idle_start_time;
 
-private:
-    //! \brief The WaylandIdleMonitor thread that monitors the Wayland session for idle state changes.
-    std::thread m_monitor_thread;
+    //! \brief Set by the callbacks on a transition that calls for a main loop pass, and cleared by FinishRead().
+    bool m_pass_needed;
 
-    //! \brief Mutex for thread synchronization
-    std::atomic<bool> m_interrupt_monitor;
-
-    //! \brief Pipe for thread interrupt handling
-    int m_interrupt_pipe_fd[2];
+    //! \brief The idle state from the notifications' idled and resumed events.
+    IdleStateTracker m_idle_tracker;
 
+private:
     //! \brief Flag to indicate whether the monitor has been initialized.
-    std::atomic<bool> m_initialized;
+    bool m_initialized;
 
     //! \brief Wayland display and registry objects
     wl_display* m_display;
     wl_registry* m_registry;
 
-    //! \brief Idle notification object
-    ext_idle_notification_v1* m_idle_notification;
-
-    //! \brief Timeout for idle notification in milliseconds
-    int m_notification_timeout_ms;
+    //!
+    //! \brief Idle notifications. The first is the activity notification, the rest the level ones. Each is the listener
+    //! data of its callbacks, so the vector is not resized while they exist.
+    //!
+    std::vector<Notification> m_notifications;
 
     //! \brief Private method to initialize Wayland and set up the idle notification.
     bool InitializeWayland();
@@ -186,11 +234,9 @@ private:
     //! \brief Private method to clean up Wayland resources.
     void CleanupWayland();
 
-    //! \brief Private method to create the idle notification object.
-    void CreateIdleNotification();
-
-    //! \brief Private method to run the Wayland event loop in a separate thread.
-    void WaylandMonitorThread();
+    //! \brief Private method to create the idle notification objects.
+    //! \return true if all were created.
+    bool CreateIdleNotifications();
 
     //! \brief Private method to handle global events.
     static void HandleGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version);
@@ -211,6 +257,406 @@ private:
     static const void* c_idle_notification_listener_ptr;
 };
 
+//!
+//! \brief The SessionBus class holds idle_detect's single long-lived session bus connection. It tracks which of the
+//! desktop services used for idle time and inhibition currently have an owner, from NameOwnerChanged signals, and holds
+//! a cached proxy for each. A query for a service that is not running costs nothing.
+//!
+//! Each service has one query: the idle time for ksmserver and Mutter, the inhibition state for the KDE PolicyAgent and
+//! the GNOME SessionManager. Queries are asynchronous. A pass starts the ones it needs, which then run concurrently,
+//! and waits for them up to a deadline with WaitForQueries(). A query that misses the deadline keeps running, and its
+//! reply is used when it arrives. Until then the last known value is used and reported as stale.
+//!
+//! This class is a singleton and is only used from the main loop thread. It has no thread of its own: the signals and
+//! replies are dispatched from a private GMainContext by ProcessPendingSignals() and WaitForQueries().
+//!
+class SessionBus
+{
+public:
+    //!
+    //! \brief The session bus services idle_detect queries.
+    //!
+    enum Service {
+        KDE_KSMSERVER,
+        KDE_POWER_MANAGEMENT,
+        GNOME_SESSION_MANAGER,
+        GNOME_MUTTER_IDLE_MONITOR,
+        SERVICE_COUNT
+    };
+
+    //! \brief Constructor
+    SessionBus();
+
+    //! \brief Destructor
+    ~SessionBus();
+
+    //! \brief Deleted copy and move constructors and assignment operators to prevent copying.
+    SessionBus(const SessionBus&) = delete;
+    SessionBus& operator=(const SessionBus&) = delete;
+    SessionBus(SessionBus&&) = delete;
+    SessionBus& operator=(SessionBus&&) = delete;
+
+    //!
+    //! \brief Connects to the session bus, starts watching the services and creates their proxies. Waits up to a second
+    //! for the initial owner of each service, so that the first pass sees the correct session type, and then queries the
+    //! inhibition state of the services that are running.
+    //! \return true if connected.
+    //!
+    bool Start();
+
+    //!
+    //! \brief Sets the intervals of the Mutter idle watches, in milliseconds, e.g. inactivity_time_trigger and the
+    //! throttle tiers. Call before Start().
+    //!
+    void SetIdleWatchLevels(const std::vector<int64_t>& levels_ms);
+
+    //! \brief Cancels the queries in flight, removes the Mutter idle watches and drops the name watches, proxies and
+    //! connection.
+    void Stop();
+
+    //! \brief Checks if the session bus connection is up.
+    bool IsAvailable() const;
+
+    //! \brief The private context the signals and replies are dispatched on, for the main loop to poll, or nullptr.
+    GMainContext* GetContext() const;
+
+    //!
+    //! \brief Dispatches any pending signals and late query replies without blocking, and starts the inhibition queries
+    //! that the signals call for. If the connection has been closed, for example by a restart of the session bus,
+    //! reconnects, at most every RECONNECT_INTERVAL_SECONDS. Called at the top of each pass.
+    //!
+    void ProcessPendingSignals();
+
+    //!
+    //! \brief Whether the service currently has an owner on the bus.
+    //!
+    bool HasOwner(Service service) const;
+
+    //!
+    //! \brief Starts the asynchronous query of the service, unless one is already in flight or the service is not
+    //! running. GNOME_MUTTER_IDLE_MONITOR is not queried while its idle state is known from the idle watches.
+    //!
+    void StartQuery(Service service);
+
+    //!
+    //! \brief Dispatches query replies until no query is in flight or deadline_ms have passed. Queries still in flight
+    //! then are counted as deadline misses.
+    //!
+    void WaitForQueries(int deadline_ms);
+
+    //!
+    //! \brief Provides the idle time from the last successful query of KDE_KSMSERVER or GNOME_MUTTER_IDLE_MONITOR. If
+    //! that reply is not from the current pass, the time since the reply is added and the value is flagged stale.
+    //! While the GNOME_MUTTER_IDLE_MONITOR idle state is known from the idle watches, this is the idle time of the
+    //! IdleStateTracker the watches and GetIdletime replies drive: capped below the next watch interval until it fires.
+    //! \param service
+    //! \param stale set true if the value is not from the current pass.
+    //! \return idle time in seconds, or -1 if the last query failed or there has been none.
+    //!
+    int64_t GetIdleSeconds(Service service, bool& stale) const;
+
+    //!
+    //! \brief Whether the service reports an inhibition: HasInhibition(ChangeScreenSettings) for
+    //! KDE_POWER_MANAGEMENT, IsInhibited(logout | user-switch | suspend | idle) for GNOME_SESSION_MANAGER. The state is
+    //! queried when the service appears and after each of its inhibitor change signals, never on a read.
+    //! \return false for other services, when the service is not running, or when the query failed.
+    //!
+    bool IsInhibited(Service service) const;
+
+    //!
+    //! \brief Logs the count, deadline misses and the 50th, 95th and 99th percentile reply latency of each service's
+    //! query.
+    //!
+    void LogQueryLatency() const;
+
+    //!
+    //! \brief The well known bus name of the service.
+    //!
+    static const char* ServiceName(Service service);
+
+    //!
+    //! \brief Whether the GNOME_MUTTER_IDLE_MONITOR idle state is tracked from the idle watches rather than polled.
+    //!
+    bool IsWatchingMutterIdle() const;
+
+    //!
+    //! \brief Seconds between reconnection attempts when the session bus is unavailable.
+    //!
+    static constexpr int RECONNECT_INTERVAL_SECONDS = 30;
+
+    //!
+    //! \brief Seconds between the query latency reports in the log.
+    //!
+    static constexpr int LATENCY_REPORT_INTERVAL_SECONDS = 3600;
+
+    //!
+    //! \brief Number of inhibitor change signals subscribed: KDE InhibitionsChanged, GNOME InhibitorAdded and
+    //! InhibitorRemoved.
+    //!
+    static constexpr int INHIBITION_SIGNAL_COUNT = 3;
+
+private:
+    //!
+    //! \brief The state of one service's query.
+    //!
+    struct Query
+    {
+        //! \brief Back pointers for the reply callback.
+        SessionBus* session_bus = nullptr;
+        Service service = SERVICE_COUNT;
+
+        //! \brief Whether a call is in flight, and when it was started (GLib monotonic time in microseconds).
+        bool in_flight = false;
+        int64_t start_time = 0;
+
+        //! \brief Whether the inhibitor change signals call for a re-query.
+        bool stale = false;
+
+        //! \brief The last successful reply: its value (idle milliseconds, or 0/1 for the inhibition queries), and when
+        //! it arrived.
+        bool has_value = false;
+        int64_t value = 0;
+        int64_t value_time = 0;
+
+        //! \brief Reply latency in microseconds, and the number of times a pass gave up waiting.
+        MetricHistogram latency;
+        uint64_t deadline_misses = 0;
+    };
+
+    //!
+    //! \brief One Mutter idle watch, at a level of m_idle_tracker. This is the user data of its AddIdleWatch reply.
+    //!
+    struct IdleWatch
+    {
+        SessionBus* session_bus = nullptr;
+        int level = -1;
+
+        //! \brief The watch id, 0 if not added.
+        unsigned int id = 0;
+    };
+
+    //!
+    //! \brief The state of the Mutter idle watches. Each idle watch fires each time the idle time reaches its interval.
+    //! The user active watch fires once, on the next input, and is re-added while at or above the first interval. Once
+    //! added, the idle state itself is held by m_idle_tracker.
+    //!
+    enum IdleWatchState {
+        IDLE_WATCH_NONE,         //!< Not added. Mutter is not running, or has just (re)appeared.
+        IDLE_WATCH_ADDING,       //!< AddIdleWatch calls are in flight.
+        IDLE_WATCH_UNAVAILABLE,  //!< A watch could not be added. GetIdletime is polled instead.
+        IDLE_WATCH_ADDED         //!< Added. The state is known after the first event or GetIdletime reply.
+    };
+
+    //! \brief Private context that the name watch, signal and reply callbacks are dispatched on.
+    GMainContext* m_context;
+
+    //! \brief The shared session bus connection.
+    GDBusConnection* m_connection;
+
+    //! \brief Cancels the queries in flight on Stop().
+    GCancellable* m_cancellable;
+
+    //! \brief g_bus_watch_name_on_connection() ids, 0 if not watched.
+    unsigned int m_watch_ids[SERVICE_COUNT];
+
+    //! \brief Cached proxies, nullptr if creation failed.
+    GDBusProxy* m_proxies[SERVICE_COUNT];
+
+    //! \brief Whether each service has an owner, from the name watches.
+    bool m_has_owner[SERVICE_COUNT];
+
+    //! \brief Whether the initial owner of each service has been reported.
+    bool m_owner_known[SERVICE_COUNT];
+
+    //! \brief Inhibitor change signal subscription ids, 0 if not subscribed.
+    unsigned int m_signal_ids[INHIBITION_SIGNAL_COUNT];
+
+    //! \brief The query state of each service.
+    Query m_queries[SERVICE_COUNT];
+
+    //! \brief Start of the current pass, as a GLib monotonic time in microseconds. Replies since then are current.
+    int64_t m_pass_start_time;
+
+    //! \brief Earliest time of the next connection attempt, as a GLib monotonic time in microseconds.
+    int64_t m_next_connect_time;
+
+    //! \brief Time of the next query latency report, as a GLib monotonic time in microseconds.
+    int64_t m_next_latency_report_time;
+
+    //! \brief Mutter idle watch state.
+    IdleWatchState m_idle_watch_state;
+
+    //! \brief The Mutter idle watch of each level of m_idle_tracker. Not resized after Start().
+    std::vector<IdleWatch> m_idle_watches;
+
+    //! \brief Mutter user active watch id, 0 if not added.
+    unsigned int m_active_watch_id;
+
+    //! \brief Whether AddUserActiveWatch is in flight.
+    bool m_active_watch_adding;
+
+    //! \brief The idle state from the Mutter watches and GetIdletime replies, on the GLib monotonic clock. The idle
+    //! watch intervals are its levels.
+    IdleStateTracker m_idle_tracker;
+
+    //! \brief Number of AddIdleWatch and AddUserActiveWatch calls in flight.
+    int m_watch_calls_in_flight;
+
+    //! \brief WatchFired signal subscription id, 0 if not subscribed.
+    unsigned int m_watch_fired_signal_id;
+
+    //! \brief Starts the queries of the services whose inhibition state is stale.
+    void StartStaleInhibitionQueries();
+
+    //! \brief Whether any query is in flight.
+    bool AnyQueryInFlight() const;
+
+    //! \brief Adds the Mutter idle watches if Mutter is running and they have not been added.
+    void StartIdleWatches();
+
+    //! \brief Forgets the Mutter watches and the idle state, e.g. when Mutter has gone. They are added again on the next
+    //! pass.
+    void ResetIdleWatches();
+
+    //! \brief Adds the one shot Mutter user active watch.
+    void StartUserActiveWatch();
+
+    //! \brief Follows up a change of m_idle_tracker from an event or reply: logs a change of level from previous_level,
+    //! and adds the user active watch at or above the first level, if it is not already there.
+    void UpdateWatchedIdleState(bool was_known, int previous_level);
+
+    //! \brief Whether GetIdletime must be queried: when the watches are not in use, and when m_idle_tracker needs a
+    //! read to catch up with the input since the last known, just below the first watch interval.
+    bool IsMutterIdleQueryNeeded() const;
+
+    //! \brief Sets the owner state of the named service.
+    void SetOwner(const char* name, bool has_owner);
+
+    //! \brief Name watch callback for a service gaining an owner.
+    static void HandleNameAppeared(GDBusConnection* connection, const char* name, const char* name_owner,
+                                   void* user_data);
+
+    //! \brief Name watch callback for a service losing its owner.
+    static void HandleNameVanished(GDBusConnection* connection, const char* name, void* user_data);
+
+    //! \brief Signal callback for the inhibitor change signals. Marks the service's inhibition state stale.
+    static void HandleInhibitionSignal(GDBusConnection* connection, const char* sender_name, const char* object_path,
+                                       const char* interface_name, const char* signal_name, GVariant* parameters,
+                                       void* user_data);
+
+    //! \brief Reply callback for the queries. user_data is the service's Query.
+    static void HandleQueryReply(GObject* source_object, GAsyncResult* result, void* user_data);
+
+    //! \brief Signal callback for the Mutter WatchFired signal.
+    static void HandleWatchFired(GDBusConnection* connection, const char* sender_name, const char* object_path,
+                                 const char* interface_name, const char* signal_name, GVariant* parameters,
+                                 void* user_data);
+
+    //! \brief Reply callback for AddIdleWatch. user_data is the IdleWatch.
+    static void HandleAddIdleWatchReply(GObject* source_object, GAsyncResult* result, void* user_data);
+
+    //! \brief Reply callback for AddUserActiveWatch. user_data is the SessionBus.
+    static void HandleAddUserActiveWatchReply(GObject* source_object, GAsyncResult* result, void* user_data);
+};
+
+//!
+//! \brief The LogindIdleMonitor class reads the IdleHint and IdleSinceHintMonotonic properties of idle_detect's login
+//! session from systemd-logind, on the system bus. The session proxy caches the properties and keeps them current from
+//! logind's PropertiesChanged signals, so a read makes no D-Bus call. The signals are dispatched from a private
+//! GMainContext by ProcessPendingSignals(), at the top of each pass. This works with any compositor or desktop that
+//! sets the hint.
+//!
+//! The hint is set by the desktop or screen locker at its own idle delay, and many desktops never set it. It is only
+//! used once it has been seen set. While it is clear, the idle time is 0, and the main loop waits up to its maximum
+//! interval: the signal for the hint wakes it. Once it is set, the idle time counts from when it was set, so it lags
+//! the last input by the desktop's idle delay.
+//!
+//! This class is a singleton and is only used from the main loop thread.
+//!
+class LogindIdleMonitor
+{
+public:
+    //! \brief Constructor
+    LogindIdleMonitor();
+
+    //! \brief Destructor
+    ~LogindIdleMonitor();
+
+    //! \brief Deleted copy and move constructors and assignment operators to prevent copying.
+    LogindIdleMonitor(const LogindIdleMonitor&) = delete;
+    LogindIdleMonitor& operator=(const LogindIdleMonitor&) = delete;
+    LogindIdleMonitor(LogindIdleMonitor&&) = delete;
+    LogindIdleMonitor& operator=(LogindIdleMonitor&&) = delete;
+
+    //!
+    //! \brief Connects to the system bus, finds idle_detect's session (XDG_SESSION_ID, the session of the process, or
+    //! the user's display session) and creates the session proxy, which loads the properties.
+    //! \return true if the session proxy was created.
+    //!
+    bool Start();
+
+    //! \brief Drops the session proxy and the connection.
+    void Stop();
+
+    //! \brief Whether the session proxy is up.
+    bool IsAvailable() const;
+
+    //! \brief The private context the signals are dispatched on, for the main loop to poll, or nullptr.
+    GMainContext* GetContext() const;
+
+    //!
+    //! \brief Dispatches any pending PropertiesChanged signals without blocking, and applies the hint changes.
+    //!
+    void ProcessPendingSignals();
+
+    //!
+    //! \brief Provides the idle time from the hint: the time since IdleSinceHintMonotonic while the hint is set, and 0
+    //! while it is clear.
+    //! \return idle time in seconds, or -1 if not available or the hint has not been seen set.
+    //!
+    int64_t GetIdleSeconds() const;
+
+    //!
+    //! \brief Seconds between attempts to find the session when it is unavailable, e.g. before it is registered.
+    //!
+    static constexpr int RECONNECT_INTERVAL_SECONDS = 60;
+
+private:
+    //! \brief Private context that the property change signals are dispatched on.
+    GMainContext* m_context;
+
+    //! \brief The system bus connection.
+    GDBusConnection* m_connection;
+
+    //! \brief org.freedesktop.login1.Session proxy for idle_detect's session, with the properties cached.
+    GDBusProxy* m_session_proxy;
+
+    //! \brief Whether Start() has been called, so that ProcessPendingSignals() reconnects.
+    bool m_start_requested;
+
+    //! \brief Whether the hint has been seen set, so that the desktop is known to manage it.
+    bool m_hint_in_use;
+
+    //! \brief The cached IdleHint, and IdleSinceHintMonotonic (the time of its last change) in microseconds.
+    bool m_idle_hint;
+    int64_t m_idle_since;
+
+    //! \brief Earliest time of the next Start() attempt from ProcessPendingSignals(), monotonic microseconds.
+    int64_t m_next_connect_time;
+
+    //!
+    //! \brief Finds the object path of idle_detect's session.
+    //! \return the path, or empty if none was found.
+    //!
+    std::string FindSessionObjectPath();
+
+    //!
+    //! \brief Reads the cached IdleHint and IdleSinceHintMonotonic properties.
+    //! \return true if both are present.
+    //!
+    bool ReadHint();
+};
+
 } // namespace IdleDetect
 
 //!
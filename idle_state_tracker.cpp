@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <idle_state_tracker.h>
+
+#include <algorithm>
+#include <chrono>
+
+IdleStateTracker::IdleStateTracker()
+    : m_now_ms([]() {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch()).count());
+    })
+    , m_known(false)
+    , m_level(-1)
+    , m_last_input_ms(0)
+    , m_last_event_ms(0)
+{}
+
+void IdleStateTracker::SetLevels(const std::vector<int64_t>& levels_ms)
+{
+    m_levels_ms.clear();
+
+    for (int64_t level_ms : levels_ms) {
+        if (level_ms > 0) {
+            m_levels_ms.push_back(level_ms);
+        }
+    }
+
+    std::sort(m_levels_ms.begin(), m_levels_ms.end());
+    m_levels_ms.erase(std::unique(m_levels_ms.begin(), m_levels_ms.end()), m_levels_ms.end());
+
+    Reset();
+}
+
+const std::vector<int64_t>& IdleStateTracker::GetLevels() const
+{
+    return m_levels_ms;
+}
+
+void IdleStateTracker::SetClock(std::function<int64_t()> now_ms)
+{
+    m_now_ms = std::move(now_ms);
+}
+
+int64_t IdleStateTracker::GetTime() const
+{
+    return m_now_ms();
+}
+
+void IdleStateTracker::Reset()
+{
+    m_known = false;
+    m_level = -1;
+    m_last_input_ms = 0;
+    m_last_event_ms = 0;
+}
+
+bool IdleStateTracker::IsKnown() const
+{
+    return m_known;
+}
+
+int IdleStateTracker::GetLevel() const
+{
+    return m_level;
+}
+
+bool IdleStateTracker::IsAboveFirstLevel() const
+{
+    return m_known && m_level >= 0;
+}
+
+void IdleStateTracker::SetLevelReached(int level)
+{
+    if (level < 0 || level >= static_cast<int>(m_levels_ms.size())) {
+        return;
+    }
+
+    int64_t now_ms = m_now_ms();
+
+    m_known = true;
+    m_level = level;
+    m_last_input_ms = now_ms - m_levels_ms[level];
+    m_last_event_ms = now_ms;
+}
+
+void IdleStateTracker::SetInput()
+{
+    int64_t now_ms = m_now_ms();
+
+    m_known = true;
+    m_level = -1;
+    m_last_input_ms = now_ms;
+    m_last_event_ms = now_ms;
+}
+
+void IdleStateTracker::RecordIdleTime(int64_t idle_ms, int64_t read_start_ms)
+{
+    if (m_known && read_start_ms < m_last_event_ms) {
+        return;
+    }
+
+    idle_ms = std::max<int64_t>(idle_ms, 0);
+
+    int read_level = LevelForIdle(idle_ms);
+
+    m_level = m_known ? std::min(m_level, read_level) : read_level;
+    m_known = true;
+    m_last_input_ms = m_now_ms() - idle_ms;
+}
+
+int64_t IdleStateTracker::GetIdleMs() const
+{
+    if (!m_known) {
+        return -1;
+    }
+
+    int64_t idle_ms = std::max<int64_t>(m_now_ms() - m_last_input_ms, 0);
+
+    if (m_level + 1 < static_cast<int>(m_levels_ms.size())) {
+        idle_ms = std::min(idle_ms, m_levels_ms[m_level + 1] - 1);
+    }
+
+    return idle_ms;
+}
+
+bool IdleStateTracker::IsRefreshNeeded() const
+{
+    if (!m_known || m_level >= 0 || m_levels_ms.empty()) {
+        return false;
+    }
+
+    return m_now_ms() - m_last_input_ms + REFRESH_LEAD_MS >= m_levels_ms[0];
+}
+
+int IdleStateTracker::LevelForIdle(int64_t idle_ms) const
+{
+    auto above = std::upper_bound(m_levels_ms.begin(), m_levels_ms.end(), idle_ms);
+
+    return static_cast<int>(above - m_levels_ms.begin()) - 1;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef IDLE_STATE_TRACKER_H
+#define IDLE_STATE_TRACKER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+//!
+//! \brief The IdleStateTracker class turns the events of an event driven idle source into an idle time, without a query
+//! per pass. The source reports when the idle time rises through each of a set of levels, e.g. the Mutter idle watches
+//! or the XSync IDLETIME alarms at the threshold, and, at or above the first level, the next input, e.g. the Mutter
+//! user active watch or the XSync reset alarm. Below the first level input is not reported, so the last input known
+//! there can be stale.
+//!
+//! The idle time is the time since the last known input, capped just below the next level, whose event has not
+//! arrived. It can be high below the first level, but never reaches a level without its event, so the levels make the
+//! threshold and tier decisions. Once the capped time nears the first level, a live read of the idle time, e.g. a
+//! Mutter GetIdletime query or an XSync counter read, catches up with the input since.
+//!
+//! It holds no source state of its own, so the glue of each source drives it. It is used from the main loop thread.
+//!
+class IdleStateTracker
+{
+public:
+    //! \brief Constructor
+    IdleStateTracker();
+
+    //!
+    //! \brief Sets the levels the source reports, in milliseconds. They are sorted, and duplicates and levels that are
+    //! not positive are dropped. The state is reset.
+    //!
+    void SetLevels(const std::vector<int64_t>& levels_ms);
+
+    //! \brief The levels, in increasing order.
+    const std::vector<int64_t>& GetLevels() const;
+
+    //! \brief Sets the steady clock in milliseconds. For the tests, and for a source with a clock of its own.
+    void SetClock(std::function<int64_t()> now_ms);
+
+    //! \brief The current time of the clock, in milliseconds, e.g. for the start of a live read.
+    int64_t GetTime() const;
+
+    //! \brief Forgets the state, e.g. when the source has (re)started, until the next event or read.
+    void Reset();
+
+    //! \brief Whether an event or a read has given the state since the last reset.
+    bool IsKnown() const;
+
+    //! \brief Index of the highest level the idle time has reached, -1 if below the first. Meaningful once known.
+    int GetLevel() const;
+
+    //! \brief Whether the state is known and the idle time has reached the first level.
+    bool IsAboveFirstLevel() const;
+
+    //!
+    //! \brief Applies the event of the idle time rising through a level.
+    //! \param level index of the level.
+    //!
+    void SetLevelReached(int level);
+
+    //! \brief Applies the event of input at or above the first level.
+    void SetInput();
+
+    //!
+    //! \brief Applies a live read of the idle time. A read started before the last event can be older than the state
+    //! it would replace, e.g. a query reply that crossed a watch event, and is ignored. A read does not raise the
+    //! level of a known state, since the level's event decides, and may still be in flight.
+    //! \param idle_ms idle time read.
+    //! \param read_start_ms clock time at which the read was started.
+    //!
+    void RecordIdleTime(int64_t idle_ms, int64_t read_start_ms);
+
+    //!
+    //! \brief Provides the idle time: the time since the last known input, capped one millisecond below the next
+    //! level.
+    //! \return idle time in milliseconds, or -1 if the state is not known.
+    //!
+    int64_t GetIdleMs() const;
+
+    //!
+    //! \brief Whether a live read is due: below the first level, once the time since the last known input is within
+    //! REFRESH_LEAD_MS of the first level. Above it, the input is reported.
+    //!
+    bool IsRefreshNeeded() const;
+
+    //!
+    //! \brief How far ahead of the first level a read is due, in milliseconds. The main loop's pass one second ahead of
+    //! the threshold then catches up.
+    //!
+    static constexpr int64_t REFRESH_LEAD_MS = 1000;
+
+private:
+    std::vector<int64_t> m_levels_ms;
+    std::function<int64_t()> m_now_ms;
+
+    bool m_known;
+    int m_level;
+
+    //! \brief Time of the last known input, and of the last event, in milliseconds.
+    int64_t m_last_input_ms;
+    int64_t m_last_event_ms;
+
+    //! \brief The index of the highest level at or below idle_ms, -1 if none.
+    int LevelForIdle(int64_t idle_ms) const;
+};
+
+#endif // IDLE_STATE_TRACKER_H
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <input_source.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Class FdInputEventSource
+
+FdInputEventSource::FdInputEventSource(int fd)
+    : m_fd(fd)
+    , m_buffer()
+    , m_buffer_bytes(0)
+    , m_buffer_pos(0)
+{}
+
+int FdInputEventSource::NextEvent(bool sync_mode, input_event& ev)
+{
+    // There is no device state behind a raw stream, so a sync completes immediately.
+    if (sync_mode) {
+        return -EAGAIN;
+    }
+
+    if (m_buffer_pos + sizeof(input_event) > m_buffer_bytes) {
+        // Keep a partial record (a writer's record split across reads) at the front of the buffer.
+        size_t partial = m_buffer_bytes - m_buffer_pos;
+        char* buffer = reinterpret_cast<char*>(m_buffer);
+
+        if (partial > 0) {
+            std::memmove(buffer, buffer + m_buffer_pos, partial);
+        }
+
+        m_buffer_bytes = partial;
+        m_buffer_pos = 0;
+
+        ssize_t bytes_read;
+
+        do {
+            bytes_read = read(m_fd, buffer + m_buffer_bytes, sizeof(m_buffer) - m_buffer_bytes);
+        } while (bytes_read < 0 && errno == EINTR);
+
+        if (bytes_read == 0) {
+            return -ENODEV;
+        }
+
+        if (bytes_read < 0) {
+            return (errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+        }
+
+        m_buffer_bytes += static_cast<size_t>(bytes_read);
+
+        if (m_buffer_bytes < sizeof(input_event)) {
+            return -EAGAIN;
+        }
+    }
+
+    std::memcpy(&ev, reinterpret_cast<char*>(m_buffer) + m_buffer_pos, sizeof(input_event));
+    m_buffer_pos += sizeof(input_event);
+
+    if (ev.type == EV_SYN && ev.code == SYN_DROPPED) {
+        return READ_SYNC;
+    }
+
+    return READ_SUCCESS;
+}
+
+
+InputEventBatch ReadInputEventBatch(InputEventSource& source)
+{
+    InputEventBatch batch;
+    input_event ev;
+    bool sync_mode = false;
+
+    while (true) {
+        int rc = source.NextEvent(sync_mode, ev);
+
+        if (rc == InputEventSource::READ_SUCCESS || rc == InputEventSource::READ_SYNC) {
+            ++batch.events;
+            batch.last_event_us = InputEventTimeMicros(ev);
+
+            if (rc == InputEventSource::READ_SYNC) {
+                // Events were dropped. Drain the sync queue before returning to normal reads.
+                ++batch.syncs;
+                sync_mode = true;
+            }
+        } else if (rc == -EAGAIN && sync_mode) {
+            // Sync complete. Resume normal reads to pick up anything that arrived meanwhile.
+            sync_mode = false;
+        } else {
+            batch.status = rc;
+            break;
+        }
+    }
+
+    return batch;
+}
+
+int64_t InputEventTimeMicros(const input_event& ev)
+{
+    return static_cast<int64_t>(ev.input_event_sec) * 1000000 + static_cast<int64_t>(ev.input_event_usec);
+}
+
+//!
+//! \brief Sets the timestamp of the event from microseconds since the epoch.
+//!
+static void SetInputEventTimeMicros(input_event& ev, int64_t time_us)
+{
+    ev.input_event_sec = time_us / 1000000;
+    ev.input_event_usec = time_us % 1000000;
+}
+
+std::vector<input_event> ReadEvemuTrace(std::istream& in)
+{
+    std::vector<input_event> events;
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (line.rfind("E:", 0) != 0) {
+            continue;
+        }
+
+        // E: 0.000001 0002 0000 0001    # EV_REL / REL_X    1
+        std::istringstream fields(line.substr(2));
+        std::string time_str;
+        unsigned int type = 0;
+        unsigned int code = 0;
+        int value = 0;
+
+        if (!(fields >> time_str >> std::hex >> type >> code >> std::dec >> value)) {
+            error_log("%s: Skipping malformed evemu event line: %s",
+                      __func__,
+                      line);
+            continue;
+        }
+
+        size_t dot = time_str.find('.');
+        int64_t sec = 0;
+        int64_t usec = 0;
+
+        try {
+            sec = ParseStringtoInt64(time_str.substr(0, dot));
+
+            if (dot != std::string::npos) {
+                // evemu writes six fractional digits, but tolerate fewer.
+                std::string frac = time_str.substr(dot + 1, 6);
+                frac.append(6 - frac.size(), '0');
+                usec = ParseStringtoInt64(frac);
+            }
+        } catch (std::exception& e) {
+            error_log("%s: Skipping evemu event line with invalid time: %s",
+                      __func__,
+                      line);
+            continue;
+        }
+
+        input_event ev {};
+        SetInputEventTimeMicros(ev, sec * 1000000 + usec);
+        ev.type = static_cast<uint16_t>(type);
+        ev.code = static_cast<uint16_t>(code);
+        ev.value = value;
+
+        events.push_back(ev);
+    }
+
+    return events;
+}
+
+std::vector<input_event> ReadBinaryTrace(const fs::path& path)
+{
+    std::vector<input_event> events;
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in) {
+        error_log("%s: Could not open trace file %s",
+                  __func__,
+                  path);
+        return events;
+    }
+
+    input_event ev;
+
+    while (in.read(reinterpret_cast<char*>(&ev), sizeof(ev))) {
+        events.push_back(ev);
+    }
+
+    return events;
+}
+
+bool WriteBinaryTrace(const fs::path& path, const std::vector<input_event>& events)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out) {
+        error_log("%s: Could not open trace file %s for writing",
+                  __func__,
+                  path);
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(events.data()),
+              static_cast<std::streamsize>(events.size() * sizeof(input_event)));
+
+    return static_cast<bool>(out);
+}
+
+std::vector<input_event> LoadInputTrace(const fs::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in) {
+        error_log("%s: Could not open trace file %s",
+                  __func__,
+                  path);
+        return {};
+    }
+
+    char header[2] = {};
+    in.read(header, sizeof(header));
+
+    bool evemu = (in.gcount() >= 1 && header[0] == '#')
+                 || (in.gcount() == 2 && std::isupper(static_cast<unsigned char>(header[0])) && header[1] == ':');
+
+    if (evemu) {
+        in.clear();
+        in.seekg(0);
+
+        return ReadEvemuTrace(in);
+    }
+
+    return ReadBinaryTrace(path);
+}
+
+std::vector<input_event> GeneratePointerTrace(int report_rate_hz, int64_t duration_us, int syn_dropped_every)
+{
+    std::vector<input_event> events;
+
+    if (report_rate_hz <= 0 || duration_us <= 0) {
+        return events;
+    }
+
+    int64_t reports = duration_us * report_rate_hz / 1000000;
+
+    events.reserve(static_cast<size_t>(reports) * 3);
+
+    for (int64_t report = 0; report < reports; ++report) {
+        int64_t time_us = report * 1000000 / report_rate_hz;
+
+        input_event ev {};
+        SetInputEventTimeMicros(ev, time_us);
+
+        ev.type = EV_REL;
+        ev.code = REL_X;
+        ev.value = (report % 2) ? 1 : -1;
+        events.push_back(ev);
+
+        ev.code = REL_Y;
+        events.push_back(ev);
+
+        ev.type = EV_SYN;
+        ev.code = SYN_REPORT;
+        ev.value = 0;
+        events.push_back(ev);
+
+        if (syn_dropped_every > 0 && (report + 1) % syn_dropped_every == 0) {
+            ev.code = SYN_DROPPED;
+            events.push_back(ev);
+        }
+    }
+
+    return events;
+}
+
+
+// Class InputTraceReplayer
+
+InputTraceReplayer::InputTraceReplayer(std::vector<input_event> events, double speed)
+    : m_events(std::move(events))
+    , m_speed(speed)
+    , m_write_fd(-1)
+    , m_thread()
+    , m_stop(false)
+    , m_events_written(0)
+{}
+
+InputTraceReplayer::~InputTraceReplayer()
+{
+    Stop();
+}
+
+bool InputTraceReplayer::Start(int write_fd)
+{
+    if (m_thread.joinable() || write_fd < 0) {
+        return false;
+    }
+
+    int flags = fcntl(write_fd, F_GETFL);
+
+    if (flags < 0 || fcntl(write_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        error_log("%s: Could not set replay fd non-blocking: %s",
+                  __func__,
+                  strerror(errno));
+        close(write_fd);
+        return false;
+    }
+
+    m_write_fd = write_fd;
+    m_stop = false;
+    m_events_written = 0;
+
+    m_thread = std::thread(&InputTraceReplayer::ReplayThread, this);
+
+    return true;
+}
+
+void InputTraceReplayer::Stop()
+{
+    m_stop = true;
+    Join();
+}
+
+void InputTraceReplayer::Join()
+{
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+uint64_t InputTraceReplayer::GetEventsWritten() const
+{
+    return m_events_written.load(std::memory_order_relaxed);
+}
+
+void InputTraceReplayer::ReplayThread()
+{
+    using clock = std::chrono::steady_clock;
+
+    const clock::time_point start = clock::now();
+    const int64_t trace_start_us = m_events.empty() ? 0 : InputEventTimeMicros(m_events.front());
+
+    std::vector<input_event> chunk;
+    size_t index = 0;
+    uint64_t bytes_written = 0;
+
+    while (index < m_events.size() && !m_stop) {
+        const int64_t due_us = InputEventTimeMicros(m_events[index]) - trace_start_us;
+
+        if (m_speed > 0.0) {
+            const clock::time_point due = start + std::chrono::microseconds(static_cast<int64_t>(due_us / m_speed));
+
+            // Sleep in slices so a sparse trace does not hold up Stop().
+            while (!m_stop && clock::now() < due) {
+                std::this_thread::sleep_until(std::min(due, clock::now() + std::chrono::milliseconds(100)));
+            }
+
+            if (m_stop) {
+                break;
+            }
+        }
+
+        // Gather every event due at the same time (one report), or everything when replaying flat out.
+        chunk.clear();
+
+        const int64_t now_us = GetUnixEpochTimeMicros();
+
+        while (index < m_events.size()
+               && (m_speed <= 0.0 || InputEventTimeMicros(m_events[index]) - trace_start_us == due_us)
+               && chunk.size() < 1024) {
+            input_event ev = m_events[index++];
+            SetInputEventTimeMicros(ev, now_us);
+            chunk.push_back(ev);
+        }
+
+        const char* data = reinterpret_cast<const char*>(chunk.data());
+        size_t remaining = chunk.size() * sizeof(input_event);
+
+        while (remaining > 0 && !m_stop) {
+            ssize_t written = write(m_write_fd, data, remaining);
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // The reader is behind. Wait for room, rechecking the stop flag periodically.
+                    pollfd pfd {m_write_fd, POLLOUT, 0};
+                    poll(&pfd, 1, 100);
+                    continue;
+                }
+
+                error_log("%s: Error writing replay events: %s",
+                          __func__,
+                          strerror(errno));
+                m_stop = true;
+                break;
+            }
+
+            data += written;
+            remaining -= static_cast<size_t>(written);
+            bytes_written += static_cast<uint64_t>(written);
+            m_events_written.store(bytes_written / sizeof(input_event), std::memory_order_relaxed);
+        }
+    }
+
+    close(m_write_fd);
+    m_write_fd = -1;
+}
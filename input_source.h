@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef INPUT_SOURCE_H
+#define INPUT_SOURCE_H
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <thread>
+#include <vector>
+
+#include <linux/input.h>
+
+#include <util.h>
+
+//!
+//! \brief The InputEventSource class abstracts where the event recorder reads input events from. In production this is
+//! an evdev device read through libevdev (EventDetect::LibevdevEventSource); for load testing and CI it is a pipe or
+//! socketpair carrying raw kernel input_event records (FdInputEventSource), typically fed by an InputTraceReplayer.
+//!
+//! The read contract is that of libevdev_next_event().
+//!
+class InputEventSource
+{
+public:
+    //!
+    //! \brief Non-negative return values of NextEvent(). These have the same values as libevdev's
+    //! LIBEVDEV_READ_STATUS_SUCCESS and LIBEVDEV_READ_STATUS_SYNC.
+    //!
+    enum ReadStatus {
+        READ_SUCCESS = 0,
+        READ_SYNC = 1
+    };
+
+    virtual ~InputEventSource() = default;
+
+    //!
+    //! \brief Reads the next event.
+    //! \param sync_mode true while reading the events that follow a SYN_DROPPED (libevdev LIBEVDEV_READ_FLAG_SYNC).
+    //! \param ev receives the event.
+    //! \return READ_SUCCESS, READ_SYNC if events were dropped and the caller should switch to sync mode, -EAGAIN if no
+    //! event is available (or the sync is complete), -ENODEV if the device is gone, or another negative errno.
+    //!
+    virtual int NextEvent(bool sync_mode, input_event& ev) = 0;
+};
+
+//!
+//! \brief The FdInputEventSource class reads raw kernel input_event records from a non-blocking file descriptor, such
+//! as the read end of a pipe or socketpair. End of file is reported as -ENODEV, which is how a replayed hotplug (device
+//! removal) is expressed. A SYN_DROPPED event is reported as READ_SYNC; as there is no device state to resynchronize,
+//! the following sync mode read completes immediately with -EAGAIN.
+//!
+//! The file descriptor is not owned and is not closed.
+//!
+class FdInputEventSource : public InputEventSource
+{
+public:
+    //!
+    //! \brief Constructor.
+    //! \param fd non-blocking file descriptor carrying input_event records.
+    //!
+    explicit FdInputEventSource(int fd);
+
+    int NextEvent(bool sync_mode, input_event& ev) override;
+
+private:
+    //!
+    //! \brief Events are read in bulk, as libevdev does, to avoid a read() per event.
+    //!
+    static constexpr size_t BUFFER_EVENTS = 64;
+
+    int m_fd;
+    input_event m_buffer[BUFFER_EVENTS];
+    size_t m_buffer_bytes;
+    size_t m_buffer_pos;
+};
+
+//!
+//! \brief Result of draining an InputEventSource with ReadInputEventBatch().
+//!
+struct InputEventBatch
+{
+    //!
+    //! \brief Number of events read, including sync events.
+    //!
+    int64_t events = 0;
+
+    //!
+    //! \brief Number of times the source reported dropped events (SYN_DROPPED).
+    //!
+    int64_t syncs = 0;
+
+    //!
+    //! \brief Kernel timestamp of the last event read in microseconds since the epoch. 0 if no event was read.
+    //!
+    int64_t last_event_us = 0;
+
+    //!
+    //! \brief The status that ended the batch: -EAGAIN normally, -ENODEV if the device is gone, or another negative
+    //! errno on a read error.
+    //!
+    int status = -EAGAIN;
+};
+
+//!
+//! \brief Reads events from the source until none are available, following libevdev's SYN_DROPPED protocol. This is the
+//! read loop of the event recorder threads, shared with the replay harness so that both exercise the same code.
+//! \param source
+//! \return batch summary
+//!
+InputEventBatch ReadInputEventBatch(InputEventSource& source);
+
+//!
+//! \brief Returns the timestamp of the event in microseconds since the epoch.
+//! \param ev
+//!
+int64_t InputEventTimeMicros(const input_event& ev);
+
+//!
+//! \brief Parses an evemu-record text trace. Only the event ("E:") lines are used; the device description lines and
+//! comments are ignored. Event lines have the form "E: <sec>.<usec> <type hex> <code hex> <value>".
+//! \param in
+//! \return events in file order
+//!
+std::vector<input_event> ReadEvemuTrace(std::istream& in);
+
+//!
+//! \brief Reads a binary trace: a sequence of raw kernel input_event records, for example as captured with
+//! "cat /dev/input/eventN > trace.bin". A trailing partial record is ignored.
+//! \param path
+//! \return events in file order
+//!
+std::vector<input_event> ReadBinaryTrace(const fs::path& path);
+
+//!
+//! \brief Writes a binary trace.
+//! \param path
+//! \param events
+//! \return true on success.
+//!
+bool WriteBinaryTrace(const fs::path& path, const std::vector<input_event>& events);
+
+//!
+//! \brief Loads a trace in either format. evemu text is recognized by a leading '#' or "<letter>:".
+//! \param path
+//! \return events in file order. Empty if the file cannot be read.
+//!
+std::vector<input_event> LoadInputTrace(const fs::path& path);
+
+//!
+//! \brief Generates a synthetic relative pointer trace: REL_X, REL_Y and SYN_REPORT per report.
+//! \param report_rate_hz reports per second, e.g. 8000 for a high polling rate gaming mouse.
+//! \param duration_us length of the trace in microseconds.
+//! \param syn_dropped_every if non-zero, a SYN_DROPPED is inserted after every this many reports.
+//! \return events with timestamps starting at zero
+//!
+std::vector<input_event> GeneratePointerTrace(int report_rate_hz, int64_t duration_us, int syn_dropped_every = 0);
+
+//!
+//! \brief The InputTraceReplayer class writes a recorded trace into a file descriptor from its own thread, reproducing
+//! the recorded inter-event timing scaled by a speed factor. The timestamps of the written events are rewritten to
+//! the time of writing, so latency measured by the reader is meaningful. Events due at the same time are written
+//! together, as the kernel delivers them.
+//!
+class InputTraceReplayer
+{
+public:
+    //!
+    //! \brief Constructor.
+    //! \param events trace to replay
+    //! \param speed 1.0 replays in real time, 2.0 twice as fast, and so on. 0 replays as fast as the reader consumes.
+    //!
+    InputTraceReplayer(std::vector<input_event> events, double speed);
+
+    //!
+    //! \brief Destructor. Stops the replay thread if running.
+    //!
+    ~InputTraceReplayer();
+
+    InputTraceReplayer(const InputTraceReplayer&) = delete;
+    InputTraceReplayer& operator=(const InputTraceReplayer&) = delete;
+
+    //!
+    //! \brief Starts replaying into write_fd, which is set non-blocking. The replayer takes ownership of write_fd and
+    //! closes it when the trace is finished, so the reader sees end of file (-ENODEV, a device removal).
+    //! \param write_fd
+    //! \return true if the thread was started.
+    //!
+    bool Start(int write_fd);
+
+    //!
+    //! \brief Stops the replay early and joins the thread. The write fd is closed.
+    //!
+    void Stop();
+
+    //!
+    //! \brief Waits for the replay to finish.
+    //!
+    void Join();
+
+    //!
+    //! \brief Number of events written so far.
+    //!
+    uint64_t GetEventsWritten() const;
+
+private:
+    void ReplayThread();
+
+    std::vector<input_event> m_events;
+    double m_speed;
+    int m_write_fd;
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_events_written;
+};
+
+#endif // INPUT_SOURCE_H
@@ -0,0 +1,572 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <logger.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//!
+//! \brief Path of the journald native protocol socket.
+//!
+static const char* JOURNAL_SOCKET_PATH = "/run/systemd/journal/socket";
+
+Logger g_logger;
+
+//!
+//! \brief Set while a Logger consumer thread is running. This is deliberately a separate, trivially destructible flag
+//! rather than a query on g_logger, so that logging from other static destructors after g_logger has been destroyed
+//! safely falls back to the synchronous path.
+//!
+static std::atomic<Logger*> g_async_logger = nullptr;
+
+void LogMessage(LogLevel level, const std::string& msg)
+{
+    Logger* logger = g_async_logger.load(std::memory_order_acquire);
+
+    if (logger != nullptr) {
+        logger->Submit(level, msg);
+        return;
+    }
+
+    std::string line;
+
+    if (g_log_timestamps.load(std::memory_order_relaxed)) {
+        line = GetLogTimestampPrefix();
+    }
+
+    line += msg;
+    line += "\n";
+
+    if (level == LogLevel::ERROR) {
+        std::cerr << line;
+    } else {
+        std::cout << line;
+    }
+}
+
+static int64_t GetSteadyTimeMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//!
+//! \brief Writes the whole buffer to fd, retrying on EINTR and short writes. Errors are otherwise ignored, since there
+//! is nowhere left to report them.
+//!
+static void WriteAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+//!
+//! \brief Determines whether stderr is connected to the journal. Per systemd.exec(5), JOURNAL_STREAM holds the device
+//! and inode of the stream socket in "dev:ino" form, and should be compared to fstat() of the fd to make sure the fd
+//! has not since been redirected.
+//!
+static bool StderrIsJournalStream()
+{
+    std::optional<std::string> journal_stream = GetEnvVariable("JOURNAL_STREAM");
+
+    if (!journal_stream || journal_stream->empty()) {
+        return false;
+    }
+
+    std::vector<std::string> parts = StringSplit(*journal_stream, ":");
+
+    if (parts.size() != 2) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(STDERR_FILENO, &st) != 0) {
+        return false;
+    }
+
+    try {
+        return static_cast<uint64_t>(st.st_dev) == std::stoull(parts[0])
+               && static_cast<uint64_t>(st.st_ino) == std::stoull(parts[1]);
+    } catch (...) {
+        return false;
+    }
+}
+
+Logger::Logger(size_t capacity)
+    : m_mask(0)
+    , m_enqueue_pos(0)
+    , m_dequeue_pos(0)
+    , m_overflow_count(0)
+    , m_rate_limited_count(0)
+    , m_dedup_suppressed_count(0)
+    , m_running(false)
+    , m_stop(false)
+    , m_out_fd(STDOUT_FILENO)
+    , m_err_fd(STDERR_FILENO)
+    , m_journal_fd(-1)
+    , m_use_journal(false)
+    , m_dedup(DEDUP_TABLE_SIZE)
+    , m_tokens(RATE_LIMIT_BURST)
+    , m_tokens_updated_ms(0)
+    , m_overflow_reported(0)
+    , m_rate_limited_reported(0)
+{
+    size_t rounded = 1;
+
+    while (rounded < std::max<size_t>(capacity, 2)) {
+        rounded <<= 1;
+    }
+
+    m_slots = std::make_unique<Slot[]>(rounded);
+    m_mask = rounded - 1;
+
+    for (size_t i = 0; i < rounded; ++i) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+Logger::~Logger()
+{
+    Stop();
+}
+
+void Logger::Start()
+{
+    if (m_running) {
+        return;
+    }
+
+    m_out_fd = STDOUT_FILENO;
+    m_err_fd = STDERR_FILENO;
+    m_use_journal = false;
+
+    if (StderrIsJournalStream()) {
+        m_journal_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+        if (m_journal_fd >= 0) {
+            struct sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, JOURNAL_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+
+            if (connect(m_journal_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+                m_use_journal = true;
+            } else {
+                close(m_journal_fd);
+                m_journal_fd = -1;
+            }
+        }
+    }
+
+    StartConsumer();
+
+    debug_log("INFO: %s: asynchronous logger started, output to %s",
+              __func__,
+              m_use_journal ? "journald native socket" : "stdout/stderr");
+}
+
+void Logger::Start(int out_fd, int err_fd)
+{
+    if (m_running) {
+        return;
+    }
+
+    m_out_fd = out_fd;
+    m_err_fd = err_fd;
+    m_use_journal = false;
+
+    StartConsumer();
+}
+
+void Logger::StartConsumer()
+{
+    // Anything already written synchronously must come out ahead of the consumer's direct writes.
+    std::cout.flush();
+    std::cerr.flush();
+
+    m_stop = false;
+    m_tokens = RATE_LIMIT_BURST;
+    m_tokens_updated_ms = GetSteadyTimeMs();
+
+    try {
+        m_consumer_thread = std::thread(&Logger::ConsumerThread, this);
+    } catch (std::system_error& e) {
+        error_log("%s: Unable to start logger thread, logging synchronously: %s",
+                  __func__,
+                  e.what());
+
+        return;
+    }
+
+    m_running = true;
+    g_async_logger.store(this, std::memory_order_release);
+}
+
+void Logger::Stop()
+{
+    if (!m_running) {
+        return;
+    }
+
+    // Route any further messages synchronously. Anything already queued is drained by the consumer before it exits.
+    Logger* expected = this;
+    g_async_logger.compare_exchange_strong(expected, nullptr);
+
+    {
+        std::unique_lock<std::mutex> lock(mtx_consumer);
+        m_stop = true;
+    }
+
+    cv_consumer.notify_one();
+
+    if (m_consumer_thread.joinable()) {
+        m_consumer_thread.join();
+    }
+
+    if (m_journal_fd >= 0) {
+        close(m_journal_fd);
+        m_journal_fd = -1;
+    }
+
+    m_use_journal = false;
+    m_running = false;
+}
+
+bool Logger::IsRunning() const
+{
+    return m_running.load();
+}
+
+bool Logger::IsUsingJournal() const
+{
+    return m_use_journal.load();
+}
+
+bool Logger::Submit(LogLevel level, const std::string& msg)
+{
+    uint64_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+
+    while (true) {
+        slot = &m_slots[pos & m_mask];
+
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+        if (diff == 0) {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Ring is full. Drop and count rather than block.
+            m_overflow_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->timestamp = GetUnixEpochTime();
+    slot->level = level;
+    slot->length = static_cast<uint32_t>(std::min(msg.size(), SLOT_TEXT_SIZE));
+    memcpy(slot->text, msg.data(), slot->length);
+
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    cv_consumer.notify_one();
+
+    return true;
+}
+
+bool Logger::Dequeue(LogLevel& level, int64_t& timestamp, std::string& text)
+{
+    Slot* slot = &m_slots[m_dequeue_pos & m_mask];
+
+    if (slot->sequence.load(std::memory_order_acquire) != m_dequeue_pos + 1) {
+        return false;
+    }
+
+    level = slot->level;
+    timestamp = slot->timestamp;
+    text.assign(slot->text, slot->length);
+
+    slot->sequence.store(m_dequeue_pos + m_mask + 1, std::memory_order_release);
+    ++m_dequeue_pos;
+
+    return true;
+}
+
+uint64_t Logger::GetOverflowCount() const
+{
+    return m_overflow_count.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::GetRateLimitedCount() const
+{
+    return m_rate_limited_count.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::GetDedupSuppressedCount() const
+{
+    return m_dedup_suppressed_count.load(std::memory_order_relaxed);
+}
+
+void Logger::ConsumerThread()
+{
+    LogLevel level = LogLevel::INFO;
+    int64_t timestamp = 0;
+    std::string text;
+    text.reserve(SLOT_TEXT_SIZE);
+
+    while (true) {
+        while (Dequeue(level, timestamp, text)) {
+            Process(level, timestamp, text);
+        }
+
+        int64_t now = GetUnixEpochTime();
+
+        ReportDrops(now, false);
+
+        FlushDedupSummaries(now, false);
+
+        if (m_stop) {
+            // Final drain. Producers have been redirected to the synchronous path by Stop(), but a message may have
+            // been published between the last Dequeue() and the flag check.
+            while (Dequeue(level, timestamp, text)) {
+                Process(level, timestamp, text);
+            }
+
+            ReportDrops(GetUnixEpochTime(), true);
+            FlushDedupSummaries(GetUnixEpochTime(), true);
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(mtx_consumer);
+
+        // A producer does not take the mutex, so a notify can be missed. The timeout bounds the extra latency
+        // in that case, and also drives the periodic dedup summaries.
+        cv_consumer.wait_for(lock, std::chrono::milliseconds(100), [this]{
+            return m_stop.load() || m_slots[m_dequeue_pos & m_mask].sequence.load(std::memory_order_acquire)
+                                        == m_dequeue_pos + 1;
+        });
+    }
+}
+
+void Logger::ReportDrops(int64_t now, bool force)
+{
+    uint64_t overflow = GetOverflowCount();
+
+    if (overflow != m_overflow_reported) {
+        Emit(LogLevel::ERROR, now, tfm::format("ERROR: %s: log ring full, %u messages dropped.",
+                                               __func__,
+                                               overflow - m_overflow_reported));
+        m_overflow_reported = overflow;
+    }
+
+    uint64_t rate_limited = GetRateLimitedCount();
+
+    // The report itself is subject to the rate limit, except on shutdown.
+    if (rate_limited != m_rate_limited_reported && (force || TakeRateToken(GetSteadyTimeMs()))) {
+        Emit(LogLevel::INFO, now, tfm::format("WARNING: %s: rate limit exceeded, %u messages suppressed.",
+                                              __func__,
+                                              rate_limited - m_rate_limited_reported));
+        m_rate_limited_reported = rate_limited;
+    }
+}
+
+void Logger::Process(LogLevel level, int64_t timestamp, const std::string& text)
+{
+    // Only errors and warnings are deduplicated. Debug output is voluminous by design and repeats every tick, and
+    // ordinary informational messages mark state changes that should always appear.
+    bool dedup = level == LogLevel::ERROR
+                 || (level == LogLevel::INFO && text.rfind("WARN", 0) == 0);
+
+    if (dedup) {
+        size_t hash = std::hash<std::string_view>{}(std::string_view(text));
+
+        DedupEntry* match = nullptr;
+        DedupEntry* oldest = &m_dedup[0];
+
+        for (auto& entry : m_dedup) {
+            if (entry.in_use && entry.hash == hash && entry.text == text) {
+                match = &entry;
+                break;
+            }
+
+            if (!entry.in_use || (oldest->in_use && entry.window_start < oldest->window_start)) {
+                oldest = &entry;
+            }
+        }
+
+        if (match != nullptr && timestamp - match->window_start < DEDUP_WINDOW_SECONDS) {
+            ++match->suppressed;
+            m_dedup_suppressed_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (match == nullptr) {
+            // Evicting an entry with pending repeats reports them first so the count is not lost.
+            if (oldest->in_use && oldest->suppressed > 0) {
+                Emit(oldest->level, timestamp, tfm::format("%s [repeated %u times in the last %u seconds]",
+                                                           oldest->text,
+                                                           oldest->suppressed,
+                                                           timestamp - oldest->window_start));
+            }
+
+            match = oldest;
+            match->hash = hash;
+            match->text = text;
+            match->level = level;
+            match->in_use = true;
+        } else if (match->suppressed > 0) {
+            // The window expired with repeats that were not yet summarized.
+            Emit(match->level, timestamp, tfm::format("%s [repeated %u times in the last %u seconds]",
+                                                      match->text,
+                                                      match->suppressed,
+                                                      timestamp - match->window_start));
+        }
+
+        match->window_start = timestamp;
+        match->suppressed = 0;
+    }
+
+    if (!TakeRateToken(GetSteadyTimeMs())) {
+        m_rate_limited_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Emit(level, timestamp, text);
+}
+
+void Logger::FlushDedupSummaries(int64_t now, bool force)
+{
+    for (auto& entry : m_dedup) {
+        if (!entry.in_use || entry.suppressed == 0) {
+            continue;
+        }
+
+        if (force || now - entry.window_start >= DEDUP_WINDOW_SECONDS) {
+            Emit(entry.level, now, tfm::format("%s [repeated %u times in the last %u seconds]",
+                                               entry.text,
+                                               entry.suppressed,
+                                               now - entry.window_start));
+
+            // Start a new window, so a message that keeps repeating produces one summary per window.
+            entry.window_start = now;
+            entry.suppressed = 0;
+        }
+    }
+}
+
+bool Logger::TakeRateToken(int64_t now_ms)
+{
+    m_tokens = std::min(RATE_LIMIT_BURST,
+                        m_tokens + static_cast<double>(now_ms - m_tokens_updated_ms) * RATE_LIMIT_PER_SECOND / 1000.0);
+    m_tokens_updated_ms = now_ms;
+
+    if (m_tokens < 1.0) {
+        return false;
+    }
+
+    m_tokens -= 1.0;
+
+    return true;
+}
+
+void Logger::Emit(LogLevel level, int64_t timestamp, const std::string& text)
+{
+    if (m_use_journal && EmitJournal(level, text)) {
+        return;
+    }
+
+    EmitStream(level, timestamp, text);
+}
+
+bool Logger::EmitJournal(LogLevel level, const std::string& text)
+{
+    // syslog(3) priorities: 3 = err, 4 = warning, 6 = info, 7 = debug.
+    int priority = 6;
+
+    if (level == LogLevel::ERROR) {
+        priority = 3;
+    } else if (level == LogLevel::DEBUG) {
+        priority = 7;
+    } else if (text.rfind("WARN", 0) == 0) {
+        priority = 4;
+    }
+
+    std::string entry = tfm::format("PRIORITY=%i\nSYSLOG_IDENTIFIER=%s\nSYSLOG_PID=%i\n",
+                                    priority,
+                                    program_invocation_short_name,
+                                    getpid());
+
+    if (text.find('\n') == std::string::npos) {
+        entry += "MESSAGE=" + text + "\n";
+    } else {
+        // Binary-safe field encoding: name, newline, little endian 64 bit length, data, newline.
+        entry += "MESSAGE\n";
+
+        uint64_t size = text.size();
+
+        for (int i = 0; i < 8; ++i) {
+            entry += static_cast<char>((size >> (8 * i)) & 0xff);
+        }
+
+        entry += text + "\n";
+    }
+
+    ssize_t sent;
+
+    do {
+        sent = send(m_journal_fd, entry.data(), entry.size(), MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    return sent >= 0;
+}
+
+void Logger::EmitStream(LogLevel level, int64_t timestamp, const std::string& text)
+{
+    thread_local int64_t cached_time = -1;
+    thread_local std::string cached_prefix;
+
+    std::string line;
+
+    if (g_log_timestamps.load(std::memory_order_relaxed)) {
+        if (timestamp != cached_time) {
+            cached_prefix = FormatISO8601DateTime(timestamp) + " ";
+            cached_time = timestamp;
+        }
+
+        line = cached_prefix;
+    }
+
+    line += text;
+    line += "\n";
+
+    WriteAll(level == LogLevel::ERROR ? m_err_fd : m_out_fd, line.data(), line.size());
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <util.h>
+
+//!
+//! \brief The Logger class is an asynchronous log writer. Producers (any thread calling normal_log, debug_log or error_log)
+//! copy the formatted message into a slot of a bounded lock-free multi-producer/single-consumer ring and return
+//! immediately. A single background thread drains the ring and performs the actual (potentially blocking) write, so a
+//! slow stdout pipe or journald backpressure can no longer stall the monitor tick or the recorder and Wayland threads.
+//!
+//! If the ring is full the message is dropped and counted; a producer never blocks. The consumer reports drops, applies
+//! a global rate limit, and deduplicates repeating messages (such as a D-Bus failure every second) within a window,
+//! emitting a periodic summary of the suppressed repeats.
+//!
+//! When JOURNAL_STREAM is set and refers to our stderr, the consumer sends each entry directly to journald using the
+//! native protocol, with PRIORITY and other structured fields, rather than writing to the stream.
+//!
+//! Before Start() is called (or after Stop()), LogMessage() writes synchronously, which is the historical behavior and
+//! is what the tests and the small read_shmem_timestamps utility use.
+//!
+class Logger
+{
+public:
+    //!
+    //! \brief Default ring capacity in slots. Must be a power of two.
+    //!
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    //!
+    //! \brief Maximum message length carried by a slot. Longer messages are truncated.
+    //!
+    static constexpr size_t SLOT_TEXT_SIZE = 512;
+
+    //!
+    //! \brief Window in seconds over which identical messages are suppressed after the first occurrence.
+    //!
+    static constexpr int64_t DEDUP_WINDOW_SECONDS = 30;
+
+    //!
+    //! \brief Number of distinct recent messages tracked for deduplication.
+    //!
+    static constexpr size_t DEDUP_TABLE_SIZE = 32;
+
+    //!
+    //! \brief Sustained rate limit in messages per second, and the burst size allowed above it.
+    //!
+    static constexpr double RATE_LIMIT_PER_SECOND = 100.0;
+    static constexpr double RATE_LIMIT_BURST = 500.0;
+
+    //!
+    //! \brief Constructor. Allocates the ring. The consumer thread is not started until Start() is called.
+    //! \param capacity in slots. Rounded up to a power of two.
+    //!
+    explicit Logger(size_t capacity = DEFAULT_CAPACITY);
+
+    //!
+    //! \brief Destructor. Stops the consumer thread if running, flushing any queued messages.
+    //!
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    //!
+    //! \brief Starts the consumer thread writing to stdout/stderr, or to the journald native socket if JOURNAL_STREAM
+    //! indicates that stderr is connected to the journal.
+    //!
+    void Start();
+
+    //!
+    //! \brief Starts the consumer thread writing to the provided file descriptors. The journal is not used. This is
+    //! primarily for testing.
+    //! \param out_fd file descriptor for normal and debug messages
+    //! \param err_fd file descriptor for error messages
+    //!
+    void Start(int out_fd, int err_fd);
+
+    //!
+    //! \brief Stops the consumer thread after draining the ring and flushing deduplication summaries.
+    //!
+    void Stop();
+
+    //!
+    //! \brief Whether the consumer thread is running.
+    //! \return boolean flag
+    //!
+    bool IsRunning() const;
+
+    //!
+    //! \brief Whether the consumer thread is sending to the journald native socket.
+    //! \return boolean flag
+    //!
+    bool IsUsingJournal() const;
+
+    //!
+    //! \brief Enqueues a message. Never blocks. Safe to call from any thread.
+    //! \param level
+    //! \param msg formatted message without timestamp prefix or trailing newline.
+    //! \return true if enqueued, false if the ring was full and the message was dropped.
+    //!
+    bool Submit(LogLevel level, const std::string& msg);
+
+    //!
+    //! \brief Number of messages dropped because the ring was full.
+    //!
+    uint64_t GetOverflowCount() const;
+
+    //!
+    //! \brief Number of messages suppressed by the rate limiter.
+    //!
+    uint64_t GetRateLimitedCount() const;
+
+    //!
+    //! \brief Number of messages suppressed as repeats by deduplication.
+    //!
+    uint64_t GetDedupSuppressedCount() const;
+
+private:
+    //!
+    //! \brief A ring slot. The sequence number implements the bounded queue algorithm by D. Vyukov: a slot is free for
+    //! the producer claiming position pos when sequence == pos, and holds a published message for the consumer when
+    //! sequence == pos + 1.
+    //!
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> sequence;
+        int64_t timestamp;
+        LogLevel level;
+        uint32_t length;
+        char text[SLOT_TEXT_SIZE];
+    };
+
+    //!
+    //! \brief Dedup table entry tracking one recently emitted message.
+    //!
+    struct DedupEntry
+    {
+        size_t hash = 0;
+        int64_t window_start = 0;
+        uint64_t suppressed = 0;
+        LogLevel level = LogLevel::INFO;
+        std::string text;
+        bool in_use = false;
+    };
+
+    void StartConsumer();
+    void ConsumerThread();
+    bool Dequeue(LogLevel& level, int64_t& timestamp, std::string& text);
+    void Process(LogLevel level, int64_t timestamp, const std::string& text);
+    void ReportDrops(int64_t now, bool force);
+    void FlushDedupSummaries(int64_t now, bool force);
+    bool TakeRateToken(int64_t now_ms);
+    void Emit(LogLevel level, int64_t timestamp, const std::string& text);
+    bool EmitJournal(LogLevel level, const std::string& text);
+    void EmitStream(LogLevel level, int64_t timestamp, const std::string& text);
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+
+    alignas(64) std::atomic<uint64_t> m_enqueue_pos;
+    alignas(64) uint64_t m_dequeue_pos;
+
+    alignas(64) std::atomic<uint64_t> m_overflow_count;
+    std::atomic<uint64_t> m_rate_limited_count;
+    std::atomic<uint64_t> m_dedup_suppressed_count;
+
+    std::thread m_consumer_thread;
+    std::mutex mtx_consumer;
+    std::condition_variable cv_consumer;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stop;
+
+    int m_out_fd;
+    int m_err_fd;
+    int m_journal_fd;
+    std::atomic<bool> m_use_journal;
+
+    // Consumer thread only state.
+    std::vector<DedupEntry> m_dedup;
+    double m_tokens;
+    int64_t m_tokens_updated_ms;
+    uint64_t m_overflow_reported;
+    uint64_t m_rate_limited_reported;
+};
+
+//!
+//! \brief The global logger used by normal_log, debug_log and error_log.
+//!
+extern Logger g_logger;
+
+#endif // LOGGER_H
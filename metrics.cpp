@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <metrics.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Class MetricHistogram
+
+const std::vector<int64_t>& MetricHistogram::DefaultMicrosecondBounds()
+{
+    static const std::vector<int64_t> bounds = {
+        10, 25, 50, 100, 250, 500,
+        1000, 2500, 5000, 10000, 25000, 50000,
+        100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+    };
+
+    return bounds;
+}
+
+MetricHistogram::MetricHistogram(const std::vector<int64_t>& bounds)
+    : m_bounds(bounds)
+    , m_buckets(std::make_unique<std::atomic<uint64_t>[]>(bounds.size() + 1))
+    , m_count(0)
+    , m_sum(0)
+{
+    for (size_t i = 0; i <= m_bounds.size(); ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricHistogram::Observe(int64_t value)
+{
+    size_t index = static_cast<size_t>(std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin());
+
+    m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+const std::vector<int64_t>& MetricHistogram::GetBounds() const
+{
+    return m_bounds;
+}
+
+uint64_t MetricHistogram::GetBucketCount(size_t index) const
+{
+    if (index > m_bounds.size()) {
+        return 0;
+    }
+
+    return m_buckets[index].load(std::memory_order_relaxed);
+}
+
+uint64_t MetricHistogram::GetCount() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+int64_t MetricHistogram::GetSum() const
+{
+    return m_sum.load(std::memory_order_relaxed);
+}
+
+double MetricHistogram::Quantile(double q) const
+{
+    q = std::clamp(q, 0.0, 1.0);
+
+    // Snapshot the buckets. The total is computed from the snapshot rather than m_count so the two are consistent.
+    std::vector<uint64_t> counts(m_bounds.size() + 1);
+    uint64_t total = 0;
+
+    for (size_t i = 0; i <= m_bounds.size(); ++i) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0 || m_bounds.empty()) {
+        return 0.0;
+    }
+
+    double rank = q * static_cast<double>(total);
+    uint64_t cumulative = 0;
+
+    for (size_t i = 0; i < m_bounds.size(); ++i) {
+        if (counts[i] > 0 && static_cast<double>(cumulative + counts[i]) >= rank) {
+            double lower = (i == 0) ? 0.0 : static_cast<double>(m_bounds[i - 1]);
+            double upper = static_cast<double>(m_bounds[i]);
+            double fraction = (rank - static_cast<double>(cumulative)) / static_cast<double>(counts[i]);
+
+            return lower + (upper - lower) * std::clamp(fraction, 0.0, 1.0);
+        }
+
+        cumulative += counts[i];
+    }
+
+    return static_cast<double>(m_bounds.back());
+}
+
+
+// Class PrometheusTextBuilder
+
+void PrometheusTextBuilder::AddFamily(const std::string& name, const std::string& type, const std::string& help)
+{
+    m_text += "# HELP " + name + " " + help + "\n";
+    m_text += "# TYPE " + name + " " + type + "\n";
+}
+
+void PrometheusTextBuilder::AddSample(const std::string& name, int64_t value, const std::string& labels)
+{
+    m_text += labels.empty() ? name : name + "{" + labels + "}";
+    m_text += " " + ToString(value) + "\n";
+}
+
+void PrometheusTextBuilder::AddSample(const std::string& name, uint64_t value, const std::string& labels)
+{
+    m_text += labels.empty() ? name : name + "{" + labels + "}";
+    m_text += " " + ToString(value) + "\n";
+}
+
+void PrometheusTextBuilder::AddSample(const std::string& name, double value, const std::string& labels)
+{
+    m_text += labels.empty() ? name : name + "{" + labels + "}";
+    m_text += " " + tfm::format("%.9g", value) + "\n";
+}
+
+void PrometheusTextBuilder::AddHistogram(const std::string& name, const std::string& help,
+                                         const MetricHistogram& histogram, double scale, const std::string& labels,
+                                         bool add_family)
+{
+    if (add_family) {
+        AddFamily(name, "histogram", help);
+    }
+
+    std::string label_prefix = labels.empty() ? std::string {} : labels + ",";
+
+    uint64_t cumulative = 0;
+    const std::vector<int64_t>& bounds = histogram.GetBounds();
+
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        cumulative += histogram.GetBucketCount(i);
+
+        AddSample(name + "_bucket", cumulative,
+                  label_prefix + "le=\"" + tfm::format("%.9g", static_cast<double>(bounds[i]) * scale) + "\"");
+    }
+
+    cumulative += histogram.GetBucketCount(bounds.size());
+
+    AddSample(name + "_bucket", cumulative, label_prefix + "le=\"+Inf\"");
+    AddSample(name + "_sum", static_cast<double>(histogram.GetSum()) * scale, labels);
+    AddSample(name + "_count", cumulative, labels);
+}
+
+std::string PrometheusTextBuilder::LabelPair(const std::string& name, const std::string& value)
+{
+    std::string escaped;
+
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+
+    return name + "=\"" + escaped + "\"";
+}
+
+const std::string& PrometheusTextBuilder::GetText() const
+{
+    return m_text;
+}
+
+
+bool WriteFileAtomically(const fs::path& path, const std::string& content)
+{
+    fs::path tmp_path = path;
+    tmp_path += ".tmp";
+
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        error_log("%s: Could not open %s for writing: %s",
+                  __func__,
+                  tmp_path,
+                  strerror(errno));
+        return false;
+    }
+
+    const char* data = content.data();
+    size_t remaining = content.size();
+
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            error_log("%s: Error writing %s: %s",
+                      __func__,
+                      tmp_path,
+                      strerror(errno));
+            close(fd);
+            unlink(tmp_path.c_str());
+            return false;
+        }
+
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+
+    close(fd);
+
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        error_log("%s: Could not rename %s to %s: %s",
+                  __func__,
+                  tmp_path,
+                  path,
+                  strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
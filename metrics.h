@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <util.h>
+
+//!
+//! \brief Size of a cache line. Each metric is aligned to this so that metrics updated by different threads never share
+//! a line, and recording one does not cause false sharing with the hot path data of another thread.
+//!
+constexpr size_t METRICS_CACHE_LINE_SIZE = 64;
+
+//!
+//! \brief The MetricCounter class is a monotonically increasing, lock-free counter.
+//!
+class alignas(METRICS_CACHE_LINE_SIZE) MetricCounter
+{
+public:
+    MetricCounter() : m_value(0) {}
+
+    //!
+    //! \brief Increments the counter.
+    //! \param n increment, default 1.
+    //!
+    void Increment(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+
+    //!
+    //! \brief Returns the current counter value.
+    //!
+    uint64_t Get() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value;
+};
+
+//!
+//! \brief The MetricGauge class is a lock-free value that can go up and down.
+//!
+class alignas(METRICS_CACHE_LINE_SIZE) MetricGauge
+{
+public:
+    MetricGauge() : m_value(0) {}
+
+    //!
+    //! \brief Sets the gauge value.
+    //!
+    void Set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+
+    //!
+    //! \brief Returns the current gauge value.
+    //!
+    int64_t Get() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> m_value;
+};
+
+//!
+//! \brief The MetricHistogram class is a lock-free fixed bucket histogram of integer observations, typically durations
+//! in microseconds. The bucket bounds are fixed at construction. Observation is a bucket search and three relaxed atomic
+//! increments; no allocation and no locking.
+//!
+class alignas(METRICS_CACHE_LINE_SIZE) MetricHistogram
+{
+public:
+    //!
+    //! \brief Default bucket upper bounds, in microseconds, spanning 10 us to 10 s.
+    //!
+    static const std::vector<int64_t>& DefaultMicrosecondBounds();
+
+    //!
+    //! \brief Constructs a histogram with the provided (ascending) bucket upper bounds. An implicit +Inf bucket is added.
+    //! \param bounds
+    //!
+    explicit MetricHistogram(const std::vector<int64_t>& bounds = DefaultMicrosecondBounds());
+
+    MetricHistogram(const MetricHistogram&) = delete;
+    MetricHistogram& operator=(const MetricHistogram&) = delete;
+
+    //!
+    //! \brief Records one observation.
+    //! \param value
+    //!
+    void Observe(int64_t value);
+
+    //!
+    //! \brief Returns the bucket upper bounds (without the implicit +Inf bucket).
+    //!
+    const std::vector<int64_t>& GetBounds() const;
+
+    //!
+    //! \brief Returns the non-cumulative count of the bucket at index. Index GetBounds().size() is the +Inf bucket.
+    //! \param index
+    //!
+    uint64_t GetBucketCount(size_t index) const;
+
+    //!
+    //! \brief Returns the total number of observations.
+    //!
+    uint64_t GetCount() const;
+
+    //!
+    //! \brief Returns the sum of all observations.
+    //!
+    int64_t GetSum() const;
+
+    //!
+    //! \brief Estimates the quantile q (0..1) from the bucket counts by linear interpolation within the bucket that
+    //! contains the target rank. Returns 0 if there are no observations. Observations in the +Inf bucket are reported
+    //! as the largest finite bound.
+    //! \param q
+    //! \return estimated value in the observation units
+    //!
+    double Quantile(double q) const;
+
+private:
+    std::vector<int64_t> m_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<int64_t> m_sum;
+};
+
+//!
+//! \brief The PrometheusTextBuilder class assembles metrics in the Prometheus text exposition format (version 0.0.4).
+//!
+class PrometheusTextBuilder
+{
+public:
+    //!
+    //! \brief Emits the HELP and TYPE lines for a metric family. Call once per family before its samples.
+    //! \param name metric name
+    //! \param type "counter", "gauge" or "histogram"
+    //! \param help one line description
+    //!
+    void AddFamily(const std::string& name, const std::string& type, const std::string& help);
+
+    //!
+    //! \brief Emits one sample line.
+    //! \param name metric name
+    //! \param value
+    //! \param labels label set without braces, e.g. device="event3". Use LabelPair() to build escaped pairs.
+    //!
+    void AddSample(const std::string& name, int64_t value, const std::string& labels = {});
+    void AddSample(const std::string& name, uint64_t value, const std::string& labels = {});
+    void AddSample(const std::string& name, double value, const std::string& labels = {});
+
+    //!
+    //! \brief Emits the family header and the _bucket, _sum and _count samples of a histogram.
+    //! \param name metric name
+    //! \param help one line description
+    //! \param histogram
+    //! \param scale factor applied to the bucket bounds and sum, e.g. 1e-6 to export microseconds as seconds.
+    //! \param labels optional label set applied to all samples
+    //! \param add_family whether to emit the HELP/TYPE lines. Set false for the second and later label sets.
+    //!
+    void AddHistogram(const std::string& name, const std::string& help, const MetricHistogram& histogram,
+                      double scale = 1.0, const std::string& labels = {}, bool add_family = true);
+
+    //!
+    //! \brief Builds an escaped label pair, name="value".
+    //! \param name
+    //! \param value
+    //!
+    static std::string LabelPair(const std::string& name, const std::string& value);
+
+    //!
+    //! \brief Returns the assembled text.
+    //!
+    const std::string& GetText() const;
+
+private:
+    std::string m_text;
+};
+
+//!
+//! \brief Writes content to path atomically: the content is written to a temporary file in the same directory, which
+//! is then renamed over the target. Readers therefore see either the previous or the new content, never a partial
+//! file.
+//! \param path
+//! \param content
+//! \return true on success.
+//!
+bool WriteFileAtomically(const fs::path& path, const std::string& content);
+
+#endif // METRICS_H
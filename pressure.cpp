@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <pressure.h>
+#include <util.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool LockProcessMemory()
+{
+    // Keep freed memory in the heap rather than returning it to the kernel, serve large allocations from the heap rather
+    // than from fresh mmaps, and use one arena for all threads, so that the pre-faulted reserve below covers them.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_ARENA_MAX, 1);
+
+    int flags = MCL_CURRENT | MCL_FUTURE;
+
+#ifdef MCL_ONFAULT
+    flags |= MCL_ONFAULT;
+#endif
+
+    if (mlockall(flags) != 0) {
+        if (errno == EINVAL && (flags & MCL_FUTURE)) {
+            // The kernel predates MCL_ONFAULT (Linux 4.4). MCL_FUTURE without it would populate each new thread's
+            // whole stack, so lock only what is mapped now.
+            error_log("WARNING: %s: mlockall does not support MCL_ONFAULT, locking current mappings only.",
+                      __func__);
+
+            flags = MCL_CURRENT;
+        }
+
+        if (flags != MCL_CURRENT || mlockall(flags) != 0) {
+            error_log("%s: mlockall failed: %s. Raise LimitMEMLOCK= in the service unit, or grant CAP_IPC_LOCK.",
+                      __func__,
+                      strerror(errno));
+
+            return false;
+        }
+    }
+
+    // Fault in the heap reserve. With the settings above it stays in the heap, now locked, after it is freed.
+    if (char* reserve = static_cast<char*>(std::malloc(PREFAULT_HEAP_BYTES))) {
+        std::memset(reserve, 0, PREFAULT_HEAP_BYTES);
+
+        // Keep the compiler from eliding the memset of memory that is only freed.
+        __asm__ __volatile__("" : : "r"(reserve) : "memory");
+
+        std::free(reserve);
+    }
+
+    normal_log("INFO: %s: Process memory locked.",
+               __func__);
+
+    return true;
+}
+
+void PrefaultThreadStack()
+{
+    char stack[PREFAULT_STACK_BYTES];
+
+    std::memset(stack, 0, sizeof(stack));
+
+    __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+bool SetOomScoreAdj(int oom_score_adj)
+{
+    if (oom_score_adj < -1000 || oom_score_adj > 1000) {
+        error_log("%s: oom_score_adj %i is out of range (-1000 to 1000).",
+                  __func__,
+                  oom_score_adj);
+
+        return false;
+    }
+
+    int fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        error_log("%s: Could not open /proc/self/oom_score_adj: %s",
+                  __func__,
+                  strerror(errno));
+
+        return false;
+    }
+
+    std::string value = std::to_string(oom_score_adj);
+    bool written = (write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size()));
+    int write_errno = errno;
+
+    close(fd);
+
+    if (!written) {
+        error_log("%s: Could not set oom_score_adj to %i: %s. Lowering it needs CAP_SYS_RESOURCE, or use "
+                  "OOMScoreAdjust= in the service unit.",
+                  __func__,
+                  oom_score_adj,
+                  strerror(write_errno));
+
+        return false;
+    }
+
+    normal_log("INFO: %s: oom_score_adj set to %i.",
+               __func__,
+               oom_score_adj);
+
+    return true;
+}
+
+bool SetThreadRealtimePriority(int priority)
+{
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    if (int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param); ret != 0) {
+        error_log("%s: Could not set SCHED_FIFO priority %i: %s. Raise LimitRTPRIO= in the service unit, or grant "
+                  "CAP_SYS_NICE.",
+                  __func__,
+                  priority,
+                  strerror(ret));
+
+        return false;
+    }
+
+    debug_log("INFO: %s: Thread set to SCHED_FIFO priority %i.",
+              __func__,
+              priority);
+
+    return true;
+}
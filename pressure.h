@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <cstddef>
+
+//!
+//! \brief Bytes of each latency critical thread's stack pre-faulted by PrefaultThreadStack(). This is far more than
+//! the threads use, but small compared to the default 8 MiB stack reservation.
+//!
+constexpr size_t PREFAULT_STACK_BYTES = 256 * 1024;
+
+//!
+//! \brief Bytes of heap pre-faulted and kept by LockProcessMemory().
+//!
+constexpr size_t PREFAULT_HEAP_BYTES = 4 * 1024 * 1024;
+
+//!
+//! \brief Locks the process memory so that event_detect's code, heap and stacks are not evicted when the machine is
+//! under memory pressure, which is exactly when the first user input has to be registered quickly.
+//!
+//! The heap is first configured to keep freed memory and to use a single arena, and PREFAULT_HEAP_BYTES of it is
+//! faulted in, so that the steady state allocations (there are none in the loops, but there are some on device
+//! changes) do not fault. Then mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) locks the current mappings and
+//! whatever is faulted in later. MCL_ONFAULT keeps the thread stacks created afterwards from being populated in full;
+//! PrefaultThreadStack() faults in the part that is used. If the kernel does not support MCL_ONFAULT, only the current
+//! mappings are locked.
+//!
+//! This needs a sufficient RLIMIT_MEMLOCK (LimitMEMLOCK= in the systemd unit) or CAP_IPC_LOCK.
+//! \return true if the memory was locked. Failures are logged.
+//!
+bool LockProcessMemory();
+
+//!
+//! \brief Faults in the top PREFAULT_STACK_BYTES of the calling thread's stack. Called at the start of the latency
+//! critical threads, so that with LockProcessMemory() in effect their stacks are resident and locked.
+//!
+void PrefaultThreadStack();
+
+//!
+//! \brief Sets the process's /proc/self/oom_score_adj, so that the OOM killer picks a DC workload rather than
+//! event_detect. Lowering the value below its current setting needs CAP_SYS_RESOURCE (or OOMScoreAdjust= in the
+//! systemd unit instead).
+//! \param oom_score_adj -1000 to 1000.
+//! \return true on success. Failures are logged.
+//!
+bool SetOomScoreAdj(int oom_score_adj);
+
+//!
+//! \brief Moves the calling thread to the SCHED_FIFO real time policy at the provided priority, so that it runs ahead of
+//! the (normal or idle priority) DC workload when input arrives. The threads this is applied to block in poll() or
+//! wait on a timer almost all of the time. This needs a sufficient RLIMIT_RTPRIO (LimitRTPRIO= in the systemd unit) or
+//! CAP_SYS_NICE.
+//! \param priority 1 to 99.
+//! \return true on success. Failures are logged.
+//!
+bool SetThreadRealtimePriority(int priority);
+
+#endif // PRESSURE_H
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+//!
+//! \file probes.h
+//! \brief USDT static probe macros. When built with ENABLE_USDT_PROBES the macros expand to the <sys/sdt.h> probes,
+//! which are a single NOP until perf or bpftrace attaches, plus an ELF note describing the probe location and argument
+//! registers. Otherwise they expand to nothing and their arguments are not evaluated.
+//!
+//! The provider is the daemon name (event_detect or idle_detect). List the probes in a binary with
+//! "bpftrace -l 'usdt:/usr/bin/event_detect:*'". Example scripts are in the bpftrace directory.
+//!
+//! Probe arguments must be integers or pointers. Pass strings as const char*.
+//!
+
+#ifdef IDLE_DETECT_ENABLE_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define IDLE_DETECT_PROBE(provider, name) DTRACE_PROBE(provider, name)
+#define IDLE_DETECT_PROBE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define IDLE_DETECT_PROBE2(provider, name, a1, a2) DTRACE_PROBE2(provider, name, a1, a2)
+#define IDLE_DETECT_PROBE3(provider, name, a1, a2, a3) DTRACE_PROBE3(provider, name, a1, a2, a3)
+#define IDLE_DETECT_PROBE4(provider, name, a1, a2, a3, a4) DTRACE_PROBE4(provider, name, a1, a2, a3, a4)
+#define IDLE_DETECT_PROBE5(provider, name, a1, a2, a3, a4, a5) DTRACE_PROBE5(provider, name, a1, a2, a3, a4, a5)
+
+#else
+
+#define IDLE_DETECT_PROBE(provider, name) do {} while (0)
+#define IDLE_DETECT_PROBE1(provider, name, a1) do {} while (0)
+#define IDLE_DETECT_PROBE2(provider, name, a1, a2) do {} while (0)
+#define IDLE_DETECT_PROBE3(provider, name, a1, a2, a3) do {} while (0)
+#define IDLE_DETECT_PROBE4(provider, name, a1, a2, a3, a4) do {} while (0)
+#define IDLE_DETECT_PROBE5(provider, name, a1, a2, a3, a4, a5) do {} while (0)
+
+#endif // IDLE_DETECT_ENABLE_USDT_PROBES
+
+#endif // PROBES_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <shmem.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// SharedMemoryTimestampExporter class
+
+SharedMemoryTimestampExporter::SharedMemoryTimestampExporter(const std::string& name) :
+    m_shm_name(name),
+    m_shm_fd(-1),
+    m_mapped_ptr(nullptr),
+    m_size(sizeof(std::atomic<int64_t>[2])), // <-- Use size of array
+    m_is_creator(false),
+    m_is_initialized(false)
+{
+    if (m_shm_name.empty() || m_shm_name[0] != '/') {
+        error_log("ERROR: %s: Shared memory name '%s' must be non-empty and start with '/'", __func__, m_shm_name.c_str());
+    }
+}
+
+SharedMemoryTimestampExporter::~SharedMemoryTimestampExporter() {
+    Cleanup(); // Unmap memory
+    // Unlinking happens explicitly via UnlinkSegment() during shutdown now
+}
+
+bool SharedMemoryTimestampExporter::CreateOrOpen(mode_t mode) {
+    if (m_is_initialized.load()) {
+        debug_log("INFO: %s: Shared memory %s already initialized.", __func__, m_shm_name.c_str());
+        return true;
+    }
+    debug_log("INFO: %s: Initializing shared memory segment %s for atomic int64_t[2]", __func__, m_shm_name.c_str());
+
+    Cleanup(); // Ensure clean state
+
+    std::unique_lock<std::mutex> lock(mtx_shmem);
+
+    m_is_creator = false;
+
+    // 1. Create or open RW
+    errno = 0;
+    m_shm_fd = shm_open(m_shm_name.c_str(), O_CREAT | O_RDWR, mode);
+    if (m_shm_fd == -1) {
+        error_log("ERROR: %s: shm_open failed for %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    // 2. Check current size, truncate if necessary
+    struct stat shm_stat;
+    errno = 0;
+    if (fstat(m_shm_fd, &shm_stat) == -1) {
+        error_log("ERROR: %s: fstat failed for shm fd %d: %s", __func__, m_shm_fd, strerror(errno));
+        close(m_shm_fd); m_shm_fd = -1;
+        return false;
+    }
+
+    if (shm_stat.st_size != (off_t)m_size) {
+        debug_log("INFO: %s: Shm %s has size %ld, resizing to %zu bytes.",
+                  __func__, m_shm_name.c_str(), (long)shm_stat.st_size, m_size);
+        m_is_creator = true; // We determined the size
+        errno = 0;
+        if (ftruncate(m_shm_fd, m_size) == -1) { // <-- Truncate to array size
+            error_log("ERROR: %s: ftruncate failed for shm %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
+            close(m_shm_fd); m_shm_fd = -1;
+            shm_unlink(m_shm_name.c_str()); // Clean up object we tried to create/resize
+            return false;
+        }
+    } else {
+        debug_log("INFO: %s: Shm %s exists with correct size.", __func__, m_shm_name.c_str());
+        // If size was already correct, we didn't necessarily create it
+        // Let's assume creator status only if we truncated.
+    }
+
+    // 3. Map memory RW
+    errno = 0;
+    void* mapped_mem = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_shm_fd, 0); // <-- Map array size
+
+    // 4. Close FD immediately after mmap
+    close(m_shm_fd);
+    m_shm_fd = -1;
+
+    if (mapped_mem == MAP_FAILED) {
+        error_log("ERROR: %s: mmap failed for shm %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
+        // If we created/resized it, unlink it.
+        if (m_is_creator) shm_unlink(m_shm_name.c_str());
+        return false;
+    }
+
+    // 5. Store pointer, initialize if we created/resized it
+    m_mapped_ptr = static_cast<int64_t*>(mapped_mem);
+    if (m_is_creator) {
+        int64_t initial_time = GetUnixEpochTime();
+        m_mapped_ptr[0] = initial_time; // update_time
+        m_mapped_ptr[1] = initial_time; // last_active_time
+        debug_log("INFO: %s: Shared memory segment %s initialized. update=%lld, last_active=%lld",
+                  __func__, m_shm_name.c_str(), (long long)initial_time, (long long)initial_time);
+    } else {
+        debug_log("INFO: %s: Shared memory segment %s mapped.", __func__, m_shm_name.c_str());
+    }
+
+    m_is_initialized.store(true);
+    return true;
+}
+
+bool SharedMemoryTimestampExporter::UpdateTimestamps(int64_t update_time, int64_t last_active_time) {
+    std::unique_lock<std::mutex> lock(mtx_shmem);
+
+    if (!m_is_initialized.load() || m_mapped_ptr == nullptr) {
+        return false;
+    }
+    // Use relaxed memory order: assumes readers don't need strict ordering
+    // relative to other non-atomic operations in this thread. Atomicity
+    // of the store itself is guaranteed.
+    m_mapped_ptr[0] = update_time;      // Store update_time at index 0
+    m_mapped_ptr[1] = last_active_time; // Store last_active_time at index 1
+    return true;
+}
+
+bool SharedMemoryTimestampExporter::IsInitialized() const {
+    return m_is_initialized.load();
+}
+
+void SharedMemoryTimestampExporter::Cleanup() { // Renamed from Close
+    std::unique_lock<std::mutex> lock(mtx_shmem);
+
+    if (m_mapped_ptr != nullptr) {
+        debug_log("DEBUG: %s: Unmapping shared memory %s...", __func__, m_shm_name.c_str());
+        if (munmap(m_mapped_ptr, m_size) == -1) { // <-- Use correct size
+            error_log("ERROR: %s: munmap failed for %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
+        } else {
+            debug_log("DEBUG: %s: Shared memory %s unmapped.", __func__, m_shm_name.c_str());
+        }
+        m_mapped_ptr = nullptr;
+    }
+    // Close FD just in case it was left open somehow (shouldn't happen)
+    if (m_shm_fd != -1) {
+        debug_log("WARNING: %s: Shared memory FD %d was open during cleanup, closing.", __func__, m_shm_fd);
+        close(m_shm_fd);
+        m_shm_fd = -1;
+    }
+    m_is_initialized.store(false); // Mark as uninitialized after cleanup
+}
+
+bool SharedMemoryTimestampExporter::UnlinkSegment() {
+    std::unique_lock<std::mutex> lock(mtx_shmem);
+
+    debug_log("INFO: %s: Requesting unlink for shared memory %s...", __func__, m_shm_name.c_str());
+    errno = 0;
+    if (shm_unlink(m_shm_name.c_str()) == -1) {
+        if (errno != ENOENT) { // Ignore "No such file or directory"
+            error_log("ERROR: %s: shm_unlink failed for %s: %s", __func__, m_shm_name.c_str(), strerror(errno));
+            return false; // Unlink failed
+        } else {
+            debug_log("DEBUG: %s: Shared memory segment %s already unlinked (ENOENT).", __func__, m_shm_name.c_str());
+        }
+    } else {
+        debug_log("INFO: %s: Shared memory segment %s unlinked successfully.", __func__, m_shm_name.c_str());
+    }
+    return true; // Unlink succeeded or segment was already gone
+}
+
+
+bool ReadSharedMemoryTimestamps(const std::string& shm_name, int64_t& update_time, int64_t& last_active_time)
+{
+    if (shm_name.empty() || shm_name[0] != '/') {
+        error_log("%s: Invalid shared memory name provided: %s", __func__, shm_name.c_str());
+        return false;
+    }
+
+    const size_t shmem_size = sizeof(int64_t[2]);
+
+    errno = 0;
+    int shm_fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (shm_fd == -1) {
+        if (errno != ENOENT) {
+            error_log("%s: shm_open(RO) failed for '%s': %s (%d)", __func__, shm_name.c_str(), strerror(errno), errno);
+        }
+        else { debug_log("INFO: %s: Shared memory '%s' not found (ENOENT).", __func__, shm_name.c_str()); }
+        return false;
+    }
+
+    errno = 0;
+    void* mapped_mem = mmap(nullptr, shmem_size, PROT_READ, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+
+    if (mapped_mem == MAP_FAILED) {
+        error_log("%s: mmap(RO) failed for shm '%s': %s (%d)", __func__, shm_name.c_str(), strerror(errno), errno);
+        return false;
+    }
+
+    const int64_t* shm_ptr = static_cast<const int64_t*>(mapped_mem);
+    update_time = shm_ptr[0];
+    last_active_time = shm_ptr[1];
+
+    errno = 0;
+    if (munmap(mapped_mem, shmem_size) == -1) {
+        normal_log("WARN: %s: munmap failed for shm '%s': %s (%d)", __func__, shm_name.c_str(), strerror(errno), errno);
+    }
+
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef SHMEM_H
+#define SHMEM_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
+
+#include <util.h>
+
+/**
+ * @brief Manages a POSIX shared memory segment for exporting timestamps.
+ * Stores an array of two int64_t: {update_time, last_active_time}.
+ * Handles creation, mapping, updating, and cleanup via RAII.
+ */
+class SharedMemoryTimestampExporter {
+public:
+    /**
+     * @brief Construct with the desired shared memory name.
+     * @param name Must start with '/' (e.g., "/idle_detect_shmem").
+     */
+    explicit SharedMemoryTimestampExporter(const std::string& name);
+
+    /**
+     * @brief Destructor handles unmapping and potentially unlinking the shared memory.
+     */
+    ~SharedMemoryTimestampExporter();
+
+    // Prevent copying/moving
+    SharedMemoryTimestampExporter(const SharedMemoryTimestampExporter&) = delete;
+    SharedMemoryTimestampExporter& operator=(const SharedMemoryTimestampExporter&) = delete;
+    SharedMemoryTimestampExporter(SharedMemoryTimestampExporter&&) = delete;
+    SharedMemoryTimestampExporter& operator=(SharedMemoryTimestampExporter&&) = delete;
+
+    /**
+     * @brief Creates (if necessary) and opens the shared memory segment,
+     * sets its size (to sizeof(int64_t[2])), and maps it for writing.
+     * Must be called before UpdateTimestamps or IsInitialized.
+     * @param mode Permissions (e.g., 0666 or 0660) to use if creating the segment.
+     * @return True on success, false on any failure (shm_open, ftruncate, mmap).
+     */
+    bool CreateOrOpen(mode_t mode = 0666);
+
+    /**
+     * @brief Updates both timestamps in the mapped shared memory.
+     * @param update_time The timestamp of the current update cycle.
+     * @param last_active_time The calculated overall last active time.
+     * @return True if updated successfully, false if not initialized or pointer is invalid.
+     */
+    // *** SIGNATURE CHANGED ***
+    bool UpdateTimestamps(int64_t update_time, int64_t last_active_time);
+
+    /**
+     * @brief Checks if the shared memory was successfully initialized (opened and mapped).
+     * @return True if initialized and ready for updates, false otherwise.
+     */
+    bool IsInitialized() const;
+
+    /**
+     * @brief Explicitly unlinks the shared memory segment.
+     * Call during clean shutdown if desired. Idempotent.
+     * @return True if unlink succeeded or segment already gone, false on error.
+     */
+    bool UnlinkSegment();
+
+private:
+    /**
+     * @brief Performs resource cleanup (munmap). Called by destructor.
+     */
+    void Cleanup();
+
+    //!
+    //! \brief This protects against multiple threads in the event_detect process from simultaneously accessing
+    //! and writing to the shared memory segment. It does NOT protect from another process encountering a torn
+    //! read. I would prefer to use a pthread_mutex_t in the shmem data structure and manege the mutex across
+    //! the writer and reader, but the BOINC architect does not believe this is necessary in practice given the small
+    //! size and low frequency of writing and reading.
+    //!
+    std::mutex mtx_shmem;
+
+    std::string m_shm_name;
+    int m_shm_fd;
+    int64_t* m_mapped_ptr;             // Pointer to the start of the int64_t[2] array
+    const size_t m_size;               // Size of the int64_t[2] array
+    bool m_is_creator;                 // Did this instance create/resize the segment?
+    std::atomic<bool> m_is_initialized;
+};
+
+//!
+//! \brief Reads both timestamps from the shared memory segment written by SharedMemoryTimestampExporter. The segment
+//! is opened read only, mapped, read and unmapped.
+//! \param shm_name Must start with '/' (e.g., "/idle_detect_shmem").
+//! \param update_time receives the timestamp of the last update cycle.
+//! \param last_active_time receives the published last active time.
+//! \return true on success, false if the segment does not exist or cannot be mapped.
+//!
+bool ReadSharedMemoryTimestamps(const std::string& shm_name, int64_t& update_time, int64_t& last_active_time);
+
+#endif // SHMEM_H
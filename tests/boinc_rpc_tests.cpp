@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <boinc_rpc.h>
+#include <tests/fake_boinc_rpc_server.h>
+#include <tests/temp_dir.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+
+#include <unistd.h>
+
+namespace {
+
+//! \brief A port on 127.0.0.1 with nothing listening, taken from a server that has since stopped.
+int UnusedPort()
+{
+    FakeBoincRpcServer server("");
+
+    return server.GetPort();
+}
+
+} // namespace
+
+// ============================================================================
+// MD5
+// ============================================================================
+
+TEST(BoincRpc, Md5MatchesRfc1321Vectors)
+{
+    EXPECT_EQ(Md5Hex(""), "d41d8cd98f00b204e9800998ecf8427e");
+    EXPECT_EQ(Md5Hex("abc"), "900150983cd24fb0d6963f7d28e17f72");
+    EXPECT_EQ(Md5Hex("message digest"), "f96b697d7cb7938d525a2f31aaf161d0");
+    EXPECT_EQ(Md5Hex("12345678901234567890123456789012345678901234567890123456789012345678901234567890"),
+              "57edf4a22be3c955ac49da2e2107b67a");
+}
+
+// ============================================================================
+// Run mode requests against the stand-in server
+// ============================================================================
+
+TEST(BoincRpc, SetRunModeAuthenticatesAndHoldsConnection)
+{
+    FakeBoincRpcServer server("secret");
+    ASSERT_NE(server.GetPort(), 0);
+
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("secret");
+
+    EXPECT_TRUE(client.SetRunMode(BoincRpcClient::RUN_MODE_NEVER));
+    EXPECT_TRUE(client.SetRunMode(BoincRpcClient::RUN_MODE_ALWAYS));
+
+    EXPECT_TRUE(client.IsConnected());
+    EXPECT_EQ(client.GetConnectCount(), 1u);
+    EXPECT_EQ(client.GetFailureCount(), 0u);
+    EXPECT_EQ(client.GetCallLatencyHistogram().GetCount(), 2u);
+    EXPECT_EQ(server.GetConnectionCount(), 1);
+    EXPECT_EQ(server.GetRunModes(), (std::vector<std::string> {"never", "always"}));
+}
+
+TEST(BoincRpc, WrongPasswordFails)
+{
+    FakeBoincRpcServer server("secret");
+    ASSERT_NE(server.GetPort(), 0);
+
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("wrong");
+
+    EXPECT_FALSE(client.SetRunMode(BoincRpcClient::RUN_MODE_NEVER));
+
+    EXPECT_FALSE(client.IsConnected());
+    EXPECT_EQ(client.GetFailureCount(), 1u);
+    EXPECT_TRUE(server.GetRunModes().empty());
+}
+
+TEST(BoincRpc, EmptyPasswordSkipsAuthentication)
+{
+    FakeBoincRpcServer server("");
+    ASSERT_NE(server.GetPort(), 0);
+
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("");
+
+    EXPECT_TRUE(client.SetRunMode(BoincRpcClient::RUN_MODE_AUTO));
+    EXPECT_EQ(server.GetRunModes(), (std::vector<std::string> {"auto"}));
+}
+
+TEST(BoincRpc, ReconnectsAfterDroppedConnection)
+{
+    FakeBoincRpcServer server("secret");
+    ASSERT_NE(server.GetPort(), 0);
+
+    BoincRpcClient client(server.GetPort());
+    client.SetPassword("secret");
+
+    ASSERT_TRUE(client.SetRunMode(BoincRpcClient::RUN_MODE_NEVER));
+
+    // As a BOINC client restart would: the held connection is closed on the next request.
+    server.DropConnection();
+
+    EXPECT_TRUE(client.SetRunMode(BoincRpcClient::RUN_MODE_ALWAYS));
+
+    EXPECT_EQ(client.GetConnectCount(), 2u);
+    EXPECT_EQ(client.GetFailureCount(), 0u);
+    EXPECT_EQ(server.GetRunModes(), (std::vector<std::string> {"never", "always"}));
+}
+
+TEST(BoincRpc, RefusedConnectionFails)
+{
+    BoincRpcClient client(UnusedPort(), 200);
+    client.SetPassword("secret");
+
+    EXPECT_FALSE(client.SetRunMode(BoincRpcClient::RUN_MODE_NEVER));
+
+    EXPECT_FALSE(client.IsConnected());
+    EXPECT_EQ(client.GetConnectCount(), 0u);
+    EXPECT_EQ(client.GetFailureCount(), 1u);
+}
+
+TEST(BoincRpc, SlowRepliesFailWithinOneTimeout)
+{
+    FakeBoincRpcServer server("secret");
+    ASSERT_NE(server.GetPort(), 0);
+
+    // Each of auth1, auth2 and set_run_mode would be answered within the timeout, but not all three together.
+    server.SetReplyDelay(150);
+
+    BoincRpcClient client(server.GetPort(), 200);
+    client.SetPassword("secret");
+
+    auto start = std::chrono::steady_clock::now();
+
+    EXPECT_FALSE(client.SetRunMode(BoincRpcClient::RUN_MODE_NEVER));
+
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+    EXPECT_EQ(client.GetFailureCount(), 1u);
+    EXPECT_TRUE(server.GetRunModes().empty());
+}
+
+// ============================================================================
+// Auth file discovery
+// ============================================================================
+
+TEST(BoincRpc, ReadPasswordTrimsTrailingWhitespace)
+{
+    TempDir dir("boinc_rpc_test");
+    fs::path auth_file = dir.path / "gui_rpc_auth.cfg";
+
+    std::ofstream(auth_file) << "secret \r\nsecond line\n";
+
+    EXPECT_EQ(BoincRpcClient::ReadPassword(auth_file), std::optional<std::string>("secret"));
+    EXPECT_EQ(BoincRpcClient::ReadPassword(dir.path / "missing.cfg"), std::nullopt);
+}
+
+TEST(BoincRpc, FindAuthFileHonoursBoincDataDir)
+{
+    TempDir dir("boinc_rpc_test");
+    fs::path auth_file = dir.path / "gui_rpc_auth.cfg";
+
+    std::ofstream(auth_file) << "secret\n";
+
+    setenv("BOINC_DATA_DIR", dir.path.c_str(), 1);
+    std::optional<fs::path> found = BoincRpcClient::FindAuthFile();
+    unsetenv("BOINC_DATA_DIR");
+
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(*found, auth_file);
+}
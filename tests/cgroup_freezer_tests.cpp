@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <cgroup_freezer.h>
+#include <tests/temp_dir.h>
+
+#include <csignal>
+#include <fstream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+//!
+//! \brief A fake cgroup v2 directory in the temporary directory: cgroup.freeze, cgroup.events and cgroup.procs, and a
+//! child cgroup. Nothing updates cgroup.events on a write of cgroup.freeze, so a test sets the state it should report.
+//!
+struct FakeCgroup
+{
+    TempDir dir {"cgroup_freezer_test"};
+    fs::path root = dir.path;
+    fs::path path = root / "boinc-client.service";
+
+    FakeCgroup()
+    {
+        fs::create_directories(path / "child");
+
+        std::ofstream(path / "cgroup.freeze") << "0\n";
+        std::ofstream(path / "cgroup.procs") << "";
+        std::ofstream(path / "child" / "cgroup.procs") << "";
+        SetEventsFrozen(false);
+    }
+
+    void SetEventsFrozen(bool frozen)
+    {
+        std::ofstream(path / "cgroup.events") << "populated 1\nfrozen " << (frozen ? 1 : 0) << "\n";
+    }
+
+    std::string ReadFreeze() const
+    {
+        std::ifstream in(path / "cgroup.freeze");
+        std::string content;
+        std::getline(in, content);
+
+        return content;
+    }
+};
+
+//! \brief A child process that waits for signals, killed on destruction.
+struct ChildProcess
+{
+    pid_t pid;
+
+    ChildProcess() : pid(fork())
+    {
+        if (pid == 0) {
+            while (true) {
+                pause();
+            }
+        }
+    }
+
+    ~ChildProcess()
+    {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    //! \brief Waits for the next stop or continue of the child. Returns its waitpid() status.
+    int WaitForChange() const
+    {
+        int status = 0;
+        waitpid(pid, &status, WUNTRACED | WCONTINUED);
+
+        return status;
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// Configuration and cgroup.events parsing
+// ============================================================================
+
+TEST(CgroupFreezer, ReadFrozenStateParsesEvents)
+{
+    FakeCgroup cgroup;
+
+    EXPECT_EQ(CgroupFreezer::ReadFrozenState(cgroup.path / "cgroup.events"), std::optional<bool>(false));
+
+    cgroup.SetEventsFrozen(true);
+    EXPECT_EQ(CgroupFreezer::ReadFrozenState(cgroup.path / "cgroup.events"), std::optional<bool>(true));
+
+    EXPECT_EQ(CgroupFreezer::ReadFrozenState(cgroup.path / "missing"), std::nullopt);
+}
+
+TEST(CgroupFreezer, SetCgroupResolvesAgainstRoot)
+{
+    FakeCgroup cgroup;
+    CgroupFreezer freezer(cgroup.root);
+
+    EXPECT_FALSE(freezer.IsEnabled());
+    EXPECT_FALSE(freezer.Freeze());
+
+    EXPECT_TRUE(freezer.SetCgroup("boinc-client.service"));
+    EXPECT_TRUE(freezer.IsEnabled());
+    EXPECT_EQ(freezer.GetCgroupPath(), cgroup.path);
+
+    EXPECT_FALSE(freezer.SetCgroup("missing.service"));
+    EXPECT_FALSE(freezer.IsEnabled());
+}
+
+// ============================================================================
+// Freeze and thaw
+// ============================================================================
+
+TEST(CgroupFreezer, FreezeConfirmedByEvents)
+{
+    FakeCgroup cgroup;
+    CgroupFreezer freezer(cgroup.root);
+    ASSERT_TRUE(freezer.SetCgroup("boinc-client.service"));
+
+    cgroup.SetEventsFrozen(true);
+
+    EXPECT_TRUE(freezer.Freeze());
+    EXPECT_TRUE(freezer.IsFrozen());
+    EXPECT_EQ(cgroup.ReadFreeze(), "1");
+
+    cgroup.SetEventsFrozen(false);
+
+    EXPECT_TRUE(freezer.Thaw());
+    EXPECT_FALSE(freezer.IsFrozen());
+    EXPECT_EQ(cgroup.ReadFreeze(), "0");
+
+    EXPECT_EQ(freezer.GetFallbackCount(), 0u);
+    EXPECT_EQ(freezer.GetConfirmLatencyHistogram().GetCount(), 2u);
+}
+
+TEST(CgroupFreezer, UnconfirmedFreezeFallsBackToSignals)
+{
+    FakeCgroup cgroup;
+    ChildProcess child;
+    ASSERT_GT(child.pid, 0);
+
+    // In the child cgroup, which the freeze covers too.
+    std::ofstream(cgroup.path / "child" / "cgroup.procs") << child.pid << "\n";
+
+    CgroupFreezer freezer(cgroup.root);
+    freezer.SetConfirmTimeout(20);
+    ASSERT_TRUE(freezer.SetCgroup("boinc-client.service"));
+
+    EXPECT_TRUE(freezer.Freeze());
+    EXPECT_TRUE(freezer.IsFrozen());
+    EXPECT_EQ(freezer.GetFallbackCount(), 1u);
+    EXPECT_TRUE(WIFSTOPPED(child.WaitForChange()));
+
+    // The thaw of the cgroup is confirmed, and continues the process the fallback stopped.
+    EXPECT_TRUE(freezer.Thaw());
+    EXPECT_FALSE(freezer.IsFrozen());
+    EXPECT_EQ(freezer.GetFallbackCount(), 1u);
+    EXPECT_TRUE(WIFCONTINUED(child.WaitForChange()));
+}
+
+TEST(CgroupFreezer, MissingFreezeFileFallsBackToSignals)
+{
+    FakeCgroup cgroup;
+    ChildProcess child;
+    ASSERT_GT(child.pid, 0);
+
+    // As on cgroup v1, or the root cgroup.
+    fs::remove(cgroup.path / "cgroup.freeze");
+    std::ofstream(cgroup.path / "cgroup.procs") << child.pid << "\n";
+
+    CgroupFreezer freezer(cgroup.root);
+    ASSERT_TRUE(freezer.SetCgroup(cgroup.path.string()));
+
+    EXPECT_TRUE(freezer.Freeze());
+    EXPECT_TRUE(WIFSTOPPED(child.WaitForChange()));
+
+    EXPECT_TRUE(freezer.Thaw());
+    EXPECT_TRUE(WIFCONTINUED(child.WaitForChange()));
+
+    EXPECT_EQ(freezer.GetFallbackCount(), 2u);
+    EXPECT_EQ(freezer.GetFailureCount(), 0u);
+}
+
+TEST(CgroupFreezer, PartialFreezeIsStillThawed)
+{
+    FakeCgroup cgroup;
+
+    // cgroup.freeze is written, but the state is never confirmed, and the fallback cannot stop pid 1 without the
+    // permission. Run as nobody in a child process, so that the test process keeps its own.
+    std::ofstream(cgroup.path / "cgroup.procs") << 1 << "\n";
+    fs::permissions(cgroup.path / "cgroup.freeze", fs::perms::all);
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+
+    if (pid == 0) {
+        if (getuid() == 0 && (setgid(65534) != 0 || setuid(65534) != 0)) {
+            _exit(2);
+        }
+
+        if (kill(1, 0) == 0) {
+            _exit(3);
+        }
+
+        CgroupFreezer freezer(cgroup.root);
+        freezer.SetConfirmTimeout(20);
+
+        bool ok = freezer.SetCgroup("boinc-client.service")
+                  && !freezer.Freeze()
+                  && freezer.IsFrozen()
+                  && freezer.Thaw()
+                  && !freezer.IsFrozen();
+
+        _exit(ok ? 0 : 1);
+    }
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+
+    if (WEXITSTATUS(status) == 3) {
+        GTEST_SKIP() << "pid 1 can be signalled here";
+    }
+
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(cgroup.ReadFreeze(), "0");
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <cgroup_throttle.h>
+#include <idle_state_tracker.h>
+#include <tests/temp_dir.h>
+
+#include <fstream>
+
+namespace {
+
+//! \brief A fake cgroup v2 directory in the temporary directory, with cpu.max, cpu.weight and io.weight.
+struct FakeCgroup
+{
+    TempDir dir {"cgroup_throttle_test"};
+    fs::path root = dir.path;
+    fs::path path = root / "boinc-client.service";
+
+    FakeCgroup()
+    {
+        fs::create_directories(path);
+
+        std::ofstream(path / "cpu.max") << "max 100000\n";
+        std::ofstream(path / "cpu.weight") << "100\n";
+        std::ofstream(path / "io.weight") << "default 100\n";
+    }
+
+    std::string Read(const char* file) const
+    {
+        std::ifstream in(path / file);
+        std::string content;
+        std::getline(in, content);
+
+        return content;
+    }
+};
+
+//! \brief Three tiers: active at 25% of the CPUs, recently active at 50% after 60 s, long idle unthrottled after 900 s.
+std::vector<CgroupThrottle::Tier> TestTiers()
+{
+    return *CgroupThrottle::ParseTiers("0:25:10:10, 60:50:50:50, 900:100:100:100");
+}
+
+} // namespace
+
+// ============================================================================
+// Tier specification
+// ============================================================================
+
+TEST(CgroupThrottle, ParseTiersAcceptsValidSpecification)
+{
+    std::optional<std::vector<CgroupThrottle::Tier>> tiers = CgroupThrottle::ParseTiers("0:25:10:20,60:100:100:100");
+
+    ASSERT_TRUE(tiers.has_value());
+    ASSERT_EQ(tiers->size(), 2u);
+    EXPECT_EQ((*tiers)[0].idle_seconds, 0);
+    EXPECT_EQ((*tiers)[0].cpu_percent, 25);
+    EXPECT_EQ((*tiers)[0].cpu_weight, 10);
+    EXPECT_EQ((*tiers)[0].io_weight, 20);
+    EXPECT_EQ((*tiers)[1].idle_seconds, 60);
+}
+
+TEST(CgroupThrottle, ParseTiersRejectsInvalidSpecification)
+{
+    EXPECT_EQ(CgroupThrottle::ParseTiers("10:25:10:10"), std::nullopt);           // First tier not at 0
+    EXPECT_EQ(CgroupThrottle::ParseTiers("0:25:10:10,0:50:50:50"), std::nullopt); // Idle times not increasing
+    EXPECT_EQ(CgroupThrottle::ParseTiers("0:0:10:10"), std::nullopt);             // cpu_percent out of range
+    EXPECT_EQ(CgroupThrottle::ParseTiers("0:25:10"), std::nullopt);               // Missing field
+    EXPECT_EQ(CgroupThrottle::ParseTiers("0:25:ten:10"), std::nullopt);           // Not a number
+}
+
+TEST(CgroupThrottle, FormatCpuMaxScalesWithCpus)
+{
+    EXPECT_EQ(CgroupThrottle::FormatCpuMax(100, 4), "max 100000");
+    EXPECT_EQ(CgroupThrottle::FormatCpuMax(25, 4), "100000 100000");
+    EXPECT_EQ(CgroupThrottle::FormatCpuMax(50, 1), "50000 100000");
+    EXPECT_EQ(CgroupThrottle::FormatCpuMax(1, 0), "1000 100000");
+}
+
+// ============================================================================
+// Tier changes
+// ============================================================================
+
+TEST(CgroupThrottle, AppliesTierControls)
+{
+    FakeCgroup cgroup;
+    CgroupThrottle throttle(cgroup.root, 2);
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(TestTiers());
+
+    throttle.Update(0);
+
+    EXPECT_EQ(throttle.GetCurrentTier(), 0);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "50000 100000");
+    EXPECT_EQ(cgroup.Read("cpu.weight"), "10");
+    EXPECT_EQ(cgroup.Read("io.weight"), "default 10");
+
+    throttle.Release();
+
+    EXPECT_EQ(cgroup.Read("cpu.max"), "max 100000");
+    EXPECT_EQ(cgroup.Read("cpu.weight"), "100");
+    EXPECT_EQ(cgroup.Read("io.weight"), "default 100");
+    EXPECT_EQ(throttle.GetWriteFailureCount(), 0u);
+}
+
+TEST(CgroupThrottle, StepDownWaitsForHysteresis)
+{
+    FakeCgroup cgroup;
+    CgroupThrottle throttle(cgroup.root, 2);
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(TestTiers());
+    throttle.SetHysteresis(10);
+    throttle.SetRampDuration(0);
+
+    throttle.Update(70);
+    ASSERT_EQ(throttle.GetCurrentTier(), 1);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "100000 100000");
+
+    // Within the hysteresis below the tier's 60 s.
+    throttle.Update(55);
+    EXPECT_EQ(throttle.GetCurrentTier(), 1);
+
+    throttle.Update(0);
+    EXPECT_EQ(throttle.GetCurrentTier(), 0);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "50000 100000");
+    EXPECT_EQ(throttle.GetTierChangeCount(), 1u);
+}
+
+TEST(CgroupThrottle, HysteresisAboveTierStillStepsDownAtZero)
+{
+    FakeCgroup cgroup;
+    CgroupThrottle throttle(cgroup.root, 2);
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(*CgroupThrottle::ParseTiers("0:25:10:10, 5:50:50:50"));
+    throttle.SetHysteresis(10);
+    throttle.SetRampDuration(0);
+
+    throttle.Update(8);
+    ASSERT_EQ(throttle.GetCurrentTier(), 1);
+
+    // The hysteresis is reduced to 4 s for the 5 s tier.
+    throttle.Update(1);
+    EXPECT_EQ(throttle.GetCurrentTier(), 1);
+
+    throttle.Update(0);
+    EXPECT_EQ(throttle.GetCurrentTier(), 0);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "50000 100000");
+}
+
+TEST(CgroupThrottle, StepUpRampsCpuMax)
+{
+    FakeCgroup cgroup;
+    int64_t clock_ms = 1000;
+    CgroupThrottle throttle(cgroup.root, 1);
+    throttle.SetClock([&clock_ms]() { return clock_ms; });
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(TestTiers());
+    throttle.SetRampDuration(3000);
+
+    throttle.Update(0);
+    ASSERT_EQ(throttle.GetAppliedCpuPercent(), 25);
+
+    // Straight to long idle: the weights apply at once, cpu.max ramps from 25% to 100% over 3 s.
+    throttle.Update(1000);
+    EXPECT_EQ(throttle.GetCurrentTier(), 2);
+    EXPECT_EQ(cgroup.Read("cpu.weight"), "100");
+    EXPECT_EQ(throttle.GetAppliedCpuPercent(), 25);
+    EXPECT_EQ(throttle.GetNextDeadlineMs(), CgroupThrottle::RAMP_STEP_MS);
+
+    clock_ms += 1000;
+    throttle.Process();
+    EXPECT_EQ(throttle.GetAppliedCpuPercent(), 50);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "50000 100000");
+
+    clock_ms += 1000;
+    throttle.Process();
+    EXPECT_EQ(throttle.GetAppliedCpuPercent(), 75);
+
+    clock_ms += 1000;
+    throttle.Process();
+    EXPECT_EQ(throttle.GetAppliedCpuPercent(), 100);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "max 100000");
+    EXPECT_EQ(throttle.GetNextDeadlineMs(), -1);
+}
+
+TEST(CgroupThrottle, StepDownCancelsRamp)
+{
+    FakeCgroup cgroup;
+    int64_t clock_ms = 1000;
+    CgroupThrottle throttle(cgroup.root, 1);
+    throttle.SetClock([&clock_ms]() { return clock_ms; });
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(TestTiers());
+    throttle.SetRampDuration(3000);
+
+    throttle.Update(0);
+    throttle.Update(1000);
+
+    clock_ms += 1000;
+    throttle.Process();
+    ASSERT_EQ(throttle.GetAppliedCpuPercent(), 50);
+
+    // The user is back: the first tier applies at once.
+    throttle.Update(0);
+    EXPECT_EQ(throttle.GetCurrentTier(), 0);
+    EXPECT_EQ(throttle.GetAppliedCpuPercent(), 25);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "25000 100000");
+    EXPECT_EQ(throttle.GetNextDeadlineMs(), -1);
+}
+
+TEST(CgroupThrottle, TiersFollowLevelsOfEventDrivenSource)
+{
+    FakeCgroup cgroup;
+    CgroupThrottle throttle(cgroup.root, 1);
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(TestTiers());
+    throttle.SetRampDuration(0);
+
+    // An event driven source with the 300 s threshold and the tiers as its levels, as main() sets them.
+    int64_t clock_ms = 1000000;
+    std::vector<int64_t> levels_ms {300000};
+
+    for (const CgroupThrottle::Tier& tier : throttle.GetTiers()) {
+        levels_ms.push_back(tier.idle_seconds * 1000);
+    }
+
+    IdleStateTracker source;
+    source.SetLevels(levels_ms);
+    source.SetClock([&clock_ms]() { return clock_ms; });
+    source.SetInput();
+
+    // The user keeps typing. Below the first level the input is not reported, but the idle time stays below it.
+    clock_ms += 600000;
+    throttle.Update(source.GetIdleMs() / 1000);
+    EXPECT_EQ(throttle.GetCurrentTier(), 0);
+
+    // The user leaves: the source reports the first tier's level.
+    source.SetLevelReached(0);
+    throttle.Update(source.GetIdleMs() / 1000);
+    EXPECT_EQ(throttle.GetCurrentTier(), 1);
+
+    // The user returns below the threshold. The input is reported there, and the throttle drops back at once.
+    clock_ms += 30000;
+    source.SetInput();
+    throttle.Update(source.GetIdleMs() / 1000);
+    EXPECT_EQ(throttle.GetCurrentTier(), 0);
+    EXPECT_EQ(cgroup.Read("cpu.max"), "25000 100000");
+}
+
+TEST(CgroupThrottle, MissingIoWeightIsSkipped)
+{
+    FakeCgroup cgroup;
+    fs::remove(cgroup.path / "io.weight");
+
+    CgroupThrottle throttle(cgroup.root, 1);
+    ASSERT_TRUE(throttle.SetCgroup(cgroup.path.string()));
+    throttle.SetTiers(TestTiers());
+
+    throttle.Update(0);
+
+    EXPECT_EQ(cgroup.Read("cpu.weight"), "10");
+    EXPECT_FALSE(fs::exists(cgroup.path / "io.weight"));
+    EXPECT_EQ(throttle.GetWriteFailureCount(), 0u);
+}
+
+// ============================================================================
+// Main loop wait
+// ============================================================================
+
+TEST(CgroupThrottle, NextWaitReachesNextTierAndPollsWhileThrottled)
+{
+    FakeCgroup cgroup;
+    CgroupThrottle throttle(cgroup.root, 1);
+    ASSERT_TRUE(throttle.SetCgroup("boinc-client.service"));
+    throttle.SetTiers(TestTiers());
+    throttle.SetRampDuration(0);
+
+    EXPECT_EQ(throttle.GetNextWaitMs(0, false, 250), -1);
+
+    // First tier: until the idle time reaches 60 s.
+    throttle.Update(10);
+    EXPECT_EQ(throttle.GetNextWaitMs(10, false, 250), 50000);
+
+    // Above the first tier the resume must be polled for, unless it is signalled.
+    throttle.Update(70);
+    EXPECT_EQ(throttle.GetNextWaitMs(70, false, 250), 250);
+    EXPECT_EQ(throttle.GetNextWaitMs(70, true, 250), 830000);
+
+    // Last tier: nothing to wait for.
+    throttle.Update(900);
+    EXPECT_EQ(throttle.GetNextWaitMs(900, true, 250), -1);
+}
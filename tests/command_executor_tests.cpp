@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <command_executor.h>
+#include <tests/temp_dir.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+int64_t SteadyNowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//!
+//! \brief Drives the executor the way the main loop does, polling its pidfd up to its next deadline, until nothing runs
+//! or is pending, or limit_ms passes.
+//!
+void RunUntilDone(CommandExecutor& executor, int64_t limit_ms = 10000)
+{
+    int64_t deadline_ms = SteadyNowMs() + limit_ms;
+
+    while ((executor.IsRunning() || executor.HasPending()) && SteadyNowMs() < deadline_ms) {
+        int64_t wait_ms = executor.GetNextDeadlineMs();
+        pollfd fd = {executor.GetFd(), POLLIN, 0};
+
+        poll(&fd, 1, static_cast<int>((wait_ms < 0) ? 100 : std::min<int64_t>(wait_ms, 100)));
+        executor.Process();
+    }
+}
+
+//! \brief A file in a temporary directory, removed with it on destruction.
+struct TempFile
+{
+    TempDir dir {"command_executor_test"};
+    std::string path = (dir.path / "output").string();
+
+    std::string Read() const
+    {
+        std::ifstream in(path);
+        std::string content;
+        std::getline(in, content);
+
+        return content;
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// Running and reaping
+// ============================================================================
+
+TEST(CommandExecutor, RunsCommandAndReapsIt)
+{
+    CommandExecutor executor(10000, 0);
+
+    executor.Request("true");
+    EXPECT_TRUE(executor.IsRunning());
+
+    RunUntilDone(executor);
+
+    EXPECT_FALSE(executor.IsRunning());
+    EXPECT_EQ(executor.GetFd(), -1);
+    EXPECT_EQ(executor.GetStartedCount(), 1u);
+    EXPECT_EQ(executor.GetFailureCount(), 0u);
+    EXPECT_EQ(executor.GetRunTimeHistogram().GetCount(), 1u);
+    EXPECT_EQ(executor.GetQueueDelayHistogram().GetCount(), 1u);
+}
+
+TEST(CommandExecutor, NonZeroExitIsFailure)
+{
+    CommandExecutor executor(10000, 0);
+
+    executor.Request("exit 3");
+    RunUntilDone(executor);
+
+    EXPECT_EQ(executor.GetStartedCount(), 1u);
+    EXPECT_EQ(executor.GetFailureCount(), 1u);
+    EXPECT_EQ(executor.GetTimeoutCount(), 0u);
+}
+
+TEST(CommandExecutor, EmptyCommandIsIgnored)
+{
+    CommandExecutor executor(10000, 0);
+
+    executor.Request("");
+
+    EXPECT_FALSE(executor.IsRunning());
+    EXPECT_FALSE(executor.HasPending());
+    EXPECT_EQ(executor.GetStartedCount(), 0u);
+}
+
+TEST(CommandExecutor, TimeoutTerminatesCommand)
+{
+    CommandExecutor executor(100, 0);
+
+    int64_t start_ms = SteadyNowMs();
+
+    executor.Request("sleep 10");
+    RunUntilDone(executor);
+
+    EXPECT_FALSE(executor.IsRunning());
+    EXPECT_EQ(executor.GetTimeoutCount(), 1u);
+    EXPECT_EQ(executor.GetFailureCount(), 1u);
+    EXPECT_LT(SteadyNowMs() - start_ms, 5000);
+}
+
+TEST(CommandExecutor, ChildStartsWithNoBlockedSignals)
+{
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGTERM);
+    ASSERT_EQ(pthread_sigmask(SIG_BLOCK, &blocked, &previous), 0);
+
+    CommandExecutor executor(10000, 0);
+
+    // grep inherits the signal mask of the shell, which is the spawned process.
+    executor.Request("grep -q '^SigBlk:[[:space:]]*0*$' /proc/self/status");
+    RunUntilDone(executor);
+
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    EXPECT_EQ(executor.GetStartedCount(), 1u);
+    EXPECT_EQ(executor.GetFailureCount(), 0u);
+}
+
+// ============================================================================
+// Serialization and flap damping
+// ============================================================================
+
+TEST(CommandExecutor, LatestRequestRunsAfterTheRunningCommand)
+{
+    TempFile file;
+    CommandExecutor executor(10000, 0);
+
+    executor.Request("sleep 0.2; echo first > " + file.path);
+    executor.Request("echo second > " + file.path);
+    executor.Request("echo third > " + file.path);
+
+    EXPECT_TRUE(executor.IsRunning());
+    EXPECT_TRUE(executor.HasPending());
+
+    RunUntilDone(executor);
+
+    EXPECT_EQ(executor.GetStartedCount(), 2u);
+    EXPECT_EQ(executor.GetSupersededCount(), 1u);
+    EXPECT_EQ(file.Read(), "third");
+}
+
+TEST(CommandExecutor, DwellDelaysStartAndDropsAppliedState)
+{
+    int64_t clock_ms = 1000;
+    CommandExecutor executor(10000, 5000);
+    executor.SetClock([&clock_ms]() { return clock_ms; });
+
+    executor.Request("true # idle");
+    RunUntilDone(executor);
+    ASSERT_EQ(executor.GetStartedCount(), 1u);
+
+    // Active within the dwell: it waits for the end of the dwell.
+    executor.Request("true # active");
+    EXPECT_FALSE(executor.IsRunning());
+    EXPECT_TRUE(executor.HasPending());
+    EXPECT_EQ(executor.GetNextDeadlineMs(), 5000);
+
+    // Idle again before it started: the idle command already applied this state.
+    executor.Request("true # idle");
+
+    clock_ms += 5000;
+    executor.Process();
+
+    EXPECT_FALSE(executor.IsRunning());
+    EXPECT_FALSE(executor.HasPending());
+    EXPECT_EQ(executor.GetStartedCount(), 1u);
+    EXPECT_EQ(executor.GetSupersededCount(), 2u);
+}
+
+TEST(CommandExecutor, FailedCommandIsRetriedOnRequest)
+{
+    int64_t clock_ms = 1000;
+    CommandExecutor executor(10000, 0);
+    executor.SetClock([&clock_ms]() { return clock_ms; });
+
+    executor.Request("exit 1");
+    RunUntilDone(executor);
+
+    executor.Request("exit 1");
+    RunUntilDone(executor);
+
+    EXPECT_EQ(executor.GetStartedCount(), 2u);
+    EXPECT_EQ(executor.GetFailureCount(), 2u);
+}
+
+TEST(CommandExecutor, StopDropsPendingCommand)
+{
+    int64_t clock_ms = 1000;
+    CommandExecutor executor(10000, 5000);
+    executor.SetClock([&clock_ms]() { return clock_ms; });
+
+    executor.Request("true # idle");
+    RunUntilDone(executor);
+
+    executor.Request("true # active");
+    ASSERT_TRUE(executor.HasPending());
+
+    executor.Stop(0);
+
+    EXPECT_FALSE(executor.HasPending());
+    EXPECT_EQ(executor.GetStartedCount(), 1u);
+}
+
+TEST(CommandExecutor, InvalidatedCommandRunsAgain)
+{
+    CommandExecutor executor(10000, 0);
+
+    executor.Request("true # idle");
+    RunUntilDone(executor);
+
+    // The state was changed another way since, e.g. over the BOINC GUI RPC.
+    executor.InvalidateApplied();
+
+    executor.Request("true # idle");
+    RunUntilDone(executor);
+
+    EXPECT_EQ(executor.GetStartedCount(), 2u);
+    EXPECT_EQ(executor.GetSupersededCount(), 0u);
+}
@@ -290,18 +290,18 @@ TEST_F(ConfigTest, ReReadConfig)
 {
     WriteConfigFile("string_param=first\n");
     TestConfig config;
+    EXPECT_EQ(config.GetGeneration(), 0u);
+
     config.ReadAndUpdateConfig(m_config_path);
     EXPECT_EQ(std::get<std::string>(config.GetArg("string_param")), "first");
+    EXPECT_EQ(config.GetGeneration(), 1u);
 
     WriteConfigFile("string_param=second\n");
     config.ReadAndUpdateConfig(m_config_path);
 
-    // After re-read, m_config gets new entries appended (multimap).
-    // GetArg returns the first match, which is from the first read.
-    // This tests the actual behavior of the multimap-based Config.
-    auto result = std::get<std::string>(config.GetArg("string_param"));
-    // The multimap accumulates entries; first inserted value is returned by find()
-    EXPECT_FALSE(result.empty());
+    // A re-read replaces the processed values, and advances the generation so that cached values are refreshed.
+    EXPECT_EQ(std::get<std::string>(config.GetArg("string_param")), "second");
+    EXPECT_EQ(config.GetGeneration(), 2u);
 }
 
 // ============================================================================
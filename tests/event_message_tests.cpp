@@ -225,3 +225,79 @@ TEST(EventMessage, RoundTripAllTypes)
         EXPECT_EQ(reconstructed.m_event_type, type);
     }
 }
+
+// ============================================================================
+// Optional sender timestamp (latency tracing)
+// ============================================================================
+
+TEST(EventMessage, SendTimeDefaultsToZeroAndIsOmitted)
+{
+    EventMessage msg(1000000000, EventMessage::USER_ACTIVE);
+    EXPECT_EQ(msg.m_send_time_us, 0);
+    EXPECT_EQ(msg.ToString(), "1000000000:USER_ACTIVE");
+}
+
+TEST(EventMessage, SendTimeRoundTrip)
+{
+    int64_t ts = GetUnixEpochTime();
+    EventMessage original(ts, EventMessage::USER_ACTIVE);
+    original.m_send_time_us = GetUnixEpochTimeMicros();
+
+    std::string serialized = original.ToString();
+    auto parts = StringSplit(serialized, ":");
+    ASSERT_EQ(parts.size(), 3u);
+
+    EventMessage reconstructed(parts[0], parts[1], parts[2]);
+    EXPECT_TRUE(reconstructed.IsValid());
+    EXPECT_EQ(reconstructed.m_timestamp, ts);
+    EXPECT_EQ(reconstructed.m_send_time_us, original.m_send_time_us);
+    EXPECT_EQ(reconstructed.ToString(), serialized);
+}
+
+TEST(EventMessage, SendTimeInvalidThrows)
+{
+    EXPECT_THROW(EventMessage("1000000000", "USER_ACTIVE", "abc"), std::invalid_argument);
+}
+
+// ============================================================================
+// FromString (pipe parse)
+// ============================================================================
+
+TEST(EventMessage, FromStringTwoAndThreeFields)
+{
+    EventMessage two = EventMessage::FromString("1700000000:USER_FORCE_IDLE\n");
+    EXPECT_EQ(two.m_timestamp, 1700000000);
+    EXPECT_EQ(two.m_event_type, EventMessage::USER_FORCE_IDLE);
+    EXPECT_EQ(two.m_send_time_us, 0);
+
+    EventMessage three = EventMessage::FromString(" 1700000000 : USER_ACTIVE : 1700000000123456 \n");
+    EXPECT_EQ(three.m_timestamp, 1700000000);
+    EXPECT_EQ(three.m_event_type, EventMessage::USER_ACTIVE);
+    EXPECT_EQ(three.m_send_time_us, 1700000000123456);
+}
+
+TEST(EventMessage, FromStringWrongFieldCountIsInvalid)
+{
+    EXPECT_EQ(EventMessage::FromString("garbage").m_event_type, EventMessage::UNKNOWN);
+    EXPECT_EQ(EventMessage::FromString("1:USER_ACTIVE:2:3").m_event_type, EventMessage::UNKNOWN);
+}
+
+TEST(EventMessage, FromStringBadTimestampThrows)
+{
+    EXPECT_THROW(EventMessage::FromString("abc:USER_ACTIVE"), std::invalid_argument);
+}
+
+TEST(EventMessage, ToCharsMatchesToString)
+{
+    EventMessage msg(1700000000, EventMessage::USER_FORCE_ACTIVE);
+    msg.m_send_time_us = 1700000000123456;
+
+    char buffer[EventMessage::MAX_CHARS];
+    size_t size = msg.ToChars(buffer, sizeof(buffer));
+
+    EXPECT_EQ(std::string(buffer, size), "1700000000:USER_FORCE_ACTIVE:1700000000123456");
+    EXPECT_EQ(std::string(buffer, size), msg.ToString());
+
+    // Too small a buffer writes nothing.
+    EXPECT_EQ(msg.ToChars(buffer, 12), 0u);
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef TESTS_FAKE_BOINC_RPC_SERVER_H
+#define TESTS_FAKE_BOINC_RPC_SERVER_H
+
+#include <boinc_rpc.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//!
+//! \brief The FakeBoincRpcServer class is a stand-in for the BOINC client's GUI RPC server, on an ephemeral loopback
+//! port. It implements the auth1/auth2 exchange and set_run_mode, and records the run modes set. It serves one
+//! connection at a time from its own thread. It is used by the BoincRpcClient tests and benchmarks.
+//!
+class FakeBoincRpcServer
+{
+public:
+    //!
+    //! \param password the GUI RPC password. Empty allows the requests without authentication.
+    //!
+    explicit FakeBoincRpcServer(const std::string& password)
+        : m_password(password)
+        , m_listen_fd(-1)
+        , m_port(0)
+        , m_stop(false)
+        , m_drop_connection(false)
+        , m_reply_delay_ms(0)
+        , m_connection_count(0)
+    {
+        m_stop_pipe[0] = -1;
+        m_stop_pipe[1] = -1;
+
+        m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = 0;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t length = sizeof(address);
+
+        if (m_listen_fd == -1
+            || bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+            || listen(m_listen_fd, 4) == -1
+            || getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&address), &length) == -1
+            || pipe2(m_stop_pipe, O_CLOEXEC) == -1) {
+            return;
+        }
+
+        m_port = ntohs(address.sin_port);
+        m_thread = std::thread(&FakeBoincRpcServer::Serve, this);
+    }
+
+    ~FakeBoincRpcServer()
+    {
+        m_stop = true;
+
+        if (m_stop_pipe[1] != -1) {
+            char wakeup = 0;
+            [[maybe_unused]] ssize_t written = write(m_stop_pipe[1], &wakeup, 1);
+        }
+
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+
+        for (int fd : {m_listen_fd, m_stop_pipe[0], m_stop_pipe[1]}) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+
+    //! \brief The listening port, 0 if the server could not start.
+    int GetPort() const { return m_port; }
+
+    //! \brief Closes the current connection before the next request is answered, as a client restart would.
+    void DropConnection() { m_drop_connection = true; }
+
+    //! \brief Delays each reply, as a busy client would.
+    void SetReplyDelay(int delay_ms) { m_reply_delay_ms = delay_ms; }
+
+    //! \brief Connections accepted.
+    int GetConnectionCount() const { return m_connection_count; }
+
+    //! \brief Run modes set, in order, e.g. "never".
+    std::vector<std::string> GetRunModes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        return m_run_modes;
+    }
+
+private:
+    std::string m_password;
+    int m_listen_fd;
+    int m_stop_pipe[2];
+    int m_port;
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_drop_connection;
+    std::atomic<int> m_reply_delay_ms;
+    std::atomic<int> m_connection_count;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::string> m_run_modes;
+
+    //! \brief Waits for fd to be readable or the stop request. Returns false on stop.
+    bool WaitReadable(int fd)
+    {
+        pollfd fds[2] = {{fd, POLLIN, 0}, {m_stop_pipe[0], POLLIN, 0}};
+
+        while (!m_stop) {
+            if (poll(fds, 2, -1) > 0) {
+                return !m_stop && fds[0].revents != 0;
+            }
+        }
+
+        return false;
+    }
+
+    void Serve()
+    {
+        while (WaitReadable(m_listen_fd)) {
+            int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+            if (fd == -1) {
+                continue;
+            }
+
+            ++m_connection_count;
+            ServeConnection(fd);
+            close(fd);
+        }
+    }
+
+    void ServeConnection(int fd)
+    {
+        std::string buffer;
+        std::string nonce = "1700000000.123456";
+        bool authorized = m_password.empty();
+
+        while (WaitReadable(fd)) {
+            char data[1024];
+            ssize_t result = recv(fd, data, sizeof(data), 0);
+
+            if (result <= 0) {
+                return;
+            }
+
+            buffer.append(data, static_cast<size_t>(result));
+
+            size_t end = 0;
+
+            while ((end = buffer.find('\003')) != std::string::npos) {
+                std::string request = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+
+                if (m_drop_connection.exchange(false)) {
+                    return;
+                }
+
+                std::string reply;
+
+                if (request.find("<auth1/>") != std::string::npos) {
+                    reply = "<nonce>" + nonce + "</nonce>\n";
+                } else if (request.find("<auth2>") != std::string::npos) {
+                    authorized = request.find("<nonce_hash>" + Md5Hex(nonce + m_password) + "</nonce_hash>")
+                                 != std::string::npos;
+                    reply = authorized ? "<authorized/>\n" : "<unauthorized/>\n";
+                } else if (!authorized) {
+                    reply = "<unauthorized/>\n";
+                } else if (request.find("<set_run_mode>") != std::string::npos) {
+                    for (const char* mode : {"always", "auto", "never"}) {
+                        if (request.find(std::string("<") + mode + "/>") != std::string::npos) {
+                            std::lock_guard<std::mutex> lock(m_mutex);
+                            m_run_modes.push_back(mode);
+                        }
+                    }
+
+                    reply = "<success/>\n";
+                } else {
+                    reply = "<error>unrecognized op</error>\n";
+                }
+
+                if (m_reply_delay_ms > 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(m_reply_delay_ms));
+                }
+
+                std::string message = "<boinc_gui_rpc_reply>\n" + reply + "</boinc_gui_rpc_reply>\n" + '\003';
+
+                if (send(fd, message.data(), message.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(message.size())) {
+                    return;
+                }
+            }
+        }
+    }
+};
+
+#endif // TESTS_FAKE_BOINC_RPC_SERVER_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef TESTS_FAKE_EVENT_DETECT_H
+#define TESTS_FAKE_EVENT_DETECT_H
+
+#include <event_detect.h>
+
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//!
+//! \brief The FakeEventDetect class sets up the event_detect singletons to run against a fake sysfs/dev tree, a
+//! SimulatedClock and a private shared memory segment. It is used by the tests that link event_detect.cpp without its
+//! main() (EVENT_DETECT_NO_MAIN). The tree has one pointing device, one non-pointing device, one pty and one tty.
+//!
+class FakeEventDetect
+{
+public:
+    //!
+    //! \brief Sets up the tree, installs the clock and runs the first monitor ticks, which enumerate the fake devices, so
+    //! that the recorders exist.
+    //! \param name distinguishes the tree and segment of concurrently running test binaries.
+    //! \param start_time initial virtual time in seconds. The terminals were last used an hour before this.
+    //!
+    FakeEventDetect(const std::string& name, int64_t start_time)
+        : m_root(fs::temp_directory_path() / (name + "_" + std::to_string(getpid())))
+        , m_clock(start_time * 1000000)
+        , m_shmem_name("/" + name + "_" + std::to_string(getpid()))
+        , m_exporter(m_shmem_name)
+    {
+        fs::remove_all(m_root);
+
+        fs::create_directories(m_root / "sys/class/input/event3/device/mouse0");
+        fs::create_directories(m_root / "sys/class/input/event4/device/input4");
+        fs::create_directories(m_root / "dev/input");
+        fs::create_directories(m_root / "dev/pts");
+        std::ofstream(m_root / "dev/input/event3").close();
+        std::ofstream(m_root / "dev/pts/0").close();
+        std::ofstream(m_root / "dev/tty1").close();
+
+        SetAccessTime(m_root / "dev/pts/0", start_time - 3600);
+        SetAccessTime(m_root / "dev/tty1", start_time - 3600);
+
+        std::ofstream config(m_root / "event_detect.conf");
+        config << "debug=false\n"
+               << "event_count_files_path=" << m_root.string() << "\n"
+               << "sysfs_root=" << (m_root / "sys").string() << "\n"
+               << "dev_root=" << (m_root / "dev").string() << "\n";
+        config.close();
+
+        g_config.ReadAndUpdateConfig(m_root / "event_detect.conf");
+
+        SetClock(&m_clock);
+
+        if (m_exporter.CreateOrOpen(0600)) {
+            g_event_monitor.SetTimestampExporter(&m_exporter);
+        }
+
+        g_event_monitor.Tick();
+        g_tty_monitor.Tick();
+        g_event_recorders.ResetEventRecorders();
+    }
+
+    ~FakeEventDetect()
+    {
+        g_event_monitor.SetTimestampExporter(nullptr);
+        SetClock(nullptr);
+        m_exporter.UnlinkSegment();
+        fs::remove_all(m_root);
+    }
+
+    FakeEventDetect(const FakeEventDetect&) = delete;
+    FakeEventDetect& operator=(const FakeEventDetect&) = delete;
+
+    //!
+    //! \brief Sets the access time of a file, which is how the tty monitor sees terminal activity.
+    //! \return true on success.
+    //!
+    static bool SetAccessTime(const fs::path& path, int64_t time)
+    {
+        struct timespec times[2] = {{static_cast<time_t>(time), 0}, {0, UTIME_OMIT}};
+
+        return utimensat(AT_FDCWD, path.c_str(), times, 0) == 0;
+    }
+
+    //!
+    //! \brief Current virtual time in seconds.
+    //!
+    int64_t Now() const
+    {
+        return m_clock.NowMicros() / 1000000;
+    }
+
+    //!
+    //! \brief Mouse activity: a report of three events at the current virtual time.
+    //!
+    void MouseMove()
+    {
+        InputEventBatch batch;
+        batch.events = 3;
+        batch.last_event_us = m_clock.NowMicros();
+
+        g_event_recorders.GetEventRecorders().at(0)->RecordBatch(batch);
+    }
+
+    //!
+    //! \brief Terminal activity on the pty at the current virtual time.
+    //!
+    bool TypeInTerminal()
+    {
+        return SetAccessTime(m_root / "dev/pts/0", Now());
+    }
+
+    //!
+    //! \brief A message from idle_detect over the pipe, stamped with the current virtual time.
+    //!
+    void IdleDetectMessage(const std::string& event_type)
+    {
+        g_idle_detect_monitor.ProcessMessage(std::to_string(Now()) + ":" + event_type);
+    }
+
+    fs::path m_root;
+    SimulatedClock m_clock;
+    std::string m_shmem_name;
+    SharedMemoryTimestampExporter m_exporter;
+};
+
+#endif // TESTS_FAKE_EVENT_DETECT_H
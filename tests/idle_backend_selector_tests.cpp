@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <idle_backend_selector.h>
+
+#include <string>
+
+namespace {
+
+//!
+//! \brief A backend with a fixed latency on a fake clock, a settable result and call counts.
+//!
+struct FakeBackend
+{
+    bool candidate = true;
+    int64_t latency_us = 0;
+    int64_t idle_seconds = 0;
+    int query_count = 0;
+    int read_count = 0;
+};
+
+//!
+//! \brief Makes an IdleBackendSelector backend from fake, advancing clock_us by its latency on each read.
+//!
+IdleBackendSelector::Backend MakeBackend(const std::string& name, FakeBackend& fake, int64_t& clock_us,
+                                         bool last_resort = false, bool has_query = false)
+{
+    IdleBackendSelector::Backend backend;
+
+    backend.name = name;
+    backend.last_resort = last_resort;
+    backend.is_candidate = [&fake]() { return fake.candidate; };
+
+    if (has_query) {
+        backend.start_query = [&fake]() { ++fake.query_count; };
+    }
+
+    backend.read = [&fake, &clock_us]() {
+        ++fake.read_count;
+        clock_us += fake.latency_us;
+        return fake.idle_seconds;
+    };
+
+    return backend;
+}
+
+} // namespace
+
+// ============================================================================
+// Probe and selection
+// ============================================================================
+
+TEST(IdleBackendSelector, SelectsFastestValidBackend)
+{
+    int64_t clock_us = 0;
+    FakeBackend slow {true, 5000, 10};
+    FakeBackend fast {true, 50, 12};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("slow", slow, clock_us));
+    selector.AddBackend(MakeBackend("fast", fast, clock_us));
+
+    ASSERT_TRUE(selector.Probe());
+    EXPECT_STREQ(selector.GetSelectedName(), "fast");
+
+    ASSERT_EQ(selector.GetProbeResults().size(), 2u);
+    EXPECT_EQ(selector.GetProbeResults()[0].latency_us, 5000);
+    EXPECT_EQ(selector.GetProbeResults()[1].latency_us, 50);
+    EXPECT_EQ(selector.GetProbeResults()[1].idle_seconds, 12);
+}
+
+TEST(IdleBackendSelector, LatencyWithinMarginPrefersFirstRegistered)
+{
+    int64_t clock_us = 0;
+    FakeBackend first {true, 60, 1};
+    FakeBackend second {true, 10, 1};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("first", first, clock_us));
+    selector.AddBackend(MakeBackend("second", second, clock_us));
+
+    ASSERT_TRUE(selector.Probe());
+    EXPECT_STREQ(selector.GetSelectedName(), "first");
+}
+
+TEST(IdleBackendSelector, SkipsNonCandidatesAndFailures)
+{
+    int64_t clock_us = 0;
+    FakeBackend other_session {false, 1, 1};
+    FakeBackend failing {true, 1, -1};
+    FakeBackend working {true, 1000, 3};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("other_session", other_session, clock_us));
+    selector.AddBackend(MakeBackend("failing", failing, clock_us));
+    selector.AddBackend(MakeBackend("working", working, clock_us));
+
+    ASSERT_TRUE(selector.Probe());
+    EXPECT_STREQ(selector.GetSelectedName(), "working");
+    EXPECT_EQ(other_session.read_count, 0);
+    EXPECT_FALSE(selector.GetProbeResults()[0].candidate);
+    EXPECT_FALSE(selector.GetProbeResults()[1].valid);
+
+    // A failed sample ends the backend's probe.
+    EXPECT_EQ(failing.read_count, 1);
+    EXPECT_EQ(working.read_count, IdleBackendSelector::DEFAULT_PROBE_SAMPLES);
+}
+
+TEST(IdleBackendSelector, LastResortOnlyWithoutOtherBackends)
+{
+    int64_t clock_us = 0;
+    FakeBackend primary {true, 10000, 5};
+    FakeBackend last_resort {true, 1, 5};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("primary", primary, clock_us));
+    selector.AddBackend(MakeBackend("last_resort", last_resort, clock_us, true));
+
+    ASSERT_TRUE(selector.Probe());
+    EXPECT_STREQ(selector.GetSelectedName(), "primary");
+
+    primary.idle_seconds = -1;
+
+    ASSERT_TRUE(selector.Probe());
+    EXPECT_STREQ(selector.GetSelectedName(), "last_resort");
+}
+
+TEST(IdleBackendSelector, NoBackendAvailable)
+{
+    int64_t clock_us = 0;
+    FakeBackend failing {true, 1, -1};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("failing", failing, clock_us));
+
+    EXPECT_FALSE(selector.Probe());
+    EXPECT_FALSE(selector.HasSelection());
+    EXPECT_STREQ(selector.GetSelectedName(), "none");
+    EXPECT_EQ(selector.GetIdleSeconds(), -1);
+}
+
+TEST(IdleBackendSelector, ProbeWaitsForStartedQueries)
+{
+    int64_t clock_us = 0;
+    int wait_count = 0;
+    FakeBackend dbus {true, 1, 7};
+
+    IdleBackendSelector selector(3, 2);
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.SetWaitForQueries([&wait_count, &clock_us]() {
+        ++wait_count;
+        clock_us += 2000;
+    });
+    selector.AddBackend(MakeBackend("dbus", dbus, clock_us, false, true));
+
+    ASSERT_TRUE(selector.Probe());
+    EXPECT_EQ(dbus.query_count, 2);
+    EXPECT_EQ(wait_count, 2);
+
+    // The wait for the reply is part of the backend's latency.
+    EXPECT_EQ(selector.GetProbeResults()[0].latency_us, 2001);
+}
+
+// ============================================================================
+// Locked in selection and re-probing
+// ============================================================================
+
+TEST(IdleBackendSelector, PassesCallOnlyTheSelectedBackend)
+{
+    int64_t clock_us = 0;
+    FakeBackend selected {true, 1, 20};
+    FakeBackend other {true, 5000, 30};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("selected", selected, clock_us, false, true));
+    selector.AddBackend(MakeBackend("other", other, clock_us, false, true));
+
+    // The first pass probes.
+    selector.StartPass();
+    EXPECT_EQ(selector.GetProbeCount(), 1u);
+    EXPECT_EQ(selector.GetIdleSeconds(), 20);
+
+    int other_reads = other.read_count;
+    int other_queries = other.query_count;
+
+    for (int i = 0; i < 10; ++i) {
+        selector.StartPass();
+        EXPECT_EQ(selector.GetIdleSeconds(), 20);
+    }
+
+    EXPECT_EQ(selector.GetProbeCount(), 1u);
+    EXPECT_EQ(other.read_count, other_reads);
+    EXPECT_EQ(other.query_count, other_queries);
+}
+
+TEST(IdleBackendSelector, ReprobesAfterMaxConsecutiveFailures)
+{
+    int64_t clock_us = 0;
+    FakeBackend primary {true, 1, 20};
+    FakeBackend secondary {true, 5000, 30};
+
+    IdleBackendSelector selector(3);
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("primary", primary, clock_us));
+    selector.AddBackend(MakeBackend("secondary", secondary, clock_us));
+
+    selector.StartPass();
+    ASSERT_STREQ(selector.GetSelectedName(), "primary");
+
+    primary.idle_seconds = -1;
+
+    // The failures below the limit are passed through, and the selection is kept.
+    selector.StartPass();
+    EXPECT_EQ(selector.GetIdleSeconds(), -1);
+    selector.StartPass();
+    EXPECT_EQ(selector.GetIdleSeconds(), -1);
+    EXPECT_EQ(selector.GetConsecutiveFailures(), 2);
+    EXPECT_EQ(selector.GetProbeCount(), 1u);
+
+    // The third re-probes, and returns the new selection's value.
+    selector.StartPass();
+    EXPECT_EQ(selector.GetIdleSeconds(), 30);
+    EXPECT_EQ(selector.GetProbeCount(), 2u);
+    EXPECT_STREQ(selector.GetSelectedName(), "secondary");
+    EXPECT_EQ(selector.GetConsecutiveFailures(), 0);
+}
+
+TEST(IdleBackendSelector, SuccessResetsFailureCount)
+{
+    int64_t clock_us = 0;
+    FakeBackend flaky {true, 1, 20};
+
+    IdleBackendSelector selector(2);
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("flaky", flaky, clock_us));
+
+    selector.StartPass();
+
+    for (int i = 0; i < 5; ++i) {
+        flaky.idle_seconds = -1;
+        EXPECT_EQ(selector.GetIdleSeconds(), -1);
+
+        flaky.idle_seconds = 20;
+        EXPECT_EQ(selector.GetIdleSeconds(), 20);
+    }
+
+    EXPECT_EQ(selector.GetProbeCount(), 1u);
+}
+
+TEST(IdleBackendSelector, ReprobesWhenSelectedBackendNoLongerApplies)
+{
+    int64_t clock_us = 0;
+    FakeBackend before {true, 1, 20};
+    FakeBackend after {false, 1, 30};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.AddBackend(MakeBackend("before", before, clock_us));
+    selector.AddBackend(MakeBackend("after", after, clock_us));
+
+    selector.StartPass();
+    ASSERT_STREQ(selector.GetSelectedName(), "before");
+
+    // E.g. ksmserver registering late at login changes the session type.
+    before.candidate = false;
+    after.candidate = true;
+
+    selector.StartPass();
+    EXPECT_EQ(selector.GetProbeCount(), 2u);
+    EXPECT_STREQ(selector.GetSelectedName(), "after");
+    EXPECT_EQ(selector.GetIdleSeconds(), 30);
+}
+
+TEST(IdleBackendSelector, EventDrivenFollowsSelectedBackend)
+{
+    int64_t clock_us = 0;
+    bool watching = true;
+    FakeBackend events {true, 1, 4};
+    FakeBackend polled {true, 5000, 4};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+
+    IdleBackendSelector::Backend backend = MakeBackend("events", events, clock_us);
+    backend.is_event_driven = [&watching]() { return watching; };
+    backend.reports_levels = true;
+    selector.AddBackend(backend);
+    selector.AddBackend(MakeBackend("polled", polled, clock_us));
+
+    EXPECT_FALSE(selector.IsSelectedEventDriven());
+
+    selector.StartPass();
+    ASSERT_STREQ(selector.GetSelectedName(), "events");
+    EXPECT_TRUE(selector.IsSelectedEventDriven());
+    EXPECT_TRUE(selector.IsSelectedReportingLevels());
+
+    // E.g. the idle watches lost with a session bus restart.
+    watching = false;
+    EXPECT_FALSE(selector.IsSelectedEventDriven());
+    EXPECT_FALSE(selector.IsSelectedReportingLevels());
+
+    // A backend without the callback is always polled.
+    events.candidate = false;
+    selector.StartPass();
+    ASSERT_STREQ(selector.GetSelectedName(), "polled");
+    EXPECT_FALSE(selector.IsSelectedEventDriven());
+}
+
+TEST(IdleBackendSelector, ProbeCallbackAndStatus)
+{
+    int64_t clock_us = 0;
+    int callback_count = 0;
+    FakeBackend used {true, 40, 9};
+    FakeBackend unused {false, 1, 1};
+
+    IdleBackendSelector selector;
+    selector.SetClock([&clock_us]() { return clock_us; });
+    selector.SetProbeCallback([&callback_count](const IdleBackendSelector& probed) {
+        ++callback_count;
+        EXPECT_TRUE(probed.HasSelection());
+    });
+    selector.AddBackend(MakeBackend("used", used, clock_us));
+    selector.AddBackend(MakeBackend("unused", unused, clock_us));
+
+    selector.Probe();
+    EXPECT_EQ(callback_count, 1);
+
+    std::string status = selector.StatusToString();
+
+    EXPECT_NE(status.find("selected_backend=used\n"), std::string::npos);
+    EXPECT_NE(status.find("probe_count=1\n"), std::string::npos);
+    EXPECT_NE(status.find("used_valid=1\n"), std::string::npos);
+    EXPECT_NE(status.find("used_latency_us=40\n"), std::string::npos);
+    EXPECT_NE(status.find("used_idle_seconds=9\n"), std::string::npos);
+    EXPECT_NE(status.find("unused_candidate=0\n"), std::string::npos);
+    EXPECT_EQ(status.find("unused_valid"), std::string::npos);
+}
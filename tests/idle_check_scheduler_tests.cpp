@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <idle_check_scheduler.h>
+
+// ============================================================================
+// Next wait
+// ============================================================================
+
+TEST(IdleCheckScheduler, ActiveWaitsUntilOneSecondBeforeThreshold)
+{
+    IdleCheckScheduler scheduler(250, 600000);
+    scheduler.SetThreshold(300);
+
+    EXPECT_EQ(scheduler.GetNextWaitMs(0, false), 299000);
+    EXPECT_EQ(scheduler.GetNextWaitMs(100, false), 199000);
+
+    // The event sources make no difference while active: the idle time cannot grow faster than the clock.
+    EXPECT_EQ(scheduler.GetNextWaitMs(100, true), 199000);
+}
+
+TEST(IdleCheckScheduler, ActiveWaitIsCappedByMaximum)
+{
+    IdleCheckScheduler scheduler(250, 60000);
+    scheduler.SetThreshold(300);
+
+    EXPECT_EQ(scheduler.GetNextWaitMs(0, false), 60000);
+    EXPECT_EQ(scheduler.GetNextWaitMs(250, false), 49000);
+}
+
+TEST(IdleCheckScheduler, NearThresholdUsesMinimum)
+{
+    IdleCheckScheduler scheduler(250, 60000);
+    scheduler.SetThreshold(300);
+
+    EXPECT_EQ(scheduler.GetNextWaitMs(299, false), 250);
+    EXPECT_EQ(scheduler.GetNextWaitMs(299, true), 250);
+}
+
+TEST(IdleCheckScheduler, IdlePollsOnlyWithoutEvents)
+{
+    IdleCheckScheduler scheduler(100, 60000);
+    scheduler.SetThreshold(300);
+
+    EXPECT_EQ(scheduler.GetNextWaitMs(300, false), 100);
+    EXPECT_EQ(scheduler.GetNextWaitMs(5000, false), 100);
+
+    // The resume is an event.
+    EXPECT_EQ(scheduler.GetNextWaitMs(300, true), 60000);
+}
+
+TEST(IdleCheckScheduler, UnknownIdleTimeRetries)
+{
+    IdleCheckScheduler scheduler(250, 60000);
+    scheduler.SetThreshold(300);
+
+    EXPECT_EQ(scheduler.GetNextWaitMs(-1, true), IdleCheckScheduler::UNKNOWN_IDLE_RETRY_MS);
+}
+
+TEST(IdleCheckScheduler, BoundsAreSanitized)
+{
+    IdleCheckScheduler scheduler(0, 0);
+    scheduler.SetThreshold(300);
+
+    // A zero minimum would spin, and a maximum below the minimum is raised to it.
+    EXPECT_EQ(scheduler.GetNextWaitMs(300, false), 1);
+    EXPECT_EQ(scheduler.GetNextWaitMs(0, false), 1);
+
+    scheduler.SetBounds(500, 100);
+    EXPECT_EQ(scheduler.GetNextWaitMs(0, false), 500);
+}
+
+// ============================================================================
+// Measurements
+// ============================================================================
+
+TEST(IdleCheckScheduler, CountsWakeupsByCause)
+{
+    IdleCheckScheduler scheduler;
+
+    scheduler.RecordWakeup(250, false);
+    scheduler.RecordWakeup(250, false);
+    scheduler.RecordWakeup(12, true);
+
+    EXPECT_EQ(scheduler.GetEventWakeups(), 1u);
+    EXPECT_EQ(scheduler.GetTimeoutWakeups(), 2u);
+    EXPECT_EQ(scheduler.GetWaitHistogram().GetCount(), 3u);
+    EXPECT_EQ(scheduler.GetWaitHistogram().GetSum(), 512);
+}
+
+TEST(IdleCheckScheduler, TransitionLatency)
+{
+    IdleCheckScheduler scheduler;
+    scheduler.SetThreshold(300);
+
+    // Seen two seconds after the threshold was crossed.
+    scheduler.RecordTransition(true, 302);
+
+    // Seen one second after the input.
+    scheduler.RecordTransition(false, 1);
+
+    EXPECT_EQ(scheduler.GetIdleLatencyHistogram().GetCount(), 1u);
+    EXPECT_EQ(scheduler.GetIdleLatencyHistogram().GetSum(), 2000);
+    EXPECT_EQ(scheduler.GetActiveLatencyHistogram().GetCount(), 1u);
+    EXPECT_EQ(scheduler.GetActiveLatencyHistogram().GetSum(), 1000);
+
+    // An idle time below the threshold, e.g. from a forced override, is not a negative latency.
+    scheduler.RecordTransition(true, 10);
+    EXPECT_EQ(scheduler.GetIdleLatencyHistogram().GetSum(), 2000);
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <idle_state_tracker.h>
+
+namespace {
+
+//! \brief A tracker with the threshold of 300 s as its one level, on a fake clock.
+struct ThresholdTracker
+{
+    int64_t clock_ms = 1000000;
+    IdleStateTracker tracker;
+
+    ThresholdTracker()
+    {
+        tracker.SetLevels({300000});
+        tracker.SetClock([this]() { return clock_ms; });
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// Levels and initial state
+// ============================================================================
+
+TEST(IdleStateTracker, LevelsAreSortedAndDeduplicated)
+{
+    IdleStateTracker tracker;
+    tracker.SetLevels({300000, 60000, 0, 60000, -5});
+
+    EXPECT_EQ(tracker.GetLevels(), (std::vector<int64_t> {60000, 300000}));
+}
+
+TEST(IdleStateTracker, UnknownUntilFirstRead)
+{
+    ThresholdTracker t;
+
+    EXPECT_FALSE(t.tracker.IsKnown());
+    EXPECT_EQ(t.tracker.GetIdleMs(), -1);
+    EXPECT_FALSE(t.tracker.IsRefreshNeeded());
+
+    // The initial read gives the level, including one already crossed, for which no event comes.
+    t.tracker.RecordIdleTime(400000, t.clock_ms);
+
+    EXPECT_TRUE(t.tracker.IsKnown());
+    EXPECT_EQ(t.tracker.GetLevel(), 0);
+    EXPECT_EQ(t.tracker.GetIdleMs(), 400000);
+}
+
+// ============================================================================
+// Transitions and the cap
+// ============================================================================
+
+TEST(IdleStateTracker, ActiveIdleTimeGrowsButStaysBelowThreshold)
+{
+    ThresholdTracker t;
+    t.tracker.SetInput();
+
+    // Not 0: reporting "active now" every pass would keep event_detect from ever reaching the threshold.
+    t.clock_ms += 10000;
+    EXPECT_EQ(t.tracker.GetIdleMs(), 10000);
+
+    // The idle event has not come, so there has been input since the last known.
+    t.clock_ms += 390000;
+    EXPECT_EQ(t.tracker.GetIdleMs(), 299999);
+    EXPECT_FALSE(t.tracker.IsAboveFirstLevel());
+}
+
+TEST(IdleStateTracker, LevelEventAndInputEventMoveTheState)
+{
+    ThresholdTracker t;
+    t.tracker.SetInput();
+
+    t.clock_ms += 300000;
+    t.tracker.SetLevelReached(0);
+
+    EXPECT_TRUE(t.tracker.IsAboveFirstLevel());
+    EXPECT_EQ(t.tracker.GetIdleMs(), 300000);
+
+    // Above the top level the time is not capped.
+    t.clock_ms += 1000000;
+    EXPECT_EQ(t.tracker.GetIdleMs(), 1300000);
+
+    t.tracker.SetInput();
+
+    EXPECT_FALSE(t.tracker.IsAboveFirstLevel());
+    EXPECT_EQ(t.tracker.GetIdleMs(), 0);
+}
+
+TEST(IdleStateTracker, IdleTimeIsCappedBelowNextLevel)
+{
+    int64_t clock_ms = 0;
+    IdleStateTracker tracker;
+    tracker.SetLevels({60000, 300000});
+    tracker.SetClock([&clock_ms]() { return clock_ms; });
+
+    tracker.SetInput();
+    clock_ms += 120000;
+    EXPECT_EQ(tracker.GetIdleMs(), 59999);
+
+    tracker.SetLevelReached(0);
+    EXPECT_EQ(tracker.GetIdleMs(), 60000);
+
+    clock_ms += 500000;
+    EXPECT_EQ(tracker.GetIdleMs(), 299999);
+
+    tracker.SetLevelReached(1);
+    EXPECT_EQ(tracker.GetLevel(), 1);
+    EXPECT_EQ(tracker.GetIdleMs(), 300000);
+}
+
+// ============================================================================
+// Catch-up reads
+// ============================================================================
+
+TEST(IdleStateTracker, ReadCatchesUpNearFirstLevel)
+{
+    ThresholdTracker t;
+    t.tracker.SetInput();
+
+    t.clock_ms += 298999;
+    EXPECT_FALSE(t.tracker.IsRefreshNeeded());
+
+    t.clock_ms += 1;
+    EXPECT_TRUE(t.tracker.IsRefreshNeeded());
+
+    // The user was typing all along.
+    t.tracker.RecordIdleTime(2000, t.clock_ms);
+
+    EXPECT_EQ(t.tracker.GetIdleMs(), 2000);
+    EXPECT_FALSE(t.tracker.IsRefreshNeeded());
+}
+
+TEST(IdleStateTracker, NoRefreshAboveFirstLevel)
+{
+    ThresholdTracker t;
+    t.tracker.SetLevelReached(0);
+
+    t.clock_ms += 1000000;
+    EXPECT_FALSE(t.tracker.IsRefreshNeeded());
+}
+
+TEST(IdleStateTracker, ReadStartedBeforeLastEventIsIgnored)
+{
+    ThresholdTracker t;
+    t.tracker.SetLevelReached(0);
+
+    int64_t read_start_ms = t.clock_ms;
+
+    // The input event overtakes the reply to a query started before it.
+    t.clock_ms += 100;
+    t.tracker.SetInput();
+    t.tracker.RecordIdleTime(300100, read_start_ms);
+
+    EXPECT_FALSE(t.tracker.IsAboveFirstLevel());
+    EXPECT_EQ(t.tracker.GetIdleMs(), 0);
+}
+
+TEST(IdleStateTracker, ReadLowersButDoesNotRaiseKnownLevel)
+{
+    ThresholdTracker t;
+    t.tracker.SetInput();
+
+    // The idle event is still in flight: the level stays, and the time is capped below it.
+    t.clock_ms += 301000;
+    t.tracker.RecordIdleTime(301000, t.clock_ms);
+
+    EXPECT_FALSE(t.tracker.IsAboveFirstLevel());
+    EXPECT_EQ(t.tracker.GetIdleMs(), 299999);
+
+    t.tracker.SetLevelReached(0);
+    EXPECT_TRUE(t.tracker.IsAboveFirstLevel());
+
+    // The input event is still in flight.
+    t.clock_ms += 5000;
+    t.tracker.RecordIdleTime(500, t.clock_ms);
+
+    EXPECT_FALSE(t.tracker.IsAboveFirstLevel());
+    EXPECT_EQ(t.tracker.GetIdleMs(), 500);
+}
+
+TEST(IdleStateTracker, ResetForgetsState)
+{
+    ThresholdTracker t;
+    t.tracker.SetLevelReached(0);
+    t.tracker.Reset();
+
+    EXPECT_FALSE(t.tracker.IsKnown());
+    EXPECT_EQ(t.tracker.GetIdleMs(), -1);
+}
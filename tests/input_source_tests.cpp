@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <input_source.h>
+
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+input_event MakeEvent(int64_t time_us, uint16_t type, uint16_t code, int32_t value)
+{
+    input_event ev {};
+    ev.input_event_sec = time_us / 1000000;
+    ev.input_event_usec = time_us % 1000000;
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+
+    return ev;
+}
+
+void WriteEvents(int fd, const std::vector<input_event>& events)
+{
+    ASSERT_EQ(write(fd, events.data(), events.size() * sizeof(input_event)),
+              static_cast<ssize_t>(events.size() * sizeof(input_event)));
+}
+
+//!
+//! \brief Non-blocking pipe, read end first.
+//!
+void MakePipe(int fds[2])
+{
+    ASSERT_EQ(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+}
+
+} // namespace
+
+// ============================================================================
+// Trace formats
+// ============================================================================
+
+TEST(InputTrace, ReadEvemu)
+{
+    std::istringstream in(
+        "# EVEMU 1.3\n"
+        "N: Test Mouse\n"
+        "I: 0003 046d c077 0111\n"
+        "E: 0.000001 0002 0000 -0001\t# EV_REL / REL_X -1\n"
+        "E: 0.000001 0000 0000 0000\t# ------------ SYN_REPORT (0) ----------\n"
+        "E: 12.5 0001 0110 0001\n"
+        "E: garbage\n");
+
+    std::vector<input_event> events = ReadEvemuTrace(in);
+
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(InputEventTimeMicros(events[0]), 1);
+    EXPECT_EQ(events[0].type, EV_REL);
+    EXPECT_EQ(events[0].code, REL_X);
+    EXPECT_EQ(events[0].value, -1);
+    EXPECT_EQ(events[1].type, EV_SYN);
+    EXPECT_EQ(InputEventTimeMicros(events[2]), 12500000);
+    EXPECT_EQ(events[2].code, BTN_LEFT);
+}
+
+TEST(InputTrace, BinaryRoundTripAndDetection)
+{
+    fs::path dir = fs::temp_directory_path() / ("idle_detect_input_test_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+
+    std::vector<input_event> events = GeneratePointerTrace(1000, 10000);
+    ASSERT_EQ(events.size(), 30u);
+
+    ASSERT_TRUE(WriteBinaryTrace(dir / "trace.bin", events));
+
+    std::vector<input_event> loaded = LoadInputTrace(dir / "trace.bin");
+    ASSERT_EQ(loaded.size(), events.size());
+    EXPECT_EQ(InputEventTimeMicros(loaded[27]), 9000);
+    EXPECT_EQ(loaded[29].code, SYN_REPORT);
+
+    {
+        std::ofstream out(dir / "trace.evemu");
+        out << "# EVEMU 1.3\nE: 1.000000 0002 0001 0005\n";
+    }
+
+    loaded = LoadInputTrace(dir / "trace.evemu");
+    ASSERT_EQ(loaded.size(), 1u);
+    EXPECT_EQ(loaded[0].code, REL_Y);
+    EXPECT_EQ(loaded[0].value, 5);
+
+    fs::remove_all(dir);
+}
+
+TEST(InputTrace, GenerateWithSynDropped)
+{
+    std::vector<input_event> events = GeneratePointerTrace(8000, 1000, 4);
+
+    // 8 reports of 3 events, plus a SYN_DROPPED after reports 4 and 8.
+    ASSERT_EQ(events.size(), 26u);
+    EXPECT_EQ(events[12].code, SYN_DROPPED);
+    EXPECT_EQ(InputEventTimeMicros(events[3]), 125);
+}
+
+// ============================================================================
+// FdInputEventSource / ReadInputEventBatch
+// ============================================================================
+
+TEST(InputEventBatch, CountsEventsAndLastTime)
+{
+    int fds[2];
+    MakePipe(fds);
+
+    WriteEvents(fds[1], {MakeEvent(100, EV_REL, REL_X, 1), MakeEvent(100, EV_SYN, SYN_REPORT, 0),
+                         MakeEvent(250, EV_REL, REL_Y, 1), MakeEvent(250, EV_SYN, SYN_REPORT, 0)});
+
+    FdInputEventSource source(fds[0]);
+    InputEventBatch batch = ReadInputEventBatch(source);
+
+    EXPECT_EQ(batch.events, 4);
+    EXPECT_EQ(batch.syncs, 0);
+    EXPECT_EQ(batch.last_event_us, 250);
+    EXPECT_EQ(batch.status, -EAGAIN);
+
+    // Nothing further to read.
+    batch = ReadInputEventBatch(source);
+    EXPECT_EQ(batch.events, 0);
+    EXPECT_EQ(batch.status, -EAGAIN);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(InputEventBatch, SynDroppedResumesNormalReads)
+{
+    int fds[2];
+    MakePipe(fds);
+
+    WriteEvents(fds[1], {MakeEvent(1, EV_REL, REL_X, 1), MakeEvent(2, EV_SYN, SYN_DROPPED, 0),
+                         MakeEvent(3, EV_REL, REL_X, 1), MakeEvent(3, EV_SYN, SYN_REPORT, 0)});
+
+    FdInputEventSource source(fds[0]);
+    InputEventBatch batch = ReadInputEventBatch(source);
+
+    // The events after the sync are still read in the same batch.
+    EXPECT_EQ(batch.events, 4);
+    EXPECT_EQ(batch.syncs, 1);
+    EXPECT_EQ(batch.last_event_us, 3);
+    EXPECT_EQ(batch.status, -EAGAIN);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(InputEventBatch, EofIsDeviceLoss)
+{
+    int fds[2];
+    MakePipe(fds);
+
+    WriteEvents(fds[1], {MakeEvent(1, EV_REL, REL_X, 1)});
+    close(fds[1]);
+
+    FdInputEventSource source(fds[0]);
+    InputEventBatch batch = ReadInputEventBatch(source);
+
+    EXPECT_EQ(batch.events, 1);
+    EXPECT_EQ(batch.status, -ENODEV);
+
+    close(fds[0]);
+}
+
+TEST(InputEventBatch, PartialRecordIsHeldUntilComplete)
+{
+    int fds[2];
+    MakePipe(fds);
+
+    input_event ev = MakeEvent(7, EV_KEY, BTN_LEFT, 1);
+    const char* bytes = reinterpret_cast<const char*>(&ev);
+
+    ASSERT_EQ(write(fds[1], bytes, 5), 5);
+
+    FdInputEventSource source(fds[0]);
+    EXPECT_EQ(ReadInputEventBatch(source).events, 0);
+
+    ASSERT_EQ(write(fds[1], bytes + 5, sizeof(ev) - 5), static_cast<ssize_t>(sizeof(ev) - 5));
+
+    InputEventBatch batch = ReadInputEventBatch(source);
+    EXPECT_EQ(batch.events, 1);
+    EXPECT_EQ(batch.last_event_us, 7);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// ============================================================================
+// InputTraceReplayer
+// ============================================================================
+
+TEST(InputTraceReplayer, ReplaysWholeTraceThenDisconnects)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds), 0);
+
+    // 8 kHz for 50 ms with periodic SYN_DROPPED, replayed as fast as possible.
+    std::vector<input_event> events = GeneratePointerTrace(8000, 50000, 100);
+    const int64_t expected = static_cast<int64_t>(events.size());
+
+    InputTraceReplayer replayer(events, 0.0);
+    const int64_t start_us = GetUnixEpochTimeMicros();
+    ASSERT_TRUE(replayer.Start(fds[1]));
+
+    FdInputEventSource source(fds[0]);
+    int64_t total = 0;
+    int64_t syncs = 0;
+    int status = -EAGAIN;
+
+    while (status == -EAGAIN) {
+        InputEventBatch batch = ReadInputEventBatch(source);
+        total += batch.events;
+        syncs += batch.syncs;
+        status = batch.status;
+
+        // Replayed timestamps are rewritten to the time of writing.
+        if (batch.events > 0) {
+            EXPECT_GE(batch.last_event_us, start_us);
+        }
+
+        if (status == -EAGAIN) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    replayer.Join();
+
+    EXPECT_EQ(status, -ENODEV);
+    EXPECT_EQ(total, expected);
+    EXPECT_EQ(syncs, 4);
+    EXPECT_EQ(replayer.GetEventsWritten(), static_cast<uint64_t>(expected));
+
+    close(fds[0]);
+}
+
+TEST(InputTraceReplayer, StopEndsBlockedReplay)
+{
+    int fds[2];
+    MakePipe(fds);
+
+    // Real time replay of a 10 second trace; Stop() must not wait for it.
+    InputTraceReplayer replayer(GeneratePointerTrace(100, 10000000), 1.0);
+    ASSERT_TRUE(replayer.Start(fds[1]));
+
+    auto start = std::chrono::steady_clock::now();
+    replayer.Stop();
+
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+    close(fds[0]);
+}
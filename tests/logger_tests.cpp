@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <logger.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+//!
+//! \brief Fixture providing pipes to capture the logger output. Timestamps are disabled so that the captured output
+//! is deterministic.
+//!
+class LoggerTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(pipe2(m_out, O_NONBLOCK), 0);
+        ASSERT_EQ(pipe2(m_err, O_NONBLOCK), 0);
+
+        m_saved_timestamps = g_log_timestamps.exchange(false);
+    }
+
+    void TearDown() override
+    {
+        g_log_timestamps = m_saved_timestamps;
+
+        for (int fd : {m_out[0], m_out[1], m_err[0], m_err[1]}) {
+            close(fd);
+        }
+    }
+
+    static std::string ReadAll(int fd)
+    {
+        std::string out;
+        char buf[4096];
+        ssize_t n;
+
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            out.append(buf, static_cast<size_t>(n));
+        }
+
+        return out;
+    }
+
+    static size_t CountLines(const std::string& str, const std::string& prefix = "")
+    {
+        size_t count = 0;
+        size_t pos = 0;
+
+        while (pos < str.size()) {
+            size_t end = str.find('\n', pos);
+
+            if (end == std::string::npos) {
+                break;
+            }
+
+            if (str.compare(pos, prefix.size(), prefix) == 0) {
+                ++count;
+            }
+
+            pos = end + 1;
+        }
+
+        return count;
+    }
+
+    int m_out[2] = {-1, -1};
+    int m_err[2] = {-1, -1};
+    bool m_saved_timestamps = true;
+};
+
+} // namespace
+
+// ============================================================================
+// Ring behavior
+// ============================================================================
+
+TEST_F(LoggerTest, DeliversInOrderToCorrectStream)
+{
+    Logger logger(16);
+    logger.Start(m_out[1], m_err[1]);
+
+    EXPECT_TRUE(logger.Submit(LogLevel::INFO, "INFO: first"));
+    EXPECT_TRUE(logger.Submit(LogLevel::DEBUG, "INFO: second"));
+    EXPECT_TRUE(logger.Submit(LogLevel::ERROR, "ERROR: third"));
+
+    logger.Stop();
+
+    EXPECT_EQ(ReadAll(m_out[0]), "INFO: first\nINFO: second\n");
+    EXPECT_EQ(ReadAll(m_err[0]), "ERROR: third\n");
+}
+
+TEST_F(LoggerTest, OverflowIsCountedAndDoesNotBlock)
+{
+    Logger logger(4);
+
+    // Consumer not started, so the ring fills.
+    for (int i = 0; i < 6; ++i) {
+        logger.Submit(LogLevel::DEBUG, "INFO: message " + std::to_string(i));
+    }
+
+    EXPECT_EQ(logger.GetOverflowCount(), 2u);
+
+    logger.Start(m_out[1], m_err[1]);
+    logger.Stop();
+
+    EXPECT_EQ(ReadAll(m_out[0]), "INFO: message 0\nINFO: message 1\nINFO: message 2\nINFO: message 3\n");
+
+    std::string err = ReadAll(m_err[0]);
+    EXPECT_NE(err.find("2 messages dropped"), std::string::npos) << err;
+}
+
+TEST_F(LoggerTest, LongMessageIsTruncated)
+{
+    Logger logger(4);
+    logger.Start(m_out[1], m_err[1]);
+
+    logger.Submit(LogLevel::INFO, std::string(Logger::SLOT_TEXT_SIZE + 100, 'x'));
+    logger.Stop();
+
+    EXPECT_EQ(ReadAll(m_out[0]), std::string(Logger::SLOT_TEXT_SIZE, 'x') + "\n");
+}
+
+TEST_F(LoggerTest, MultipleProducers)
+{
+    const int producers = 4;
+    const int per_producer = 500;
+
+    Logger logger(4096);
+    logger.Start(m_out[1], m_err[1]);
+
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&logger, p]() {
+            for (int i = 0; i < per_producer; ++i) {
+                logger.Submit(LogLevel::DEBUG, "INFO: producer " + std::to_string(p) + " " + std::to_string(i));
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    logger.Stop();
+
+    // Debug messages are not deduplicated, but are subject to the rate limiter. Everything is accounted for.
+    std::string out = ReadAll(m_out[0]);
+    EXPECT_EQ(CountLines(out, "INFO: producer") + logger.GetRateLimitedCount() + logger.GetOverflowCount(),
+              static_cast<size_t>(producers * per_producer));
+}
+
+// ============================================================================
+// Deduplication
+// ============================================================================
+
+TEST_F(LoggerTest, RepeatedErrorsAreDeduplicated)
+{
+    Logger logger(64);
+    logger.Start(m_out[1], m_err[1]);
+
+    for (int i = 0; i < 10; ++i) {
+        logger.Submit(LogLevel::ERROR, "ERROR: GetIdleTimeKdeDBus: D-Bus call failed");
+    }
+
+    logger.Submit(LogLevel::ERROR, "ERROR: something else");
+
+    logger.Stop();
+
+    std::string err = ReadAll(m_err[0]);
+
+    // The first occurrence, the other message, and the summary flushed at Stop().
+    EXPECT_EQ(CountLines(err), 3u) << err;
+    EXPECT_NE(err.find("[repeated 9 times"), std::string::npos) << err;
+    EXPECT_EQ(logger.GetDedupSuppressedCount(), 9u);
+}
+
+TEST_F(LoggerTest, InfoAndDebugAreNotDeduplicated)
+{
+    Logger logger(64);
+    logger.Start(m_out[1], m_err[1]);
+
+    for (int i = 0; i < 3; ++i) {
+        logger.Submit(LogLevel::INFO, "INFO: state change");
+        logger.Submit(LogLevel::DEBUG, "INFO: tick");
+    }
+
+    logger.Stop();
+
+    EXPECT_EQ(CountLines(ReadAll(m_out[0])), 6u);
+    EXPECT_EQ(logger.GetDedupSuppressedCount(), 0u);
+}
+
+TEST_F(LoggerTest, WarningsAreDeduplicated)
+{
+    Logger logger(64);
+    logger.Start(m_out[1], m_err[1]);
+
+    for (int i = 0; i < 5; ++i) {
+        logger.Submit(LogLevel::INFO, "WARNING: Monitor: device busy");
+    }
+
+    logger.Stop();
+
+    EXPECT_EQ(CountLines(ReadAll(m_out[0])), 2u);
+    EXPECT_EQ(logger.GetDedupSuppressedCount(), 4u);
+}
+
+// ============================================================================
+// Rate limiting
+// ============================================================================
+
+TEST_F(LoggerTest, RateLimitCapsBurst)
+{
+    const size_t total = static_cast<size_t>(Logger::RATE_LIMIT_BURST) * 2;
+
+    Logger logger(2048);
+
+    // Fill before starting so the whole burst is processed at once.
+    for (size_t i = 0; i < total; ++i) {
+        logger.Submit(LogLevel::DEBUG, "INFO: burst " + std::to_string(i));
+    }
+
+    logger.Start(m_out[1], m_err[1]);
+    logger.Stop();
+
+    std::string out = ReadAll(m_out[0]);
+
+    EXPECT_GT(logger.GetRateLimitedCount(), 0u);
+    EXPECT_EQ(CountLines(out, "INFO: burst") + logger.GetRateLimitedCount(), total);
+    EXPECT_NE(out.find("messages suppressed"), std::string::npos);
+}
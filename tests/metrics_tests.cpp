@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <metrics.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ============================================================================
+// MetricCounter / MetricGauge
+// ============================================================================
+
+TEST(MetricCounter, IncrementAndGet)
+{
+    MetricCounter counter;
+    EXPECT_EQ(counter.Get(), 0u);
+
+    counter.Increment();
+    counter.Increment(4);
+    EXPECT_EQ(counter.Get(), 5u);
+}
+
+TEST(MetricCounter, ConcurrentIncrement)
+{
+    MetricCounter counter;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&counter]() {
+            for (int i = 0; i < 10000; ++i) {
+                counter.Increment();
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(counter.Get(), 40000u);
+}
+
+TEST(MetricCounter, CacheLineAligned)
+{
+    EXPECT_EQ(alignof(MetricCounter), METRICS_CACHE_LINE_SIZE);
+    EXPECT_EQ(alignof(MetricGauge), METRICS_CACHE_LINE_SIZE);
+
+    // Adjacent metrics must not share a cache line.
+    MetricCounter counters[2];
+    EXPECT_GE(reinterpret_cast<uintptr_t>(&counters[1]) - reinterpret_cast<uintptr_t>(&counters[0]),
+              METRICS_CACHE_LINE_SIZE);
+}
+
+TEST(MetricGauge, SetAndGet)
+{
+    MetricGauge gauge;
+    gauge.Set(42);
+    EXPECT_EQ(gauge.Get(), 42);
+    gauge.Set(-3);
+    EXPECT_EQ(gauge.Get(), -3);
+}
+
+// ============================================================================
+// MetricHistogram
+// ============================================================================
+
+TEST(MetricHistogram, BucketAssignment)
+{
+    MetricHistogram histogram({10, 100, 1000});
+
+    histogram.Observe(5);     // <= 10
+    histogram.Observe(10);    // <= 10 (upper bound is inclusive)
+    histogram.Observe(11);    // <= 100
+    histogram.Observe(1000);  // <= 1000
+    histogram.Observe(5000);  // +Inf
+
+    EXPECT_EQ(histogram.GetBucketCount(0), 2u);
+    EXPECT_EQ(histogram.GetBucketCount(1), 1u);
+    EXPECT_EQ(histogram.GetBucketCount(2), 1u);
+    EXPECT_EQ(histogram.GetBucketCount(3), 1u);
+    EXPECT_EQ(histogram.GetCount(), 5u);
+    EXPECT_EQ(histogram.GetSum(), 5 + 10 + 11 + 1000 + 5000);
+}
+
+TEST(MetricHistogram, QuantileEmptyIsZero)
+{
+    MetricHistogram histogram({10, 100});
+    EXPECT_DOUBLE_EQ(histogram.Quantile(0.5), 0.0);
+}
+
+TEST(MetricHistogram, QuantileInterpolatesWithinBucket)
+{
+    MetricHistogram histogram({100, 200});
+
+    for (int i = 0; i < 10; ++i) {
+        histogram.Observe(150);
+    }
+
+    // All observations are in (100, 200]; the median interpolates to the middle of that bucket.
+    EXPECT_DOUBLE_EQ(histogram.Quantile(0.5), 150.0);
+    EXPECT_DOUBLE_EQ(histogram.Quantile(1.0), 200.0);
+}
+
+TEST(MetricHistogram, QuantileOverflowReportsLargestBound)
+{
+    MetricHistogram histogram({100, 200});
+    histogram.Observe(10000);
+
+    EXPECT_DOUBLE_EQ(histogram.Quantile(0.99), 200.0);
+}
+
+// ============================================================================
+// PrometheusTextBuilder
+// ============================================================================
+
+TEST(PrometheusTextBuilder, FamilyAndSamples)
+{
+    PrometheusTextBuilder builder;
+
+    builder.AddFamily("test_total", "counter", "A test counter.");
+    builder.AddSample("test_total", uint64_t {3});
+    builder.AddSample("test_total", int64_t {4}, PrometheusTextBuilder::LabelPair("device", "event3"));
+
+    EXPECT_EQ(builder.GetText(),
+              "# HELP test_total A test counter.\n"
+              "# TYPE test_total counter\n"
+              "test_total 3\n"
+              "test_total{device=\"event3\"} 4\n");
+}
+
+TEST(PrometheusTextBuilder, LabelEscaping)
+{
+    EXPECT_EQ(PrometheusTextBuilder::LabelPair("l", "a\"b\\c\nd"), "l=\"a\\\"b\\\\c\\nd\"");
+}
+
+TEST(PrometheusTextBuilder, HistogramIsCumulativeAndScaled)
+{
+    MetricHistogram histogram({1000, 2000});
+    histogram.Observe(500);
+    histogram.Observe(1500);
+    histogram.Observe(3000);
+
+    PrometheusTextBuilder builder;
+    builder.AddHistogram("tick_seconds", "Tick duration.", histogram, 1e-6);
+
+    const std::string& text = builder.GetText();
+
+    EXPECT_NE(text.find("# TYPE tick_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("tick_seconds_bucket{le=\"0.001\"} 1\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("tick_seconds_bucket{le=\"0.002\"} 2\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("tick_seconds_bucket{le=\"+Inf\"} 3\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("tick_seconds_sum 0.005\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("tick_seconds_count 3\n"), std::string::npos) << text;
+}
+
+// ============================================================================
+// WriteFileAtomically
+// ============================================================================
+
+TEST(WriteFileAtomically, WritesAndReplaces)
+{
+    fs::path dir = fs::temp_directory_path() / ("idle_detect_metrics_test_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+
+    fs::path file = dir / "metrics.prom";
+
+    ASSERT_TRUE(WriteFileAtomically(file, "first\n"));
+    ASSERT_TRUE(WriteFileAtomically(file, "second\n"));
+
+    std::ifstream in(file);
+    std::stringstream content;
+    content << in.rdbuf();
+
+    EXPECT_EQ(content.str(), "second\n");
+    EXPECT_FALSE(fs::exists(dir / "metrics.prom.tmp"));
+
+    fs::remove_all(dir);
+}
+
+TEST(WriteFileAtomically, FailsForMissingDirectory)
+{
+    EXPECT_FALSE(WriteFileAtomically("/nonexistent_idle_detect_dir/metrics.prom", "x\n"));
+}
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include "fake_event_detect.h"
+
+#include <pressure.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Performance regression gate. Each test runs one of the steady state loops of the daemons for a fixed number of
+// iterations and measures, per iteration:
+//
+//   - user and system CPU time of the calling thread (getrusage),
+//   - read and write family system calls of the process (syscr + syscw in /proc/self/io),
+//   - heap allocations (the operator new replacement below).
+//
+// The test fails if any measurement exceeds its budget in tests/perf_budgets.conf. Allocation and system call counts
+// are deterministic, so their budgets are tight; a regression such as building a std::regex per tick shows up there
+// first. System CPU covers the system calls that /proc/self/io does not count, such as stat() and getdents() in the
+// device scans. CPU budgets leave headroom for slow machines, and can be scaled with IDLE_DETECT_PERF_CPU_SCALE, e.g. for
+// sanitizer builds.
+
+namespace {
+
+std::atomic<uint64_t> g_allocations {0};
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* ptr = std::malloc(size != 0 ? size : 1)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    size_t align = static_cast<size_t>(alignment);
+
+    if (void* ptr = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace {
+
+constexpr int64_t PERF_START = 1748822400;
+
+//!
+//! \brief Returns syscr + syscw from /proc/self/io, or 0 if it is not readable. This does not allocate.
+//!
+uint64_t ReadSyscallCount()
+{
+    int fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return 0;
+    }
+
+    char buffer[512];
+    ssize_t bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+
+    if (bytes_read <= 0) {
+        return 0;
+    }
+
+    buffer[bytes_read] = '\0';
+
+    uint64_t total = 0;
+
+    for (const char* key : {"syscr: ", "syscw: "}) {
+        if (const char* pos = std::strstr(buffer, key)) {
+            total += std::strtoull(pos + std::strlen(key), nullptr, 10);
+        }
+    }
+
+    return total;
+}
+
+int64_t TimevalMicros(const struct timeval& tv)
+{
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+//!
+//! \brief Per iteration cost of a loop.
+//!
+struct LoopCost
+{
+    double cpu_ns = 0.0;
+    double sys_cpu_ns = 0.0;
+    double syscalls = 0.0;
+    double allocations = 0.0;
+};
+
+//!
+//! \brief Runs body for warmup iterations, which are not measured, then for iterations measured ones.
+//!
+template <typename F>
+LoopCost MeasureLoop(int iterations, F&& body, int warmup = 100)
+{
+    for (int i = 0; i < warmup; ++i) {
+        body();
+    }
+
+    const uint64_t syscalls_start = ReadSyscallCount();
+    const uint64_t allocations_start = g_allocations.load(std::memory_order_relaxed);
+    struct rusage usage_start;
+    getrusage(RUSAGE_THREAD, &usage_start);
+
+    for (int i = 0; i < iterations; ++i) {
+        body();
+    }
+
+    struct rusage usage_end;
+    getrusage(RUSAGE_THREAD, &usage_end);
+
+    const uint64_t allocations_end = g_allocations.load(std::memory_order_relaxed);
+    const uint64_t syscalls_end = ReadSyscallCount();
+
+    LoopCost cost;
+    cost.cpu_ns = static_cast<double>(TimevalMicros(usage_end.ru_utime) - TimevalMicros(usage_start.ru_utime))
+                  * 1000.0 / iterations;
+    cost.sys_cpu_ns = static_cast<double>(TimevalMicros(usage_end.ru_stime) - TimevalMicros(usage_start.ru_stime))
+                      * 1000.0 / iterations;
+    // Less the read() of /proc/self/io for syscalls_start itself.
+    cost.syscalls = static_cast<double>(syscalls_end - syscalls_start - 1) / iterations;
+    cost.allocations = static_cast<double>(allocations_end - allocations_start) / iterations;
+
+    return cost;
+}
+
+//!
+//! \brief The checked-in budgets. Each loop has <loop>_cpu_ns, <loop>_sys_cpu_ns, <loop>_syscalls and
+//! <loop>_allocations, all per iteration.
+//!
+class PerfBudgets : public Config
+{
+public:
+    static const std::vector<std::string>& Loops()
+    {
+        static const std::vector<std::string> loops = {
+            "monitor_tick", "tty_tick", "pipe_parse", "shmem_publish", "idle_detect_check"
+        };
+
+        return loops;
+    }
+
+private:
+    void ProcessArgs() override
+    {
+        for (const auto& loop : Loops()) {
+            for (const char* metric : {"_cpu_ns", "_sys_cpu_ns", "_syscalls", "_allocations"}) {
+                int budget = -1;
+
+                try {
+                    budget = ParseStringToInt(GetArgString(loop + metric, "-1"));
+                } catch (std::exception& e) {
+                    error_log("%s: %s in perf budgets has invalid value: %s",
+                              __func__,
+                              loop + metric,
+                              e.what());
+                }
+
+                m_config.insert(std::make_pair(loop + metric, budget));
+            }
+        }
+
+        // pressure_tick_p95_us
+
+        int pressure_budget = -1;
+
+        try {
+            pressure_budget = ParseStringToInt(GetArgString("pressure_tick_p95_us", "-1"));
+        } catch (std::exception& e) {
+            error_log("%s: pressure_tick_p95_us in perf budgets has invalid value: %s",
+                      __func__,
+                      e.what());
+        }
+
+        m_config.insert(std::make_pair("pressure_tick_p95_us", pressure_budget));
+    }
+};
+
+//!
+//! \brief Checks a measured loop against its budgets and prints the measurement, so budgets can be re-baselined from
+//! the test log.
+//!
+void CheckBudget(const std::string& loop, const LoopCost& cost)
+{
+    PerfBudgets budgets;
+    budgets.ReadAndUpdateConfig(PERF_BUDGETS_FILE);
+
+    double cpu_scale = 1.0;
+
+    if (const char* scale = std::getenv("IDLE_DETECT_PERF_CPU_SCALE")) {
+        cpu_scale = std::max(1.0, std::atof(scale));
+    }
+
+    const int cpu_budget = std::get<int>(budgets.GetArg(loop + "_cpu_ns"));
+    const int sys_cpu_budget = std::get<int>(budgets.GetArg(loop + "_sys_cpu_ns"));
+    const int syscall_budget = std::get<int>(budgets.GetArg(loop + "_syscalls"));
+    const int allocation_budget = std::get<int>(budgets.GetArg(loop + "_allocations"));
+
+    std::printf("PERF %s: cpu %.0f ns (budget %d), sys cpu %.0f ns (budget %d), syscalls %.2f (budget %d), "
+                "allocations %.2f (budget %d)\n",
+                loop.c_str(), cost.cpu_ns, cpu_budget, cost.sys_cpu_ns, sys_cpu_budget, cost.syscalls, syscall_budget,
+                cost.allocations, allocation_budget);
+
+    ASSERT_GE(cpu_budget, 0) << "no budget for " << loop << " in " << PERF_BUDGETS_FILE;
+    ASSERT_GE(sys_cpu_budget, 0) << "no budget for " << loop << " in " << PERF_BUDGETS_FILE;
+    ASSERT_GE(syscall_budget, 0) << "no budget for " << loop << " in " << PERF_BUDGETS_FILE;
+    ASSERT_GE(allocation_budget, 0) << "no budget for " << loop << " in " << PERF_BUDGETS_FILE;
+
+    EXPECT_LE(cost.cpu_ns, cpu_budget * cpu_scale) << loop << " user CPU per iteration";
+    EXPECT_LE(cost.sys_cpu_ns, sys_cpu_budget * cpu_scale) << loop << " system CPU per iteration";
+    EXPECT_LE(cost.syscalls, syscall_budget) << loop << " read/write system calls per iteration";
+    EXPECT_LE(cost.allocations, allocation_budget) << loop << " heap allocations per iteration";
+}
+
+//!
+//! \brief Writes a cgroup control file with a single write(), so that a rejected value is reported.
+//! \return true on success.
+//!
+bool WriteCgroupFile(const fs::path& path, const std::string& value)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    bool written = (write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size()));
+    close(fd);
+
+    return written;
+}
+
+//!
+//! \brief Creates a cgroup v2 child cgroup with the memory controller for the memory pressure test. The parent is
+//! IDLE_DETECT_PRESSURE_CGROUP if set (for example a delegated cgroup from systemd-run --user -p Delegate=yes), else
+//! the test's own cgroup.
+//! \return the path of the new cgroup, or an empty path if none can be created with memory.high.
+//!
+fs::path CreatePressureCgroup()
+{
+    fs::path parent;
+
+    if (const char* delegated = std::getenv("IDLE_DETECT_PRESSURE_CGROUP")) {
+        parent = delegated;
+    } else {
+        // The cgroup2 mount point, from the mount info, and this process's cgroup within it.
+        fs::path mount_point;
+        std::ifstream mountinfo("/proc/self/mountinfo");
+
+        for (std::string line; std::getline(mountinfo, line);) {
+            std::vector<std::string> fields = StringSplit(line, " ");
+
+            if (fields.size() > 4 && line.find(" - cgroup2 ") != std::string::npos) {
+                mount_point = fields[4];
+                break;
+            }
+        }
+
+        std::ifstream cgroup("/proc/self/cgroup");
+
+        for (std::string line; !mount_point.empty() && std::getline(cgroup, line);) {
+            if (line.rfind("0::", 0) == 0) {
+                parent = mount_point / line.substr(4);
+                break;
+            }
+        }
+    }
+
+    if (parent.empty()) {
+        return {};
+    }
+
+    fs::path cgroup = parent / ("idle_detect_pressure_" + std::to_string(getpid()));
+    std::error_code ec;
+
+    if (!fs::create_directory(cgroup, ec)) {
+        return {};
+    }
+
+    if (!fs::exists(cgroup / "memory.high")) {
+        fs::remove(cgroup, ec);
+
+        return {};
+    }
+
+    return cgroup;
+}
+
+//!
+//! \brief Input to publish latency percentiles, in microseconds.
+//!
+struct PressureLatency
+{
+    int64_t p95_us = -1;
+    int64_t max_us = -1;
+};
+
+//!
+//! \brief Measures the monitor tick (mouse activity to shared memory publish) under memory pressure. A child process
+//! joins the cgroup, limits it to its current usage plus 32 MiB with memory.high, optionally applies the pressure
+//! resilient settings, and then starts a balloon process in the same cgroup that keeps allocating and touching memory
+//! past the limit. The balloon is a separate process because memory locks are not inherited across fork(). Reclaim in
+//! the cgroup then evicts the pages that the child faulted in after joining it, unless they are locked.
+//! \return the latencies, or -1 values if the child failed.
+//!
+PressureLatency MeasureTickUnderPressure(FakeEventDetect& sim, const fs::path& cgroup, bool pressure_resilient)
+{
+    constexpr int ITERATIONS = 50;
+    constexpr size_t BALLOON_CHUNK_BYTES = 1024 * 1024;
+
+    PressureLatency result;
+    int result_pipe[2];
+
+    if (pipe(result_pipe) != 0) {
+        return result;
+    }
+
+    pid_t child = fork();
+
+    if (child == 0) {
+        close(result_pipe[0]);
+
+        PressureLatency latency;
+
+        if (WriteCgroupFile(cgroup / "cgroup.procs", std::to_string(getpid()))) {
+            int64_t current = 0;
+            std::ifstream(cgroup / "memory.current") >> current;
+
+            WriteCgroupFile(cgroup / "memory.high", std::to_string(current + 32 * 1024 * 1024));
+
+            if (pressure_resilient) {
+                LockProcessMemory();
+                PrefaultThreadStack();
+            }
+
+            pid_t balloon = fork();
+
+            if (balloon == 0) {
+                std::vector<char*> chunks;
+
+                while (true) {
+                    if (chunks.size() < 256) {
+                        chunks.push_back(static_cast<char*>(mmap(nullptr, BALLOON_CHUNK_BYTES, PROT_READ | PROT_WRITE,
+                                                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)));
+                    }
+
+                    for (char* chunk : chunks) {
+                        if (chunk != MAP_FAILED) {
+                            for (size_t offset = 0; offset < BALLOON_CHUNK_BYTES; offset += 4096) {
+                                ++chunk[offset];
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Let the pressure build.
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+            std::vector<int64_t> samples;
+            samples.reserve(ITERATIONS);
+
+            for (int i = 0; i < ITERATIONS; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+                auto start = std::chrono::steady_clock::now();
+
+                sim.m_clock.AdvanceMicros(1000000);
+                sim.MouseMove();
+                g_event_monitor.Tick();
+
+                samples.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::steady_clock::now() - start).count());
+            }
+
+            if (balloon > 0) {
+                kill(balloon, SIGKILL);
+                waitpid(balloon, nullptr, 0);
+            }
+
+            std::sort(samples.begin(), samples.end());
+
+            latency.p95_us = samples[samples.size() * 95 / 100];
+            latency.max_us = samples.back();
+        }
+
+        ssize_t ignored = write(result_pipe[1], &latency, sizeof(latency));
+        (void) ignored;
+
+        // Skip the atexit handlers, which belong to the parent's test run.
+        _exit(0);
+    }
+
+    close(result_pipe[1]);
+
+    if (child > 0) {
+        if (read(result_pipe[0], &result, sizeof(result)) != static_cast<ssize_t>(sizeof(result))) {
+            result = PressureLatency();
+        }
+
+        waitpid(child, nullptr, 0);
+    }
+
+    close(result_pipe[0]);
+
+    return result;
+}
+
+class PerfGate : public ::testing::Test
+{
+protected:
+    std::unique_ptr<FakeEventDetect> m_sim;
+
+    void SetUp() override
+    {
+        m_sim = std::make_unique<FakeEventDetect>("idle_detect_perf_test", PERF_START);
+
+        ASSERT_TRUE(m_sim->m_exporter.IsInitialized());
+    }
+
+    void TearDown() override
+    {
+        m_sim.reset();
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// event_detect loops
+// ============================================================================
+
+TEST_F(PerfGate, MonitorTick)
+{
+    LoopCost cost = MeasureLoop(2000, [this]() {
+        m_sim->m_clock.AdvanceMicros(1000000);
+        m_sim->MouseMove();
+        g_event_monitor.Tick();
+    });
+
+    CheckBudget("monitor_tick", cost);
+}
+
+TEST_F(PerfGate, TtyTick)
+{
+    LoopCost cost = MeasureLoop(2000, [this]() {
+        m_sim->m_clock.AdvanceMicros(1000000);
+        g_tty_monitor.Tick();
+    });
+
+    CheckBudget("tty_tick", cost);
+}
+
+TEST_F(PerfGate, PipeParse)
+{
+    const std::string message = std::to_string(m_sim->Now()) + ":USER_ACTIVE";
+
+    LoopCost cost = MeasureLoop(20000, [&message]() {
+        g_idle_detect_monitor.ProcessMessage(message);
+    });
+
+    CheckBudget("pipe_parse", cost);
+}
+
+TEST_F(PerfGate, ShmemPublish)
+{
+    int64_t now = m_sim->Now();
+
+    LoopCost cost = MeasureLoop(100000, [this, &now]() {
+        ++now;
+        m_sim->m_exporter.UpdateTimestamps(now, now - 1);
+    });
+
+    CheckBudget("shmem_publish", cost);
+}
+
+// ============================================================================
+// idle_detect loop
+// ============================================================================
+
+TEST_F(PerfGate, IdleDetectCheck)
+{
+    m_sim->m_exporter.UpdateTimestamps(m_sim->Now(), m_sim->Now() - 30);
+
+    int64_t idle_count = 0;
+
+    // The idle_detect check: read event_detect's published time from shmem, combine with the (here absent, tty)
+    // session idle time, and apply the threshold.
+    LoopCost cost = MeasureLoop(20000, [this, &idle_count]() {
+        int64_t update_time = 0;
+        int64_t last_active_time = 0;
+
+        if (ReadSharedMemoryTimestamps(m_sim->m_shmem_name, update_time, last_active_time)) {
+            int64_t idle_seconds = CombineIdleSeconds(-2, last_active_time, GetUnixEpochTime());
+
+            idle_count += idle_seconds >= 300;
+        }
+    });
+
+    EXPECT_EQ(idle_count, 0);
+
+    CheckBudget("idle_detect_check", cost);
+}
+
+// ============================================================================
+// Memory pressure
+// ============================================================================
+
+TEST_F(PerfGate, PressureResilientSettings)
+{
+    EXPECT_FALSE(std::get<bool>(g_config.GetArg("pressure_resilient")));
+    EXPECT_EQ(std::get<int>(g_config.GetArg("oom_score_adj")), 0);
+    EXPECT_EQ(std::get<int>(g_config.GetArg("realtime_priority")), 0);
+
+    EXPECT_FALSE(SetOomScoreAdj(1001));
+    EXPECT_FALSE(SetOomScoreAdj(-1001));
+
+    // Raising the score never needs a privilege. Setting the current value is a no-op either way.
+    int current = 0;
+    std::ifstream("/proc/self/oom_score_adj") >> current;
+
+    EXPECT_TRUE(SetOomScoreAdj(current));
+
+    PrefaultThreadStack();
+}
+
+TEST_F(PerfGate, TickUnderMemoryPressure)
+{
+    fs::path cgroup = CreatePressureCgroup();
+
+    if (cgroup.empty()) {
+        GTEST_SKIP() << "no cgroup v2 memory controller available; set IDLE_DETECT_PRESSURE_CGROUP to a delegated cgroup";
+    }
+
+    PressureLatency unlocked = MeasureTickUnderPressure(*m_sim, cgroup, false);
+    PressureLatency locked;
+
+    if (unlocked.p95_us >= 0) {
+        locked = MeasureTickUnderPressure(*m_sim, cgroup, true);
+    }
+
+    std::error_code ec;
+    fs::remove(cgroup, ec);
+
+    if (unlocked.p95_us < 0) {
+        GTEST_SKIP() << "cannot move a process into " << cgroup;
+    }
+
+    PerfBudgets budgets;
+    budgets.ReadAndUpdateConfig(PERF_BUDGETS_FILE);
+
+    const int budget = std::get<int>(budgets.GetArg("pressure_tick_p95_us"));
+
+    std::printf("PERF pressure_tick: unlocked p95 %lld us, max %lld us; pressure_resilient p95 %lld us (budget %d), "
+                "max %lld us\n",
+                static_cast<long long>(unlocked.p95_us), static_cast<long long>(unlocked.max_us),
+                static_cast<long long>(locked.p95_us), budget, static_cast<long long>(locked.max_us));
+
+    ASSERT_GE(budget, 0) << "no budget for pressure_tick_p95_us in " << PERF_BUDGETS_FILE;
+    ASSERT_GE(locked.p95_us, 0) << "pressure measurement failed";
+
+    EXPECT_LE(locked.p95_us, budget) << "input to publish latency under memory pressure";
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <shmem.h>
+
+#include <unistd.h>
+
+namespace {
+
+std::string TestShmemName()
+{
+    return "/idle_detect_test_" + std::to_string(getpid());
+}
+
+} // namespace
+
+// ============================================================================
+// SharedMemoryTimestampExporter / ReadSharedMemoryTimestamps
+// ============================================================================
+
+TEST(SharedMemory, WriteThenRead)
+{
+    SharedMemoryTimestampExporter exporter(TestShmemName());
+    ASSERT_TRUE(exporter.CreateOrOpen(0600));
+    EXPECT_TRUE(exporter.IsInitialized());
+
+    ASSERT_TRUE(exporter.UpdateTimestamps(1700000100, 1700000050));
+
+    int64_t update_time = 0;
+    int64_t last_active_time = 0;
+
+    ASSERT_TRUE(ReadSharedMemoryTimestamps(TestShmemName(), update_time, last_active_time));
+    EXPECT_EQ(update_time, 1700000100);
+    EXPECT_EQ(last_active_time, 1700000050);
+
+    EXPECT_TRUE(exporter.UnlinkSegment());
+}
+
+TEST(SharedMemory, ReadMissingSegmentFails)
+{
+    int64_t update_time = -1;
+    int64_t last_active_time = -1;
+
+    EXPECT_FALSE(ReadSharedMemoryTimestamps("/idle_detect_test_missing_segment", update_time, last_active_time));
+    EXPECT_FALSE(ReadSharedMemoryTimestamps("no_leading_slash", update_time, last_active_time));
+}
+
+TEST(SharedMemory, UpdateBeforeCreateFails)
+{
+    SharedMemoryTimestampExporter exporter(TestShmemName());
+
+    EXPECT_FALSE(exporter.IsInitialized());
+    EXPECT_FALSE(exporter.UpdateTimestamps(1, 1));
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include "fake_event_detect.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+
+// These tests link event_detect.cpp without its main() and drive the monitors' Tick() methods against a fake
+// sysfs/dev tree and a SimulatedClock, so a full day of activity runs in a few seconds.
+
+namespace {
+
+//!
+//! \brief Start of the simulated day: 2025-06-02 00:00:00 UTC.
+//!
+constexpr int64_t SIM_START = 1748822400;
+
+constexpr int64_t HOUR = 3600;
+
+//!
+//! \brief Test fixture holding one simulated event_detect.
+//!
+class EventDetectSimulation : public ::testing::Test
+{
+protected:
+    std::unique_ptr<FakeEventDetect> m_sim;
+
+    void SetUp() override
+    {
+        m_sim = std::make_unique<FakeEventDetect>("idle_detect_sim_test", SIM_START);
+
+        ASSERT_TRUE(m_sim->m_exporter.IsInitialized());
+    }
+
+    void TearDown() override
+    {
+        m_sim.reset();
+    }
+
+    int64_t Now() const
+    {
+        return m_sim->Now();
+    }
+
+    //!
+    //! \brief Runs the simulation one virtual second per tick, as the monitor threads would, applying the script for each
+    //! second before the ticks. Every published shmem sample is passed to the check.
+    //!
+    void Run(int64_t duration_seconds,
+             const std::map<int64_t, std::function<void()>>& script,
+             const std::function<void(int64_t update_time, int64_t last_active_time)>& check)
+    {
+        for (int64_t second = 1; second <= duration_seconds; ++second) {
+            m_sim->m_clock.AdvanceMicros(1000000);
+
+            if (auto it = script.find(second); it != script.end()) {
+                it->second();
+            }
+
+            g_tty_monitor.Tick();
+            g_event_monitor.Tick();
+
+            int64_t update_time = 0;
+            int64_t last_active_time = 0;
+
+            ASSERT_TRUE(ReadSharedMemoryTimestamps(m_sim->m_shmem_name, update_time, last_active_time));
+
+            check(update_time, last_active_time);
+        }
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// SimulatedClock
+// ============================================================================
+
+TEST(SimulatedClock, DrivesGetUnixEpochTime)
+{
+    SimulatedClock clock(SIM_START * 1000000 + 500000);
+    SetClock(&clock);
+
+    EXPECT_EQ(GetUnixEpochTime(), SIM_START);
+    EXPECT_EQ(GetUnixEpochTimeMicros(), SIM_START * 1000000 + 500000);
+
+    clock.AdvanceMicros(HOUR * 1000000);
+    EXPECT_EQ(GetUnixEpochTime(), SIM_START + HOUR);
+
+    SetClock(nullptr);
+    EXPECT_GT(GetUnixEpochTime(), SIM_START + HOUR);
+}
+
+// ============================================================================
+// Full day simulation
+// ============================================================================
+
+TEST_F(EventDetectSimulation, ScriptedDayTimeline)
+{
+    EXPECT_EQ(g_event_monitor.GetEventDevices().size(), 1u);
+    EXPECT_EQ(g_tty_monitor.GetTtyDevices().size(), 2u);
+
+    std::map<int64_t, std::function<void()>> script;
+
+    // Morning: mouse use every 10 seconds from 09:00 to 12:00.
+    for (int64_t t = 9 * HOUR; t <= 12 * HOUR; t += 10) {
+        script[t] = [this]() { m_sim->MouseMove(); };
+    }
+
+    // Afternoon: terminal work at 13:30 and 14:00.
+    script[13 * HOUR + 1800] = [this]() { ASSERT_TRUE(m_sim->TypeInTerminal()); };
+    script[14 * HOUR] = [this]() { ASSERT_TRUE(m_sim->TypeInTerminal()); };
+
+    // Evening: a desktop session reports activity through idle_detect, then the user forces idle for an hour.
+    script[18 * HOUR] = [this]() { m_sim->IdleDetectMessage("USER_ACTIVE"); };
+    script[20 * HOUR] = [this]() { m_sim->IdleDetectMessage("USER_FORCE_IDLE"); };
+    script[21 * HOUR] = [this]() { m_sim->IdleDetectMessage("USER_UNFORCE"); };
+
+    // Late: mouse again, from 22:00 to 22:30.
+    for (int64_t t = 22 * HOUR; t <= 22 * HOUR + 1800; t += 10) {
+        script[t] = [this]() { m_sim->MouseMove(); };
+    }
+
+    // The expected published last active time follows directly from the script.
+    int64_t expected_last_active = SIM_START - HOUR;
+    bool forced_idle = false;
+    int64_t samples = 0;
+    int64_t mismatches = 0;
+
+    auto check = [&](int64_t update_time, int64_t last_active_time) {
+        const int64_t now = Now();
+        const int64_t second = now - SIM_START;
+
+        if (script.count(second)) {
+            if (second == 20 * HOUR) {
+                forced_idle = true;
+            } else if (second == 21 * HOUR) {
+                forced_idle = false;
+            }
+
+            // USER_FORCE_IDLE and USER_UNFORCE are activity too.
+            expected_last_active = now;
+        }
+
+        ++samples;
+
+        EXPECT_EQ(update_time, now);
+
+        if (last_active_time != (forced_idle ? 0 : expected_last_active)) {
+            // Report only the first few, rather than every second of a broken timeline.
+            if (++mismatches <= 5) {
+                ADD_FAILURE() << "at " << FormatISO8601DateTime(now) << ": published " << last_active_time
+                              << ", expected " << (forced_idle ? 0 : expected_last_active);
+            }
+        }
+    };
+
+    Run(24 * HOUR, script, check);
+
+    EXPECT_EQ(samples, 24 * HOUR);
+    EXPECT_EQ(mismatches, 0);
+
+    // The last activity of the day was the mouse at 22:30.
+    EXPECT_EQ(g_event_monitor.GetLastActiveTime(), SIM_START + 22 * HOUR + 1800);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef TESTS_TEMP_DIR_H
+#define TESTS_TEMP_DIR_H
+
+#include <util.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+//!
+//! \brief The TempDir class is an empty directory in the gtest temporary directory, removed with its contents on
+//! destruction. The name is suffixed with the pid, so concurrently running test binaries do not share it.
+//!
+class TempDir
+{
+public:
+    //!
+    //! \brief Creates the directory, after removing any left by an earlier run that was killed.
+    //! \param name distinguishes the directory of each test file.
+    //!
+    explicit TempDir(const std::string& name)
+        : path(fs::path(::testing::TempDir()) / (name + "_" + std::to_string(getpid())))
+    {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+        fs::create_directories(path);
+    }
+
+    //! \brief Removes the directory with its contents.
+    ~TempDir()
+    {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+    }
+
+    //! \brief Deleted copy and move constructors and assignment operators, so that the directory is removed once.
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+    TempDir(TempDir&&) = delete;
+    TempDir& operator=(TempDir&&) = delete;
+
+    //! \brief The directory.
+    const fs::path path;
+};
+
+#endif // TESTS_TEMP_DIR_H
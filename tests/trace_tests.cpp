@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <gtest/gtest.h>
+#include <trace.h>
+
+// ============================================================================
+// ChromeTraceBuffer
+// ============================================================================
+
+TEST(ChromeTraceBuffer, DisabledByDefault)
+{
+    ChromeTraceBuffer trace;
+    trace.AddSpan("input_to_read", "event3", 1000, 10);
+
+    EXPECT_FALSE(trace.IsEnabled());
+    EXPECT_EQ(trace.Size(), 0u);
+}
+
+TEST(ChromeTraceBuffer, IgnoresInvalidSpans)
+{
+    ChromeTraceBuffer trace;
+    trace.SetEnabled(true);
+
+    trace.AddSpan("a", "t", 0, 10);
+    trace.AddSpan("a", "t", 1000, -1);
+
+    EXPECT_EQ(trace.Size(), 0u);
+}
+
+TEST(ChromeTraceBuffer, DropsOldestWhenFull)
+{
+    ChromeTraceBuffer trace(2);
+    trace.SetEnabled(true);
+
+    trace.AddSpan("first", "t", 1000, 1);
+    trace.AddSpan("second", "t", 2000, 1);
+    trace.AddSpan("third", "t", 3000, 1);
+
+    std::string json = trace.ToJson();
+
+    EXPECT_EQ(trace.Size(), 2u);
+    EXPECT_EQ(json.find("\"first\""), std::string::npos) << json;
+    EXPECT_NE(json.find("\"third\""), std::string::npos) << json;
+}
+
+TEST(ChromeTraceBuffer, JsonFormat)
+{
+    ChromeTraceBuffer trace;
+    trace.SetEnabled(true);
+
+    trace.AddSpan("input_to_publish", "monitor", 1700000000000000, 250);
+    trace.AddSpan("pipe_transit", "idle \"pipe\"", 1700000000000100, 50);
+
+    std::string json = trace.ToJson();
+
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0), 0u) << json;
+    EXPECT_NE(json.find("{\"name\":\"input_to_publish\",\"cat\":\"latency\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                        "\"ts\":1700000000000000,\"dur\":250}"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"args\":{\"name\":\"idle \\\"pipe\\\"\"}"), std::string::npos) << json;
+    EXPECT_EQ(json.substr(json.size() - 3), "]}\n");
+}
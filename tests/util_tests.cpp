@@ -226,6 +226,53 @@ TEST(FormatISO8601DateTime, AnotherKnownTimestamp)
     EXPECT_EQ(FormatISO8601DateTime(1704067200), "2024-01-01T00:00:00Z");
 }
 
+// ============================================================================
+// Logging
+// ============================================================================
+
+TEST(Logging, TimestampPrefixFormat)
+{
+    const std::string& prefix = GetLogTimestampPrefix();
+
+    // "YYYY-MM-DDTHH:MM:SSZ "
+    ASSERT_EQ(prefix.size(), 21u);
+    EXPECT_EQ(prefix.back(), ' ');
+    EXPECT_EQ(prefix[19], 'Z');
+}
+
+TEST(Logging, LogPrintStrUsesPrefixWhenEnabled)
+{
+    bool saved = g_log_timestamps.exchange(true);
+    std::string msg = LogPrintStr("value = %d", 5);
+    g_log_timestamps = saved;
+
+    ASSERT_GE(msg.size(), 21u);
+    EXPECT_EQ(msg.substr(21), "value = 5\n");
+}
+
+TEST(Logging, LogPrintStrNoPrefixWhenDisabled)
+{
+    bool saved = g_log_timestamps.exchange(false);
+    std::string msg = LogPrintStr("value = %d", 5);
+    g_log_timestamps = saved;
+
+    EXPECT_EQ(msg, "value = 5\n");
+}
+
+TEST(Logging, DebugLogDoesNotEvaluateArgsWhenOff)
+{
+    bool saved = g_debug.exchange(false);
+    int evaluations = 0;
+
+    auto count = [&evaluations]() { return ++evaluations; };
+
+    debug_log("INFO: %s: %d", __func__, count());
+
+    g_debug = saved;
+
+    EXPECT_EQ(evaluations, 0);
+}
+
 // ============================================================================
 // IsValidTimestamp
 // ============================================================================
@@ -263,6 +310,34 @@ TEST(IsValidTimestamp, SlightlyFutureIsValid)
     EXPECT_TRUE(IsValidTimestamp(GetUnixEpochTime() + 30));
 }
 
+// ============================================================================
+// CombineIdleSeconds
+// ============================================================================
+
+TEST(CombineIdleSeconds, SessionAndEventDetectTakeMostRecent)
+{
+    // Session idle 600 s, event_detect saw activity 60 s ago: the more recent activity wins.
+    EXPECT_EQ(CombineIdleSeconds(600, 1000 - 60, 1000), 60);
+    EXPECT_EQ(CombineIdleSeconds(30, 1000 - 60, 1000), 30);
+}
+
+TEST(CombineIdleSeconds, NoSessionUsesEventDetect)
+{
+    EXPECT_EQ(CombineIdleSeconds(-2, 1000 - 60, 1000), 60);
+    EXPECT_EQ(CombineIdleSeconds(-1, 1000 - 60, 1000), 60);
+}
+
+TEST(CombineIdleSeconds, ForcedIdleOverridesSession)
+{
+    // A published last active time of 0 is event_detect forced idle.
+    EXPECT_EQ(CombineIdleSeconds(5, 0, 1000), 1000);
+}
+
+TEST(CombineIdleSeconds, FutureLastActiveIsZero)
+{
+    EXPECT_EQ(CombineIdleSeconds(-2, 1010, 1000), 0);
+}
+
 TEST(IsValidTimestamp, TooFarFutureBySeconds)
 {
     // 120 seconds in the future (limit is 60)
@@ -394,6 +469,27 @@ TEST_F(FindDirEntriesTest, MatchSpecificExtension)
     EXPECT_EQ(result[0].filename(), "other.log");
 }
 
+TEST_F(FindDirEntriesTest, ScanDirEntriesByPrefix)
+{
+    std::vector<std::string> names;
+
+    ASSERT_TRUE(ScanDirEntries(m_test_dir.string(), "test_file_", names));
+    EXPECT_EQ(names, (std::vector<std::string> {"test_file_1.txt", "test_file_2.txt"}));
+
+    ASSERT_TRUE(ScanDirEntries(m_test_dir.string(), "", names));
+    EXPECT_EQ(names, (std::vector<std::string> {"other.log", "test_file_1.txt", "test_file_2.txt"}));
+
+    EXPECT_FALSE(ScanDirEntries("/nonexistent_dir_xyz", "", names));
+    EXPECT_TRUE(names.empty());
+}
+
+TEST_F(FindDirEntriesTest, DirHasEntryWithPrefix)
+{
+    EXPECT_TRUE(DirHasEntryWithPrefix(m_test_dir.string(), "other"));
+    EXPECT_FALSE(DirHasEntryWithPrefix(m_test_dir.string(), "mouse"));
+    EXPECT_FALSE(DirHasEntryWithPrefix("/nonexistent_dir_xyz", ""));
+}
+
 // ============================================================================
 // GetEnvVariable
 // ============================================================================
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <trace.h>
+#include <metrics.h>
+
+#include <map>
+
+// Class ChromeTraceBuffer
+
+ChromeTraceBuffer::ChromeTraceBuffer(size_t capacity)
+    : m_enabled(false)
+    , m_capacity(capacity)
+    , m_spans()
+{}
+
+void ChromeTraceBuffer::SetEnabled(bool enabled)
+{
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool ChromeTraceBuffer::IsEnabled() const
+{
+    return m_enabled.load(std::memory_order_relaxed);
+}
+
+void ChromeTraceBuffer::AddSpan(std::string_view name, std::string_view track, int64_t start_us, int64_t duration_us)
+{
+    if (!IsEnabled() || start_us <= 0 || duration_us < 0 || m_capacity == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_trace);
+
+    if (m_spans.size() >= m_capacity) {
+        m_spans.pop_front();
+    }
+
+    m_spans.push_back({std::string(name), std::string(track), start_us, duration_us});
+}
+
+size_t ChromeTraceBuffer::Size() const
+{
+    std::lock_guard<std::mutex> lock(mtx_trace);
+
+    return m_spans.size();
+}
+
+std::string ChromeTraceBuffer::JsonEscape(const std::string& str)
+{
+    std::string out;
+
+    for (char c : str) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += tfm::format("\\u%04x", static_cast<int>(c));
+            } else {
+                out += c;
+            }
+        }
+    }
+
+    return out;
+}
+
+std::string ChromeTraceBuffer::ToJson() const
+{
+    std::lock_guard<std::mutex> lock(mtx_trace);
+
+    // Each distinct track becomes a thread id, named via a metadata event so the viewer shows the stage names.
+    std::map<std::string, int> track_ids;
+
+    for (const auto& span : m_spans) {
+        track_ids.emplace(span.track, static_cast<int>(track_ids.size()) + 1);
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+
+    for (const auto& [track, tid] : track_ids) {
+        out += first ? "" : ",";
+        out += tfm::format("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+                           tid,
+                           JsonEscape(track));
+        first = false;
+    }
+
+    for (const auto& span : m_spans) {
+        out += first ? "" : ",";
+        out += tfm::format("{\"name\":\"%s\",\"cat\":\"latency\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%lld,\"dur\":%lld}",
+                           JsonEscape(span.name),
+                           track_ids[span.track],
+                           span.start_us,
+                           span.duration_us);
+        first = false;
+    }
+
+    out += "]}\n";
+
+    return out;
+}
+
+bool ChromeTraceBuffer::WriteTraceFile(const fs::path& filepath) const
+{
+    return WriteFileAtomically(filepath, ToJson());
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <util.h>
+
+//!
+//! \brief The ChromeTraceBuffer class collects latency spans and writes them in the Chrome trace event JSON format, which
+//! can be loaded into chrome://tracing or https://ui.perfetto.dev for offline analysis. Each span is a complete ("X")
+//! event with an absolute start time and a duration in microseconds, placed on a named track.
+//!
+//! The buffer holds at most the configured number of spans; the oldest are discarded when it is full. Recording is a no-op
+//! unless the buffer has been enabled, so the instrumentation points cost a relaxed load when tracing is off.
+//!
+class ChromeTraceBuffer
+{
+public:
+    //!
+    //! \brief Default maximum number of spans retained.
+    //!
+    static constexpr size_t DEFAULT_CAPACITY = 10000;
+
+    //!
+    //! \brief Constructor.
+    //! \param capacity maximum number of spans retained.
+    //!
+    explicit ChromeTraceBuffer(size_t capacity = DEFAULT_CAPACITY);
+
+    //!
+    //! \brief Enables or disables recording.
+    //! \param enabled
+    //!
+    void SetEnabled(bool enabled);
+
+    //!
+    //! \brief Whether recording is enabled.
+    //! \return boolean flag
+    //!
+    bool IsEnabled() const;
+
+    //!
+    //! \brief Records a span. Spans with a non-positive start time or negative duration are ignored. Nothing is copied
+    //! (or allocated) unless tracing is enabled.
+    //! \param name span name, e.g. the latency stage
+    //! \param track track (thread) name the span is drawn on
+    //! \param start_us start time in microseconds since the epoch
+    //! \param duration_us duration in microseconds
+    //!
+    void AddSpan(std::string_view name, std::string_view track, int64_t start_us, int64_t duration_us);
+
+    //!
+    //! \brief Number of spans currently retained.
+    //!
+    size_t Size() const;
+
+    //!
+    //! \brief Renders the retained spans as a Chrome trace JSON document.
+    //! \return JSON text
+    //!
+    std::string ToJson() const;
+
+    //!
+    //! \brief Atomically rewrites the trace file with the retained spans.
+    //! \param filepath
+    //! \return true on success.
+    //!
+    bool WriteTraceFile(const fs::path& filepath) const;
+
+private:
+    struct Span
+    {
+        std::string name;
+        std::string track;
+        int64_t start_us;
+        int64_t duration_us;
+    };
+
+    static std::string JsonEscape(const std::string& str);
+
+    mutable std::mutex mtx_trace;
+
+    std::atomic<bool> m_enabled;
+    size_t m_capacity;
+    std::deque<Span> m_spans;
+};
+
+#endif // TRACE_H
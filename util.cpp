@@ -7,11 +7,20 @@
  */
 
 #include <util.h>
+#include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <cstddef>
+#include <cstring>
 #include <regex>
+#include <sstream>
 #include <fstream>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 //!
 //! \brief This to support early use of the log utility functions before the config is read to get the
 //! debug flag.
@@ -82,18 +91,66 @@ std::string ToLower(const std::string& str)
     return r;
 }
 
-int64_t GetUnixEpochTime()
+// Class SystemClock
+
+int64_t SystemClock::NowMicros() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+// Class SimulatedClock
+
+SimulatedClock::SimulatedClock(int64_t start_us)
+    : m_now_us(start_us)
+{}
+
+int64_t SimulatedClock::NowMicros() const
+{
+    return m_now_us.load(std::memory_order_relaxed);
+}
+
+void SimulatedClock::SetMicros(int64_t now_us)
+{
+    m_now_us.store(now_us, std::memory_order_relaxed);
+}
+
+void SimulatedClock::AdvanceMicros(int64_t delta_us)
+{
+    m_now_us.fetch_add(delta_us, std::memory_order_relaxed);
+}
+
+
+//!
+//! \brief The installed clock, or nullptr for the system clock. This is read on every time query, so it is an atomic
+//! pointer rather than lock protected.
+//!
+static std::atomic<const Clock*> g_clock = nullptr;
+
+void SetClock(const Clock* clock)
+{
+    g_clock.store(clock, std::memory_order_release);
+}
+
+const Clock& GetClock()
 {
-    // Get the current time point
-    auto now = std::chrono::system_clock::now();
+    // Function local so that it is usable during static initialization of other translation units.
+    static const SystemClock system_clock;
+
+    const Clock* clock = g_clock.load(std::memory_order_acquire);
 
-    // Convert the time point to a duration since the epoch
-    auto duration = now.time_since_epoch();
+    return clock != nullptr ? *clock : system_clock;
+}
 
-    // Convert the duration to seconds
-    int64_t seconds = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
+int64_t GetUnixEpochTime()
+{
+    return GetClock().NowMicros() / 1000000;
+}
 
-    return seconds;
+int64_t GetUnixEpochTimeMicros()
+{
+    return GetClock().NowMicros();
 }
 
 std::string FormatISO8601DateTime(int64_t time)
@@ -108,6 +165,21 @@ std::string FormatISO8601DateTime(int64_t time)
                      ts.tm_year + 1900, ts.tm_mon + 1, ts.tm_mday, ts.tm_hour, ts.tm_min, ts.tm_sec);
 }
 
+const std::string& GetLogTimestampPrefix()
+{
+    thread_local int64_t cached_time = -1;
+    thread_local std::string cached_prefix;
+
+    int64_t now = GetUnixEpochTime();
+
+    if (now != cached_time) {
+        cached_prefix = FormatISO8601DateTime(now) + " ";
+        cached_time = now;
+    }
+
+    return cached_prefix;
+}
+
 bool IsValidTimestamp(const int64_t& timestamp)
 {
     int64_t now = GetUnixEpochTime();
@@ -118,6 +190,20 @@ bool IsValidTimestamp(const int64_t& timestamp)
     return timestamp >= past_limit && timestamp <= future_limit;
 }
 
+int64_t CombineIdleSeconds(int64_t session_idle_seconds, int64_t event_detect_last_active_time, int64_t now)
+{
+    int64_t calculated_idle = std::max<int64_t>(now - event_detect_last_active_time, 0);
+
+    // A negative session idle time is not usable directly (error, or a tty session). A last active time of 0 means
+    // force_idle was set in event_detect directly, e.g. by a script from a service, and the calculated idle time must
+    // win. This has the same effect as FORCED_IDLE in the idle_detect control monitor.
+    if (session_idle_seconds >= 0 && event_detect_last_active_time > 0) {
+        return std::min(session_idle_seconds, calculated_idle);
+    }
+
+    return calculated_idle;
+}
+
 [[nodiscard]] int ParseStringToInt(const std::string& str)
 {
     try {
@@ -176,6 +262,97 @@ std::vector<fs::path> FindDirEntriesWithWildcard(const fs::path& directory, cons
     return matching_entries;
 }
 
+namespace {
+
+//!
+//! \brief Calls the provided function with the name of each entry of the directory other than . and .., until it
+//! returns false. The directory is read into a stack buffer, so this does not allocate.
+//! \return false if the directory could not be opened or read.
+//!
+template <typename F>
+bool ForEachDirEntry(const std::string& directory, F&& function)
+{
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    alignas(struct dirent64) char buffer[4096];
+    bool result = true;
+
+    while (true) {
+        long bytes_read = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+
+        if (bytes_read <= 0) {
+            result = (bytes_read == 0);
+            break;
+        }
+
+        for (long offset = 0; offset < bytes_read;) {
+            // The records returned by getdents64 have the layout of struct dirent64, as glibc's readdir64 relies on.
+            const struct dirent64* entry = reinterpret_cast<const struct dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            std::string_view name(entry->d_name);
+
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            if (!function(name)) {
+                close(fd);
+                return true;
+            }
+        }
+    }
+
+    close(fd);
+
+    return result;
+}
+
+} // namespace
+
+bool ScanDirEntries(const std::string& directory, std::string_view prefix, std::vector<std::string>& names)
+{
+    size_t count = 0;
+
+    bool result = ForEachDirEntry(directory, [&](std::string_view name) {
+        if (name.substr(0, prefix.size()) == prefix) {
+            // Reuse the existing strings, and so their capacity, rather than clearing the vector.
+            if (count < names.size()) {
+                names[count].assign(name.data(), name.size());
+            } else {
+                names.emplace_back(name);
+            }
+
+            ++count;
+        }
+
+        return true;
+    });
+
+    names.resize(result ? count : 0);
+
+    std::sort(names.begin(), names.end());
+
+    return result;
+}
+
+bool DirHasEntryWithPrefix(const std::string& directory, std::string_view prefix)
+{
+    bool found = false;
+
+    ForEachDirEntry(directory, [&](std::string_view name) {
+        found = (name.substr(0, prefix.size()) == prefix);
+
+        return !found;
+    });
+
+    return found;
+}
+
 //! \brief Function to safely get an environment variable as a std::string
 std::optional<std::string> GetEnvVariable(const std::string& var_name)
 {
@@ -195,6 +372,7 @@ std::optional<std::string> GetEnvVariable(const std::string& var_name)
 // Class Config
 
 Config::Config()
+    : m_generation(0)
 {}
 
 void Config::ReadAndUpdateConfig(const fs::path& config_file) {
@@ -241,11 +419,20 @@ void Config::ReadAndUpdateConfig(const fs::path& config_file) {
                   e.what());
     }
 
-    // If the config file read failed, we will process args anyway, which will result in defaults being chosen.
+    // If the config file read failed, we will process args anyway, which will result in defaults being chosen. The
+    // processed values are replaced, not added to, so that a re-read takes effect.
+    m_config.clear();
     ProcessArgs();
+
+    ++m_generation;
+}
+
+uint64_t Config::GetGeneration() const
+{
+    return m_generation.load();
 }
 
-config_variant Config::GetArg(const std::string& arg)
+config_variant Config::GetArg(std::string_view arg)
 {
     std::unique_lock<std::mutex> lock(mtx_config);
 
@@ -272,17 +459,18 @@ std::string Config::GetArgString(const std::string& arg, const std::string& defa
 EventMessage::EventMessage()
     : m_timestamp(0)
     , m_event_type(UNKNOWN)
+    , m_send_time_us(0)
 {}
 
-EventMessage::EventType EventMessage::EventTypeStringToEnum(const std::string& event_type_str)
+EventMessage::EventType EventMessage::EventTypeStringToEnum(std::string_view event_type_str)
 {
-    if (event_type_str == std::string {"USER_ACTIVE"}) {
+    if (event_type_str == "USER_ACTIVE") {
         return USER_ACTIVE;
-    } else if (event_type_str == std::string {"USER_UNFORCE"}) {
+    } else if (event_type_str == "USER_UNFORCE") {
         return USER_UNFORCE;
-    } else if (event_type_str == std::string {"USER_FORCE_ACTIVE"}) {
+    } else if (event_type_str == "USER_FORCE_ACTIVE") {
         return USER_FORCE_ACTIVE;
-    } else if (event_type_str == std::string {"USER_FORCE_IDLE"}) {
+    } else if (event_type_str == "USER_FORCE_IDLE") {
         return USER_FORCE_IDLE;
     }
 
@@ -292,15 +480,107 @@ EventMessage::EventType EventMessage::EventTypeStringToEnum(const std::string& e
 EventMessage::EventMessage(int64_t timestamp, EventType event_type)
     : m_timestamp(timestamp)
     , m_event_type(event_type)
+    , m_send_time_us(0)
 {}
 
 EventMessage::EventMessage(std::string timestamp_str, std::string event_type_str)
+    : m_send_time_us(0)
 {
     m_timestamp = ParseStringtoInt64(timestamp_str);
 
     m_event_type = EventTypeStringToEnum(event_type_str);
 }
 
+EventMessage::EventMessage(std::string timestamp_str, std::string event_type_str, std::string send_time_str)
+    : EventMessage(timestamp_str, event_type_str)
+{
+    m_send_time_us = ParseStringtoInt64(send_time_str);
+}
+
+namespace {
+
+//!
+//! \brief Trims whitespace from both ends of a string_view without copying.
+//!
+std::string_view TrimView(std::string_view str)
+{
+    const char* whitespace = " \f\n\r\t\v";
+
+    size_t front = str.find_first_not_of(whitespace);
+
+    if (front == std::string_view::npos) {
+        return {};
+    }
+
+    return str.substr(front, str.find_last_not_of(whitespace) - front + 1);
+}
+
+//!
+//! \brief Allocation-free equivalent of ParseStringtoInt64() for the pipe fields, which are already trimmed. As with
+//! std::stoll, trailing non-numeric characters are ignored.
+//! \throws std::invalid_argument or std::out_of_range, as ParseStringtoInt64() does.
+//!
+int64_t ParseInt64Field(std::string_view field)
+{
+    if (!field.empty() && field[0] == '+') {
+        field.remove_prefix(1);
+    }
+
+    int64_t value = 0;
+    auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+
+    if (ec == std::errc::invalid_argument) {
+        error_log("%s: Invalid argument: %s",
+                  __func__,
+                  std::string(field));
+        throw std::invalid_argument("ParseInt64Field: no conversion");
+    } else if (ec == std::errc::result_out_of_range) {
+        error_log("%s: Out of range: %s",
+                  __func__,
+                  std::string(field));
+        throw std::out_of_range("ParseInt64Field: out of range");
+    }
+
+    return value;
+}
+
+} // namespace
+
+EventMessage EventMessage::FromString(std::string_view str)
+{
+    // Split on ':' as std::getline would, i.e. a trailing ':' does not start another field, without copying. A
+    // fourth field means the message is invalid, so there is no need to look further.
+    std::string_view parts[4];
+    size_t part_count = 0;
+    size_t pos = 0;
+
+    while (pos < str.size() && part_count < 4) {
+        size_t end = str.find(':', pos);
+
+        if (end == std::string_view::npos) {
+            end = str.size();
+        }
+
+        parts[part_count++] = str.substr(pos, end - pos);
+        pos = end + 1;
+    }
+
+    if (part_count != 2 && part_count != 3) {
+        return EventMessage();
+    }
+
+    EventMessage event;
+
+    event.m_timestamp = ParseInt64Field(TrimView(parts[0]));
+    event.m_event_type = EventTypeStringToEnum(TrimView(parts[1]));
+
+    if (part_count == 3) {
+        event.m_send_time_us = ParseInt64Field(TrimView(parts[2]));
+    }
+
+    return event;
+}
+
 std::string EventMessage::EventTypeToString()
 {
     return EventTypeToString(m_event_type);
@@ -308,27 +588,25 @@ std::string EventMessage::EventTypeToString()
 
 std::string EventMessage::EventTypeToString(const EventType& event_type)
 {
-    std::string out;
+    return EventTypeName(event_type);
+}
 
+const char* EventMessage::EventTypeName(EventType event_type)
+{
     switch (event_type) {
     case UNKNOWN:
-        out = "UNKNOWN";
-        break;
+        return "UNKNOWN";
     case USER_ACTIVE:
-        out = "USER_ACTIVE";
-        break;
+        return "USER_ACTIVE";
     case USER_UNFORCE:
-        out = "USER_UNFORCE";
-        break;
+        return "USER_UNFORCE";
     case USER_FORCE_ACTIVE:
-        out = "USER_FORCE_ACTIVE";
-        break;
+        return "USER_FORCE_ACTIVE";
     case USER_FORCE_IDLE:
-        out = "USER_FORCE_IDLE";
-        break;
+        return "USER_FORCE_IDLE";
     }
 
-    return out;
+    return "UNKNOWN";
 }
 
 bool EventMessage::IsValid()
@@ -338,7 +616,47 @@ bool EventMessage::IsValid()
 
 std::string EventMessage::ToString()
 {
-    std::string out = ::ToString(m_timestamp) + ":" + EventTypeToString(m_event_type);
+    char buffer[MAX_CHARS];
+
+    return std::string(buffer, ToChars(buffer, sizeof(buffer)));
+}
+
+size_t EventMessage::ToChars(char* buffer, size_t size)
+{
+    char* const end = buffer + size;
+
+    auto [ptr, ec] = std::to_chars(buffer, end, m_timestamp);
+
+    if (ec != std::errc()) {
+        return 0;
+    }
+
+    const char* event_type = EventTypeName(m_event_type);
+    const size_t event_type_size = std::strlen(event_type);
+
+    if (static_cast<size_t>(end - ptr) < event_type_size + 1) {
+        return 0;
+    }
+
+    *ptr++ = ':';
+    std::memcpy(ptr, event_type, event_type_size);
+    ptr += event_type_size;
+
+    if (m_send_time_us > 0) {
+        if (ptr == end) {
+            return 0;
+        }
+
+        *ptr++ = ':';
+
+        auto send_time_result = std::to_chars(ptr, end, m_send_time_us);
+
+        if (send_time_result.ec != std::errc()) {
+            return 0;
+        }
+
+        ptr = send_time_result.ptr;
+    }
 
-    return out;
+    return static_cast<size_t>(ptr - buffer);
 }
@@ -13,6 +13,7 @@
 #include <map>
 #include <mutex>
 #include <optional>
+#include <string_view>
 #include <tinyformat.h>
 #include <variant>
 #include <vector>
@@ -82,12 +83,88 @@ constexpr char ToLower(char c);
  */
 std::string ToLower(const std::string& str);
 
+//!
+//! \brief The Clock class is the source of wall clock time for GetUnixEpochTime() and GetUnixEpochTimeMicros(). The
+//! default is the system realtime clock. A SimulatedClock can be installed with SetClock() so that the monitors can be
+//! driven through hours of virtual time in a test.
+//!
+class Clock
+{
+public:
+    virtual ~Clock() = default;
+
+    //!
+    //! \brief Returns the current time.
+    //! \return microseconds since the beginning of the Unix Epoch.
+    //!
+    virtual int64_t NowMicros() const = 0;
+};
+
+//!
+//! \brief The SystemClock class reads std::chrono::system_clock.
+//!
+class SystemClock : public Clock
+{
+public:
+    int64_t NowMicros() const override;
+};
+
+//!
+//! \brief The SimulatedClock class is a virtual clock that only moves when it is set or advanced. It is thread-safe.
+//!
+class SimulatedClock : public Clock
+{
+public:
+    //!
+    //! \brief Constructor.
+    //! \param start_us initial time in microseconds since the beginning of the Unix Epoch.
+    //!
+    explicit SimulatedClock(int64_t start_us);
+
+    int64_t NowMicros() const override;
+
+    //!
+    //! \brief Sets the current time.
+    //! \param now_us microseconds since the beginning of the Unix Epoch.
+    //!
+    void SetMicros(int64_t now_us);
+
+    //!
+    //! \brief Moves the clock forward.
+    //! \param delta_us microseconds
+    //!
+    void AdvanceMicros(int64_t delta_us);
+
+private:
+    std::atomic<int64_t> m_now_us;
+};
+
+//!
+//! \brief Installs the clock used by GetUnixEpochTime() and GetUnixEpochTimeMicros(). The clock is not owned and must
+//! outlive its use.
+//! \param clock The clock to use, or nullptr to restore the system clock.
+//!
+void SetClock(const Clock* clock);
+
+//!
+//! \brief Returns the installed clock.
+//! \return reference to the installed clock, the system clock by default.
+//!
+const Clock& GetClock();
+
 //!
 //! \brief Returns number of seconds since the beginning of the Unix Epoch.
 //! \return int64_t seconds.
 //!
 int64_t GetUnixEpochTime();
 
+//!
+//! \brief Returns number of microseconds since the beginning of the Unix Epoch. This is on the same (realtime) clock as
+//! the kernel input event timestamps and is used for latency tracing across threads and processes.
+//! \return int64_t microseconds.
+//!
+int64_t GetUnixEpochTimeMicros();
+
 //!
 //! \brief Formats input unix epoch time in human readable format.
 //! \param int64_t seconds.
@@ -102,6 +179,55 @@ std::string FormatISO8601DateTime(int64_t time);
 //!
 bool IsValidTimestamp(const int64_t& timestamp);
 
+//!
+//! \brief Combines the idle time reported by the desktop session with the last active time published by event_detect.
+//! This is the idle_detect decision input on every check.
+//! \param session_idle_seconds idle time from the GUI session, or negative if not available (an error, or -2 for a tty
+//! session).
+//! \param event_detect_last_active_time last active time from event_detect. 0 means event_detect has been forced idle.
+//! \param now current Unix Epoch time in seconds.
+//! \return effective idle time in seconds, never negative.
+//!
+int64_t CombineIdleSeconds(int64_t session_idle_seconds, int64_t event_detect_last_active_time, int64_t now);
+
+//!
+//! \brief Returns the ISO8601 timestamp prefix (including the trailing space) for log lines. The formatted string is
+//! cached per thread and only regenerated when the wall clock second changes, so that bursts of log lines do not
+//! each pay for gmtime_r and a format call.
+//! \return reference to the thread local cached prefix.
+//!
+const std::string& GetLogTimestampPrefix();
+
+//!
+//! \brief Log levels. These determine the output stream (stdout for DEBUG and INFO, stderr for ERROR) and the journal
+//! priority when logging natively to journald.
+//!
+enum class LogLevel {
+    DEBUG,
+    INFO,
+    ERROR
+};
+
+template <typename... Args>
+//!
+//! \brief Formats the fmt specifier and variadic args into the message text, without timestamp prefix or newline.
+//! \param fmt specifier
+//! \param args... variadic
+//! \return formatted std::string
+//!
+static inline std::string LogFormatMessage(const char* fmt, const Args&... args)
+{
+    std::string log_msg;
+
+    try {
+        log_msg = tfm::format(fmt, args...);
+    } catch (tinyformat::format_error& fmterr) {
+        log_msg = "Error \"" + std::string(fmterr.what()) + "\" while formatting log message: " + fmt;
+    }
+
+    return log_msg;
+}
+
 template <typename... Args>
 //!
 //! \brief Creates a string with fmt specifier and variadic args.
@@ -115,21 +241,24 @@ static inline std::string LogPrintStr(const char* fmt, const Args&... args)
 
     // Conditionally add timestamp prefix based on g_log_timestamps flag.
     if (g_log_timestamps.load(std::memory_order_relaxed)) { // Check the flag
-        log_msg = FormatISO8601DateTime(GetUnixEpochTime()) + " ";
+        log_msg = GetLogTimestampPrefix();
     }
 
-    try {
-        log_msg += tfm::format(fmt, args...);
-    } catch (tinyformat::format_error& fmterr) {
-        /* Original format string will have newline so don't add one here */
-        log_msg += "Error \"" + std::string(fmterr.what()) + "\" while formatting log message: " + fmt;
-    }
+    log_msg += LogFormatMessage(fmt, args...);
 
     log_msg += "\n";
 
     return log_msg;
 }
 
+//!
+//! \brief Hands a formatted log message to the logger. If the asynchronous logger (see logger.h) is running the message
+//! is queued and this returns immediately; otherwise it is written synchronously to cout or cerr.
+//! \param level
+//! \param msg formatted message without timestamp prefix or trailing newline.
+//!
+void LogMessage(LogLevel level, const std::string& msg);
+
 template <typename... Args>
 //!
 //! \brief LogPrintStr directed to cout.
@@ -138,22 +267,33 @@ template <typename... Args>
 //!
 void normal_log(const char* fmt, const Args&... args)
 {
-    std::cout << LogPrintStr(fmt, args...);
+    LogMessage(LogLevel::INFO, LogFormatMessage(fmt, args...));
 }
 
 template <typename... Args>
 //!
-//! \brief LogPrintStr directed to cout, conditioned on the debug setting.
+//! \brief LogPrintStr directed to cout without any check of the debug setting. This is the implementation behind the
+//! debug_log macro and should not normally be called directly.
 //! \param fmt
 //! \param args
 //!
-void debug_log(const char* fmt, const Args&... args)
+void debug_log_print(const char* fmt, const Args&... args)
 {
-    if (g_debug.load()) {
-        normal_log(fmt, args...);
-    }
+    LogMessage(LogLevel::DEBUG, LogFormatMessage(fmt, args...));
 }
 
+//!
+//! \brief LogPrintStr directed to cout, conditioned on the debug setting. This is a macro rather than a function
+//! template so that the arguments (which frequently include FormatISO8601DateTime() and StateToString() calls) are
+//! not evaluated at all when debug logging is off. If the project is configured with -DDISABLE_DEBUG_LOG=ON, debug
+//! logging is compiled out entirely; the arguments are still type checked, but the branch is eliminated.
+//!
+#ifdef IDLE_DETECT_DISABLE_DEBUG_LOG
+#define debug_log(...) do { if (false) { debug_log_print(__VA_ARGS__); } } while (0)
+#else
+#define debug_log(...) do { if (g_debug.load(std::memory_order_relaxed)) { debug_log_print(__VA_ARGS__); } } while (0)
+#endif
+
 template <typename... Args>
 //!
 //! \brief LogPrintStr directed to cerr
@@ -165,7 +305,7 @@ void error_log(const char* fmt, const Args&... args)
     std::string error_fmt = "ERROR: ";
     error_fmt += fmt;
 
-    std::cerr << LogPrintStr(error_fmt.c_str(), args...);
+    LogMessage(LogLevel::ERROR, LogFormatMessage(error_fmt.c_str(), args...));
 }
 
 [[nodiscard]] int ParseStringToInt(const std::string& str);
@@ -180,6 +320,27 @@ void error_log(const char* fmt, const Args&... args)
 //!
 std::vector<fs::path> FindDirEntriesWithWildcard(const fs::path& directory, const std::string& wildcard);
 
+//!
+//! \brief Lists the entries of a directory whose names start with the provided prefix, other than . and .., in sorted
+//! order. Unlike FindDirEntriesWithWildcard() this does not allocate once names has grown to the size of the directory,
+//! since the directory is read with getdents64 into a stack buffer and the strings in names are reused. This is what
+//! the once a second device scans use.
+//! \param directory
+//! \param prefix the empty prefix matches all entries.
+//! \param names receives the matching entry names (not paths).
+//! \return false if the directory could not be read, in which case names is empty.
+//!
+bool ScanDirEntries(const std::string& directory, std::string_view prefix, std::vector<std::string>& names);
+
+//!
+//! \brief Checks whether a directory has at least one entry whose name starts with the provided prefix. Does not
+//! allocate.
+//! \param directory
+//! \param prefix
+//! \return true if such an entry exists. False if not, or if the directory could not be read.
+//!
+bool DirHasEntryWithPrefix(const std::string& directory, std::string_view prefix);
+
 //!
 //! \brief Safely get an environment variable value from the provided name
 //! \param std::string of the name of the variable to retrieve
@@ -246,11 +407,20 @@ public:
     void ReadAndUpdateConfig(const fs::path& config_file);
 
     //!
-    //! \brief Provides the config_variant type value of the config parameter (argument).
+    //! \brief Provides the config_variant type value of the config parameter (argument). The lookup itself does not
+    //! allocate, so bool and int parameters can be read in the steady state loops.
     //! \param arg (key) to look up value.
     //! \return config_variant type value of the value of the config parameter (argument).
     //!
-    config_variant GetArg(const std::string& arg);
+    config_variant GetArg(std::string_view arg);
+
+    //!
+    //! \brief Provides a counter that is incremented each time the config is (re)read. Loops that cache values derived
+    //! from the config, such as paths, compare this to refresh their cache rather than rebuilding the values every
+    //! iteration.
+    //! \return generation of the config, starting at 1 after the first ReadAndUpdateConfig().
+    //!
+    uint64_t GetGeneration() const;
 
 protected:
     //!
@@ -266,7 +436,7 @@ protected:
     //! \brief Holds the processed parameter-values, which are strongly typed and in a config_variant union, and where
     //! default values are populated if not found in the config file (m_config_in).
     //!
-    std::multimap<std::string, config_variant> m_config;
+    std::multimap<std::string, config_variant, std::less<>> m_config;
 
 private:
     //!
@@ -287,6 +457,10 @@ private:
     //!
     std::multimap<std::string, std::string> m_config_in;
 
+    //!
+    //! \brief The config generation provided by GetGeneration().
+    //!
+    std::atomic<uint64_t> m_generation;
 };
 
 //!
@@ -332,6 +506,24 @@ public:
     //!
     EventMessage(std::string timestamp_str, std::string event_type_str);
 
+    //!
+    //! \brief Constructs an EventMessage from the provided strings, including the optional sender timestamp used for
+    //! latency tracing.
+    //! \param timestamp_str
+    //! \param event_type_str
+    //! \param send_time_str microseconds since the epoch at which the message was sent.
+    //!
+    EventMessage(std::string timestamp_str, std::string event_type_str, std::string send_time_str);
+
+    //!
+    //! \brief Parses the pipe format produced by ToString(): <timestamp>:<event_type>[:<send time>]. Whitespace around
+    //! the fields (including the trailing newline) is trimmed.
+    //! \param str
+    //! \return the parsed EventMessage. If the number of fields is wrong, an empty (invalid) EventMessage is returned.
+    //! \throws std::invalid_argument or std::out_of_range if a numeric field cannot be parsed.
+    //!
+    static EventMessage FromString(std::string_view str);
+
     //!
     //! \brief Converts m_event_type member variable in the EventMessage object to a string.
     //! \return string representation of enum value
@@ -354,20 +546,48 @@ public:
     //!
     //! \brief Returns the string message format of the EventMessage object. This is meant to go on the pipe. This
     //! is in lieu of a full serialization approach, which is overkill here.
-    //! \return std::string in the format of <timestamp>:<event_type string>
+    //! \return std::string in the format of <timestamp>:<event_type string>, followed by :<send time> if m_send_time_us
+    //! is set.
     //!
     std::string ToString();
 
+    //!
+    //! \brief Writes the ToString() format into the provided buffer without allocating. This is what the pipe senders
+    //! use.
+    //! \param buffer
+    //! \param size size of the buffer. MAX_CHARS is always sufficient.
+    //! \return number of characters written (no terminating null), or 0 if the buffer is too small.
+    //!
+    size_t ToChars(char* buffer, size_t size);
+
+    //!
+    //! \brief Buffer size sufficient for ToChars() for any EventMessage.
+    //!
+    static constexpr size_t MAX_CHARS = 64;
+
     int64_t m_timestamp;
     EventType m_event_type;
 
+    //!
+    //! \brief Optional time in microseconds since the epoch at which the sender put the message on the pipe. Zero if not
+    //! present. This is used only for latency tracing and is not part of validity.
+    //!
+    int64_t m_send_time_us;
+
 private:
     //!
     //! \brief This converts the event type string to the proper enum value. It is the converse of EventTypeToString().
     //! \param event_type_str
     //! \return EventType enum value
     //!
-    EventType EventTypeStringToEnum(const std::string& event_type_str);
+    static EventType EventTypeStringToEnum(std::string_view event_type_str);
+
+    //!
+    //! \brief Static string representation of the event type, used by EventTypeToString() and ToChars().
+    //! \param event_type
+    //! \return null terminated event type name
+    //!
+    static const char* EventTypeName(EventType event_type);
 };
 
 
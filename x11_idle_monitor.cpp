@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#include <x11_idle_monitor.h>
+#include <util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+//!
+//! \brief Set by X11IdleMonitor_HandleError(), so that a failed request can be detected after an XSync().
+//!
+bool g_x_error_occurred = false;
+
+//!
+//! \brief Logs X protocol errors, instead of the default Xlib handler's exit.
+//!
+int X11IdleMonitor_HandleError(Display* display, XErrorEvent* event)
+{
+    char text[256] = {};
+
+    XGetErrorText(display, event->error_code, text, sizeof(text));
+
+    error_log("%s: X error: %s (request %u.%u)",
+              __func__,
+              text,
+              static_cast<unsigned int>(event->request_code),
+              static_cast<unsigned int>(event->minor_code));
+
+    g_x_error_occurred = true;
+
+    return 0;
+}
+
+//!
+//! \brief Set by X11IdleMonitor_HandleIOErrorExit(), so that the monitor closes the display after the failed call.
+//!
+bool g_x_connection_lost = false;
+
+//!
+//! \brief Logs the loss of the X connection. Xlib then calls the exit handler, where there is one, and otherwise exits.
+//!
+int X11IdleMonitor_HandleIOError(Display* /* display */)
+{
+    error_log("%s: Lost the connection to the X display.",
+              __func__);
+
+    return 0;
+}
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+//!
+//! \brief Replaces Xlib's exit on the loss of the connection. The call that failed returns, and the monitor closes the
+//! display after it.
+//!
+void X11IdleMonitor_HandleIOErrorExit(Display* /* display */, void* /* user_data */)
+{
+    g_x_connection_lost = true;
+}
+#endif
+
+//!
+//! \brief Steady clock time in milliseconds.
+//!
+int64_t X11IdleMonitor_Now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//!
+//! \brief Converts an XSyncValue, which holds the counter in two 32 bit halves, to int64_t.
+//!
+int64_t X11IdleMonitor_ValueToInt64(const XSyncValue& value)
+{
+    return (static_cast<int64_t>(static_cast<uint32_t>(XSyncValueHigh32(value))) << 32)
+           | static_cast<int64_t>(XSyncValueLow32(value));
+}
+
+} // namespace
+
+X11IdleMonitor::X11IdleMonitor()
+    : m_display(nullptr)
+    , m_idle_counter(None)
+    , m_reset_alarm(None)
+    , m_sync_event_base(0)
+    , m_screen_saver_info(nullptr)
+    , m_next_connect_time(0)
+{
+    m_idle_tracker.SetClock(X11IdleMonitor_Now);
+}
+
+X11IdleMonitor::~X11IdleMonitor()
+{
+    Stop();
+}
+
+void X11IdleMonitor::SetIdleLevels(const std::vector<int64_t>& levels_ms)
+{
+    m_idle_tracker.SetLevels(levels_ms);
+}
+
+bool X11IdleMonitor::Start()
+{
+    if (m_display) {
+        return true;
+    }
+
+    int64_t now = X11IdleMonitor_Now();
+
+    if (now < m_next_connect_time) {
+        return false;
+    }
+
+    m_next_connect_time = now + static_cast<int64_t>(RECONNECT_INTERVAL_SECONDS) * 1000;
+
+    m_display = XOpenDisplay(nullptr);
+
+    if (!m_display) {
+        error_log("%s: Could not open X display. Retrying in %i seconds.",
+                  __func__,
+                  RECONNECT_INTERVAL_SECONDS);
+
+        return false;
+    }
+
+    XSetErrorHandler(X11IdleMonitor_HandleError);
+    XSetIOErrorHandler(X11IdleMonitor_HandleIOError);
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+    XSetIOErrorExitHandler(m_display, X11IdleMonitor_HandleIOErrorExit, nullptr);
+#endif
+
+    int event_base = 0;
+    int error_base = 0;
+
+    if (XScreenSaverQueryExtension(m_display, &event_base, &error_base)) {
+        m_screen_saver_info = XScreenSaverAllocInfo();
+    }
+
+    int major_version = 0;
+    int minor_version = 0;
+
+    if (XSyncQueryExtension(m_display, &m_sync_event_base, &error_base)
+        && XSyncInitialize(m_display, &major_version, &minor_version)) {
+        int counter_count = 0;
+        XSyncSystemCounter* counters = XSyncListSystemCounters(m_display, &counter_count);
+
+        for (int i = 0; i < counter_count; ++i) {
+            if (strcmp(counters[i].name, "IDLETIME") == 0) {
+                m_idle_counter = counters[i].counter;
+                break;
+            }
+        }
+
+        if (counters) {
+            XSyncFreeSystemCounterList(counters);
+        }
+    }
+
+    bool using_alarms = (m_idle_counter != None && !m_idle_tracker.GetLevels().empty() && CreateAlarms());
+
+    if (!using_alarms && !m_screen_saver_info) {
+        error_log("%s: X display %s has neither the XSync IDLETIME counter nor the XScreenSaver extension.",
+                  __func__,
+                  DisplayString(m_display));
+
+        Stop();
+
+        return false;
+    }
+
+    normal_log("INFO: %s: Connected to X display %s. Idle time from %s.",
+               __func__,
+               DisplayString(m_display),
+               using_alarms ? "XSync IDLETIME alarms" : "XScreenSaver queries");
+
+    return true;
+}
+
+void X11IdleMonitor::Stop()
+{
+    if (!m_display) {
+        return;
+    }
+
+    // Requests on a lost connection would only fail again. The server has dropped the alarms with it.
+    if (g_x_connection_lost) {
+        m_idle_alarms.clear();
+        m_reset_alarm = None;
+    } else {
+        DestroyAlarms();
+    }
+
+    if (m_screen_saver_info) {
+        XFree(m_screen_saver_info);
+        m_screen_saver_info = nullptr;
+    }
+
+    XCloseDisplay(m_display);
+
+    m_display = nullptr;
+    m_idle_counter = None;
+    m_idle_tracker.Reset();
+    g_x_connection_lost = false;
+}
+
+bool X11IdleMonitor::IsAvailable() const
+{
+    return m_display != nullptr;
+}
+
+bool X11IdleMonitor::IsUsingAlarms() const
+{
+    return !m_idle_alarms.empty() && m_reset_alarm != None;
+}
+
+int X11IdleMonitor::GetFd() const
+{
+    return m_display ? ConnectionNumber(m_display) : -1;
+}
+
+bool X11IdleMonitor::ProcessPendingEvents()
+{
+    if (!m_display) {
+        return false;
+    }
+
+    bool alarm_fired = false;
+
+    while (!g_x_connection_lost && XPending(m_display) > 0) {
+        XEvent event;
+        XNextEvent(m_display, &event);
+
+        if (g_x_connection_lost || !IsUsingAlarms() || event.type != m_sync_event_base + XSyncAlarmNotify) {
+            continue;
+        }
+
+        const XSyncAlarmNotifyEvent& alarm_event = reinterpret_cast<const XSyncAlarmNotifyEvent&>(event);
+        auto idle_alarm = std::find(m_idle_alarms.begin(), m_idle_alarms.end(), alarm_event.alarm);
+
+        if (idle_alarm != m_idle_alarms.end()) {
+            m_idle_tracker.SetLevelReached(static_cast<int>(idle_alarm - m_idle_alarms.begin()));
+        } else if (alarm_event.alarm == m_reset_alarm) {
+            m_idle_tracker.SetInput();
+        } else {
+            continue;
+        }
+
+        alarm_fired = true;
+
+        debug_log("INFO: %s: XSync %s alarm at idle time %lld ms.",
+                  __func__,
+                  idle_alarm != m_idle_alarms.end() ? "idle" : "reset",
+                  X11IdleMonitor_ValueToInt64(alarm_event.counter_value));
+
+        // The event may have waited for up to a pass, so read where the counter is now.
+        SyncLastInputTime();
+    }
+
+    if (!CheckConnection()) {
+        return true;
+    }
+
+    return alarm_fired;
+}
+
+int64_t X11IdleMonitor::GetIdleSeconds()
+{
+    ProcessPendingEvents();
+
+    if (!m_display) {
+        return -1;
+    }
+
+    if (!IsUsingAlarms()) {
+        int64_t idle_time_ms = QueryScreenSaverIdleMs();
+
+        if (!CheckConnection()) {
+            return -1;
+        }
+
+        return idle_time_ms < 0 ? -1 : idle_time_ms / 1000;
+    }
+
+    // Near the first level without its idle alarm, catch up with the input since the last known. The idle alarms make
+    // the level decisions, even if their events are still in flight.
+    if (m_idle_tracker.IsRefreshNeeded()) {
+        SyncLastInputTime();
+
+        if (!CheckConnection()) {
+            return -1;
+        }
+    }
+
+    return m_idle_tracker.GetIdleMs() / 1000;
+}
+
+int64_t X11IdleMonitor::QueryIdleCounterMs()
+{
+    if (!m_display || m_idle_counter == None || g_x_connection_lost) {
+        return -1;
+    }
+
+    XSyncValue value;
+
+    if (!XSyncQueryCounter(m_display, m_idle_counter, &value) || g_x_connection_lost) {
+        return -1;
+    }
+
+    return X11IdleMonitor_ValueToInt64(value);
+}
+
+int64_t X11IdleMonitor::QueryScreenSaverIdleMs()
+{
+    if (!m_display || !m_screen_saver_info || g_x_connection_lost) {
+        return -1;
+    }
+
+    if (!XScreenSaverQueryInfo(m_display, DefaultRootWindow(m_display), m_screen_saver_info) || g_x_connection_lost) {
+        return -1;
+    }
+
+    return static_cast<int64_t>(m_screen_saver_info->idle);
+}
+
+bool X11IdleMonitor::CreateAlarms()
+{
+    g_x_error_occurred = false;
+
+    // Each idle alarm fires when the idle time rises through its level. The reset alarm fires when it drops from the
+    // first level or above to below it, which is the first input after an idle period. Transition tests keep them
+    // armed after they fire.
+    const std::vector<int64_t>& levels_ms = m_idle_tracker.GetLevels();
+
+    for (int64_t level_ms : levels_ms) {
+        m_idle_alarms.push_back(CreateAlarm(level_ms, XSyncPositiveTransition));
+    }
+
+    m_reset_alarm = CreateAlarm(levels_ms.front() - 1, XSyncNegativeTransition);
+
+    // Surface any error from the requests above.
+    XSync(m_display, False);
+
+    // A transition alarm does not fire for a level that is already crossed, so the read gives the initial level.
+    m_idle_tracker.Reset();
+
+    bool created = (m_reset_alarm != None
+                    && std::find(m_idle_alarms.begin(), m_idle_alarms.end(), None) == m_idle_alarms.end());
+
+    if (g_x_error_occurred || !created || !SyncLastInputTime()) {
+        error_log("%s: Could not set the XSync IDLETIME alarms. Falling back to XScreenSaver queries.",
+                  __func__);
+
+        DestroyAlarms();
+
+        return false;
+    }
+
+    return true;
+}
+
+XSyncAlarm X11IdleMonitor::CreateAlarm(int64_t value_ms, XSyncTestType test_type)
+{
+    XSyncAlarmAttributes attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+
+    attributes.trigger.counter = m_idle_counter;
+    attributes.trigger.value_type = XSyncAbsolute;
+    attributes.trigger.test_type = test_type;
+    XSyncIntToValue(&attributes.trigger.wait_value, static_cast<int>(value_ms));
+    XSyncIntToValue(&attributes.delta, 0);
+    attributes.events = True;
+
+    return XSyncCreateAlarm(m_display,
+                            XSyncCACounter | XSyncCAValueType | XSyncCAValue | XSyncCATestType | XSyncCADelta
+                            | XSyncCAEvents,
+                            &attributes);
+}
+
+void X11IdleMonitor::DestroyAlarms()
+{
+    for (XSyncAlarm alarm : m_idle_alarms) {
+        if (alarm != None) {
+            XSyncDestroyAlarm(m_display, alarm);
+        }
+    }
+
+    m_idle_alarms.clear();
+
+    if (m_reset_alarm != None) {
+        XSyncDestroyAlarm(m_display, m_reset_alarm);
+        m_reset_alarm = None;
+    }
+}
+
+bool X11IdleMonitor::SyncLastInputTime()
+{
+    int64_t read_start_time = m_idle_tracker.GetTime();
+    int64_t idle_time_ms = QueryIdleCounterMs();
+
+    if (idle_time_ms < 0) {
+        return false;
+    }
+
+    m_idle_tracker.RecordIdleTime(idle_time_ms, read_start_time);
+
+    return true;
+}
+
+bool X11IdleMonitor::CheckConnection()
+{
+    if (m_display && g_x_connection_lost) {
+        error_log("%s: Closing the lost X display connection. Reconnecting in %i seconds.",
+                  __func__,
+                  RECONNECT_INTERVAL_SECONDS);
+
+        Stop();
+
+        m_next_connect_time = X11IdleMonitor_Now() + static_cast<int64_t>(RECONNECT_INTERVAL_SECONDS) * 1000;
+    }
+
+    return m_display != nullptr;
+}
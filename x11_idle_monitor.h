@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 James C. Owens
+ *
+ * This code is licensed under the MIT license. See LICENSE.md in the repository.
+ */
+
+#ifndef X11_IDLE_MONITOR_H
+#define X11_IDLE_MONITOR_H
+
+#include <cstdint>
+#include <vector>
+
+#include <idle_state_tracker.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/scrnsaver.h>
+#include <X11/extensions/sync.h>
+
+//!
+//! \brief The X11IdleMonitor class holds one connection to the X display for the X11 idle time. Where the server has
+//! the XSync IDLETIME system counter, alarms on it push the idle and active transitions: one for each idle level, e.g.
+//! the threshold and the throttle tiers, when the idle time rises through it, and one when it drops back below the
+//! first (the reset). The alarm events are read from the connection, so a pass makes no round trip while the state is
+//! stable. Without the counter, each read is one XScreenSaverQueryInfo() on the held connection, with the
+//! XScreenSaverInfo allocated once.
+//!
+//! With libX11 1.8 or later, the loss of the connection, e.g. to a restart of the X server, closes the display instead
+//! of exiting, and it is opened again after RECONNECT_INTERVAL_SECONDS. Older Xlib exits.
+//!
+//! The X connection is not thread safe. Everything here is called from the idle_detect main loop.
+//!
+class X11IdleMonitor
+{
+public:
+    //! \brief Constructor
+    X11IdleMonitor();
+
+    //! \brief Destructor
+    ~X11IdleMonitor();
+
+    //! \brief Deleted copy and move constructors and assignment operators to prevent copying.
+    X11IdleMonitor(const X11IdleMonitor&) = delete;
+    X11IdleMonitor& operator=(const X11IdleMonitor&) = delete;
+    X11IdleMonitor(X11IdleMonitor&&) = delete;
+    X11IdleMonitor& operator=(X11IdleMonitor&&) = delete;
+
+    //!
+    //! \brief Sets the idle levels of the alarms, in milliseconds, e.g. inactivity_time_trigger and the throttle tiers.
+    //! None disables the alarms. Call before Start(). They are kept for the reconnections.
+    //!
+    void SetIdleLevels(const std::vector<int64_t>& levels_ms);
+
+    //!
+    //! \brief Opens the display, finds the IDLETIME counter and sets the alarms, or falls back to XScreenSaver. If
+    //! the display cannot be opened, this is not retried for RECONNECT_INTERVAL_SECONDS.
+    //! \return true if an idle source is available.
+    //!
+    bool Start();
+
+    //! \brief Destroys the alarms and closes the display.
+    void Stop();
+
+    //! \brief Whether the display is open.
+    bool IsAvailable() const;
+
+    //! \brief Whether the idle state is pushed by the XSync alarms, rather than queried from XScreenSaver.
+    bool IsUsingAlarms() const;
+
+    //! \brief The X connection fd, for polling, or -1 if the display is not open.
+    int GetFd() const;
+
+    //!
+    //! \brief Reads the queued events without blocking and applies the alarm notifications. Afterwards nothing is left
+    //! in the Xlib queue, so the main loop can poll GetFd() for the next event.
+    //! \return true if an alarm fired, or the connection was lost.
+    //!
+    bool ProcessPendingEvents();
+
+    //!
+    //! \brief Provides the idle time. With the alarms, this is the idle time of the IdleStateTracker the alarms and
+    //! counter reads drive, without a round trip: capped below the next level until its alarm, with one counter read to
+    //! catch up when it nears the first level without that alarm. Without the alarms it is one
+    //! XScreenSaverQueryInfo() round trip.
+    //! \return idle time in seconds, or -1 on error.
+    //!
+    int64_t GetIdleSeconds();
+
+    //!
+    //! \brief Reads the IDLETIME counter: one round trip.
+    //! \return idle time in milliseconds, or -1 if there is no counter or the read failed.
+    //!
+    int64_t QueryIdleCounterMs();
+
+    //!
+    //! \brief Queries XScreenSaver on the held connection: one round trip.
+    //! \return idle time in milliseconds, or -1 if the extension is not available.
+    //!
+    int64_t QueryScreenSaverIdleMs();
+
+    //!
+    //! \brief Seconds between attempts to open the display when it is unavailable.
+    //!
+    static constexpr int RECONNECT_INTERVAL_SECONDS = 5;
+
+private:
+    //! \brief The X display connection, nullptr if not open.
+    Display* m_display;
+
+    //! \brief The IDLETIME system counter, None if the server has none.
+    XSyncCounter m_idle_counter;
+
+    //! \brief The idle alarm of each level of m_idle_tracker, empty if not created.
+    std::vector<XSyncAlarm> m_idle_alarms;
+
+    //! \brief The reset alarm, None if not created.
+    XSyncAlarm m_reset_alarm;
+
+    //! \brief First event code of the XSync extension.
+    int m_sync_event_base;
+
+    //! \brief XScreenSaverInfo for the fallback queries, nullptr if the extension is not available.
+    XScreenSaverInfo* m_screen_saver_info;
+
+    //! \brief The idle state from the alarms and counter reads. The idle levels are its levels.
+    IdleStateTracker m_idle_tracker;
+
+    //! \brief Earliest time of the next attempt to open the display, steady clock milliseconds.
+    int64_t m_next_connect_time;
+
+    //!
+    //! \brief Creates the idle and reset alarms and reads the initial state.
+    //! \return true if all of the alarms were created.
+    //!
+    bool CreateAlarms();
+
+    //! \brief Creates one alarm on the IDLETIME counter at value_ms.
+    XSyncAlarm CreateAlarm(int64_t value_ms, XSyncTestType test_type);
+
+    //! \brief Destroys the alarms.
+    void DestroyAlarms();
+
+    //! \brief Reads the counter into m_idle_tracker.
+    bool SyncLastInputTime();
+
+    //!
+    //! \brief Closes the display once its connection has been lost, and schedules the reconnection.
+    //! \return true if the display is open.
+    //!
+    bool CheckConnection();
+};
+
+#endif // X11_IDLE_MONITOR_H